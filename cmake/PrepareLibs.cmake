@@ -54,9 +54,16 @@ endif()
 
 message(STATUS "Found NGSpice library: ${NGSPICE_LIB_PATH}")
 
-# Create the library copies needed for parallel simulation
+# Create the library copies needed for parallel simulation, one per
+# partition (pass -DNGSPICE_INSTANCES=N for more than three)
 # Always use .so extension for consistency across platforms
-set(lib_copies "libngspice1.so" "libngspice2.so" "libngspice3.so")
+if(NOT NGSPICE_INSTANCES)
+    set(NGSPICE_INSTANCES 3)
+endif()
+set(lib_copies "")
+foreach(i RANGE 1 ${NGSPICE_INSTANCES})
+    list(APPEND lib_copies "libngspice${i}.so")
+endforeach()
 
 foreach(lib_copy ${lib_copies})
     set(dest_file "${CMAKE_CURRENT_BINARY_DIR}/${lib_copy}")
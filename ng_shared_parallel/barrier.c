@@ -0,0 +1,170 @@
+/*
+Generation counted barrier with hybrid spin-then-block waiting.
+See barrier.h for the interface description.
+*/
+
+#include <string.h>
+
+#include "barrier.h"
+
+#define STATE(count, arrived) (((uint64_t)(count) << 32) | (uint64_t)(arrived))
+#define STATE_COUNT(s) ((unsigned)((s) >> 32))
+#define STATE_ARRIVED(s) ((unsigned)((s) & 0xffffffffu))
+
+void
+ngbarrier_init(ngbarrier_t *b, int count, int spin)
+{
+    memset(b, 0, sizeof(*b));
+    b->state = STATE(count, 0);
+    b->spin = spin < 0 ? NGBARRIER_DEFAULT_SPIN : spin;
+#if !defined(__linux__)
+    mutex_init(&b->lock);
+    cond_init(&b->cond);
+#endif
+}
+
+void
+ngbarrier_init_shared(ngbarrier_t *b, int count, int spin)
+{
+    memset(b, 0, sizeof(*b));
+    b->state = STATE(count, 0);
+    b->spin = spin < 0 ? NGBARRIER_DEFAULT_SPIN : spin;
+    b->shared = true;
+#if defined(__MINGW32__) || defined(_MSC_VER)
+    mutex_init(&b->lock);
+    cond_init(&b->cond);
+#elif !defined(__linux__)
+    mutex_init_shared(&b->lock);
+    cond_init_shared(&b->cond);
+#endif
+}
+
+void
+ngbarrier_destroy(ngbarrier_t *b)
+{
+#if !defined(__linux__)
+    mutex_delete(&b->lock);
+    cond_delete(&b->cond);
+#else
+    (void)b;
+#endif
+}
+
+/* Run the completion function, then open the barrier for the
+   next generation and wake up all sleeping threads. */
+static void
+complete(ngbarrier_t *b, ngbarrier_fn *fn, void *arg)
+{
+    if (fn)
+        fn(arg);
+    ngat_add_u64(&b->stats.completions, 1);
+#if defined(__linux__)
+    ngat_add_i(&b->generation, 1);
+    if (ngat_load_i(&b->sleepers) > 0)
+        ng_futex_wake(&b->generation, b->shared);
+#else
+    mutex_lock(&b->lock);
+    ngat_add_i(&b->generation, 1);
+    cond_broadcast(&b->cond);
+    mutex_unlock(&b->lock);
+#endif
+}
+
+bool
+ngbarrier_wait(ngbarrier_t *b, ngbarrier_fn *fn, void *arg)
+{
+    uint64_t t0 = ng_now_ns(), dt, s, ns;
+    unsigned count, arrived;
+    int gen, i;
+    bool last;
+
+    /* the generation must be read before arriving */
+    gen = ngat_load_i(&b->generation);
+    s = ngat_load_u64(&b->state);
+    do {
+        count = STATE_COUNT(s);
+        arrived = STATE_ARRIVED(s) + 1;
+        last = (arrived >= count);
+        ns = last ? STATE(count, 0) : STATE(count, arrived);
+    } while (!ngat_cas_u64(&b->state, &s, ns));
+
+    ngat_add_u64(&b->stats.waits, 1);
+
+    if (last) {
+        complete(b, fn, arg);
+        return true;
+    }
+
+    /* spin phase */
+    for (i = 0; i < b->spin; i++) {
+        if (ngat_load_i(&b->generation) != gen) {
+            ngat_add_u64(&b->stats.spun, 1);
+            goto released;
+        }
+        ng_cpu_relax();
+    }
+
+    /* blocking phase */
+    ngat_add_u64(&b->stats.blocked, 1);
+#if defined(__linux__)
+    ngat_add_i(&b->sleepers, 1);
+    while (ngat_load_i(&b->generation) == gen)
+        ng_futex_wait(&b->generation, gen, b->shared);
+    ngat_add_i(&b->sleepers, -1);
+#else
+    mutex_lock(&b->lock);
+    while (ngat_load_i(&b->generation) == gen)
+        cond_wait(&b->cond, &b->lock);
+    mutex_unlock(&b->lock);
+#endif
+
+released:
+    dt = ng_now_ns() - t0;
+    ngat_add_u64(&b->stats.wait_ns, dt);
+    ngat_max_u64(&b->stats.wait_max_ns, dt);
+    return false;
+}
+
+void
+ngbarrier_leave(ngbarrier_t *b, ngbarrier_fn *fn, void *arg)
+{
+    uint64_t s, ns;
+    unsigned count, arrived;
+    bool last;
+
+    s = ngat_load_u64(&b->state);
+    do {
+        if (STATE_COUNT(s) == 0)
+            return;
+        count = STATE_COUNT(s) - 1;
+        arrived = STATE_ARRIVED(s);
+        last = (arrived > 0 && arrived >= count);
+        ns = last ? STATE(count, 0) : STATE(count, arrived);
+    } while (!ngat_cas_u64(&b->state, &s, ns));
+
+    if (last)
+        complete(b, fn, arg);
+}
+
+int
+ngbarrier_count(ngbarrier_t *b)
+{
+    return (int)STATE_COUNT(ngat_load_u64(&b->state));
+}
+
+void
+ngbarrier_get_stats(ngbarrier_t *b, ngbarrier_stats *st)
+{
+    st->waits = ngat_load_u64(&b->stats.waits);
+    st->completions = ngat_load_u64(&b->stats.completions);
+    st->spun = ngat_load_u64(&b->stats.spun);
+    st->blocked = ngat_load_u64(&b->stats.blocked);
+    st->wait_ns = ngat_load_u64(&b->stats.wait_ns);
+    st->wait_max_ns = ngat_load_u64(&b->stats.wait_max_ns);
+}
+
+void
+ngbarrier_reset_stats(ngbarrier_t *b)
+{
+    memset(&b->stats, 0, sizeof(b->stats));
+}
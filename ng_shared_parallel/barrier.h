@@ -0,0 +1,68 @@
+/*
+Reusable, generation counted barrier for the ngspice sync callback.
+
+Threads arriving at the barrier spin for a configurable number of
+iterations, then block on a futex (Linux) or a condition variable
+(other systems) until the last arriver has advanced the generation.
+The last arriver runs an optional completion function before it
+releases the others, this is where the consensus of all partitions
+is calculated. A participant may leave the barrier (its bg thread
+has finished), the barrier then completes with the remaining ones.
+A barrier initialized by ngbarrier_init_shared() may be placed in
+memory shared by processes, each participant a process of its own.
+*/
+
+#ifndef NG_BARRIER_H
+#define NG_BARRIER_H
+
+#include "port.h"
+
+/* default number of spin iterations before blocking */
+#define NGBARRIER_DEFAULT_SPIN 2000
+
+/* called by the thread completing a generation, before release */
+typedef void (ngbarrier_fn)(void *arg);
+
+typedef struct ngbarrier_stats {
+    uint64_t waits;        /* calls to ngbarrier_wait() */
+    uint64_t completions;  /* generations completed */
+    uint64_t spun;         /* waits released while still spinning */
+    uint64_t blocked;      /* waits which had to sleep */
+    uint64_t wait_ns;      /* accumulated time from arrival to release */
+    uint64_t wait_max_ns;  /* worst case time from arrival to release */
+} ngbarrier_stats;
+
+typedef struct ngbarrier {
+    /* participant count in the upper, arrived threads in the lower 32 bits */
+    volatile uint64_t state;
+    /* bumped by the last arriver, waited upon by all others */
+    volatile int generation;
+    volatile int sleepers;
+    int spin;
+    bool shared;               /* participants in several processes */
+#if !defined(__linux__)
+    mutexType lock;
+    condType cond;
+#endif
+    ngbarrier_stats stats;
+} ngbarrier_t;
+
+void ngbarrier_init(ngbarrier_t *b, int count, int spin);
+void ngbarrier_init_shared(ngbarrier_t *b, int count, int spin);
+void ngbarrier_destroy(ngbarrier_t *b);
+
+/* Wait until all participants have arrived. Returns true for the
+   single thread which completed the generation (and called fn). */
+bool ngbarrier_wait(ngbarrier_t *b, ngbarrier_fn *fn, void *arg);
+
+/* Remove a participant. If all remaining participants are already
+   waiting, the generation is completed by the caller (calling fn). */
+void ngbarrier_leave(ngbarrier_t *b, ngbarrier_fn *fn, void *arg);
+
+/* number of participants still taking part */
+int ngbarrier_count(ngbarrier_t *b);
+
+void ngbarrier_get_stats(ngbarrier_t *b, ngbarrier_stats *st);
+void ngbarrier_reset_stats(ngbarrier_t *b);
+
+#endif
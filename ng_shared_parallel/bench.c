@@ -0,0 +1,369 @@
+/*
+Accuracy versus speed benchmark against a monolithic reference run.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "bench.h"
+#include "gen.h"
+
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#define BENCH_MAXVECS 64
+
+typedef struct benchvec {
+    char name[NGCPL_NAMELEN];
+    double *t, *v;
+    int n;
+} benchvec_t;
+
+typedef struct benchcfg {
+    const char *label;
+    int sync_mode;
+    const char *pred;          /* lockstep schemes */
+    int mr_interp;             /* SYNC_MULTIRATE */
+} benchcfg_t;
+
+static const benchcfg_t configs[] = {
+    { "lockstep hold",    SYNC_BARRIER,   "hold",   MR_HOLD },
+    { "lockstep linear",  SYNC_BARRIER,   "linear", MR_HOLD },
+    { "lockstep poly3",   SYNC_BARRIER,   "poly3",  MR_HOLD },
+    { "multirate hold",   SYNC_MULTIRATE, "linear", MR_HOLD },
+    { "multirate linear", SYNC_MULTIRATE, "linear", MR_LINEAR },
+    { "optimistic",       SYNC_OPTIMISTIC, "linear", MR_HOLD },
+    { "waveform relax.",  SYNC_WR,        "linear", MR_HOLD },
+};
+
+/* copy vector name and its scale from the current plot of p */
+static bool
+fetch(ngpart_t *p, const char *plot, const char *name, benchvec_t *bv)
+{
+    char vname[300];
+    pvector_info vi, ti;
+    int i;
+
+    sprintf(vname, "%s.%s", plot, name);
+    vi = ngpart_vecinfo(p, vname);
+    sprintf(vname, "%s.time", plot);
+    ti = ngpart_vecinfo(p, vname);
+    if (!vi || !ti || !vi->v_realdata || !ti->v_realdata || vi->v_length != ti->v_length)
+        return false;
+
+    strncpy(bv->name, name, NGCPL_NAMELEN - 1);
+    bv->n = vi->v_length;
+    bv->t = (double *)malloc(bv->n * sizeof(double));
+    bv->v = (double *)malloc(bv->n * sizeof(double));
+    for (i = 0; i < bv->n; i++) {
+        bv->t[i] = ti->v_realdata[i];
+        bv->v[i] = vi->v_realdata[i];
+    }
+    return true;
+}
+
+/* fetch all vectors of the current plot but time, returns their number */
+static int
+fetch_all(ngpart_t *p, benchvec_t *bv, int nmax)
+{
+    char *plot = ngpart_curplot(p);
+    char **names = ngpart_allvecs(p, plot);
+    int n = 0;
+
+    for (; names && *names && n < nmax; names++)
+        if (!cieq(*names, "time") && fetch(p, plot, *names, &bv[n]))
+            n++;
+    return n;
+}
+
+static void
+free_vecs(benchvec_t *bv, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        free(bv[i].t);
+        free(bv[i].v);
+    }
+}
+
+/* value of the reference at time t */
+static double
+ref_at(const benchvec_t *r, double t)
+{
+    int lo = 0, hi = r->n - 1;
+
+    if (t <= r->t[0])
+        return r->v[0];
+    if (t >= r->t[hi])
+        return r->v[hi];
+    while (hi - lo > 1) {
+        int mid = (lo + hi) / 2;
+        if (r->t[mid] <= t)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    if (r->t[hi] <= r->t[lo])
+        return r->v[hi];
+    return r->v[lo] + (r->v[hi] - r->v[lo]) * (t - r->t[lo]) / (r->t[hi] - r->t[lo]);
+}
+
+/* deviation of all vectors found in the reference */
+static int
+compare(const benchvec_t *ref, int nref, const benchvec_t *bv, int n, double *maxerr, double *rmserr)
+{
+    double sum = 0;
+    long cnt = 0;
+    int i, k, j, matched = 0;
+
+    *maxerr = 0;
+    for (i = 0; i < n; i++)
+        for (k = 0; k < nref; k++) {
+            if (!cieq(bv[i].name, ref[k].name))
+                continue;
+            matched++;
+            for (j = 0; j < bv[i].n; j++) {
+                double d = fabs(bv[i].v[j] - ref_at(&ref[k], bv[i].t[j]));
+                *maxerr = MAX(*maxerr, d);
+                sum += d * d;
+                cnt++;
+            }
+        }
+    *rmserr = cnt > 0 ? sqrt(sum / cnt) : 0;
+    return matched;
+}
+
+/* simulate the monolithic netlist file in a single instance */
+static int
+reference_run(const char *file, int spin, benchvec_t *ref, int nmax, double *wall,
+              uint64_t *points)
+{
+    ngengine_t *e = ngengine_new(1, SYNC_BARRIER, spin);
+    int n;
+
+    if (!e || ngengine_load(e))
+        return -1;
+    ngengine_init(e, 0);
+    snprintf(e->parts[0].netlist, sizeof(e->parts[0].netlist), "%s", file);
+    ngengine_source(e);
+    ngengine_run(e);
+    ngengine_wait(e);
+    *wall = e->wall_ns / 1e9;
+    n = fetch_all(&e->parts[0], ref, nmax);
+    *points = n > 0 ? (uint64_t)ref[0].n : 0;
+    ngengine_free(e);
+    return n;
+}
+
+/* deviation of the vectors of all partitions of e from the reference,
+   returns the number of vectors compared */
+static int
+deviation(ngengine_t *e, const benchvec_t *ref, int nref, double *maxerr, double *rmserr)
+{
+    benchvec_t bv[BENCH_MAXVECS];
+    int i, matched = 0;
+
+    *maxerr = *rmserr = 0;
+    for (i = 0; i < e->nparts; i++) {
+        double mx, rms;
+        int m = fetch_all(&e->parts[i], bv, BENCH_MAXVECS);
+        int k = compare(ref, nref, bv, m, &mx, &rms);
+        if (k > 0) {
+            *maxerr = MAX(*maxerr, mx);
+            *rmserr = MAX(*rmserr, rms);
+            matched += k;
+        }
+        free_vecs(bv, m);
+    }
+    return matched;
+}
+
+/* a run with the scheme of e */
+static void
+run_scheme(ngengine_t *e, const ngwr_opts *wr)
+{
+    if (e->sync_mode == SYNC_WR) {
+        ngengine_wr(e, wr);
+    }
+    else {
+        ngengine_run(e);
+        ngengine_wait(e);
+    }
+}
+
+int
+ngbench_run(const ngbench_opts *o)
+{
+    benchvec_t ref[BENCH_MAXVECS];
+    double wall[16], maxerr[16], rmserr[16], refwall;
+    uint64_t points[16], refpoints;
+    int matched[16], nref, c;
+    int ncfg = (int)(sizeof(configs) / sizeof(configs[0]));
+
+    printf("\n** Reference run of %s **\n", o->reference);
+    nref = reference_run(o->reference, o->spin, ref, BENCH_MAXVECS, &refwall, &refpoints);
+    if (nref <= 0) {
+        fprintf(stderr, "Error: no reference vectors from %s\n", o->reference);
+        return 1;
+    }
+
+    for (c = 0; c < ncfg; c++) {
+        const benchcfg_t *cfg = &configs[c];
+        ngcoupling_t *cpl;
+        ngengine_t *e;
+
+        printf("\n** Partitioned run: %s **\n", cfg->label);
+        cpl = o->couplingfile ? ngcoupling_read(o->couplingfile)
+                              : ngcoupling_chain(o->nparts, "./examples");
+        if (!cpl) {
+            free_vecs(ref, nref);
+            return 1;
+        }
+        e = ngengine_new(cpl->nparts, cfg->sync_mode, o->spin);
+        if (ngengine_couple(e, cpl) || ngengine_load(e)) {
+            ngengine_free(e);
+            free_vecs(ref, nref);
+            return 1;
+        }
+        ngengine_init(e, NGENGINE_SYNC);
+        ngengine_source(e);
+        e->pred = ngpred_find(cfg->pred);
+        e->mr_interval = o->mr_interval;
+        e->mr_interp = cfg->mr_interp;
+        e->opt_tol = o->opt_tol;
+        run_scheme(e, &o->wr);
+
+        wall[c] = e->wall_ns / 1e9;
+        points[c] = ngengine_points(e);
+        matched[c] = deviation(e, ref, nref, &maxerr[c], &rmserr[c]);
+        ngengine_free(e);
+    }
+
+    printf("\n** Accuracy versus speed, reference %s: %.3f s, %llu points **\n", o->reference,
+           refwall, (unsigned long long)refpoints);
+    printf("%-18s %10s %10s %12s %12s %8s\n", "scheme", "wall [s]", "speedup", "points",
+           "max err [V]", "rms [V]");
+    for (c = 0; c < ncfg; c++)
+        printf("%-18s %10.3f %10.2f %12llu %12.3g %8.3g%s\n", configs[c].label, wall[c],
+               wall[c] > 0 ? refwall / wall[c] : 0, (unsigned long long)points[c], maxerr[c],
+               rmserr[c], matched[c] ? "" : "  (no vector in reference)");
+    free_vecs(ref, nref);
+    return 0;
+}
+
+/* results of a suite */
+typedef struct suiterun {
+    int nparts;
+    double wall, maxerr, rmserr;
+    uint64_t steps, points;
+    int matched;
+} suiterun_t;
+
+static const char *
+scheme_name(int sync_mode)
+{
+    return sync_mode == SYNC_LEGACY ? "legacy" : sync_mode == SYNC_WR ? "wr" :
+           sync_mode == SYNC_MULTIRATE ? "multirate" :
+           sync_mode == SYNC_OPTIMISTIC ? "optimistic" : "barrier";
+}
+
+static int
+write_csv(const ngbench_opts *o, const suiterun_t *r, int runs, double refwall,
+          uint64_t refpoints)
+{
+    FILE *fp = fopen(o->out, "w");
+    int i;
+
+    if (!fp) {
+        fprintf(stderr, "Error: cannot write %s\n", o->out);
+        return 1;
+    }
+    fprintf(fp, "circuit,size,partitions,scheme,seconds,speedup,steps,points,max_err,rms_err\n");
+    fprintf(fp, "%s,%d,1,monolithic,%.6f,1,%llu,%llu,0,0\n", nggen_name(o->gen), o->gen_size,
+            refwall, (unsigned long long)refpoints, (unsigned long long)refpoints);
+    for (i = 0; i < runs; i++)
+        fprintf(fp, "%s,%d,%d,%s,%.6f,%.4f,%llu,%llu,%.6g,%.6g\n", nggen_name(o->gen), o->gen_size,
+                r[i].nparts, scheme_name(o->sync_mode), r[i].wall,
+                r[i].wall > 0 ? refwall / r[i].wall : 0, (unsigned long long)r[i].steps,
+                (unsigned long long)r[i].points, r[i].maxerr, r[i].rmserr);
+    fclose(fp);
+    printf("%d runs written to %s\n", runs + 1, o->out);
+    return 0;
+}
+
+int
+ngbench_suite(const ngbench_opts *o)
+{
+    char flat[300], cplfile[300];
+    suiterun_t r[32];
+    benchvec_t *ref;
+    double refwall;
+    uint64_t refpoints;
+    int runs = 0, nsaved, nref, n, i, ret = 0;
+    int nmax = o->maxparts < o->gen_size ? o->maxparts : o->gen_size;
+
+    nsaved = nggen_flat(o->gen, o->gen_size, nmax, o->gen_dir, flat, sizeof(flat));
+    if (nsaved < 0)
+        return 1;
+    ref = (benchvec_t *)calloc((size_t)nsaved, sizeof(benchvec_t));
+    printf("\n** Monolithic run of %s **\n", flat);
+    nref = reference_run(flat, o->spin, ref, nsaved, &refwall, &refpoints);
+    if (nref <= 0) {
+        fprintf(stderr, "Error: no reference vectors from %s\n", flat);
+        free(ref);
+        return 1;
+    }
+
+    for (n = 1; runs < 32; n = nggen_next(n, nmax)) {
+        ngcoupling_t *cpl = NULL;
+        ngengine_t *e;
+
+        if (nggen_split(o->gen, o->gen_size, n, o->gen_dir, cplfile, sizeof(cplfile)) ||
+            !(cpl = ngcoupling_read(cplfile))) {
+            ret = 1;
+            break;
+        }
+        printf("\n** Partitioned run: %s **\n", cplfile);
+        e = ngengine_new(cpl->nparts, o->sync_mode, o->spin);
+        if (ngengine_couple(e, cpl) || ngengine_load(e)) {
+            ngengine_free(e);
+            ret = 1;
+            break;
+        }
+        ngengine_init(e, NGENGINE_SYNC);
+        ngengine_source(e);
+        if (o->pred)
+            e->pred = o->pred;
+        e->mr_interval = o->mr_interval;
+        e->mr_interp = o->mr_interp;
+        e->opt_tol = o->opt_tol;
+        run_scheme(e, &o->wr);
+
+        r[runs].nparts = n;
+        r[runs].wall = e->wall_ns / 1e9;
+        r[runs].steps = ngengine_steps(e);
+        r[runs].points = ngengine_points(e);
+        r[runs].matched = deviation(e, ref, nref, &r[runs].maxerr, &r[runs].rmserr);
+        runs++;
+        ngengine_free(e);
+        if (n >= nmax)
+            break;
+    }
+
+    printf("\n** Speedup of the %d %s %s (%s), monolithic: %.3f s, %llu points **\n",
+           o->gen_size, o->gen == NGGEN_ADDER ? "bit" : "stage", nggen_name(o->gen),
+           scheme_name(o->sync_mode), refwall, (unsigned long long)refpoints);
+    printf("%10s %10s %10s %10s %12s %12s %8s\n", "partitions", "wall [s]", "speedup", "steps",
+           "points", "max err [V]", "rms [V]");
+    for (i = 0; i < runs; i++)
+        printf("%10d %10.3f %10.2f %10llu %12llu %12.3g %8.3g%s\n", r[i].nparts, r[i].wall,
+               r[i].wall > 0 ? refwall / r[i].wall : 0, (unsigned long long)r[i].steps,
+               (unsigned long long)r[i].points, r[i].maxerr, r[i].rmserr,
+               r[i].matched ? "" : "  (no vector in reference)");
+    if (o->out && runs && write_csv(o, r, runs, refwall, refpoints))
+        ret = 1;
+    free_vecs(ref, nref);
+    free(ref);
+    return ret;
+}
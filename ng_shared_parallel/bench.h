@@ -0,0 +1,45 @@
+/*
+Accuracy versus speed of the partitioned simulation.
+
+The circuit is simulated once in a single ngspice instance from a
+monolithic netlist, this is the reference. Then the partitioned circuit
+is run with several synchronization schemes and interface predictors.
+Every vector saved by a partition which is also found in the reference
+is compared with it, the maximum and rms deviation are reported with
+wall time and accepted points.
+
+ngbench_suite() does the same for the synthetic circuits of gen.h with
+one scheme, split into 1, 2, 4, ... N partitions: wall time, speedup
+against the monolithic run, steps, points and the deviation, printed
+and written as CSV.
+*/
+
+#ifndef NG_BENCH_H
+#define NG_BENCH_H
+
+#include "wr.h"
+
+typedef struct ngbench_opts {
+    const char *reference;     /* monolithic netlist */
+    const char *couplingfile;  /* partitions, NULL for the inverter chain */
+    int nparts;                /* partitions of the inverter chain */
+    int spin;
+    double mr_interval;
+    double opt_tol;
+    ngwr_opts wr;
+
+    /* ngbench_suite() */
+    int gen;                   /* circuit, NGGEN_CHAIN ..., gen.h */
+    int gen_size;              /* stages or bits */
+    int maxparts;              /* 1, 2, 4, ... maxparts partitions */
+    const char *gen_dir;       /* netlists written to */
+    const char *out;           /* CSV file, or NULL */
+    int sync_mode;             /* scheme of the partitioned runs */
+    const ngpredictor_t *pred; /* NULL for the default */
+    int mr_interp;
+} ngbench_opts;
+
+int ngbench_run(const ngbench_opts *o);
+int ngbench_suite(const ngbench_opts *o);
+
+#endif
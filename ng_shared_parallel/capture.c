@@ -0,0 +1,402 @@
+/*
+Streaming waveform capture, see capture.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+
+#if defined(__MINGW32__) || defined(_MSC_VER)
+
+ngcapture_t *
+ngcapture_open(const char *file, pvecinfoall info, const char *vectors)
+{
+    (void)file;
+    (void)info;
+    (void)vectors;
+    fprintf(stderr, "Error: waveform capture is not available on MS Windows\n");
+    return NULL;
+}
+
+void
+ngcapture_push(ngcapture_t *c, pvecvaluesall v)
+{
+    (void)c;
+    (void)v;
+}
+
+void
+ngcapture_append(ngcapture_t *c, const double *values)
+{
+    (void)c;
+    (void)values;
+}
+
+void
+ngcapture_close(ngcapture_t *c)
+{
+    (void)c;
+}
+
+ngcapture_reader_t *
+ngcapture_read(const char *file)
+{
+    (void)file;
+    fprintf(stderr, "Error: waveform capture is not available on MS Windows\n");
+    return NULL;
+}
+
+void
+ngcapture_reader_free(ngcapture_reader_t *r)
+{
+    (void)r;
+}
+
+int
+ngcapture_column(ngcapture_reader_t *r, const char *name)
+{
+    (void)r;
+    (void)name;
+    return -1;
+}
+
+const char *
+ngcapture_name(ngcapture_reader_t *r, int col)
+{
+    (void)r;
+    (void)col;
+    return NULL;
+}
+
+uint64_t
+ngcapture_values(ngcapture_reader_t *r, int col, uint64_t first, uint64_t n, double *dst)
+{
+    (void)r;
+    (void)col;
+    (void)first;
+    (void)n;
+    (void)dst;
+    return 0;
+}
+
+#else
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static size_t
+block_bytes(int ncols)
+{
+    return (size_t)ncols * NGCAPTURE_BLOCKPTS * sizeof(double);
+}
+
+/* "x" of "v(x)", for the node voltages ngspice names "x" */
+static bool
+vec_match(const char *vecname, const char *want)
+{
+    size_t n = strlen(want);
+    char inner[NGCAPTURE_NAMELEN];
+
+    if (cieq(vecname, want))
+        return true;
+    if (n > 3 && n - 3 < sizeof(inner) && (want[0] == 'v' || want[0] == 'V') && want[1] == '('
+        && want[n - 1] == ')') {
+        memcpy(inner, want + 2, n - 3);
+        inner[n - 3] = '\0';
+        return cieq(vecname, inner) != 0;
+    }
+    return false;
+}
+
+ngcapture_t *
+ngcapture_open(const char *file, pvecinfoall info, const char *vectors)
+{
+    ngcapture_t *c;
+    int i, scale = -1;
+
+    for (i = 0; i < info->veccount; i++)
+        if (scale < 0 && cieq(info->vecs[i]->vecname, "time"))
+            scale = i;
+    if (scale < 0) {
+        fprintf(stderr, "Error: no time scale to capture in %s\n", info->name);
+        return NULL;
+    }
+
+    c = (ngcapture_t *)calloc(1, sizeof(ngcapture_t));
+    snprintf(c->file, sizeof(c->file), "%s", file);
+    c->vecindex = (int *)malloc((size_t)(info->veccount + 1) * sizeof(int));
+    c->vecindex[c->ncols++] = scale;
+    if (cieq(vectors, "all")) {
+        for (i = 0; i < info->veccount && c->ncols < NGCAPTURE_MAXCOLS; i++)
+            if (i != scale)
+                c->vecindex[c->ncols++] = i;
+    }
+    else {
+        char list[1024], *tok, *save = NULL;
+        snprintf(list, sizeof(list), "%s", vectors);
+        for (tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+            for (i = 0; i < info->veccount; i++)
+                if (i != scale && vec_match(info->vecs[i]->vecname, tok))
+                    break;
+            if (i < info->veccount && c->ncols < NGCAPTURE_MAXCOLS)
+                c->vecindex[c->ncols++] = i;
+            else if (i == info->veccount)
+                fprintf(stderr, "Warning: vector %s not found, not captured\n", tok);
+        }
+    }
+
+    c->fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (c->fd < 0 || ftruncate(c->fd, NGCAPTURE_DATAOFF)) {
+        perror(file);
+        goto error;
+    }
+    c->hdr = (ngcapture_header_t *)mmap(NULL, NGCAPTURE_DATAOFF, PROT_READ | PROT_WRITE,
+                                        MAP_SHARED, c->fd, 0);
+    if (c->hdr == MAP_FAILED) {
+        c->hdr = NULL;
+        perror("mmap");
+        goto error;
+    }
+    memcpy(c->hdr->magic, NGCAPTURE_MAGIC, sizeof(c->hdr->magic));
+    c->hdr->ncols = (uint32_t)c->ncols;
+    c->hdr->blockpts = NGCAPTURE_BLOCKPTS;
+    for (i = 0; i < c->ncols; i++)
+        snprintf(c->hdr->names[i], NGCAPTURE_NAMELEN, "%s", info->vecs[c->vecindex[i]]->vecname);
+    c->mapped = -1;
+    return c;
+
+error:
+    if (c->fd >= 0)
+        close(c->fd);
+    free(c->vecindex);
+    free(c);
+    return NULL;
+}
+
+/* map block b, the file grows by whole blocks */
+static bool
+map_block(ngcapture_t *c, int64_t b)
+{
+    size_t bb = block_bytes(c->ncols);
+    off_t off = NGCAPTURE_DATAOFF + (off_t)b * (off_t)bb;
+    struct stat st;
+
+    if (c->mapped == b)
+        return true;
+    if (c->block) {
+        munmap(c->block, bb);
+        c->block = NULL;
+        c->hdr->npoints = c->npoints;
+    }
+    if (fstat(c->fd, &st) || (st.st_size < off + (off_t)bb && ftruncate(c->fd, off + (off_t)bb))) {
+        perror(c->file);
+        return false;
+    }
+    c->block = (double *)mmap(NULL, bb, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, off);
+    if (c->block == MAP_FAILED) {
+        c->block = NULL;
+        perror("mmap");
+        return false;
+    }
+    c->mapped = b;
+    return true;
+}
+
+/* scale of point i, from the mapped block or the file */
+static bool
+point_time(ngcapture_t *c, uint64_t i, double *t)
+{
+    int64_t b = (int64_t)(i / NGCAPTURE_BLOCKPTS);
+    off_t off;
+
+    if (b == c->mapped) {
+        *t = c->block[i % NGCAPTURE_BLOCKPTS];
+        return true;
+    }
+    off = NGCAPTURE_DATAOFF + (off_t)b * (off_t)block_bytes(c->ncols)
+          + (off_t)(i % NGCAPTURE_BLOCKPTS) * (off_t)sizeof(double);
+    if (pread(c->fd, t, sizeof(double), off) != (ssize_t)sizeof(double)) {
+        perror(c->file);
+        return false;
+    }
+    return true;
+}
+
+/* drop the points at or after t, found by binary search on the scale */
+static bool
+rewind_to(ngcapture_t *c, double t)
+{
+    uint64_t lo = 0, hi = c->npoints, mid;
+    double tm;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (!point_time(c, mid, &tm))
+            return false;
+        if (tm < t)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    c->npoints = lo;
+    c->hdr->npoints = lo;
+    return true;
+}
+
+void
+ngcapture_append(ngcapture_t *c, const double *values)
+{
+    double t = values[0];
+    uint64_t n;
+    int i, k;
+
+    if (c->mapped == -2)
+        return;
+    if (c->npoints > 0 && t <= c->last && !rewind_to(c, t))
+        goto error;
+    n = c->npoints;
+    if (!map_block(c, (int64_t)(n / NGCAPTURE_BLOCKPTS)))
+        goto error;
+    k = (int)(n % NGCAPTURE_BLOCKPTS);
+    for (i = 0; i < c->ncols; i++)
+        c->block[(size_t)i * NGCAPTURE_BLOCKPTS + k] = values[i];
+    c->npoints++;
+    c->last = t;
+    return;
+
+error:
+    /* stop capturing, what was written is kept */
+    c->mapped = -2;
+}
+
+void
+ngcapture_push(ngcapture_t *c, pvecvaluesall v)
+{
+    double values[NGCAPTURE_MAXCOLS];
+    int i;
+
+    for (i = 0; i < c->ncols; i++)
+        values[i] = v->vecsa[c->vecindex[i]]->creal;
+    ngcapture_append(c, values);
+}
+
+void
+ngcapture_close(ngcapture_t *c)
+{
+    uint64_t nblocks;
+
+    if (!c)
+        return;
+    if (c->block)
+        munmap(c->block, block_bytes(c->ncols));
+    /* blocks behind a rewind */
+    nblocks = (c->npoints + NGCAPTURE_BLOCKPTS - 1) / NGCAPTURE_BLOCKPTS;
+    if (ftruncate(c->fd, NGCAPTURE_DATAOFF + (off_t)(nblocks * block_bytes(c->ncols))))
+        perror(c->file);
+    c->hdr->npoints = c->npoints;
+    c->hdr->complete = 1;
+    munmap(c->hdr, NGCAPTURE_DATAOFF);
+    close(c->fd);
+    free(c->vecindex);
+    free(c);
+}
+
+ngcapture_reader_t *
+ngcapture_read(const char *file)
+{
+    ngcapture_reader_t *r;
+    struct stat st;
+    uint64_t nblocks;
+    void *m;
+    int fd = open(file, O_RDONLY);
+
+    if (fd < 0) {
+        perror(file);
+        return NULL;
+    }
+    if (fstat(fd, &st) || st.st_size < NGCAPTURE_DATAOFF) {
+        fprintf(stderr, "Error: %s is not a capture file\n", file);
+        close(fd);
+        return NULL;
+    }
+    m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+        return NULL;
+    }
+    r = (ngcapture_reader_t *)calloc(1, sizeof(ngcapture_reader_t));
+    r->fd = fd;
+    r->hdr = (const ngcapture_header_t *)m;
+    r->size = (size_t)st.st_size;
+    if (memcmp(r->hdr->magic, NGCAPTURE_MAGIC, sizeof(r->hdr->magic))
+        || r->hdr->blockpts != NGCAPTURE_BLOCKPTS || r->hdr->ncols < 1
+        || r->hdr->ncols > NGCAPTURE_MAXCOLS) {
+        fprintf(stderr, "Error: %s is not a capture file\n", file);
+        ngcapture_reader_free(r);
+        return NULL;
+    }
+    r->ncols = (int)r->hdr->ncols;
+    /* of a file being written, the points in whole blocks */
+    nblocks = (r->size - NGCAPTURE_DATAOFF) / block_bytes(r->ncols);
+    r->npoints = r->hdr->npoints;
+    if (r->npoints > nblocks * NGCAPTURE_BLOCKPTS)
+        r->npoints = nblocks * NGCAPTURE_BLOCKPTS;
+    return r;
+}
+
+void
+ngcapture_reader_free(ngcapture_reader_t *r)
+{
+    if (!r)
+        return;
+    munmap((void *)r->hdr, r->size);
+    close(r->fd);
+    free(r);
+}
+
+int
+ngcapture_column(ngcapture_reader_t *r, const char *name)
+{
+    int i;
+
+    for (i = 0; i < r->ncols; i++)
+        if (vec_match(r->hdr->names[i], name))
+            return i;
+    return -1;
+}
+
+const char *
+ngcapture_name(ngcapture_reader_t *r, int col)
+{
+    return col >= 0 && col < r->ncols ? r->hdr->names[col] : NULL;
+}
+
+uint64_t
+ngcapture_values(ngcapture_reader_t *r, int col, uint64_t first, uint64_t n, double *dst)
+{
+    const char *data = (const char *)r->hdr + NGCAPTURE_DATAOFF;
+    uint64_t done = 0;
+
+    if (col < 0 || col >= r->ncols || first >= r->npoints)
+        return 0;
+    if (n > r->npoints - first)
+        n = r->npoints - first;
+    while (done < n) {
+        uint64_t i = first + done;
+        uint64_t k = i % NGCAPTURE_BLOCKPTS;
+        uint64_t m = NGCAPTURE_BLOCKPTS - k;
+        const double *b = (const double *)(data + (i / NGCAPTURE_BLOCKPTS) * block_bytes(r->ncols));
+
+        if (m > n - done)
+            m = n - done;
+        memcpy(dst + done, b + (size_t)col * NGCAPTURE_BLOCKPTS + k, m * sizeof(double));
+        done += m;
+    }
+    return done;
+}
+
+#endif
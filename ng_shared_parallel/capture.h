@@ -0,0 +1,95 @@
+/*
+Streaming waveform capture.
+
+Instead of "write file.raw all" after the run, which needs the whole
+plot and writes it from one thread at the end, the points are written
+as they are accepted: ng_data() appends the selected vectors of every
+point to a file of its own per partition, mapped into memory.
+
+The file is columnar in blocks. A header with the column names is
+followed by blocks of NGCAPTURE_BLOCKPTS points, every block holding
+the points of column 0 (the scale, time), then of column 1, and so on.
+Only the block being filled is mapped, so the memory of the capture
+stays at one block per partition however long the run is. The header
+holds the number of points written, updated with every block and when
+the capture is closed; a file may be read while it is written.
+
+A capture is opened by the first ng_initdata() of a run and closed when
+the run has ended. Waveform relaxation simulates from time 0 again in
+every iteration, within the one run: a point at or before the last one
+written rewinds the capture to it, found by a binary search on the
+scale, so the file ends up with the last iteration. Values are doubles
+in the byte order of the host.
+Not available on MS Windows.
+*/
+
+#ifndef NG_CAPTURE_H
+#define NG_CAPTURE_H
+
+#include "port.h"
+#include "../include/sharedspice.h"
+
+#define NGCAPTURE_MAGIC "NGCAP01"
+#define NGCAPTURE_NAMELEN 64
+#define NGCAPTURE_BLOCKPTS 4096
+/* first block, a multiple of any page size */
+#define NGCAPTURE_DATAOFF 65536
+#define NGCAPTURE_MAXCOLS ((NGCAPTURE_DATAOFF - 64) / NGCAPTURE_NAMELEN)
+
+typedef struct ngcapture_header {
+    char magic[8];
+    uint32_t ncols;
+    uint32_t blockpts;
+    uint64_t npoints;
+    uint32_t complete;         /* closed by the writer */
+    uint32_t pad[9];
+    char names[1][NGCAPTURE_NAMELEN];  /* ncols */
+} ngcapture_header_t;
+
+typedef struct ngcapture {
+    char file[256];
+    int fd;
+    int ncols;
+    int *vecindex;             /* in the SendData array, per column */
+    ngcapture_header_t *hdr;   /* mapped */
+    double *block;             /* mapped block, or NULL */
+    int64_t mapped;            /* its index, -2 after an error */
+    uint64_t npoints;
+    double last;               /* scale of the last point */
+} ngcapture_t;
+
+/* Start a capture of the vectors given as a comma separated list, or
+   "all", into file. The scale is always column 0, names not found are
+   reported and skipped. NULL on error. */
+ngcapture_t *ngcapture_open(const char *file, pvecinfoall info, const char *vectors);
+
+/* append a point, in ng_data() */
+void ngcapture_push(ngcapture_t *c, pvecvaluesall v);
+
+/* append a point given by the values of the columns, handoff.h */
+void ngcapture_append(ngcapture_t *c, const double *values);
+
+/* write the header and unmap, the file stays */
+void ngcapture_close(ngcapture_t *c);
+
+/* reading a capture file */
+typedef struct ngcapture_reader {
+    int fd;
+    const ngcapture_header_t *hdr;
+    size_t size;
+    int ncols;
+    uint64_t npoints;
+} ngcapture_reader_t;
+
+ngcapture_reader_t *ngcapture_read(const char *file);
+void ngcapture_reader_free(ngcapture_reader_t *r);
+
+/* column of a vector name, -1 if not captured */
+int ngcapture_column(ngcapture_reader_t *r, const char *name);
+const char *ngcapture_name(ngcapture_reader_t *r, int col);
+
+/* copy n values of column col from point first to dst; returns the
+   number copied */
+uint64_t ngcapture_values(ngcapture_reader_t *r, int col, uint64_t first, uint64_t n, double *dst);
+
+#endif
@@ -0,0 +1,117 @@
+/*
+Interface sample channel, single producer single consumer ring.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chan.h"
+
+void
+ngchan_init(ngchan_t *c, int size)
+{
+    memset(c, 0, sizeof(*c));
+    c->buf = (ngsample_t *)calloc((size_t)ngring_init(&c->ring, (uint64_t)size),
+                                  sizeof(ngsample_t));
+}
+
+void
+ngchan_free(ngchan_t *c)
+{
+    free(c->buf);
+    c->buf = NULL;
+}
+
+/* empty the channel, only while no bg thread is running */
+void
+ngchan_reset(ngchan_t *c)
+{
+    ngring_reset(&c->ring);
+    c->overflows = 0;
+}
+
+/* Append a sample, times are increasing. If the consumer lags a whole
+   ring behind, the sample is dropped. */
+bool
+ngchan_push(ngchan_t *c, double t, double v)
+{
+    ngsample_t *s;
+
+    if (ngring_full(&c->ring)) {
+        c->overflows++;
+        return false;
+    }
+    s = &c->buf[ngring_slot(&c->ring)];
+    s->t = t;
+    s->v = v;
+    ngring_push(&c->ring);
+    return true;
+}
+
+bool
+ngchan_full(ngchan_t *c)
+{
+    return ngring_full(&c->ring);
+}
+
+/* Copy the samples around time t to w, in increasing time: up to
+   nmax - 1 samples at or before t and the first one after t, if the
+   producer has already reached it. Returns the number of samples. */
+int
+ngchan_window(ngchan_t *c, double t, ngsample_t *w, int nmax)
+{
+    uint64_t head = ngring_end(&c->ring), mask = c->ring.mask;
+    uint64_t tail = c->ring.tail, i = tail, start, end;
+    int n = 0;
+
+    if (i == head)
+        return 0;
+    while (i + 1 < head && c->buf[(i + 1) & mask].t <= t)
+        i++;
+    end = (i + 1 < head) ? i + 2 : i + 1;
+    start = (end - tail > (uint64_t)nmax) ? end - (uint64_t)nmax : tail;
+    for (i = start; i < end; i++)
+        w[n++] = c->buf[i & mask];
+    return n;
+}
+
+/* The consumer has accepted time t and will never ask for an earlier
+   time again: drop all samples but the last NGCHAN_HISTORY ones at or
+   before t. */
+void
+ngchan_retire(ngchan_t *c, double t)
+{
+    uint64_t head = ngring_end(&c->ring), mask = c->ring.mask;
+    uint64_t tail = c->ring.tail, i = tail;
+
+    while (i + 1 < head && c->buf[(i + 1) & mask].t <= t)
+        i++;
+    i = (i - tail >= NGCHAN_HISTORY) ? i - (NGCHAN_HISTORY - 1) : tail;
+    if (i != tail)
+        ngring_pop_to(&c->ring, i);
+}
+
+int
+ngchan_take(ngchan_t *c, ngsample_t *w, int nmax)
+{
+    uint64_t head = ngring_end(&c->ring);
+    uint64_t i = c->ring.tail;
+    int n = 0;
+
+    for (; i < head && n < nmax; i++)
+        w[n++] = c->buf[i & c->ring.mask];
+    if (n)
+        ngring_pop_to(&c->ring, i);
+    return n;
+}
+
+bool
+ngchan_latest(ngchan_t *c, ngsample_t *s)
+{
+    uint64_t head = ngring_end(&c->ring);
+
+    if (head == ngat_load_u64(&c->ring.tail))
+        return false;
+    *s = c->buf[(head - 1) & c->ring.mask];
+    return true;
+}
@@ -0,0 +1,54 @@
+/*
+Interface sample channel: a single producer, single consumer ring of
+timestamped samples, one per coupling edge.
+
+The bg thread of the source partition appends (time, value) for every
+accepted time point in ng_data(). The bg thread of the driven partition
+takes the samples around the requested time in ng_VSRCData(), the
+interface predictor (pred.h) calculates the value from them. It retires
+the samples it does not need any more in ng_SyncData(), where its own
+accepted time is known, keeping NGCHAN_HISTORY of them for the
+predictors. The indices are an ngring_t (ring.h).
+*/
+
+#ifndef NG_CHAN_H
+#define NG_CHAN_H
+
+#include "ring.h"
+
+/* samples per channel, a power of 2 */
+#define NGCHAN_SIZE 4096
+
+/* samples kept at or before the accepted time of the consumer */
+#define NGCHAN_HISTORY 8
+
+typedef struct ngsample {
+    double t, v;
+} ngsample_t;
+
+typedef struct ngchan {
+    ngring_t ring;             /* tail: oldest sample still needed */
+    ngsample_t *buf;
+    uint64_t overflows;        /* samples dropped on a full ring, producer */
+} ngchan_t;
+
+void ngchan_init(ngchan_t *c, int size);
+void ngchan_free(ngchan_t *c);
+void ngchan_reset(ngchan_t *c);
+
+/* producer */
+bool ngchan_push(ngchan_t *c, double t, double v);
+bool ngchan_full(ngchan_t *c);
+
+/* consumer */
+int ngchan_window(ngchan_t *c, double t, ngsample_t *w, int nmax);
+void ngchan_retire(ngchan_t *c, double t);
+
+/* consumer forwarding the samples elsewhere (net.c): take up to nmax
+   of them, oldest first, nothing is kept */
+int ngchan_take(ngchan_t *c, ngsample_t *w, int nmax);
+
+/* newest sample, false if the channel is empty */
+bool ngchan_latest(ngchan_t *c, ngsample_t *s);
+
+#endif
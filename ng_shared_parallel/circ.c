@@ -0,0 +1,306 @@
+/*
+Netlist cache, see circ.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "circ.h"
+
+/* nesting of .include files */
+#define CIRC_MAXDEPTH 16
+/* longest card read, with the newline */
+#define CIRC_LINELEN 4096
+
+#if defined(__MINGW32__) || defined(_MSC_VER)
+static SRWLOCK cache_cs = SRWLOCK_INIT;
+#define cache_lock() AcquireSRWLockExclusive(&cache_cs)
+#define cache_unlock() ReleaseSRWLockExclusive(&cache_cs)
+#else
+static pthread_mutex_t cache_cs = PTHREAD_MUTEX_INITIALIZER;
+#define cache_lock() mutex_lock(&cache_cs)
+#define cache_unlock() mutex_unlock(&cache_cs)
+#endif
+
+static ngcirc_t *cache;
+static uint64_t hits, misses;
+
+static void
+add_line(ngcirc_t *c, int *cap, const char *line)
+{
+    if (c->nlines + 1 >= *cap) {
+        *cap = *cap ? 2 * *cap : 256;
+        c->lines = (char **)realloc(c->lines, (size_t)*cap * sizeof(char *));
+    }
+    c->lines[c->nlines++] = strdup(line);
+    c->bytes += strlen(line) + 1;
+}
+
+/* length of the card name if line is the card .inc, .include or .lib
+   followed by a file name, else 0 */
+static size_t
+file_card(const char *s, bool *lib)
+{
+    size_t n;
+
+    if (s[0] != '.')
+        return 0;
+    if (tolower((unsigned char)s[1]) == 'l' && tolower((unsigned char)s[2]) == 'i'
+        && tolower((unsigned char)s[3]) == 'b')
+        n = 4;
+    else if (tolower((unsigned char)s[1]) == 'i' && tolower((unsigned char)s[2]) == 'n'
+             && tolower((unsigned char)s[3]) == 'c')
+        /* .inc or .include */
+        n = (!strncmp(s + 4, "lude", 4) || !strncmp(s + 4, "LUDE", 4)) ? 8 : 4;
+    else
+        return 0;
+    if (!isspace((unsigned char)s[n]))
+        return 0;
+    *lib = (n == 4 && tolower((unsigned char)s[1]) == 'l');
+    return n;
+}
+
+/* File name of an .include or .lib card, relative to the including
+   file as ngspice does; the name starts at line + *start and is *nlen
+   characters long, quotes excluded. */
+static bool
+include_path(const char *line, const char *from, char *path, size_t len, bool *lib,
+             size_t *start, size_t *nlen)
+{
+    const char *s = line;
+    const char *slash;
+    char name[256];
+    size_t n = file_card(line, lib);
+
+    if (!n)
+        return false;
+    s += n;
+    while (isspace((unsigned char)*s))
+        s++;
+    if (*s == '"' || *s == '\'')
+        s++;
+    for (n = 0; s[n] && !isspace((unsigned char)s[n]) && s[n] != '"' && s[n] != '\''
+                && n < sizeof(name) - 1; n++)
+        name[n] = s[n];
+    name[n] = '\0';
+    if (!n)
+        return false;
+    *start = (size_t)(s - line);
+    *nlen = n;
+
+    slash = strrchr(from, '/');
+    if (!slash)
+        slash = strrchr(from, '\\');
+    if (name[0] == '/' || name[0] == '\\' || (name[0] && name[1] == ':') || !slash)
+        snprintf(path, len, "%s", name);
+    else
+        snprintf(path, len, "%.*s%s", (int)(slash - from + 1), from, name);
+    return true;
+}
+
+/* A .lib card selects a section of the library, which is left to
+   ngspice; only its file name is made relative to the including file,
+   as ngSpice_Circ() reads it relative to the working directory. */
+static void
+add_lib(ngcirc_t *c, int *cap, const char *line, const char *path, size_t start, size_t nlen)
+{
+    size_t len = strlen(line) + strlen(path) + 1;
+    char *l = (char *)malloc(len);
+
+    snprintf(l, len, "%.*s%s%s", (int)start, line, path, line + start + nlen);
+    add_line(c, cap, l);
+    free(l);
+}
+
+static int
+read_file(ngcirc_t *c, int *cap, const char *file, int depth)
+{
+    char line[CIRC_LINELEN], inc[512];
+    int lineno = 0;
+    size_t start, nlen;
+    bool lib;
+    FILE *fp;
+
+    if (depth > CIRC_MAXDEPTH) {
+        fprintf(stderr, "Error: .include nested too deep in %s\n", file);
+        return 1;
+    }
+    fp = fopen(file, "r");
+    if (!fp) {
+        fprintf(stderr, "Error: cannot open netlist %s\n", file);
+        return 1;
+    }
+    c->files++;
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        /* a card must not be split into two */
+        if (!strchr(line, '\n') && !feof(fp)) {
+            fprintf(stderr, "Error: line %d of %s is longer than %d characters\n", lineno, file,
+                    CIRC_LINELEN - 2);
+            fclose(fp);
+            return 1;
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        /* the title of the netlist is its first line, included files have none */
+        if (!(depth == 0 && c->nlines == 0)
+            && include_path(line, file, inc, sizeof(inc), &lib, &start, &nlen)) {
+            if (lib) {
+                add_lib(c, cap, line, inc, start, nlen);
+                continue;
+            }
+            if (read_file(c, cap, inc, depth + 1)) {
+                fclose(fp);
+                return 1;
+            }
+            continue;
+        }
+        add_line(c, cap, line);
+    }
+    fclose(fp);
+    return 0;
+}
+
+static ngcirc_t *
+circ_read(const char *file)
+{
+    ngcirc_t *c = (ngcirc_t *)calloc(1, sizeof(ngcirc_t));
+    uint64_t t0 = ng_now_ns();
+    int cap = 0, i;
+
+    snprintf(c->file, sizeof(c->file), "%s", file);
+    if (read_file(c, &cap, file, 0)) {
+        for (i = 0; i < c->nlines; i++)
+            free(c->lines[i]);
+        free(c->lines);
+        free(c);
+        return NULL;
+    }
+    if (!c->lines)
+        c->lines = (char **)malloc(sizeof(char *));
+    c->lines[c->nlines] = NULL;
+    c->templ = (int *)malloc((size_t)(c->nlines + 1) * sizeof(int));
+    for (i = 0; i < c->nlines; i++)
+        if (strchr(c->lines[i], '{'))
+            c->templ[c->ntempl++] = i;
+    c->read_ns = ng_now_ns() - t0;
+    return c;
+}
+
+const ngcirc_t *
+ngcirc_get(const char *file)
+{
+    ngcirc_t *c;
+
+    cache_lock();
+    for (c = cache; c; c = c->next)
+        if (!strcmp(c->file, file))
+            break;
+    if (c) {
+        hits++;
+    }
+    else {
+        c = circ_read(file);
+        if (c) {
+            c->next = cache;
+            cache = c;
+            misses++;
+        }
+    }
+    cache_unlock();
+    return c;
+}
+
+/* line with the known {name} replaced, others are left to ngspice */
+static char *
+subst_line(const char *src, const char *const *names, const double *values, int n)
+{
+    size_t cap = strlen(src) + 64, len = 0;
+    char *dst = (char *)malloc(cap);
+    int j;
+
+    while (*src) {
+        const char *close;
+        char num[32];
+        size_t k;
+        if (*src == '{' && (close = strchr(src, '}')) != NULL) {
+            for (j = 0; j < n; j++) {
+                k = strlen(names[j]);
+                if ((size_t)(close - src - 1) == k && !strncmp(src + 1, names[j], k))
+                    break;
+            }
+            if (j < n) {
+                k = (size_t)snprintf(num, sizeof(num), "%.9g", values[j]);
+                if (len + k + 1 > cap) {
+                    cap = 2 * (len + k + 1);
+                    dst = (char *)realloc(dst, cap);
+                }
+                memcpy(dst + len, num, k);
+                len += k;
+                src = close + 1;
+                continue;
+            }
+        }
+        if (len + 2 > cap) {
+            cap *= 2;
+            dst = (char *)realloc(dst, cap);
+        }
+        dst[len++] = *src++;
+    }
+    dst[len] = '\0';
+    return dst;
+}
+
+char **
+ngcirc_subst(const ngcirc_t *c, const char *const *names, const double *values, int n)
+{
+    char **lines = (char **)malloc((size_t)(c->nlines + 1) * sizeof(char *));
+    int k;
+
+    memcpy(lines, c->lines, (size_t)(c->nlines + 1) * sizeof(char *));
+    for (k = 0; k < c->ntempl; k++)
+        lines[c->templ[k]] = subst_line(c->lines[c->templ[k]], names, values, n);
+    return lines;
+}
+
+void
+ngcirc_release(const ngcirc_t *c, char **lines)
+{
+    int k;
+
+    if (!lines)
+        return;
+    for (k = 0; k < c->ntempl; k++)
+        if (lines[c->templ[k]] != c->lines[c->templ[k]])
+            free(lines[c->templ[k]]);
+    free(lines);
+}
+
+void
+ngcirc_flush(void)
+{
+    ngcirc_t *c, *next;
+    int i;
+
+    cache_lock();
+    for (c = cache; c; c = next) {
+        next = c->next;
+        for (i = 0; i < c->nlines; i++)
+            free(c->lines[i]);
+        free(c->lines);
+        free(c->templ);
+        free(c);
+    }
+    cache = NULL;
+    cache_unlock();
+}
+
+void
+ngcirc_stats(uint64_t *h, uint64_t *m)
+{
+    cache_lock();
+    *h = hits;
+    *m = misses;
+    cache_unlock();
+}
@@ -0,0 +1,54 @@
+/*
+Netlist cache.
+
+"source file" makes ngspice read and parse the netlist and all of its
+.include files again, in every instance and for every run. The cache
+reads a netlist once, expands its .include cards recursively, relative
+to the including file as ngspice does, and keeps the lines in memory.
+A partition hands them over to ngSpice_Circ() as they are. ngspice
+reads the files of the remaining cards relative to the working
+directory then, so the file name of a .lib card, whose section is
+selected by ngspice, is made relative to the including file as well.
+A line longer than the buffer is an error, not split into two cards.
+
+Lines holding a '{' are listed when reading. ngcirc_subst() replaces
+{name} by a value in these lines only, all other lines of the copy
+are shared with the cache; ngspice copies them anyway.
+
+Netlists are cached by file name until ngcirc_flush(); a file changed
+after it has been read is not noticed.
+*/
+
+#ifndef NG_CIRC_H
+#define NG_CIRC_H
+
+#include <stddef.h>
+
+#include "port.h"
+
+typedef struct ngcirc {
+    char file[256];
+    char **lines;              /* NULL terminated, for ngSpice_Circ() */
+    int nlines;
+    int *templ;                /* indices of the lines holding a '{' */
+    int ntempl;
+    int files;                 /* netlist and included files read */
+    size_t bytes;
+    uint64_t read_ns;
+    struct ngcirc *next;
+} ngcirc_t;
+
+/* the netlist file, read on the first call; NULL on error */
+const ngcirc_t *ngcirc_get(const char *file);
+
+/* copy of the lines with {names[i]} replaced by values[i] */
+char **ngcirc_subst(const ngcirc_t *c, const char *const *names, const double *values, int n);
+void ngcirc_release(const ngcirc_t *c, char **lines);
+
+/* forget all cached netlists */
+void ngcirc_flush(void);
+
+/* lookups served from the cache, and files read */
+void ngcirc_stats(uint64_t *hits, uint64_t *misses);
+
+#endif
@@ -0,0 +1,350 @@
+/*
+Coupling graph: reading the description file and compiling it into
+the index tables used by the data and source callbacks.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "partition.h"
+
+#define CPL_MAXTOK 8
+
+static int
+find_part(ngcoupling_t *c, const char *name)
+{
+    int i;
+
+    for (i = 0; i < c->nparts; i++)
+        if (cieq(c->parts[i].name, name))
+            return i;
+    return -1;
+}
+
+/* split a line into whitespace separated tokens, '#' starts a comment */
+static int
+tokenize(char *line, char **tok)
+{
+    int n = 0;
+    char *s = line;
+
+    while (*s && n < CPL_MAXTOK) {
+        while (*s && isspace((unsigned char)*s))
+            s++;
+        if (!*s || *s == '#')
+            break;
+        tok[n++] = s;
+        while (*s && !isspace((unsigned char)*s))
+            s++;
+        if (*s)
+            *s++ = '\0';
+    }
+    return n;
+}
+
+ngcoupling_t *
+ngcoupling_read(const char *file)
+{
+    ngcoupling_t *c;
+    char line[1024], dir[256], *tok[CPL_MAXTOK], *slash;
+    int lineno = 0, n, i;
+    FILE *fp = fopen(file, "r");
+
+    if (!fp) {
+        fprintf(stderr, "Error: cannot open coupling description %s\n", file);
+        return NULL;
+    }
+
+    /* netlists are relative to the directory of the description */
+    strncpy(dir, file, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+    slash = strrchr(dir, '/');
+    if (!slash)
+        slash = strrchr(dir, '\\');
+    if (slash)
+        slash[1] = '\0';
+    else
+        dir[0] = '\0';
+
+    c = (ngcoupling_t *)calloc(1, sizeof(ngcoupling_t));
+    c->parts = (ngcpart_t *)calloc(NGENGINE_MAXPARTS, sizeof(ngcpart_t));
+
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        n = tokenize(line, tok);
+        if (n == 0)
+            continue;
+
+        if (cieq(tok[0], "partition") && n == 3) {
+            ngcpart_t *p;
+            if (c->nparts >= NGENGINE_MAXPARTS) {
+                fprintf(stderr, "%s:%d: too many partitions\n", file, lineno);
+                goto error;
+            }
+            if (find_part(c, tok[1]) >= 0) {
+                fprintf(stderr, "%s:%d: partition %s defined twice\n", file, lineno, tok[1]);
+                goto error;
+            }
+            p = &c->parts[c->nparts++];
+            strncpy(p->name, tok[1], NGCPL_NAMELEN - 1);
+            if (tok[2][0] == '/' || tok[2][0] == '\\' || (tok[2][0] && tok[2][1] == ':'))
+                snprintf(p->netlist, sizeof(p->netlist), "%s", tok[2]);
+            else
+                snprintf(p->netlist, sizeof(p->netlist), "%s%s", dir, tok[2]);
+        }
+        else if (cieq(tok[0], "couple") && n == 7 && !strcmp(tok[3], "<->")) {
+            /* voltage forward, load current back */
+            ngedge_t *ed;
+            int src = find_part(c, tok[1]), dsti = find_part(c, tok[4]);
+            if (src < 0 || dsti < 0) {
+                fprintf(stderr, "%s:%d: unknown partition %s\n", file, lineno,
+                        src < 0 ? tok[1] : tok[4]);
+                goto error;
+            }
+            c->edges = (ngedge_t *)realloc(c->edges, (c->nedges + 2) * sizeof(ngedge_t));
+            ed = &c->edges[c->nedges];
+            memset(ed, 0, 2 * sizeof(*ed));
+            ed[0].src = ed[1].dst = src;
+            ed[0].dst = ed[1].src = dsti;
+            strncpy(ed[0].vector, tok[2], NGCPL_NAMELEN - 1);
+            strncpy(ed[0].source, tok[5], NGCPL_NAMELEN - 1);
+            snprintf(ed[1].vector, NGCPL_NAMELEN, "%s#branch", tok[5]);
+            strncpy(ed[1].source, tok[6], NGCPL_NAMELEN - 1);
+            c->nedges += 2;
+        }
+        else if (cieq(tok[0], "couple") && (n == 5 || (n == 6 && !strcmp(tok[3], "->")))) {
+            ngedge_t *ed;
+            char **dst = (n == 6) ? &tok[4] : &tok[3];
+            int src = find_part(c, tok[1]), dsti = find_part(c, dst[0]);
+            if (src < 0 || dsti < 0) {
+                fprintf(stderr, "%s:%d: unknown partition %s\n", file, lineno,
+                        src < 0 ? tok[1] : dst[0]);
+                goto error;
+            }
+            c->edges = (ngedge_t *)realloc(c->edges, (c->nedges + 1) * sizeof(ngedge_t));
+            ed = &c->edges[c->nedges++];
+            memset(ed, 0, sizeof(*ed));
+            ed->src = src;
+            ed->dst = dsti;
+            strncpy(ed->vector, tok[2], NGCPL_NAMELEN - 1);
+            strncpy(ed->source, dst[1], NGCPL_NAMELEN - 1);
+        }
+        else {
+            fprintf(stderr, "%s:%d: syntax error\n", file, lineno);
+            goto error;
+        }
+    }
+    fclose(fp);
+    for (n = 0; n < c->nedges; n++)
+        c->edges[n].current = tolower((unsigned char)c->edges[n].source[0]) == 'i';
+
+    if (c->nparts == 0) {
+        fprintf(stderr, "%s: no partitions\n", file);
+        ngcoupling_free(c);
+        return NULL;
+    }
+    /* a source may only be driven once */
+    for (n = 0; n < c->nedges; n++)
+        for (i = 0; i < n; i++)
+            if (c->edges[i].dst == c->edges[n].dst && cieq(c->edges[i].source, c->edges[n].source)) {
+                fprintf(stderr, "%s: source %s of %s is driven twice\n", file,
+                        c->edges[n].source, c->parts[c->edges[n].dst].name);
+                ngcoupling_free(c);
+                return NULL;
+            }
+    return c;
+
+error:
+    fclose(fp);
+    ngcoupling_free(c);
+    return NULL;
+}
+
+/* The inverter chain example: partition 1 is inv_oc1.cir, the last one
+   inv_oc3.cir, all in between are inv_oc2.cir. Each partition drives
+   the EXTERNAL source vin of the next one. */
+ngcoupling_t *
+ngcoupling_chain(int nparts, const char *dir)
+{
+    ngcoupling_t *c = (ngcoupling_t *)calloc(1, sizeof(ngcoupling_t));
+    int i;
+
+    c->nparts = nparts;
+    c->parts = (ngcpart_t *)calloc((size_t)nparts, sizeof(ngcpart_t));
+    c->nedges = nparts - 1;
+    c->edges = (ngedge_t *)calloc((size_t)(nparts > 1 ? nparts - 1 : 1), sizeof(ngedge_t));
+
+    for (i = 0; i < nparts; i++) {
+        int stage = (i == 0) ? 1 : (i == nparts - 1) ? 3 : 2;
+        sprintf(c->parts[i].name, "p%d", i + 1);
+        snprintf(c->parts[i].netlist, sizeof(c->parts[i].netlist), "%s/inv_oc%d.cir", dir, stage);
+        if (i > 0) {
+            ngedge_t *ed = &c->edges[i - 1];
+            int srcstage = (i == 1) ? 1 : 2;
+            ed->src = i - 1;
+            ed->dst = i;
+            sprintf(ed->vector, "out%d", srcstage);
+            strcpy(ed->source, "vin");
+        }
+    }
+    return c;
+}
+
+void
+ngcoupling_free(ngcoupling_t *c)
+{
+    int i;
+
+    if (!c)
+        return;
+    for (i = 0; i < c->nedges; i++)
+        ngchan_free(&c->edges[i].chan);
+    free(c->parts);
+    free(c->edges);
+    free(c);
+}
+
+void
+ngcoupling_print(ngcoupling_t *c)
+{
+    int i;
+
+    for (i = 0; i < c->nparts; i++)
+        printf("partition %-8s %s\n", c->parts[i].name, c->parts[i].netlist);
+    for (i = 0; i < c->nedges; i++)
+        printf("couple %s %s -> %s %s\n", c->parts[c->edges[i].src].name, c->edges[i].vector,
+               c->parts[c->edges[i].dst].name, c->edges[i].source);
+}
+
+/* Compile the coupling graph into the tables of the partitions.
+   The engine takes ownership of c, on error c is freed; e may be the
+   NULL of a failed ngengine_new(). Returns 0 on success. */
+int
+ngengine_couple(ngengine_t *e, ngcoupling_t *c)
+{
+    int i, k;
+
+    if (!e || !c) {
+        ngcoupling_free(c);
+        return 1;
+    }
+    if (c->nparts != e->nparts) {
+        fprintf(stderr, "Error: coupling has %d partitions, engine %d\n", c->nparts, e->nparts);
+        ngcoupling_free(c);
+        return 1;
+    }
+    ngcoupling_free(e->cpl);
+    e->cpl = c;
+    for (k = 0; k < c->nedges; k++)
+        ngchan_init(&c->edges[k].chan, NGCHAN_SIZE);
+
+    for (i = 0; i < e->nparts; i++) {
+        ngpart_t *p = &e->parts[i];
+        unsigned size = 8;
+
+        strcpy(p->netlist, c->parts[i].netlist);
+        free(p->outputs);
+        free(p->inputs);
+        free(p->srccache);
+        p->noutputs = p->ninputs = 0;
+        p->outputs = (ngoutput_t *)calloc((size_t)c->nedges + 1, sizeof(ngoutput_t));
+        p->inputs = (nginput_t *)calloc((size_t)c->nedges + 1, sizeof(nginput_t));
+
+        for (k = 0; k < c->nedges; k++) {
+            if (c->edges[k].src == i) {
+                p->outputs[p->noutputs].edge = k;
+                p->outputs[p->noutputs].vecindex = -1;
+                p->noutputs++;
+            }
+            if (c->edges[k].dst == i)
+                p->inputs[p->ninputs++].edge = k;
+        }
+
+        /* open addressed source cache, at most half full */
+        while (size < 2u * (unsigned)(p->ninputs + 4))
+            size *= 2;
+        p->srccache = (ngsrccache_t *)calloc(size, sizeof(ngsrccache_t));
+        p->srcmask = size - 1;
+    }
+    return 0;
+}
+
+/* strip v( ... ) from a vector name, i(src) is src#branch */
+static const char *
+bare_name(const char *name, char *buf)
+{
+    size_t len = strlen(name);
+
+    if (len > 3 && (name[0] == 'v' || name[0] == 'V') && name[1] == '(' && name[len - 1] == ')'
+            && len - 3 < NGCPL_NAMELEN) {
+        memcpy(buf, name + 2, len - 3);
+        buf[len - 3] = '\0';
+        return buf;
+    }
+    if (len > 3 && (name[0] == 'i' || name[0] == 'I') && name[1] == '(' && name[len - 1] == ')'
+            && len + 4 < NGCPL_NAMELEN) {
+        memcpy(buf, name + 2, len - 3);
+        strcpy(buf + len - 3, "#branch");
+        return buf;
+    }
+    return name;
+}
+
+/* Called by ng_initdata(): resolve the vector indices of all outputs */
+void
+coupling_resolve_outputs(ngpart_t *p, pvecinfoall intdata)
+{
+    ngcoupling_t *c = p->engine->cpl;
+    char b1[NGCPL_NAMELEN], b2[NGCPL_NAMELEN];
+    int i, k;
+
+    for (k = 0; k < p->noutputs; k++) {
+        ngoutput_t *o = &p->outputs[k];
+        const char *want = bare_name(c->edges[o->edge].vector, b1);
+        o->vecindex = -1;
+        for (i = 0; i < intdata->veccount; i++)
+            if (cieq(bare_name(intdata->vecs[i]->vecname, b2), want)) {
+                o->vecindex = i;
+                break;
+            }
+        if (o->vecindex < 0)
+            fprintf(stderr, "Warning: vector %s not found in partition %s\n",
+                    c->edges[o->edge].vector, c->parts[p->ident - 1].name);
+    }
+}
+
+/* Find the edge driving the EXTERNAL source named by ngspice. The name
+   pointer stays the same for a source, so the string comparison is done
+   only once per source, later calls hit the pointer cache. */
+int
+coupling_input_edge(ngpart_t *p, const char *name)
+{
+    ngcoupling_t *c = p->engine->cpl;
+    unsigned h = (unsigned)(((size_t)name >> 3) * 2654435761u) & p->srcmask;
+    int k, edge = -1;
+
+    while (p->srccache[h].key) {
+        if (p->srccache[h].key == name)
+            return p->srccache[h].edge;
+        h = (h + 1) & p->srcmask;
+    }
+
+    for (k = 0; k < p->ninputs; k++)
+        if (cieq(c->edges[p->inputs[k].edge].source, name)) {
+            edge = p->inputs[k].edge;
+            break;
+        }
+    if (edge < 0)
+        fprintf(stderr, "Warning: EXTERNAL source %s of partition %s is not coupled\n",
+                name, c->parts[p->ident - 1].name);
+
+    /* keep the cache at most half full, a full cache would never end the probing */
+    if (p->nsrccached < (int)(p->srcmask + 1) / 2) {
+        p->srccache[h].key = name;
+        p->srccache[h].edge = edge;
+        p->nsrccached++;
+    }
+    return edge;
+}
@@ -0,0 +1,77 @@
+/*
+Coupling graph of a partitioned circuit.
+
+A coupling description lists the partitions with their netlists and
+the edges between them: which output vector of one partition drives
+which EXTERNAL voltage or current source of another one.
+
+    # comment
+    partition <name> <netlist>
+    couple <name> <vector> -> <name> <source>
+    couple <name> <vector> <-> <name> <vsource> <isource>
+
+The second form couples a cut node in both directions: the driving
+partition's node voltage is the Thevenin source <vsource> of the other
+partition, the current of <vsource> (vector <vsource>#branch) flows back
+into the node through the Norton source <isource> of the driving
+partition, written as "<isource> 0 <node> dc 0 external". So the load
+behind the cut is seen by the driver and nodes may be cut anywhere.
+
+Netlist paths are relative to the directory of the description file.
+Any graph is allowed, including cycles. When the engine is set up,
+the description is compiled into per-partition index tables: the
+vector indices are resolved once in ng_initdata(), the source names
+once per source in ng_VSRCData(), then cached by pointer. The samples
+are passed along the edges in lock-free channels (chan.h).
+*/
+
+#ifndef NG_COUPLING_H
+#define NG_COUPLING_H
+
+#include "chan.h"
+
+#define NGCPL_NAMELEN 64
+
+typedef struct ngedge {
+    int src, dst;                   /* partition indices */
+    char vector[NGCPL_NAMELEN];     /* output vector of src */
+    char source[NGCPL_NAMELEN];     /* EXTERNAL source in dst */
+    bool current;                   /* source is a current source */
+    ngchan_t chan;                  /* accepted samples of vector */
+    double t0, v0, t1, v1;          /* last two rendezvous, multirate */
+    double used_t, used_v;          /* last value given to the source, optimistic */
+} ngedge_t;
+
+typedef struct ngcpart {
+    char name[NGCPL_NAMELEN];
+    char netlist[256];
+} ngcpart_t;
+
+typedef struct ngcoupling {
+    int nparts;
+    ngcpart_t *parts;
+    int nedges;
+    ngedge_t *edges;
+} ngcoupling_t;
+
+/* compiled tables, one set per partition */
+typedef struct ngoutput {
+    int edge;
+    int vecindex;                   /* in the SendData array, -1 if unresolved */
+} ngoutput_t;
+
+typedef struct nginput {
+    int edge;
+} nginput_t;
+
+typedef struct ngsrccache {
+    const char *key;                /* source name pointer handed over by ngspice */
+    int edge;                       /* -1: not an input of this partition */
+} ngsrccache_t;
+
+ngcoupling_t *ngcoupling_read(const char *file);
+ngcoupling_t *ngcoupling_chain(int nparts, const char *dir);
+void ngcoupling_free(ngcoupling_t *c);
+void ngcoupling_print(ngcoupling_t *c);
+
+#endif
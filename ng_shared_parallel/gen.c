@@ -0,0 +1,275 @@
+/*
+Generator of the synthetic benchmark circuits, see gen.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gen.h"
+#include "port.h"
+
+static const char *kinds[] = { "chain", "nand", "adder" };
+
+static const char *pmos = "p1 l=0.1u w=10u ad=5p pd=11u as=5p ps=11u";
+static const char *nmos = "n1 l=0.1u w=5u ad=2.5p pd=6u as=2.5p ps=6u";
+
+int
+nggen_kind(const char *name)
+{
+    int i;
+
+    for (i = 0; i <= NGGEN_ADDER; i++)
+        if (cieq(name, kinds[i]))
+            return i;
+    return -1;
+}
+
+const char *
+nggen_name(int kind)
+{
+    return kind >= 0 && kind <= NGGEN_ADDER ? kinds[kind] : "none";
+}
+
+int
+nggen_next(int n, int nmax)
+{
+    return (n < nmax && 2 * n > nmax) ? nmax : 2 * n;
+}
+
+/* first stage of partition k of n */
+static int
+bound(int size, int n, int k)
+{
+    return (int)((long long)k * size / n);
+}
+
+/* input node of stage i, output node of stage i - 1 */
+static void
+node(char *buf, int kind, int i)
+{
+    sprintf(buf, "%c%d", kind == NGGEN_ADDER ? 'c' : 'o', i);
+}
+
+static void
+header(FILE *fp, int kind, int size, const char *what)
+{
+    fprintf(fp, "*****==== %d %s %s, %s ====*****\n", size,
+            kind == NGGEN_ADDER ? "bit" : "stage", kind == NGGEN_CHAIN ? "inverter chain" :
+            kind == NGGEN_NAND ? "NAND chain" : "ripple carry adder", what);
+    fprintf(fp, "* written by --gen-bench\n\n");
+    fprintf(fp, ".include modelcard.nmos\n.include modelcard.pmos\n\n");
+    fprintf(fp, "vdd 1 0 1.8\n");
+    if (kind == NGGEN_NAND)
+        fprintf(fp, "vc c 0 dc 1.8 pulse(1.8 0 45n 0.2n 0.2n 10n 200n)\n");
+    if (kind == NGGEN_CHAIN)
+        return;
+
+    fprintf(fp, "\n.SUBCKT NAND in1 in2 out Vdd\n");
+    fprintf(fp, "M1 out in2 Vdd Vdd %s\n", pmos);
+    fprintf(fp, "M2 net.1 in2 0 0 %s\n", nmos);
+    fprintf(fp, "M3 out in1 Vdd Vdd %s\n", pmos);
+    fprintf(fp, "M4 out in1 net.1 0 %s\n", nmos);
+    fprintf(fp, ".ENDS NAND\n");
+    if (kind != NGGEN_ADDER)
+        return;
+
+    /* inputs, carry-in, sum, carry-out, supply */
+    fprintf(fp, "\n.SUBCKT ONEBIT 1 2 3 4 5 6\n");
+    fprintf(fp, "X1   1  2  7  6   NAND\n");
+    fprintf(fp, "X2   1  7  8  6   NAND\n");
+    fprintf(fp, "X3   2  7  9  6   NAND\n");
+    fprintf(fp, "X4   8  9 10  6   NAND\n");
+    fprintf(fp, "X5   3 10 11  6   NAND\n");
+    fprintf(fp, "X6   3 11 12  6   NAND\n");
+    fprintf(fp, "X7  10 11 13  6   NAND\n");
+    fprintf(fp, "X8  12 13  4  6   NAND\n");
+    fprintf(fp, "X9  11  7  5  6   NAND\n");
+    fprintf(fp, ".ENDS ONEBIT\n");
+}
+
+/* the input of stage i: a pulse, or EXTERNAL in a partition behind the first */
+static void
+input(FILE *fp, int kind, int i, bool external)
+{
+    char in[32];
+
+    node(in, kind, i);
+    if (external)
+        fprintf(fp, "vin %s 0 dc 0 external\n", in);
+    else
+        fprintf(fp, "vin %s 0 dc 0 pulse(0 1.8 0 0.2n 0.2n 1.2n 2.8n)\n", in);
+}
+
+static void
+stage(FILE *fp, int kind, int i)
+{
+    char in[32], out[32];
+    double period = 2.8e-9 * (1 << (i % 4));
+
+    node(in, kind, i);
+    node(out, kind, i + 1);
+    if (kind == NGGEN_CHAIN) {
+        fprintf(fp, "mp%d %s %s 1 1 %s\n", i + 1, out, in, pmos);
+        fprintf(fp, "mn%d %s %s 0 0 %s\n", i + 1, out, in, nmos);
+    }
+    else if (kind == NGGEN_NAND) {
+        fprintf(fp, "x%d %s c %s 1 NAND\n", i + 1, in, out);
+    }
+    else {
+        /* the operands change at different rates, so the carries ripple */
+        fprintf(fp, "va%d a%d 0 dc 0 pulse(0 1.8 0 0.2n 0.2n %gn %gn)\n", i, i,
+                period / 2e-9, period / 1e-9);
+        fprintf(fp, "vb%d b%d 0 dc 1.8 pulse(1.8 0 0.7n 0.2n 0.2n %gn %gn)\n", i, i,
+                period / 2e-9, period / 1e-9);
+        fprintf(fp, "x%d a%d b%d %s s%d %s 1 ONEBIT\n", i + 1, i, i, in, i, out);
+    }
+}
+
+/* the first gate of the next partition on output node i */
+static void
+load(FILE *fp, int kind, int i)
+{
+    char out[32];
+
+    node(out, kind, i);
+    fprintf(fp, "* load of the next partition\n");
+    if (kind == NGGEN_CHAIN) {
+        fprintf(fp, "mpbuf buf %s 1 1 %s\n", out, pmos);
+        fprintf(fp, "mnbuf buf %s 0 0 %s\n", out, nmos);
+    }
+    else if (kind == NGGEN_NAND) {
+        fprintf(fp, "xbuf %s c buf 1 NAND\n", out);
+    }
+    else {
+        /* the carry-in drives two gates of a bit */
+        fprintf(fp, "xbuf %s %s buf 1 NAND\n", out, out);
+    }
+}
+
+/* .save of the interface vectors behind the stages marked in out */
+static int
+save(FILE *fp, int kind, int size, const char *out)
+{
+    char name[32];
+    int i, n = 0;
+
+    fprintf(fp, "\n.tran .1ns 0.2us\n");
+    for (i = 1; i <= size; i++) {
+        if (!out[i])
+            continue;
+        node(name, kind, i);
+        fprintf(fp, "%sV(%s)", n % 8 ? " " : n ? "\n.save " : ".save ", name);
+        n++;
+        if (kind == NGGEN_ADDER) {
+            fprintf(fp, "%sV(s%d)", n % 8 ? " " : "\n.save ", i - 1);
+            n++;
+        }
+    }
+    fprintf(fp, "\n\n.end\n");
+    return n;
+}
+
+static void
+base_name(char *buf, size_t len, int kind, int size, const char *dir)
+{
+    snprintf(buf, len, "%s/gen_%s%d", dir, kinds[kind], size);
+}
+
+int
+nggen_flat(int kind, int size, int nmax, const char *dir, char *file, size_t len)
+{
+    char base[256], *out;
+    FILE *fp;
+    int i, k, n, nsaved;
+
+    if (kind < 0 || kind > NGGEN_ADDER || size < 1) {
+        fprintf(stderr, "Error: no circuit to generate\n");
+        return -1;
+    }
+    base_name(base, sizeof(base), kind, size, dir);
+    snprintf(file, len, "%s.cir", base);
+    fp = fopen(file, "w");
+    if (!fp) {
+        fprintf(stderr, "Error: cannot write %s\n", file);
+        return -1;
+    }
+    if (nmax > size)
+        nmax = size;
+    out = (char *)calloc((size_t)size + 1, 1);
+    for (n = 1;; n = nggen_next(n, nmax)) {
+        for (k = 1; k <= n; k++)
+            out[bound(size, n, k)] = 1;
+        if (n >= nmax)
+            break;
+    }
+
+    header(fp, kind, size, "not partitioned");
+    fprintf(fp, "\n");
+    input(fp, kind, 0, false);
+    for (i = 0; i < size; i++)
+        stage(fp, kind, i);
+    nsaved = save(fp, kind, size, out);
+    fclose(fp);
+    free(out);
+    return nsaved;
+}
+
+int
+nggen_split(int kind, int size, int nparts, const char *dir, char *cplfile, size_t len)
+{
+    char base[256], path[300], what[64], vec[32], *slash, *out;
+    FILE *cpl, *fp;
+    int i, k;
+
+    if (nparts < 1 || nparts > size) {
+        fprintf(stderr, "Error: %d stages cannot be split into %d partitions\n", size, nparts);
+        return 1;
+    }
+    base_name(base, sizeof(base), kind, size, dir);
+    snprintf(cplfile, len, "%s_%d.cpl", base, nparts);
+    cpl = fopen(cplfile, "w");
+    if (!cpl) {
+        fprintf(stderr, "Error: cannot write %s\n", cplfile);
+        return 1;
+    }
+    fprintf(cpl, "# %s.cir split into %d partitions.\n", base, nparts);
+    fprintf(cpl, "# partition <name> <netlist, relative to this file>\n");
+    fprintf(cpl, "# couple <partition> <output vector> -> <partition> <EXTERNAL source>\n\n");
+
+    slash = strrchr(base, '/');
+    out = (char *)calloc((size_t)size + 1, 1);
+    for (k = 0; k < nparts; k++) {
+        int lo = bound(size, nparts, k), hi = bound(size, nparts, k + 1);
+
+        snprintf(path, sizeof(path), "%s_%dp%d.cir", base, nparts, k + 1);
+        fp = fopen(path, "w");
+        if (!fp) {
+            fprintf(stderr, "Error: cannot write %s\n", path);
+            fclose(cpl);
+            free(out);
+            return 1;
+        }
+        sprintf(what, "partition %d of %d", k + 1, nparts);
+        header(fp, kind, size, what);
+        fprintf(fp, "\n");
+        input(fp, kind, lo, k > 0);
+        for (i = lo; i < hi; i++)
+            stage(fp, kind, i);
+        if (k < nparts - 1)
+            load(fp, kind, hi);
+        memset(out, 0, (size_t)size + 1);
+        out[hi] = 1;
+        save(fp, kind, size, out);
+        fclose(fp);
+        fprintf(cpl, "partition p%d %s\n", k + 1, slash ? strrchr(path, '/') + 1 : path);
+    }
+    fprintf(cpl, "\n");
+    for (k = 1; k < nparts; k++) {
+        node(vec, kind, bound(size, nparts, k));
+        fprintf(cpl, "couple p%d %s -> p%d vin\n", k, vec, k + 1);
+    }
+    fclose(cpl);
+    free(out);
+    return 0;
+}
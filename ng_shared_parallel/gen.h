@@ -0,0 +1,60 @@
+/*
+Synthetic circuits of any size for the speedup benchmark.
+
+The inverter chain of test 2 has 25 transistors per partition, far too
+few to gain anything from running the partitions in parallel. The
+generator writes the same kind of circuit with a given number of
+stages, flat and split into N partitions the way inv_oc1.cir ...
+inv_oc3.cir are:
+
+    chain       inverters in series, driven by a pulse
+    nand        NAND gates in series, the second input of all of them
+                blanked by a common control pulse, as in test 2
+    adder       ripple carry adder of one bit full adders made of 9
+                NAND gates each, size is the number of bits
+
+Partition k of N gets stages (bits) k * size / N ... (k + 1) * size / N - 1.
+Its input is the EXTERNAL source vin on the output (the carry) of
+partition k - 1, its own output is loaded by a copy of the first gate
+of partition k + 1, as the buffer in inv_oc1.cir. Shared sources
+(supply, blanking) are in every partition, the data inputs of the
+adder bits only in the partition of the bit.
+
+The flat netlist saves the interface vectors of all partitionings into
+1, 2, 4, ... nmax partitions, so every vector of a partitioned run is
+found in the reference. The files are written into a directory holding
+modelcard.nmos and modelcard.pmos, examples by default:
+
+    gen_chain200.cir            flat
+    gen_chain200_4.cpl          coupling description, 4 partitions
+    gen_chain200_4p1.cir ...    partition netlists
+*/
+
+#ifndef NG_GEN_H
+#define NG_GEN_H
+
+#include <stddef.h>
+
+#define NGGEN_CHAIN 0
+#define NGGEN_NAND 1
+#define NGGEN_ADDER 2
+
+/* default stages */
+#define NGGEN_SIZE 128
+
+/* NGGEN_CHAIN ... by name, -1 if unknown */
+int nggen_kind(const char *name);
+const char *nggen_name(int kind);
+
+/* partition counts of a benchmark: 1, 2, 4, ... nmax */
+int nggen_next(int n, int nmax);
+
+/* flat netlist of size stages, its path is returned in file; returns
+   the number of vectors saved, -1 on error */
+int nggen_flat(int kind, int size, int nmax, const char *dir, char *file, size_t len);
+
+/* nparts partition netlists and their coupling description, its path
+   is returned in cplfile */
+int nggen_split(int kind, int size, int nparts, const char *dir, char *cplfile, size_t len);
+
+#endif
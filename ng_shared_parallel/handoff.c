@@ -0,0 +1,259 @@
+/*
+Handoff of accepted points to a consumer thread, see handoff.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "handoff.h"
+#include "capture.h"
+
+static const char *policies[] = { "block", "drop", "decimate" };
+
+int
+nghandoff_policy(const char *name)
+{
+    int i;
+
+    for (i = 0; i <= HANDOFF_DECIMATE; i++)
+        if (cieq(name, policies[i]))
+            return i;
+    return -1;
+}
+
+const char *
+nghandoff_name(int policy)
+{
+    return policy >= 0 && policy <= HANDOFF_DECIMATE ? policies[policy] : "none";
+}
+
+/* hand the points in the ring over to the capture */
+static uint64_t
+drain(nghandoff_t *h, nghandoffq_t *q)
+{
+    uint64_t head, n, i, t0;
+
+    if (!ngat_load_i(&q->ready))
+        return 0;
+    head = ngring_end(&q->ring);
+    n = head - q->ring.tail;
+    if (!n)
+        return 0;
+    t0 = ng_now_ns();
+    for (i = q->ring.tail; i < head; i++)
+        ngcapture_append(q->part->capture, &q->slots[(i & q->ring.mask) * (uint64_t)q->width]);
+    ngring_pop_to(&q->ring, head);
+    ngwake_signal(&q->space);
+    h->busy_ns += ng_now_ns() - t0;
+    h->consumed += n;
+    return n;
+}
+
+static bool
+pending(nghandoff_t *h)
+{
+    int i;
+
+    for (i = 0; i < h->nq; i++)
+        if (ngat_load_i(&h->q[i].ready) && ngring_end(&h->q[i].ring) != h->q[i].ring.tail)
+            return true;
+    return false;
+}
+
+static void *
+consumer(void *arg)
+{
+    nghandoff_t *h = (nghandoff_t *)arg;
+    int i, key;
+
+    for (;;) {
+        /* the producers are done when stop is seen, one more round */
+        int stop = ngat_load_i(&h->stop);
+        uint64_t n = 0;
+
+        for (i = 0; i < h->nq; i++)
+            n += drain(h, &h->q[i]);
+        if (stop)
+            break;
+        if (n)
+            continue;
+        key = ngwake_prepare(&h->wake);
+        if (ngat_load_i(&h->stop) || pending(h))
+            ngwake_cancel(&h->wake);
+        else
+            ngwake_wait(&h->wake, key);
+    }
+    return NULL;
+}
+
+int
+nghandoff_start(ngengine_t *e)
+{
+    nghandoff_t *h = e->handoff;
+    int i;
+
+    if (e->handoff_policy < 0 || !e->capture)
+        return 0;
+    if (!h) {
+        h = (nghandoff_t *)calloc(1, sizeof(nghandoff_t));
+        h->q = (nghandoffq_t *)calloc((size_t)e->nparts, sizeof(nghandoffq_t));
+        h->nq = e->nparts;
+        ngwake_init(&h->wake);
+        for (i = 0; i < h->nq; i++)
+            ngwake_init(&h->q[i].space);
+        e->handoff = h;
+    }
+    h->policy = e->handoff_policy;
+    h->size = e->handoff_size > 0 ? e->handoff_size : NGHANDOFF_SIZE;
+    h->stop = 0;
+    h->consumed = 0;
+    h->busy_ns = 0;
+    for (i = 0; i < h->nq; i++) {
+        nghandoffq_t *q = &h->q[i];
+        ngring_reset(&q->ring);
+        q->ready = 0;
+        q->part = &e->parts[i];
+        q->pushed = q->dropped = q->decimated = 0;
+        q->blocked_ns = q->seq = q->depth_max = 0;
+        e->parts[i].handoff = q;
+    }
+    if (ng_thread_start(&h->tid, consumer, h)) {
+        fprintf(stderr, "Error: cannot start the handoff consumer\n");
+        for (i = 0; i < h->nq; i++)
+            e->parts[i].handoff = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+void
+nghandoff_stop(ngengine_t *e)
+{
+    nghandoff_t *h = e->handoff;
+    int i;
+
+    if (!h || !e->parts[0].handoff)
+        return;
+    ngat_store_i(&h->stop, 1);
+    ngwake_signal(&h->wake);
+    ng_thread_join(h->tid);
+    for (i = 0; i < h->nq; i++) {
+        ngat_store_i(&h->q[i].ready, 0);
+        ngwake_signal(&h->q[i].space);
+        e->parts[i].handoff = NULL;
+        ngpart_capture_close(&e->parts[i]);
+    }
+}
+
+void
+nghandoff_print(ngengine_t *e)
+{
+    nghandoff_t *h = e->handoff;
+    int i;
+
+    if (!h)
+        return;
+    printf("\n** Handoff to the consumer thread (%s, %d slots) **\n", nghandoff_name(h->policy),
+           h->size);
+    printf("points consumed:     %llu, busy %.3f ms\n", (unsigned long long)h->consumed,
+           h->busy_ns / 1e6);
+    for (i = 0; i < h->nq && i < 16; i++) {
+        nghandoffq_t *q = &h->q[i];
+        printf("  partition %3d:     %llu handed off, %llu dropped, %llu decimated, max depth %llu,"
+               " blocked %.3f ms\n", q->part->ident, (unsigned long long)q->pushed,
+               (unsigned long long)q->dropped, (unsigned long long)q->decimated,
+               (unsigned long long)q->depth_max, q->blocked_ns / 1e6);
+    }
+}
+
+void
+nghandoff_free(ngengine_t *e)
+{
+    nghandoff_t *h = e->handoff;
+    int i;
+
+    if (!h)
+        return;
+    nghandoff_stop(e);
+    for (i = 0; i < h->nq; i++) {
+        free(h->q[i].slots);
+        ngwake_destroy(&h->q[i].space);
+    }
+    ngwake_destroy(&h->wake);
+    free(h->q);
+    free(h);
+    e->handoff = NULL;
+}
+
+void
+nghandoff_attach(ngpart_t *p)
+{
+    nghandoffq_t *q = p->handoff;
+    nghandoff_t *h = p->engine->handoff;
+    uint64_t n;
+
+    /* Once per run, with the capture. Until ready is set the consumer
+       does not look at the ring, afterwards the slots must stay. */
+    if (!q || !p->capture || ngat_load_i(&q->ready))
+        return;
+    n = ngring_init(&q->ring, (uint64_t)h->size);
+    if (n * (uint64_t)p->capture->ncols > q->nslots) {
+        free(q->slots);
+        q->nslots = n * (uint64_t)p->capture->ncols;
+        q->slots = (double *)malloc(q->nslots * sizeof(double));
+    }
+    q->width = p->capture->ncols;
+    q->vecindex = p->capture->vecindex;
+    ngat_store_i(&q->ready, 1);
+}
+
+void
+nghandoff_push(nghandoffq_t *q, pvecvaluesall v)
+{
+    int policy = q->part->engine->handoff_policy;
+    uint64_t mask = q->ring.mask, depth;
+    double *slot;
+    int i;
+
+    if (!ngat_load_i(&q->ready))
+        return;
+    q->seq++;
+    depth = ngring_depth(&q->ring);
+    if (depth > mask) {
+        uint64_t t0;
+
+        if (policy != HANDOFF_BLOCK) {
+            q->dropped++;
+            return;
+        }
+        t0 = ng_now_ns();
+        while (ngring_full(&q->ring) && ngat_load_i(&q->ready)) {
+            int key = ngwake_prepare(&q->space);
+            if (ngring_full(&q->ring) && ngat_load_i(&q->ready))
+                ngwake_wait(&q->space, key);
+            else
+                ngwake_cancel(&q->space);
+        }
+        q->blocked_ns += ng_now_ns() - t0;
+        /* the consumer has ended */
+        if (!ngat_load_i(&q->ready))
+            return;
+        depth = ngring_depth(&q->ring);
+    }
+    else if (policy == HANDOFF_DECIMATE && depth > mask / 2) {
+        uint64_t every = depth > mask / 2 + mask / 4 ? 4 : 2;
+        if (q->seq % every) {
+            q->decimated++;
+            return;
+        }
+    }
+    if (depth + 1 > q->depth_max)
+        q->depth_max = depth + 1;
+    slot = &q->slots[ngring_slot(&q->ring) * (uint64_t)q->width];
+    for (i = 0; i < q->width; i++)
+        slot[i] = v->vecsa[q->vecindex[i]]->creal;
+    q->pushed++;
+    ngring_push(&q->ring);
+    ngwake_signal(&q->part->engine->handoff->wake);
+}
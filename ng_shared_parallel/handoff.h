@@ -0,0 +1,89 @@
+/*
+Handoff of accepted points from ng_data() to a consumer thread.
+
+Whatever ng_data() does runs on the bg thread of ngspice and holds up
+the next time step, and with it all partitions waiting in the barrier.
+Only the interface samples have to be pushed there; the rest of the
+work on a point, now the waveform capture (capture.h), can be done
+later. With a handoff, ng_data() copies the values needed out of
+pvecvaluesall into the next slot of a ring per partition and returns.
+One consumer thread per engine empties the rings of all partitions and
+does the work.
+
+Every ring (ring.h) has one producer, the bg thread of its partition,
+and one consumer; the consumer sleeps while all rings are empty. The
+slots are allocated when the vectors are known, by the first
+ng_initdata() of the run, which opens the capture; they are only freed
+with the engine, so the consumer never sees them go. A full ring is handled by the policy:
+
+    block       sleep until the consumer has made room, no point is lost
+    drop        the point is dropped and counted
+    decimate    beyond half full only every 2nd point is kept, beyond
+                3/4 every 4th, when full the point is dropped
+
+The consumer is started by ngengine_run() and stopped by
+ngengine_wait(), after it has emptied all rings; the captures are then
+closed. Worker processes run a consumer each.
+*/
+
+#ifndef NG_HANDOFF_H
+#define NG_HANDOFF_H
+
+#include "partition.h"
+#include "ring.h"
+
+/* policies on a full ring */
+#define HANDOFF_BLOCK 0
+#define HANDOFF_DROP 1
+#define HANDOFF_DECIMATE 2
+
+/* slots per ring, a power of 2 */
+#define NGHANDOFF_SIZE 8192
+
+typedef struct nghandoffq {
+    ngring_t ring;
+    ngwake_t space;            /* the consumer has taken points, for block */
+    volatile int ready;        /* slots allocated, ngspice has sent the vectors */
+    int width;                 /* values per slot */
+    const int *vecindex;       /* in the SendData array, per value */
+    double *slots;
+    uint64_t nslots;           /* values allocated, kept from run to run */
+    ngpart_t *part;
+
+    /* producer */
+    uint64_t pushed, dropped, decimated;
+    uint64_t blocked_ns;       /* waiting on a full ring */
+    uint64_t seq;              /* points offered, for decimation */
+    uint64_t depth_max;
+} nghandoffq_t;
+
+typedef struct nghandoff {
+    int policy;
+    int size;
+    nghandoffq_t *q;           /* one per partition */
+    int nq;
+    threadId_t tid;
+    ngwake_t wake;             /* points pushed, or stop */
+    volatile int stop;
+    uint64_t consumed;
+    uint64_t busy_ns;          /* consumer working on points */
+} nghandoff_t;
+
+int nghandoff_policy(const char *name);
+const char *nghandoff_name(int policy);
+
+/* consumer of the partitions of e, by e->handoff_policy */
+int nghandoff_start(ngengine_t *e);
+
+/* empty the rings, end the consumer, close the captures */
+void nghandoff_stop(ngengine_t *e);
+void nghandoff_print(ngengine_t *e);
+void nghandoff_free(ngengine_t *e);
+
+/* ng_initdata(): slots for the columns of the capture of p */
+void nghandoff_attach(ngpart_t *p);
+
+/* ng_data(): copy the point, or apply the policy */
+void nghandoff_push(nghandoffq_t *q, pvecvaluesall v);
+
+#endif
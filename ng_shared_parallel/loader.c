@@ -0,0 +1,306 @@
+/*
+Loader for independent ngspice instances, see loader.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "loader.h"
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/syscall.h>
+#define NGLOAD_LINUX 1
+#endif
+
+static const char *methods[] = { "copy", "memfd", "dlmopen", "plain" };
+
+typedef struct apisym {
+    const char *name;
+    size_t offset;
+    bool required;
+} apisym_t;
+
+#define APISYM(f, req) { #f, offsetof(ngspice_api_t, f), req }
+
+static const apisym_t apisyms[] = {
+    APISYM(ngSpice_Init, true),
+    APISYM(ngSpice_Command, true),
+    APISYM(ngGet_Vec_Info, true),
+    APISYM(ngSpice_CurPlot, true),
+    APISYM(ngSpice_AllVecs, true),
+    APISYM(ngSpice_Init_Sync, false),
+    APISYM(ngSpice_Circ, false),
+    APISYM(ngSpice_AllPlots, false),
+    APISYM(ngSpice_running, false),
+    APISYM(ngSpice_SetBkpt, false),
+#ifdef XSPICE
+    APISYM(ngSpice_Init_Evt, false),
+    APISYM(ngGet_Evt_NodeInfo, false),
+    APISYM(ngSpice_AllEvtNodes, false),
+#endif
+};
+
+int
+ngload_method(const char *name)
+{
+    int i;
+
+    for (i = 0; i < (int)(sizeof(methods) / sizeof(methods[0])); i++)
+        if (cieq(name, methods[i]))
+            return i;
+    return -1;
+}
+
+const char *
+ngload_name(int method)
+{
+    return method >= 0 && method <= NGLOAD_PLAIN ? methods[method] : "?";
+}
+
+static void *
+open_lib(const char *name)
+{
+    void *h;
+    char *errmsg;
+
+    dlerror();
+    h = dlopen(name, RTLD_NOW);
+    errmsg = dlerror();
+    if (errmsg)
+        printf("%s\n", errmsg);
+    return h;
+}
+
+/* physical copy made by prepare-libs, or at load time on MS Windows */
+static void *
+open_copy(int ident, char *desc, size_t len)
+{
+#ifdef __CYGWIN__
+    snprintf(desc, len, "/cygdrive/c/cygwin/usr/local/bin/cygngspice-%d.dll", ident);
+#elif  defined(__MINGW32__) || defined(_MSC_VER)
+    snprintf(desc, len, "ngspice%d.dll", ident);
+    if (GetFileAttributes("ngspice.dll") == INVALID_FILE_ATTRIBUTES)
+        fprintf(stderr, "File ngspice.dll not found");
+    else
+        CopyFile("ngspice.dll", desc, false);
+#else
+    snprintf(desc, len, "libngspice%d.so", ident);
+#endif
+    return open_lib(desc);
+}
+
+#ifdef NGLOAD_LINUX
+
+/* Open memfd images. Their /proc/self/fd path is the name the dynamic
+   linker knows them by, a reused fd number would return the old handle,
+   so the fd is kept open until the instance is closed. */
+typedef struct memimage {
+    void *handle;
+    int fd;
+} memimage_t;
+
+static memimage_t *images;
+static int nimages, maximages;
+static pthread_mutex_t images_cs = PTHREAD_MUTEX_INITIALIZER;
+
+/* path of the library base, searched like the dynamic linker would */
+static bool
+find_lib(const char *base, char *path, size_t len)
+{
+    static const char *dirs[] = {
+        ".", "/usr/local/lib", "/usr/lib", "/usr/lib/x86_64-linux-gnu", "/usr/lib64",
+        "/usr/lib/aarch64-linux-gnu", "/usr/lib/arm-linux-gnueabihf"
+    };
+    const char *env = getenv("LD_LIBRARY_PATH");
+    int i;
+
+    if (strchr(base, '/')) {
+        snprintf(path, len, "%s", base);
+        return access(path, R_OK) == 0;
+    }
+    while (env && *env) {
+        const char *end = strchr(env, ':');
+        int n = end ? (int)(end - env) : (int)strlen(env);
+        if (n > 0) {
+            snprintf(path, len, "%.*s/%s", n, env, base);
+            if (access(path, R_OK) == 0)
+                return true;
+        }
+        env = end ? end + 1 : NULL;
+    }
+    for (i = 0; i < (int)(sizeof(dirs) / sizeof(dirs[0])); i++) {
+        snprintf(path, len, "%s/%s", dirs[i], base);
+        if (access(path, R_OK) == 0)
+            return true;
+    }
+    return false;
+}
+
+/* copy of the library in an anonymous file */
+static void *
+open_memfd(const char *path, int ident, char *desc, size_t len)
+{
+    char name[64], buf[65536];
+    void *h = NULL;
+    ssize_t n = 0;
+    int in, fd;
+
+    snprintf(name, sizeof(name), "libngspice%d.so", ident);
+    fd = (int)syscall(SYS_memfd_create, name, 1u /* MFD_CLOEXEC */);
+    if (fd < 0) {
+        perror("memfd_create");
+        return NULL;
+    }
+    in = open(path, O_RDONLY);
+    if (in < 0) {
+        perror(path);
+        close(fd);
+        return NULL;
+    }
+    while ((n = read(in, buf, sizeof(buf))) > 0)
+        if (write(fd, buf, (size_t)n) != n) {
+            n = -1;
+            break;
+        }
+    close(in);
+    if (n == 0) {
+        snprintf(desc, len, "/proc/self/fd/%d", fd);
+        h = open_lib(desc);
+    }
+    else {
+        perror(name);
+    }
+    snprintf(desc, len, "memfd:%s", name);
+    if (!h) {
+        close(fd);
+        return NULL;
+    }
+    mutex_lock(&images_cs);
+    if (nimages == maximages) {
+        maximages = maximages ? 2 * maximages : 16;
+        images = (memimage_t *)realloc(images, maximages * sizeof(memimage_t));
+    }
+    images[nimages].handle = h;
+    images[nimages++].fd = fd;
+    mutex_unlock(&images_cs);
+    return h;
+}
+
+static void *
+open_dlmopen(const char *path, char *desc, size_t len)
+{
+    void *h;
+
+    dlerror();
+    h = dlmopen(LM_ID_NEWLM, path, RTLD_NOW);
+    if (!h)
+        printf("%s\n", dlerror());
+    snprintf(desc, len, "dlmopen:%s", path);
+    return h;
+}
+
+#endif
+
+void *
+ngload_open(int method, const char *base, int ident, int *used, char *desc, size_t len)
+{
+#ifdef NGLOAD_LINUX
+    /* the namespaces are those of the process, shared by the loading
+       threads (--job-threads, pool refill) */
+    static volatile int nsfull = 0;
+    char path[512];
+#endif
+
+    if (method == NGLOAD_PLAIN) {
+        *used = NGLOAD_PLAIN;
+        snprintf(desc, len, "%s", base);
+        return open_lib(base);
+    }
+#ifdef NGLOAD_LINUX
+    if (method != NGLOAD_COPY) {
+        if (!find_lib(base, path, sizeof(path))) {
+            fprintf(stderr, "Error: library %s not found\n", base);
+            return NULL;
+        }
+        if (method == NGLOAD_DLMOPEN && !ngat_load_i(&nsfull)) {
+            void *h = open_dlmopen(path, desc, len);
+            if (h) {
+                *used = NGLOAD_DLMOPEN;
+                return h;
+            }
+            /* out of namespaces (or static TLS), the rest by memfd */
+            fprintf(stderr, "Warning: no namespace for instance %d, loading it by memfd\n",
+                    ident);
+            ngat_store_i(&nsfull, 1);
+        }
+        *used = NGLOAD_MEMFD;
+        return open_memfd(path, ident, desc, len);
+    }
+#else
+    if (method != NGLOAD_COPY)
+        fprintf(stderr, "Warning: loader %s not available, loading copies\n",
+                ngload_name(method));
+    (void)base;
+#endif
+    *used = NGLOAD_COPY;
+    return open_copy(ident, desc, len);
+}
+
+int
+ngload_resolve(void *handle, ngspice_api_t *api, const char **missing)
+{
+    int i;
+
+    memset(api, 0, sizeof(*api));
+    for (i = 0; i < (int)(sizeof(apisyms) / sizeof(apisyms[0])); i++) {
+        funptr_t fn = dlsym(handle, apisyms[i].name);
+        dlerror();
+        if (!fn && apisyms[i].required) {
+            *missing = apisyms[i].name;
+            return 1;
+        }
+        /* the slots are function pointers of the size of funptr_t */
+        memcpy((char *)api + apisyms[i].offset, &fn, sizeof(fn));
+    }
+    return 0;
+}
+
+int
+ngload_close(void *handle)
+{
+    int ret = dlclose(handle);
+#ifdef NGLOAD_LINUX
+    int i;
+
+    mutex_lock(&images_cs);
+    for (i = 0; i < nimages; i++)
+        if (images[i].handle == handle) {
+            close(images[i].fd);
+            images[i] = images[--nimages];
+            break;
+        }
+    mutex_unlock(&images_cs);
+#endif
+    return ret;
+}
+
+uint64_t
+ngload_rss(void)
+{
+#ifdef NGLOAD_LINUX
+    unsigned long size, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+
+    if (!fp)
+        return 0;
+    if (fscanf(fp, "%lu %lu", &size, &resident) != 2)
+        resident = 0;
+    fclose(fp);
+    return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,82 @@
+/*
+Loader for independent ngspice instances.
+
+dlopen() returns the same handle for a library already loaded, so every
+partition needs an image of its own. NGLOAD_COPY opens the physical
+copies libngspice1.so ... libngspiceN.so made by prepare-libs (or
+ngspice1.dll ... on MS Windows, copied at load time). On Linux two
+loaders need no files besides the original library:
+
+NGLOAD_MEMFD copies the library into an anonymous file (memfd_create)
+for every instance and opens it by its /proc/self/fd path. The images
+are distinct files for the dynamic linker, nothing is left on disk.
+
+NGLOAD_DLMOPEN opens the library itself in a new link map namespace
+(dlmopen LM_ID_NEWLM) for every instance. Code pages come from the one
+file in the page cache, only data and relocations are private. glibc
+has 16 namespaces, the instances beyond are loaded by NGLOAD_MEMFD.
+Each namespace has its own C library: the bg threads are started by it,
+so the callbacks must not rely on per thread state of ours like the
+locale (cieq() is ASCII only), and output of ngspice to its own stdout
+is not flushed at exit.
+
+NGLOAD_PLAIN opens the library itself, for a single instance per
+process (worker.h).
+*/
+
+#ifndef NG_LOADER_H
+#define NG_LOADER_H
+
+#include "port.h"
+#include "../include/sharedspice.h"
+
+#define NGLOAD_COPY 0     /* libngspiceN.so, physical copies */
+#define NGLOAD_MEMFD 1    /* in-memory copy of the library per instance */
+#define NGLOAD_DLMOPEN 2  /* library in a new namespace per instance */
+#define NGLOAD_PLAIN 3    /* the library itself, one instance per process */
+
+/* Functions exported by an instance (sharedspice.h), resolved once by
+   ngload_resolve(). Optional ones are NULL if the library lacks them:
+   synchronization (ngspice 26), breakpoints (28), event nodes (with XSPICE defined). */
+typedef struct ngspice_api {
+    int (*ngSpice_Init)(SendChar*, SendStat*, ControlledExit*, SendData*, SendInitData*,
+                        BGThreadRunning*, void*);
+    int (*ngSpice_Command)(char*);
+    pvector_info (*ngGet_Vec_Info)(char*);
+    char *(*ngSpice_CurPlot)(void);
+    char **(*ngSpice_AllVecs)(char*);
+    /* optional */
+    int (*ngSpice_Init_Sync)(GetVSRCData*, GetISRCData*, GetSyncData*, int*, void*);
+    int (*ngSpice_Circ)(char**);
+    char **(*ngSpice_AllPlots)(void);
+    bool (*ngSpice_running)(void);
+    bool (*ngSpice_SetBkpt)(double);
+#ifdef XSPICE
+    int (*ngSpice_Init_Evt)(SendEvtData*, SendInitEvtData*, void*);
+    pevt_shared_data (*ngGet_Evt_NodeInfo)(char*);
+    char **(*ngSpice_AllEvtNodes)(void);
+#endif
+} ngspice_api_t;
+
+/* NGLOAD_* by name, -1 if unknown */
+int ngload_method(const char *name);
+const char *ngload_name(int method);
+
+/* Open instance ident (1 ... N) by method. base is the original library
+   for NGLOAD_MEMFD and NGLOAD_DLMOPEN, a file name is searched in
+   LD_LIBRARY_PATH and the usual library directories. What was opened is
+   returned in desc, the method used in *used. NULL on error. */
+void *ngload_open(int method, const char *base, int ident, int *used,
+                  char *desc, size_t len);
+
+/* Fill api from handle. Returns 0, or 1 with the name of the first
+   required function not found in *missing. */
+int ngload_resolve(void *handle, ngspice_api_t *api, const char **missing);
+
+/* dlclose() an instance and release its image */
+int ngload_close(void *handle);
+
+/* resident set size of the process in bytes, 0 if unknown */
+uint64_t ngload_rss(void);
+
+#endif
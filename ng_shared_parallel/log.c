@@ -0,0 +1,332 @@
+/*
+Log pipeline for the output of the ngspice instances, see log.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+
+typedef struct nglogrec {
+    volatile uint64_t seq;     /* slot index when free, + 1 when written */
+    uint64_t t_ns;
+    int level;
+    int len;
+    char text[NGLOG_LINELEN];
+} nglogrec_t;
+
+typedef struct logq {
+    volatile uint64_t head;    /* next slot to be reserved, producers */
+    char pad1[64 - sizeof(uint64_t)];
+    uint64_t tail;             /* next slot to be written, writer */
+    char pad2[64 - sizeof(uint64_t)];
+    nglogrec_t ring[NGLOG_RING];
+    volatile uint64_t dropped;
+    uint64_t reported;         /* drops the writer has told about */
+    FILE *fp;
+} logq_t;
+
+typedef struct logstat {
+    uint64_t last_stat_ns;
+    volatile uint64_t lines, filtered, suppressed, put_ns;
+} logstat_t;
+
+static const char *levels[] = { "stderr", "stdout", "status" };
+
+static nglog_opts opts = { false, NULL, NGLOG_STATUS, 0 };
+static bool started;
+static volatile int running;   /* the writer takes the lines */
+static volatile int stopping;
+static threadId_t writer_tid;
+static ngwake_t wake;          /* lines put, or stopping */
+static mutexType queues_cs;
+static volatile uint64_t queues[NGLOG_MAXINST + 1];   /* logq_t *, by ident */
+static logstat_t stats[NGLOG_MAXINST + 1];            /* [0] for other idents */
+static uint64_t written, dropped_total;
+
+void
+nglog_defaults(nglog_opts *o)
+{
+    o->async = false;
+    o->dir = NULL;
+    o->level = NGLOG_STATUS;
+    o->stat_ms = 0;
+}
+
+int
+nglog_level(const char *name)
+{
+    int i;
+
+    for (i = 0; i <= NGLOG_STATUS; i++)
+        if (cieq(name, levels[i]))
+            return i;
+    return -1;
+}
+
+/* ring of ident, created on its first line */
+static logq_t *
+get_queue(int ident)
+{
+    logq_t *q = (logq_t *)(uintptr_t)ngat_load_u64(&queues[ident]);
+    uint64_t i;
+
+    if (q)
+        return q;
+    mutex_lock(&queues_cs);
+    q = (logq_t *)(uintptr_t)queues[ident];
+    if (!q) {
+        q = (logq_t *)calloc(1, sizeof(logq_t));
+        for (i = 0; i < NGLOG_RING; i++)
+            q->ring[i].seq = i;
+        ngat_store_u64(&queues[ident], (uint64_t)(uintptr_t)q);
+    }
+    mutex_unlock(&queues_cs);
+    return q;
+}
+
+void
+nglog_put(int ident, int level, const char *text)
+{
+    logstat_t *st = &stats[ident > 0 && ident <= NGLOG_MAXINST ? ident : 0];
+    uint64_t t0 = ng_now_ns(), pos, seq;
+    nglogrec_t *r;
+    logq_t *q;
+    size_t len;
+
+    if (level > opts.level) {
+        ngat_add_u64(&st->filtered, 1);
+        goto out;
+    }
+    if (level == NGLOG_STATUS && opts.stat_ms > 0) {
+        if (t0 - st->last_stat_ns < (uint64_t)opts.stat_ms * 1000000ull) {
+            ngat_add_u64(&st->suppressed, 1);
+            goto out;
+        }
+        st->last_stat_ns = t0;
+    }
+    ngat_add_u64(&st->lines, 1);
+    if (!ngat_load_i(&running) || ident < 1 || ident > NGLOG_MAXINST) {
+        printf("lib %d: %s\n", ident, text);
+        goto out;
+    }
+
+    q = get_queue(ident);
+    pos = ngat_load_u64(&q->head);
+    for (;;) {
+        r = &q->ring[pos & (NGLOG_RING - 1)];
+        seq = ngat_load_u64(&r->seq);
+        if (seq == pos) {
+            if (ngat_cas_u64(&q->head, &pos, pos + 1))
+                break;
+        }
+        else if (seq < pos) {
+            /* full */
+            ngat_add_u64(&q->dropped, 1);
+            ngwake_signal(&wake);
+            goto out;
+        }
+        else {
+            pos = ngat_load_u64(&q->head);
+        }
+    }
+    len = strlen(text);
+    if (len >= NGLOG_LINELEN)
+        len = NGLOG_LINELEN - 1;
+    memcpy(r->text, text, len);
+    r->text[len] = '\0';
+    r->len = (int)len;
+    r->level = level;
+    r->t_ns = t0;
+    ngat_store_u64(&r->seq, pos + 1);
+    ngwake_signal(&wake);
+
+out:
+    ngat_add_u64(&st->put_ns, ng_now_ns() - t0);
+}
+
+/* output of ident, stdout or its file */
+static FILE *
+output(int ident, logq_t *q)
+{
+    char file[512];
+
+    if (!opts.dir)
+        return stdout;
+    if (!q->fp) {
+        snprintf(file, sizeof(file), "%s/lib%d.log", opts.dir, ident);
+        q->fp = fopen(file, "w");
+        if (!q->fp) {
+            perror(file);
+            q->fp = stdout;
+        }
+    }
+    return q->fp;
+}
+
+static uint64_t
+drain(int ident, logq_t *q)
+{
+    uint64_t n = 0, dropped;
+    FILE *fp = NULL;
+
+    for (;;) {
+        nglogrec_t *r = &q->ring[q->tail & (NGLOG_RING - 1)];
+        if (ngat_load_u64(&r->seq) != q->tail + 1)
+            break;
+        if (!fp)
+            fp = output(ident, q);
+        if (fp == stdout)
+            fprintf(fp, "lib %d: %s\n", ident, r->text);
+        else
+            fprintf(fp, "%s\n", r->text);
+        ngat_store_u64(&r->seq, q->tail + NGLOG_RING);
+        q->tail++;
+        n++;
+    }
+    dropped = ngat_load_u64(&q->dropped);
+    if (dropped != q->reported) {
+        if (!fp)
+            fp = output(ident, q);
+        fprintf(fp, "lib %d: (%llu lines dropped, log ring full)\n", ident,
+                (unsigned long long)(dropped - q->reported));
+        dropped_total += dropped - q->reported;
+        q->reported = dropped;
+    }
+    written += n;
+    return n;
+}
+
+static bool
+pending(void)
+{
+    int i;
+
+    for (i = 1; i <= NGLOG_MAXINST; i++) {
+        logq_t *q = (logq_t *)(uintptr_t)ngat_load_u64(&queues[i]);
+        if (q && (ngat_load_u64(&q->ring[q->tail & (NGLOG_RING - 1)].seq) == q->tail + 1 ||
+                  ngat_load_u64(&q->dropped) != q->reported))
+            return true;
+    }
+    return false;
+}
+
+static void *
+writer(void *arg)
+{
+    int i, key;
+
+    (void)arg;
+    for (;;) {
+        int stop = ngat_load_i(&stopping);
+        uint64_t n = 0;
+
+        for (i = 1; i <= NGLOG_MAXINST; i++) {
+            logq_t *q = (logq_t *)(uintptr_t)ngat_load_u64(&queues[i]);
+            if (q)
+                n += drain(i, q);
+        }
+        if (stop && !n)
+            break;
+        if (n)
+            continue;
+        /* nothing came in, let the lines out and sleep */
+        fflush(stdout);
+        for (i = 1; i <= NGLOG_MAXINST; i++) {
+            logq_t *q = (logq_t *)(uintptr_t)ngat_load_u64(&queues[i]);
+            if (q && q->fp && q->fp != stdout)
+                fflush(q->fp);
+        }
+        key = ngwake_prepare(&wake);
+        if (ngat_load_i(&stopping) || pending())
+            ngwake_cancel(&wake);
+        else
+            ngwake_wait(&wake, key);
+    }
+    return NULL;
+}
+
+#if !defined(__MINGW32__) && !defined(_MSC_VER)
+/* a forked process has no writer */
+static void
+forked_child(void)
+{
+    running = 0;
+}
+#endif
+
+int
+nglog_start(const nglog_opts *o)
+{
+    opts = *o;
+    if (opts.dir)
+        opts.async = true;
+    if (started)
+        return 0;
+    started = true;
+    atexit(nglog_stop);
+    if (!opts.async)
+        return 0;
+    mutex_init(&queues_cs);
+    ngwake_init(&wake);
+#if !defined(__MINGW32__) && !defined(_MSC_VER)
+    pthread_atfork(NULL, NULL, forked_child);
+#endif
+    stopping = 0;
+    if (ng_thread_start(&writer_tid, writer, NULL)) {
+        fprintf(stderr, "Error: cannot start the log writer, printing directly\n");
+        return 1;
+    }
+    ngat_store_i(&running, 1);
+    return 0;
+}
+
+void
+nglog_stop(void)
+{
+    int i;
+
+    if (!started)
+        return;
+    if (ngat_load_i(&running)) {
+        /* lines put from now on are printed directly */
+        ngat_store_i(&running, 0);
+        ngat_store_i(&stopping, 1);
+        ngwake_signal(&wake);
+        ng_thread_join(writer_tid);
+        /* the rings stay, a bg thread may still be putting a line */
+        for (i = 1; i <= NGLOG_MAXINST; i++) {
+            logq_t *q = (logq_t *)(uintptr_t)queues[i];
+            if (q && q->fp && q->fp != stdout) {
+                fclose(q->fp);
+                q->fp = stdout;
+            }
+        }
+    }
+    nglog_print_stats();
+    started = false;
+}
+
+void
+nglog_print_stats(void)
+{
+    uint64_t lines = 0, filtered = 0, suppressed = 0, put_ns = 0;
+    int i;
+
+    for (i = 0; i <= NGLOG_MAXINST; i++) {
+        lines += stats[i].lines;
+        filtered += stats[i].filtered;
+        suppressed += stats[i].suppressed;
+        put_ns += stats[i].put_ns;
+    }
+    printf("\n** Log (%s%s%s, up to %s, status every %d ms) **\n", opts.async ? "async" : "direct",
+           opts.dir ? ", files in " : "", opts.dir ? opts.dir : "", levels[opts.level], opts.stat_ms);
+    printf("lines logged:        %llu\n", (unsigned long long)lines);
+    if (opts.async)
+        printf("lines written:       %llu, dropped %llu\n", (unsigned long long)written,
+               (unsigned long long)dropped_total);
+    printf("filtered:            %llu, status suppressed %llu\n", (unsigned long long)filtered,
+           (unsigned long long)suppressed);
+    printf("time in callbacks:   %.3f ms\n", put_ns / 1e6);
+}
@@ -0,0 +1,67 @@
+/*
+Log pipeline for the output of the ngspice instances.
+
+ng_getchar() and ng_getstat() are called from the bg thread of every
+instance. Printing there serializes all instances on the lock of
+stdout, and the status updates ("tran 12.3%") come in at a high rate.
+nglog_put() filters and rate limits the lines, and in async mode it
+only copies them into a ring of the instance and returns; one writer
+thread prints them, to stdout tagged by the instance ("lib N: ...") or
+to a file per instance.
+
+The rings are lock free with many producers, as the main thread may
+print through an instance while its bg thread is running: every slot
+has a sequence number, a producer reserves a slot by a compare and
+swap on the head and publishes it by the sequence number, the writer
+takes the slots in order and sleeps on an ngwake_t (port.h) while the
+rings are empty. A full ring drops the line and counts it.
+
+Levels are given by the token ngspice puts in front of a line: stderr
+lines, stdout lines, and the status lines of ng_getstat(). Only lines
+up to the level set are logged. Status lines of an instance closer
+than the interval set to the last one logged are suppressed.
+
+Without nglog_start() the lines are printed directly, as before, after
+filtering. A process forked after the start prints directly as well.
+*/
+
+#ifndef NG_LOG_H
+#define NG_LOG_H
+
+#include "port.h"
+
+/* levels */
+#define NGLOG_STDERR 0
+#define NGLOG_STDOUT 1
+#define NGLOG_STATUS 2
+
+/* instances with a ring, by ident; others print directly */
+#define NGLOG_MAXINST 256
+/* lines per ring, a power of 2 */
+#define NGLOG_RING 512
+/* longer lines are cut */
+#define NGLOG_LINELEN 232
+
+typedef struct nglog_opts {
+    bool async;
+    const char *dir;           /* a file per instance, or NULL for stdout */
+    int level;                 /* highest level logged */
+    int stat_ms;               /* minimum interval of status lines */
+} nglog_opts;
+
+void nglog_defaults(nglog_opts *o);
+int nglog_level(const char *name);
+
+/* set the options, start the writer thread in async mode; it is
+   stopped and the rings are written at exit */
+int nglog_start(const nglog_opts *o);
+void nglog_stop(void);
+
+/* a line of instance ident, level NGLOG_STATUS for status lines */
+void nglog_put(int ident, int level, const char *text);
+
+/* lines logged, filtered, suppressed and dropped, and time spent in
+   nglog_put() */
+void nglog_print_stats(void);
+
+#endif
@@ -16,19 +16,162 @@ Write rawfiles test1.raw and test2.raw
 Unload ngspice libs
 
 Test 2
-Load and initialize three ngspice instances.
-Run a simulation with three inverter chains in series,
-emulating a circuit partitioned into three parts.
+Load and initialize N (default three) ngspice instances.
+Run a simulation with N inverter chains in series,
+emulating a circuit partitioned into N parts.
 Each partition runs in its own ngspice instance. They are
 synchronized via a commonly used callback function.
-Each inverter is blanked out by a NAND gate during 
+Each inverter is blanked out by a NAND gate during
 a small time period, just to show that there is no interference.
-Circuit coupling is only by the two interfaces Vout1 --> Vin2, 
-Vout2 --> Vin3.
+Circuit coupling is only by the interfaces Vout1 --> Vin2,
+Vout2 --> Vin3, and so on.
 
-This example is by far not ready: sometimes synchronization is lost, 
+This example is by far not ready: sometimes synchronization is lost,
 spuriously a thread may jump ahead and finish (too) early. More
 experience in multithreaded programming is required from my side.
+
+Synchronization
+By default the threads meet in ng_SyncData() at a generation counted
+barrier (barrier.c), spinning for --spin iterations before sleeping.
+The original scheme with busy waiting on ok1/ok2 is still available
+by --sync legacy, for comparison. Barrier latency and cpu load are
+printed after the run.
+
+Partitions
+The instances are handled by the partition engine (partition.c), all
+per-partition data are kept in an array of structs. With --scale N
+test 2 is repeated for 1, 2, 4, ... N partitions and the throughput
+is reported. Instead of the inverter chain, test 2 may run any
+partitioned circuit given by a coupling description (coupling.h),
+e.g. --coupling examples/inv_oc.cpl
+
+Waveform relaxation
+With --wr jacobi|gs the partitions are not synchronized at every time
+step. Each one integrates a time window (--wr-window) driven by the
+interface waveforms of the previous iteration, until the interfaces
+change by less than --wr-tol (wr.c).
+
+Multirate
+With --sync multirate every partition keeps its own time step control,
+the partitions meet only at rendezvous times k * --mr-interval, set as
+breakpoints in all of them. In between, the interface values are held
+or extrapolated from the last two rendezvous (--mr-interp).
+
+Interface predictors
+In lockstep the EXTERNAL sources are interpolated in the samples of the
+driving partition, or predicted from its history if it has not reached
+the requested time yet (--pred hold|linear|polyN, pred.h). --bench
+compares all schemes with a monolithic run of examples/inv_oc_flat.cir.
+
+Optimistic
+With --sync optimistic no partition waits for the others in every time
+step. It advances with predicted interface values, and checks them
+against the samples of the driving partitions when the step is done.
+A step with a prediction off by more than --opt-tol is redone with half
+the time step. Rollbacks and the work wasted on them are reported.
+
+Netlist partitioner
+--split FILE flattens a netlist and cuts it into -n partitions of
+balanced device count with a minimum of cut nodes (split.c). The
+partition netlists with EXTERNAL sources at the cut nodes and the
+coupling description are written next to FILE, then simulated as with
+--coupling, unless --split-only is given. With --split-current the load
+current behind every cut is fed back to the driving partition by an
+EXTERNAL current source (ng_ISRCData), so nodes may be cut anywhere.
+
+Instance loading
+Every partition needs its own image of the ngspice library. By default
+the copies libngspice1.so ... made by prepare-libs are loaded. On Linux
+--loader memfd loads in-memory copies of one library (--lib), --loader
+dlmopen loads it into a separate namespace per instance, so no copies
+are needed (loader.c). --load-bench N compares load time and resident
+memory of N instances for all loaders.
+
+Jobs and the instance pool
+--jobs K runs test 2 K times, from --job-threads threads. Each job loads
+its instances and unloads them at the end, or, with --pool M, leases
+them from a pool of M initialized instances, reset after every job
+(pool.c). Startup and run time per job, lease waits and instances not
+clean after the reset are reported.
+
+Worker processes
+With --workers every partition of test 2 runs in a process of its own,
+loading libngspice.so (--lib) itself, so a crashing instance does not
+end the others and no library copies are needed. Engine, channels and
+barrier are in shared memory (worker.c). --worker-bench compares the
+time per synchronized step of threads and processes.
+
+Distributed run
+The partitions of test 2 may run on different hosts. --hub ADDR waits
+for a node per partition and takes the place of the barrier, --node
+ADDR --part K runs partition K and connects to it, ADDR is tcp:HOST:PORT
+or unix:PATH. Every step is one message to the hub and back, with the
+proposed time step and all interface samples (net.c). --net ADDR runs
+hub and nodes on this machine, the round trip per step is reported.
+
+Parameter sweep
+Where test 1 runs two copies side by side, --sweep FILE runs all the
+variants of a netlist given by a sweep description (sweep.h): grid and
+Monte Carlo parameters substituted into the netlist, handed over by
+ngSpice_Circ(), each run reduced to scalar measurements. The points are
+spread over --sweep-threads instances (default one per core), which
+steal work from each other at the end. Throughput in simulations per
+second is reported, --sweep-out writes all points as CSV.
+
+Netlist cache
+Netlists are read once, with their .include files expanded, and kept in
+memory (circ.c); every instance gets the lines by ngSpice_Circ() instead
+of reading and parsing the files again by "source". --source turns the
+cache off. --circ-bench N compares loading by "source" and from the
+cache for 1, 2, 4, ... N instances.
+
+Waveform capture
+With --capture VECS (a comma separated list, or all) every partition
+streams the vectors of each accepted point into nsynctestN.ngc, a
+memory mapped columnar file (capture.c), instead of writing
+nsynctestN.raw after the run. --capture-read FILE prints a capture,
+--capture-bench compares wall time and peak memory of test 2 with the
+rawfile and with the capture.
+
+--handoff block|drop|decimate moves the capture out of ng_data() to a
+consumer thread: ng_data() only copies the point into a ring, the
+policy says what happens when the ring is full (handoff.c). The time
+spent in ng_data() is reported per partition, --capture-bench adds a
+run with the handoff.
+
+Log
+The output of the instances goes through nglog_put() (log.c). --log
+async copies it into a ring per instance, printed by a writer thread,
+--log-dir DIR writes a file per instance instead of stdout. --log-level
+stderr|stdout|status filters, --log-stat-ms N passes one status line
+per instance in N ms at most.
+
+Watchdog
+A partition stalled in ngspice, or all of them stuck in the
+synchronization, for --watchdog MS is reported with the state of every
+partition, as is the first divergence of their time points in a barrier
+(watchdog.c). --watchdog-action report|resync|abort says what is done
+then, report by default. Off unless one of them is given; an action
+alone watches with a timeout of 10000 ms.
+
+Instrumentation
+--prof takes the time of every partition in ng_SyncData() and between
+two calls (prof.c): compute and wait histograms per partition, how
+often each one was the last to arrive and set the consensus delta, the
+critical path and the compute time lost to load imbalance.
+
+Timeline
+--trace FILE writes when every partition computed, waited in
+ng_SyncData(), redid a step and was in the source and data callbacks
+as a Chrome trace (trace.c), --trace-size N events buffered per
+partition. Open it in chrome://tracing or ui.perfetto.dev.
+
+Speedup benchmark
+--gen-bench chain|nand|adder writes a circuit of --gen-size stages
+(bits of the adder) flat and split into 1, 2, 4, ... -n partitions
+(gen.c), runs them with the scheme given by --sync, --pred, --wr and
+compares every run with the flat one: wall time, speedup, steps and
+waveform deviation, as a table and with --gen-out FILE as CSV.
 */
 
 
@@ -37,436 +180,494 @@ experience in multithreaded programming is required from my side.
 #include <stdlib.h>
 #include <signal.h>
 #include <string.h>
-#include <assert.h>
 
-#ifndef _MSC_VER
-#include <stdbool.h>
-#include <pthread.h>
-#include <stdint.h>
-#else
-#define bool int
-#define true 1
-#define false 0
-#define strdup _strdup
-typedef signed __int64       int64_t;
+#include "bench.h"
+#include "gen.h"
+#include "split.h"
+#include "pool.h"
+#include "worker.h"
+#include "net.h"
+#include "sweep.h"
+#include "circ.h"
+#include "capture.h"
+#include "handoff.h"
+#include "log.h"
+#include "watchdog.h"
+#include "trace.h"
+
+#if !defined(__MINGW32__) && !defined(_MSC_VER)
+#include <sys/wait.h>
 #endif
-#include "../include/sharedspice.h"
-
-
-#if defined(__MINGW32__) ||  defined(_MSC_VER)
-#undef BOOLEAN
-#include <windows.h>
-typedef FARPROC funptr_t;
-void *dlopen (const char *, int);
-funptr_t dlsym (void *, const char *);
-int dlclose (void *);
-char *dlerror (void);
-#define RTLD_LAZY	1	/* lazy function call binding */
-#define RTLD_NOW	2	/* immediate function call binding */
-#define RTLD_GLOBAL	4	/* symbols in this dlopen'ed obj are visible to other dlopen'ed objs */
-static char errstr[128];
-#else
-#include <dlfcn.h> /* to load libraries*/
-#include <unistd.h>
-#include <ctype.h>
-typedef void *  funptr_t;
-#endif
-
-/* Defines for thread handling, as a unified interface for pthreads
-   and MS Windows threads*/
-/* MS Windows */
-#if defined(__MINGW32__) || defined(_MSC_VER)
-#define mutex_lock(a) EnterCriticalSection(a)
-#define mutex_unlock(a) LeaveCriticalSection(a)
-#define mutex_init(a) InitializeCriticalSection(a)
-#define mutex_delete(a) DeleteCriticalSection(a)
-typedef CRITICAL_SECTION mutexType;
-#define thread_self() GetCurrentThread()
-#define threadid_self() GetThreadId(GetCurrentThread())
-typedef HANDLE threadId_t;
-/* LINUX, CYGWIN, etc. */
-#else
-#include <pthread.h>
-#define mutex_lock(a) pthread_mutex_lock(a)
-#define mutex_unlock(a) pthread_mutex_unlock(a)
-#define mutex_init(a) pthread_mutex_init(a, NULL)
-#define mutex_delete(a) pthread_mutex_destroy(a)
-#define thread_self() pthread_self()
-typedef pthread_mutex_t mutexType;
-typedef pthread_t threadId_t;
-#endif
-
-bool no_bg = true;
-bool not_yet = true;
-bool will_unload = false;
-int numthreads = 0;
-
-/* case insensitive string comparison */
-int cieq(register char *p, register char *s);
-/* comparing two double numbers */
-bool AlmostEqualUlps(double A, double B, int maxUlps);
-
-/* callback functions used by ngspice, initialized by ngSpice_Init() */
-int
-ng_getchar(char* outputreturn, int ident, void* userdata);
-
-int
-ng_getstat(char* outputreturn, int ident, void* userdata);
-
-int
-ng_thread_runs(bool noruns, int ident, void* userdata);
-
-ControlledExit ng_exit;
-SendData ng_data;
-SendInitData ng_initdata;
-
-/* callback functions used by ngspice, initialized by ngSpice_Init_Sync() */
-
-GetVSRCData ng_VSRCData;
-GetISRCData ng_ISRCData;
-GetSyncData ng_SyncData;
-
-int vecgetnumber1 = 0, vecgetnumber2 = 0;
-double v2dat;
-static bool has_break = false;
-int testnumber = 0;
-
-/* functions exported by ngspice1 */
-funptr_t ngSpice_Init_handle1 = NULL;
-funptr_t ngSpice_Init_Sync_handle1 = NULL;
-funptr_t ngSpice_Command_handle1 = NULL;
-funptr_t ngSpice_Circ_handle1 = NULL;
-funptr_t ngSpice_CurPlot_handle1 = NULL;
-funptr_t ngSpice_AllVecs_handle1 = NULL;
-funptr_t ngSpice_GVI_handle1 = NULL;
-
-/* functions exported by ngspice2 */
-funptr_t ngSpice_Init_handle2 = NULL;
-funptr_t ngSpice_Init_Sync_handle2 = NULL;
-funptr_t ngSpice_Command_handle2 = NULL;
-funptr_t ngSpice_Circ_handle2 = NULL;
-funptr_t ngSpice_CurPlot_handle2 = NULL;
-funptr_t ngSpice_AllVecs_handle2 = NULL;
-funptr_t ngSpice_GVI_handle2 = NULL;
-
-/* functions exported by ngspice3 */
-funptr_t ngSpice_Init_handle3 = NULL;
-funptr_t ngSpice_Init_Sync_handle3 = NULL;
-funptr_t ngSpice_Command_handle3 = NULL;
-funptr_t ngSpice_Circ_handle3 = NULL;
-funptr_t ngSpice_CurPlot_handle3 = NULL;
-funptr_t ngSpice_AllVecs_handle3 = NULL;
-funptr_t ngSpice_GVI_handle3 = NULL;
-
-void * ngdllhandle1 = NULL;
-void * ngdllhandle2 = NULL;
-void * ngdllhandle3 = NULL;
-
-/* simple thread identification numbers */
-int dll1 = 1, dll2 = 2, dll3 = 3;
-
-int numtreads = 0, threadmax = 0;
-bool ok1 = false, ok2 = false;
-
-mutexType rt_cs; // used in ng_thread_runs()
-mutexType sy_cs1; // used in ng_SyncData()
-mutexType sy_cs2; // used in ng_SyncData()
-mutexType sy_cs3; // used in ng_SyncData()
-
-#define int64_min (((int64_t) -1) << 63)
-#ifdef _MSC_VER
-#define llabs(x) ((x) < 0 ? -(x) : (x))
-#endif
-
-bool AlmostEqualUlps(double A, double B, int maxUlps)
-{
-    int64_t aInt, bInt, intDiff;
-
-    union {
-        double d;
-        int64_t i;
-    } uA, uB;
-
-    if (A == B)
-        return true;
-
-    /* If not - the entire method can not work */
-    assert(sizeof(double) == sizeof(int64_t));
-
-    /* Make sure maxUlps is non-negative and small enough that the */
-    /* default NAN won't compare as equal to anything. */
-    assert(maxUlps > 0 && maxUlps < 4 * 1024 * 1024);
-
-    uA.d = A;
-    aInt = uA.i;
-    /* Make aInt lexicographically ordered as a twos-complement int */
-    if (aInt < 0)
-        aInt = int64_min - aInt;
 
-    uB.d = B;
-    bInt = uB.i;
-    /* Make bInt lexicographically ordered as a twos-complement int */
-    if (bInt < 0)
-        bInt = int64_min - bInt;
-
-    intDiff = llabs(aInt - bInt);
-
-    /* printf("A:%e B:%e aInt:%d bInt:%d  diff:%d\n", A, B, aInt, bInt, intDiff); */
-
-    if (intDiff <= maxUlps)
-        return true;
-    return false;
-}
-
-
-/* Case insensitive str eq. */
-/* Like strcasecmp( ) XXX */
-
-int
-cieq(register char *p, register char *s)
+static int sync_mode = SYNC_BARRIER;
+static int sync_spin = -1;
+static int npartitions = 3;
+static char *couplingfile = NULL;
+static ngwr_opts wropts;
+static double mr_interval = 1e-9;
+static double opt_tol = 1e-2;
+static int mr_interp = MR_HOLD;
+static const ngpredictor_t *predictor = NULL;
+static char *reference = "./examples/inv_oc_flat.cir";
+static char splitcpl[300];
+static bool splitcurrent = false;
+static int loader = NGLOAD_COPY;
+static char *libbase = NULL;
+static int poolsize = 0;
+static int jobthreads = 1;
+static bool useworkers = false;
+static char *hubaddr = NULL;
+static char *nodeaddr = NULL;
+static int nodepart = 0;
+static bool loopback = false;
+static char *capturevecs = NULL;
+static int handoff = -1;
+static int handoffsize = 0;
+static nglog_opts logopts;
+static int wdms = -1;
+static int wdaction = WATCHDOG_REPORT;
+static bool profile = false;
+static char *tracefile = NULL;
+static int gen = -1;
+static int gensize = NGGEN_SIZE;
+static char *gendir = "./examples";
+static char *genout = NULL;
+static int tracesize = 0;
+static int sweepthreads = 0;
+static char *sweepout = NULL;
+
+static int test1(void);
+static int test2(void);
+static int scale(int nmax);
+static int run_engine(ngengine_t *e);
+static int bench(void);
+static int genbench(void);
+static int split(const char *file);
+static int loadbench(int n);
+static int jobs(int k);
+static int workerbench(void);
+static int netrun(ngcoupling_t *cpl);
+static int sweep(const char *file);
+static int circbench(int n);
+static int captureread(const char *file);
+static int capturebench(void);
+
+static void
+usage(char *prog)
 {
-    while (*p) {
-        if ((isupper(*p) ? tolower(*p) : *p) !=
-                (isupper(*s) ? tolower(*s) : *s))
-            return(false);
-        p++;
-        s++;
-    }
-    return (*s ? false : true);
+    printf("Usage: %s [options]\n", prog);
+    printf("  -t, --test 1|2             run test 1 or test 2 (default 2)\n");
+    printf("  -n, --partitions N         number of partitions in test 2 (default 3)\n");
+    printf("  -c, --coupling FILE        run test 2 with the partitions given in FILE\n");
+    printf("      --scale N              run test 2 with 1, 2, 4, ... N partitions\n");
+    printf("  -s, --sync barrier|legacy|multirate|optimistic\n");
+    printf("                             synchronization scheme (default barrier)\n");
+    printf("      --mr-interval T        multirate rendezvous interval (default 1n)\n");
+    printf("      --mr-interp hold|linear  interface values between rendezvous\n");
+    printf("      --opt-tol V            optimistic misprediction tolerance (default 10m)\n");
+    printf("      --spin N               barrier spin iterations before sleeping\n");
+    printf("      --wr jacobi|gs         waveform relaxation instead of lockstep\n");
+    printf("      --wr-window T          window length in s (default whole run)\n");
+    printf("      --wr-tol V             convergence tolerance (default 1m)\n");
+    printf("      --wr-maxit N           iterations per window (default 20)\n");
+    printf("      --pred hold|linear|polyN  interface predictor in lockstep (default linear)\n");
+    printf("      --bench                accuracy and speed of all schemes against a reference\n");
+    printf("      --reference FILE       monolithic netlist for --bench\n");
+    printf("      --gen-bench chain|nand|adder  speedup of a generated circuit, 1, 2, 4, ... -n parts\n");
+    printf("      --gen-size N           stages or bits of the circuit (default %d)\n", NGGEN_SIZE);
+    printf("      --gen-dir DIR          netlists written to DIR (default ./examples)\n");
+    printf("      --gen-out FILE         results of --gen-bench as CSV\n");
+    printf("      --split FILE           partition netlist FILE into -n parts and run them\n");
+    printf("      --split-only           only write the partition netlists\n");
+    printf("      --split-current        couple the load currents back, cut anywhere\n");
+    printf("      --loader copy|memfd|dlmopen  how the instances are loaded (default copy)\n");
+    printf("      --lib FILE             library for memfd and dlmopen (default libngspice.so)\n");
+    printf("      --load-bench N         load time and memory of N instances, all loaders\n");
+    printf("      --jobs K               run test 2 K times, see --pool\n");
+    printf("      --job-threads T        threads running the jobs (default 1)\n");
+    printf("      --pool M               lease the instances from a pool of M\n");
+    printf("      --workers              test 2 with one process per partition\n");
+    printf("      --worker-bench         time per step of threads and worker processes\n");
+    printf("      --hub ADDR             serve the nodes of a distributed test 2\n");
+    printf("      --node ADDR --part K   run partition K as a node of the hub at ADDR\n");
+    printf("      --net ADDR             hub and all nodes on this machine\n");
+    printf("      --sweep FILE           parameter sweep or Monte Carlo given in FILE\n");
+    printf("      --sweep-threads N      instances of the sweep (default one per core)\n");
+    printf("      --sweep-out FILE       write the sweep points as CSV\n");
+    printf("      --source               load the netlists by \"source\", not from the cache\n");
+    printf("      --circ-bench N         netlist loading of 1, 2, 4, ... N instances\n");
+    printf("      --capture VECS|all     stream the vectors into nsynctestN.ngc, no rawfile\n");
+    printf("      --capture-read FILE    print a capture file\n");
+    printf("      --capture-bench        test 2 with the rawfile against the capture\n");
+    printf("      --handoff block|drop|decimate  capture in a consumer thread, full ring policy\n");
+    printf("      --handoff-size N       slots of the ring per partition (default %d)\n", NGHANDOFF_SIZE);
+    printf("      --log direct|async     print the output of the instances, or by a writer thread\n");
+    printf("      --log-dir DIR          a log file per instance in DIR (async)\n");
+    printf("      --log-level stderr|stdout|status  highest level logged (default status)\n");
+    printf("      --log-stat-ms N        one status line per instance in N ms at most\n");
+    printf("      --watchdog MS          stall timeout of the synchronization (default off,\n"
+           "                             %d with --watchdog-action)\n", NGWATCHDOG_MS);
+    printf("      --watchdog-action report|resync|abort  when a stall or divergence is found (default report)\n");
+    printf("      --prof                 compute, wait and load imbalance of the partitions per step\n");
+    printf("      --trace FILE           timeline of the partitions as a Chrome trace\n");
+    printf("      --trace-size N         events buffered per partition (default %d)\n", NGTRACE_SIZE);
+    printf("  -h, --help                 show this help\n");
 }
 
-
-/* Unify LINUX and Windows dynamic library handling */
-#if defined(__MINGW32__) ||  defined(_MSC_VER)
-
-void *dlopen(const char *name,int type)
+int main(int argc, char **argv)
 {
-    return LoadLibrary((LPCSTR)name);
-}
-
-funptr_t dlsym(void *hDll, const char *funcname)
-{
-    return GetProcAddress(hDll, funcname);
-}
+    int i, testnumber = 2, scalemax = 0, loadmax = 0, njobs = 0, circmax = 0;
+    bool dobench = false, splitonly = false, doworkerbench = false, usecache = true;
+    bool docapturebench = false, dolog = false;
+    char *splitfile = NULL, *sweepfile = NULL, *capturefile = NULL;
+
+    wr_defaults(&wropts);
+    nglog_defaults(&logopts);
+    for (i = 1; i < argc; i++) {
+        if ((!strcmp(argv[i], "-s") || !strcmp(argv[i], "--sync")) && i + 1 < argc) {
+            i++;
+            if (cieq(argv[i], "legacy"))
+                sync_mode = SYNC_LEGACY;
+            else if (cieq(argv[i], "barrier"))
+                sync_mode = SYNC_BARRIER;
+            else if (cieq(argv[i], "multirate"))
+                sync_mode = SYNC_MULTIRATE;
+            else if (cieq(argv[i], "optimistic"))
+                sync_mode = SYNC_OPTIMISTIC;
+            else {
+                fprintf(stderr, "Unknown sync scheme %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (!strcmp(argv[i], "--wr") && i + 1 < argc) {
+            i++;
+            sync_mode = SYNC_WR;
+            if (cieq(argv[i], "jacobi"))
+                wropts.method = WR_JACOBI;
+            else if (cieq(argv[i], "gs") || cieq(argv[i], "gauss-seidel"))
+                wropts.method = WR_GAUSS_SEIDEL;
+            else {
+                fprintf(stderr, "Unknown relaxation method %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (!strcmp(argv[i], "--wr-window") && i + 1 < argc) {
+            wropts.window = wr_value(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--wr-tol") && i + 1 < argc) {
+            wropts.tol = wr_value(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--wr-maxit") && i + 1 < argc) {
+            wropts.maxit = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--mr-interval") && i + 1 < argc) {
+            mr_interval = wr_value(argv[++i]);
+            if (mr_interval <= 0) {
+                fprintf(stderr, "Rendezvous interval must be > 0\n");
+                exit(1);
+            }
+        }
+        else if (!strcmp(argv[i], "--opt-tol") && i + 1 < argc) {
+            opt_tol = wr_value(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--mr-interp") && i + 1 < argc) {
+            i++;
+            if (cieq(argv[i], "linear"))
+                mr_interp = MR_LINEAR;
+            else if (cieq(argv[i], "hold"))
+                mr_interp = MR_HOLD;
+            else {
+                fprintf(stderr, "Unknown interpolation %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (!strcmp(argv[i], "--pred") && i + 1 < argc) {
+            predictor = ngpred_find(argv[++i]);
+            if (!predictor) {
+                fprintf(stderr, "Unknown predictor %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (!strcmp(argv[i], "--bench")) {
+            dobench = true;
+        }
+        else if (!strcmp(argv[i], "--reference") && i + 1 < argc) {
+            reference = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--gen-bench") && i + 1 < argc) {
+            gen = nggen_kind(argv[++i]);
+            if (gen < 0) {
+                fprintf(stderr, "Unknown circuit %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (!strcmp(argv[i], "--gen-size") && i + 1 < argc) {
+            gensize = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--gen-dir") && i + 1 < argc) {
+            gendir = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--gen-out") && i + 1 < argc) {
+            genout = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--spin") && i + 1 < argc) {
+            sync_spin = atoi(argv[++i]);
+        }
+        else if ((!strcmp(argv[i], "-t") || !strcmp(argv[i], "--test")) && i + 1 < argc) {
+            testnumber = atoi(argv[++i]);
+        }
+        else if ((!strcmp(argv[i], "-n") || !strcmp(argv[i], "--partitions")) && i + 1 < argc) {
+            npartitions = atoi(argv[++i]);
+        }
+        else if ((!strcmp(argv[i], "-c") || !strcmp(argv[i], "--coupling")) && i + 1 < argc) {
+            couplingfile = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--scale") && i + 1 < argc) {
+            scalemax = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--split") && i + 1 < argc) {
+            splitfile = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--split-only")) {
+            splitonly = true;
+        }
+        else if (!strcmp(argv[i], "--split-current")) {
+            splitcurrent = true;
+        }
+        else if (!strcmp(argv[i], "--loader") && i + 1 < argc) {
+            loader = ngload_method(argv[++i]);
+            if (loader < 0) {
+                fprintf(stderr, "Unknown loader %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (!strcmp(argv[i], "--lib") && i + 1 < argc) {
+            libbase = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--load-bench") && i + 1 < argc) {
+            loadmax = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--jobs") && i + 1 < argc) {
+            njobs = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--job-threads") && i + 1 < argc) {
+            jobthreads = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--pool") && i + 1 < argc) {
+            poolsize = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--workers")) {
+            useworkers = true;
+        }
+        else if (!strcmp(argv[i], "--worker-bench")) {
+            doworkerbench = true;
+        }
+        else if (!strcmp(argv[i], "--hub") && i + 1 < argc) {
+            hubaddr = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--node") && i + 1 < argc) {
+            nodeaddr = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--part") && i + 1 < argc) {
+            nodepart = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--net") && i + 1 < argc) {
+            hubaddr = nodeaddr = argv[++i];
+            loopback = true;
+        }
+        else if (!strcmp(argv[i], "--sweep") && i + 1 < argc) {
+            sweepfile = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--sweep-threads") && i + 1 < argc) {
+            sweepthreads = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--sweep-out") && i + 1 < argc) {
+            sweepout = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--source")) {
+            usecache = false;
+        }
+        else if (!strcmp(argv[i], "--circ-bench") && i + 1 < argc) {
+            circmax = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--capture") && i + 1 < argc) {
+            capturevecs = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--capture-read") && i + 1 < argc) {
+            capturefile = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--capture-bench")) {
+            docapturebench = true;
+        }
+        else if (!strcmp(argv[i], "--handoff") && i + 1 < argc) {
+            handoff = nghandoff_policy(argv[++i]);
+            if (handoff < 0) {
+                fprintf(stderr, "Unknown handoff policy %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (!strcmp(argv[i], "--handoff-size") && i + 1 < argc) {
+            handoffsize = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--log") && i + 1 < argc) {
+            i++;
+            if (cieq(argv[i], "async"))
+                logopts.async = true;
+            else if (cieq(argv[i], "direct"))
+                logopts.async = false;
+            else {
+                fprintf(stderr, "Unknown log mode %s\n", argv[i]);
+                exit(1);
+            }
+            dolog = true;
+        }
+        else if (!strcmp(argv[i], "--log-dir") && i + 1 < argc) {
+            logopts.dir = argv[++i];
+            dolog = true;
+        }
+        else if (!strcmp(argv[i], "--log-level") && i + 1 < argc) {
+            logopts.level = nglog_level(argv[++i]);
+            if (logopts.level < 0) {
+                fprintf(stderr, "Unknown log level %s\n", argv[i]);
+                exit(1);
+            }
+            dolog = true;
+        }
+        else if (!strcmp(argv[i], "--log-stat-ms") && i + 1 < argc) {
+            logopts.stat_ms = atoi(argv[++i]);
+            dolog = true;
+        }
+        else if (!strcmp(argv[i], "--watchdog") && i + 1 < argc) {
+            wdms = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--watchdog-action") && i + 1 < argc) {
+            wdaction = ngwatchdog_action(argv[++i]);
+            if (wdaction < 0) {
+                fprintf(stderr, "Unknown watchdog action %s\n", argv[i]);
+                exit(1);
+            }
+            if (wdms < 0)
+                wdms = NGWATCHDOG_MS;
+        }
+        else if (!strcmp(argv[i], "--prof")) {
+            profile = true;
+        }
+        else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            tracefile = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--trace-size") && i + 1 < argc) {
+            tracesize = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            usage(argv[0]);
+            return 0;
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            usage(argv[0]);
+            exit(1);
+        }
+    }
 
-char *dlerror(void)
-{
-    LPVOID lpMsgBuf;
-    char * testerr;
-    DWORD dw = GetLastError();
-
-    FormatMessage(
-        FORMAT_MESSAGE_ALLOCATE_BUFFER |
-        FORMAT_MESSAGE_FROM_SYSTEM |
-        FORMAT_MESSAGE_IGNORE_INSERTS,
-        NULL,
-        dw,
-        MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
-        (LPTSTR) &lpMsgBuf,
-        0,
-        NULL
-    );
-    testerr = (char*)lpMsgBuf;
-    strcpy(errstr,lpMsgBuf);
-    LocalFree(lpMsgBuf);
-    return errstr;
-}
+    if (splitfile) {
+        if (split(splitfile))
+            return 1;
+        if (splitonly)
+            return 0;
+        couplingfile = splitcpl;
+    }
 
-int dlclose (void *lhandle)
-{
-    return (int)FreeLibrary(lhandle);
-}
+#if defined(__MINGW32__) || defined(_MSC_VER)
+    {
+        /* find path of executable, the libraries are copied there */
+        char *exepath, *exeptr;
+        _get_pgmptr(&exepath);
+        exeptr = strrchr(exepath, '\\');
+        *(++exeptr) = '\0';
+        SetCurrentDirectory(exepath);
+    }
 #endif
 
-/**************************************************************************************/
-/**************************************************************************************/
-
-
-double in1out2 = 0.0, in2out1 = 0.0, in3out2 = 0.0;
+    ngengine_set_loader(loader, libbase);
+    ngengine_set_circ_cache(usecache);
+    ngengine_set_capture(capturevecs);
+    ngengine_set_handoff(handoff, handoffsize);
+    ngengine_set_watchdog(wdms > 0 ? wdms : 0, wdaction);
+    ngengine_set_profile(profile);
+    if (dolog)
+        nglog_start(&logopts);
+    if (tracefile && ngtrace_start(tracefile, tracesize))
+        exit(1);
+    if (capturefile)
+        return captureread(capturefile);
+    if (docapturebench)
+        return capturebench();
+    if (circmax > 0)
+        return circbench(circmax);
+    if (loadmax > 0)
+        return loadbench(loadmax);
+    if (njobs > 0)
+        return jobs(njobs);
+    if (doworkerbench)
+        return workerbench();
+    if (sweepfile)
+        return sweep(sweepfile);
+    if (dobench)
+        return bench();
+    if (gen >= 0)
+        return genbench();
+    if (scalemax > 0)
+        return scale(scalemax);
+    if (testnumber == 1)
+        return test1();
+    return test2();
+}
 
-int main()
+/* Test 1: two independent simulations, one of them halted for a while */
+static int
+test1(void)
 {
-    char *errmsg = NULL, *loadstring1, *loadstring2, *loadstring3, *curplot, *vecname;
-    char *exepath, *exeptr;
-    int *ret, i;
-    char ** circarray;
+    ngengine_t *e;
+    char *curplot, *vecname;
     char **vecarray;
-    char newpath[256];
-
-/* mutex initializing */
-    mutex_init(&rt_cs);
-    mutex_init(&sy_cs1);
-    mutex_init(&sy_cs2);
-    mutex_init(&sy_cs3);
-
-#if defined(__MINGW32__) || defined(_MSC_VER)
-    /* find path of executable */
-    _get_pgmptr(&exepath); 
-    exeptr = strrchr(exepath, '\\');
-    *(++exeptr) = '\0';
-    sprintf(newpath, "%sngspice.dll", exepath);
-#endif
-
-    goto next;  /* skip example 1 */
+    int i;
 
     printf("***********************************\n");
     printf("**  ngspice parrallel example 1  **\n");
     printf("***********************************\n");
 
-
-    printf("Load ngspice.dll\n");
-#ifdef __CYGWIN__
-    loadstring1 = "/cygdrive/c/cygwin/usr/local/bin/cygngspice-0.dll";
-#elif _MSC_VER
-    loadstring1 = "ngspice.dll";
-#else
-    loadstring1 = "libngspice1.so";
-#endif
-    dlerror();
-
-    ngdllhandle1 = dlopen(loadstring1, RTLD_NOW);
-
-    errmsg = dlerror();
-    if (errmsg)
-        printf("%s\n", errmsg);
-    if (ngdllhandle1) {
-        printf("%s loaded\n", loadstring1);
-        numthreads++;
-    } else {
-        printf("%s not loaded !\n", loadstring1);
+    e = ngengine_new(2, sync_mode, sync_spin);
+    if (!e || ngengine_load(e))
         exit(1);
-    }
 
-    printf("Load ngspice2.dll\n");
-#ifdef __CYGWIN__
-    loadstring2 = "/cygdrive/c/cygwin/usr/local/bin/cygngspice-2.dll";
-#elif _MSC_VER
-    loadstring2 = "ngspice2.dll";
-#else
-    loadstring2 = "libngspice2.so";
-#endif
-    ngdllhandle2 = dlopen(loadstring2, RTLD_NOW);
-
-    errmsg = dlerror();
-    if (errmsg)
-        printf("%s\n", errmsg);
-    if (ngdllhandle2) {
-        printf("ngspice2.dll loaded\n");
-        numthreads++;
-    } else {
-        printf("ngspice2.dll not loaded !\n");
-        exit(1);
-    }
-    /* retrieve handles for all exported functions */
-    ngSpice_Init_handle1 = dlsym(ngdllhandle1, "ngSpice_Init");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_Init_Sync_handle1 = dlsym(ngdllhandle1, "ngSpice_Init_Sync");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_Command_handle1 = dlsym(ngdllhandle1, "ngSpice_Command");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_CurPlot_handle1 = dlsym(ngdllhandle1, "ngSpice_CurPlot");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_AllVecs_handle1 = dlsym(ngdllhandle1, "ngSpice_AllVecs");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_GVI_handle1 = dlsym(ngdllhandle1, "ngGet_Vec_Info");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-
-    ngSpice_Init_handle2 = dlsym(ngdllhandle2, "ngSpice_Init");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_Init_Sync_handle2 = dlsym(ngdllhandle2, "ngSpice_Init_Sync");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_Command_handle2 = dlsym(ngdllhandle2, "ngSpice_Command");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_CurPlot_handle2 = dlsym(ngdllhandle2, "ngSpice_CurPlot");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_AllVecs_handle2 = dlsym(ngdllhandle2, "ngSpice_AllVecs");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_GVI_handle2 = dlsym(ngdllhandle2, "ngGet_Vec_Info");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-
-    /* initialize both shared libraries */
-    ret = ((int * (*)(SendChar*, SendStat*, ControlledExit*, SendData*, SendInitData*,
-                      BGThreadRunning*, void*)) ngSpice_Init_handle1)(ng_getchar, ng_getstat,
-                              ng_exit, NULL, ng_initdata, ng_thread_runs, NULL);
-
-    ret = ((int * (*)(SendChar*, SendStat*, ControlledExit*, SendData*, SendInitData*,
-                      BGThreadRunning*, void*)) ngSpice_Init_handle2)(ng_getchar, ng_getstat,
-                              ng_exit, NULL, ng_initdata, ng_thread_runs, NULL);
-
-    /* just send the ngspice library identifiers */
-    ret = ((int * (*)(GetVSRCData*, GetISRCData*, GetSyncData*, int*,
-                      void*)) ngSpice_Init_Sync_handle1)(NULL, NULL, NULL, &dll1, NULL);
-
-    ret = ((int * (*)(GetVSRCData*, GetISRCData*, GetSyncData*, int*,
-                      void*)) ngSpice_Init_Sync_handle2)(NULL, NULL, NULL, &dll2, NULL);
-
-    testnumber = 1;
-    printf("\n**  Test no. %d: Sourcing two input files and running them independently **\n\n", testnumber);
+    /* initialize both shared libraries, just send the library identifiers */
+    ngengine_init(e, 0);
+
+    printf("\n**  Test no. %d: Sourcing two input files and running them independently **\n\n", 1);
 #if defined(__CYGWIN__)
-    ret = ((int * (*)(char*)) ngSpice_Command_handle1)("source /cygdrive/d/Spice_general/ngspice_sh/examples/shared-ngspice/adder_mos.cir");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle2)("source /cygdrive/d/Spice_general/ngspice_sh/examples/shared-ngspice/adder_mos.cir");
+    ngengine_command_all(e, "source /cygdrive/d/Spice_general/ngspice_sh/examples/shared-ngspice/adder_mos.cir");
 #elif __MINGW32__
-    ret = ((int * (*)(char*)) ngSpice_Command_handle1)("source D:\\Spice_general\\ngspice_sh\\examples\\shared-ngspice\\adder_mos.cir");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle2)("source D:\\Spice_general\\ngspice_sh\\examples\\shared-ngspice\\adder_mos.cir");
-#else
-//    ret = ((int * (*)(char*)) ngSpice_Command_handle)("../../examples/adder_mos.cir");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle1)("source ./examples/adder_mos.cir");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle2)("source ./examples/adder_mos.cir");
-#endif
-    ret = ((int * (*)(char*)) ngSpice_Command_handle1)("bg_run");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle2)("bg_run");
-#if defined(__MINGW32__) || defined(_MSC_VER)
-    Sleep (5000);
+    ngengine_command_all(e, "source D:\\Spice_general\\ngspice_sh\\examples\\shared-ngspice\\adder_mos.cir");
 #else
-    usleep (5000000);
+    ngengine_command_all(e, "source ./examples/adder_mos.cir");
 #endif
-    ret = ((int * (*)(char*)) ngSpice_Command_handle1)("bg_halt");
+    ngengine_run(e);
+    ng_msleep(5000);
+    ngpart_command(&e->parts[0], "bg_halt");
     for (i = 5; i > 0; i--) {
         printf("Pause for %d seconds\n", i);
-#if defined(__MINGW32__) || defined(_MSC_VER)
-        Sleep (1000);
-#else
-        usleep (1000000);
-#endif
+        ng_msleep(1000);
     }
-    ret = ((int * (*)(char*)) ngSpice_Command_handle1)("bg_resume");
+    ngpart_command(&e->parts[0], "bg_resume");
 
     /* wait for 1s while simulation continues */
-#if defined(__MINGW32__) || defined(_MSC_VER)
-    Sleep (1000);
-#else
-    usleep (1000000);
-#endif
+    ng_msleep(1000);
     /* read current plot while simulation continues */
-    curplot = ((char * (*)()) ngSpice_CurPlot_handle1)();
+    curplot = ngpart_curplot(&e->parts[0]);
     printf("\nlib 1: Current plot is %s\n\n", curplot);
 
     /* get some data from ngspice1 */
-    vecarray = ((char ** (*)(char*)) ngSpice_AllVecs_handle1)(curplot);
+    vecarray = ngpart_allvecs(&e->parts[0], curplot);
     /* get length of first vector */
     if (vecarray) {
         char plotvec[256];
@@ -474,516 +675,766 @@ int main()
         int veclength;
         vecname = vecarray[0];
         sprintf(plotvec, "%s.%s", curplot, vecname);
-        myvec = ((pvector_info (*)(char*)) ngSpice_GVI_handle1)(plotvec);
+        myvec = ngpart_vecinfo(&e->parts[0], plotvec);
         veclength = myvec->v_length;
         printf("\nlib 1: Actual length of vector %s is %d\n\n", plotvec, veclength);
     }
 
-    /* wait until simulation finishes */
-    for (;;) {
-#if defined(__MINGW32__) || defined(_MSC_VER)
-        Sleep (100);
-#else
-        usleep (100000);
-#endif
-        if (no_bg)
-            break;
-    }
-    ret = ((int * (*)(char*)) ngSpice_Command_handle1)("write test1.raw V(5)");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle2)("write test2.raw V(5)");
+    /* wait until simulation finishes, tell which one first */
+    while ((i = ngengine_wait_any(e, -1)) >= 0)
+        printf("\nlib %d: simulation finished\n\n", e->parts[i].ident);
+    ngengine_wait(e);
+    ngpart_command(&e->parts[0], "write test1.raw V(5)");
+    ngpart_command(&e->parts[1], "write test2.raw V(5)");
 
-    ret = ((int * (*)(char*)) ngSpice_Command_handle1)("rusage trantime");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle2)("rusage trantime");
+    ngengine_command_all(e, "rusage trantime");
 
-    dlclose(ngdllhandle1);
-    dlclose(ngdllhandle2);
+    ngengine_free(e);
+    return 0;
+}
 
-//******************************************************************************************
-next:
+/* Test 2: the inverter chain partitioned into npartitions parts,
+   or the partitions of the coupling description */
+static int
+test2(void)
+{
+    ngengine_t *e;
+    ngcoupling_t *cpl;
+    char cmd[64];
+    int i, ret;
 
     /* load ngspice again */
     printf("***********************************\n");
     printf("**  ngspice parrallel example 2  **\n");
     printf("***********************************\n");
 
-    printf("Copy ngspice dlls\n");
-
-/* search for ngspice libraries 1 - 3, create them by copying, if not already existing */
-#ifdef __CYGWIN__
-    /*copying t.b.d.*/
-    loadstring1 = "/cygdrive/c/cygwin/usr/local/bin/cygngspice-1.dll";
-#elif  defined(__MINGW32__) || defined(_MSC_VER)
-    SetCurrentDirectory(exepath);
-    if (GetFileAttributes("ngspice.dll") == INVALID_FILE_ATTRIBUTES)
-        fprintf(stderr, "File ngspice.dll not found");
-    else {
-        CopyFile("ngspice.dll", "ngspice1.dll", false);
-        CopyFile("ngspice.dll", "ngspice2.dll", false);
-        CopyFile("ngspice.dll", "ngspice3.dll", false);
-    }
-
-    printf("Load ngspice1.dll\n");
-    loadstring1 = "ngspice1.dll";
-#else
-    /*copying t.b.d.*/
-    loadstring1 = "libngspice1.so";
-#endif
-
-    dlerror();
-
-    ngdllhandle1 = dlopen(loadstring1, RTLD_NOW);
-
-    errmsg = dlerror();
-    if (errmsg)
-        printf("%s\n", errmsg);
-    if (ngdllhandle1) {
-        printf("%s loaded\n", loadstring1);
-        numthreads++;
-    } else {
-        fprintf(stderr, "%s not loaded !\n", loadstring1);
+    if (couplingfile)
+        cpl = ngcoupling_read(couplingfile);
+    else
+        cpl = ngcoupling_chain(npartitions, "./examples");
+    if (!cpl)
         exit(1);
+    ngcoupling_print(cpl);
+
+    if (hubaddr || nodeaddr)
+        return netrun(cpl);
+
+    if (useworkers) {
+        /* the workers load, source and run, then write their results */
+        e = ngworkers_new(cpl->nparts, sync_mode, sync_spin);
+        if (ngengine_couple(e, cpl))
+            exit(1);
+        printf("\n**  Test no. %d: %d worker processes, run synchronized **\n\n", 2,
+               e->nparts);
+        ret = run_engine(e);
+        ngengine_print_stats(e);
+        ngengine_free(e);
+        printf("\n****** End of simulation ******\n");
+        return ret;
     }
 
-    printf("Load ngspice2.dll\n");
-#ifdef __CYGWIN__
-    loadstring2 = "/cygdrive/c/cygwin/usr/local/bin/cygngspice-2.dll";
-#elif  defined(__MINGW32__) || defined(_MSC_VER)
-    loadstring2 = "ngspice2.dll";
-#else
-    loadstring2 = "libngspice2.so";
-#endif
+    e = ngengine_new(cpl->nparts, sync_mode, sync_spin);
+    if (ngengine_couple(e, cpl) || ngengine_load(e))
+        exit(1);
 
-    ngdllhandle2 = dlopen(loadstring2, RTLD_NOW);
+    /* initialze the callbacks and the library identifiers */
+    ngengine_init(e, NGENGINE_SYNC);
 
-    errmsg = dlerror();
-    if (errmsg)
-        printf("%s\n", errmsg);
-    if (ngdllhandle2) {
-        printf("%s loaded\n", loadstring2);
-        numthreads++;
-    } else {
-        fprintf(stderr, "%s not loaded !\n", loadstring2);
-        exit(1);
-    }
+    printf("\n**  Test no. %d: Load %d netlists, run synchronized **\n\n", 2, e->nparts);
 
-    printf("Load ngspice3.dll\n");
-#ifdef __CYGWIN__
-    loadstring3 = "/cygdrive/c/cygwin/usr/local/bin/cygngspice-3.dll";
-#elif  defined(__MINGW32__) || defined(_MSC_VER)
-    loadstring3 = "ngspice3.dll";
-#else
-    loadstring3 = "libngspice3.so";
-#endif
+    ngengine_source(e);
 
-    ngdllhandle3 = dlopen(loadstring3, RTLD_NOW);
+    /* run and wait until simulation finishes */
+    ret = run_engine(e);
+    if (sync_mode == SYNC_WR)
+        ngengine_print_wr(e);
+    else
+        ngengine_print_stats(e);
 
-    errmsg = dlerror();
-    if (errmsg)
-        printf("%s\n", errmsg);
-    if (ngdllhandle3) {
-        printf("%s loaded\n", loadstring3);
-        numthreads++;
-    } else {
-        fprintf(stderr, "%s not loaded !\n", loadstring3);
-        exit(1);
+    /* with --capture, the results are on disk already */
+    for (i = 0; i < e->nparts && !e->capture; i++) {
+        sprintf(cmd, "write nsynctest%d.raw all", e->parts[i].ident);
+        ngpart_command(&e->parts[i], cmd);
     }
+    ngengine_command_all(e, "rusage");
+    ngengine_command_all(e, "rusage trantime");
 
-    threadmax = numthreads;
-
-    /* retrieve handles for all exported functions */
-    ngSpice_Init_handle1 = dlsym(ngdllhandle1, "ngSpice_Init");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_Init_Sync_handle1 = dlsym(ngdllhandle1, "ngSpice_Init_Sync");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_Command_handle1 = dlsym(ngdllhandle1, "ngSpice_Command");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_CurPlot_handle1 = dlsym(ngdllhandle1, "ngSpice_CurPlot");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_AllVecs_handle1 = dlsym(ngdllhandle1, "ngSpice_AllVecs");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_GVI_handle1 = dlsym(ngdllhandle1, "ngGet_Vec_Info");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-
-    ngSpice_Init_handle2 = dlsym(ngdllhandle2, "ngSpice_Init");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_Init_Sync_handle2 = dlsym(ngdllhandle2, "ngSpice_Init_Sync");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_Command_handle2 = dlsym(ngdllhandle2, "ngSpice_Command");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_CurPlot_handle2 = dlsym(ngdllhandle2, "ngSpice_CurPlot");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_AllVecs_handle2 = dlsym(ngdllhandle2, "ngSpice_AllVecs");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_GVI_handle2 = dlsym(ngdllhandle2, "ngGet_Vec_Info");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-
-    ngSpice_Init_handle3 = dlsym(ngdllhandle3, "ngSpice_Init");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_Init_Sync_handle3 = dlsym(ngdllhandle3, "ngSpice_Init_Sync");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_Command_handle3 = dlsym(ngdllhandle3, "ngSpice_Command");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_CurPlot_handle3 = dlsym(ngdllhandle3, "ngSpice_CurPlot");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_AllVecs_handle3 = dlsym(ngdllhandle3, "ngSpice_AllVecs");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-    ngSpice_GVI_handle3 = dlsym(ngdllhandle3, "ngGet_Vec_Info");
-    errmsg = dlerror();
-    if (errmsg)
-        printf(errmsg);
-
-    /* initialize all shared libraries */
-    ret = ((int * (*)(SendChar*, SendStat*, ControlledExit*, SendData*, SendInitData*,
-                      BGThreadRunning*, void*)) ngSpice_Init_handle1)(ng_getchar, ng_getstat,
-                              ng_exit, ng_data, ng_initdata, ng_thread_runs, NULL);
-
-    ret = ((int * (*)(SendChar*, SendStat*, ControlledExit*, SendData*, SendInitData*,
-                      BGThreadRunning*, void*)) ngSpice_Init_handle2)(ng_getchar, ng_getstat,
-                              ng_exit, ng_data, ng_initdata, ng_thread_runs, NULL);
-
-    ret = ((int * (*)(SendChar*, SendStat*, ControlledExit*, SendData*, SendInitData*,
-                      BGThreadRunning*, void*)) ngSpice_Init_handle3)(ng_getchar, ng_getstat,
-                              ng_exit, ng_data, ng_initdata, ng_thread_runs, NULL);
-
-    /* initialze the sync callbacks and the library identifiers */
-    ret = ((int * (*)(GetVSRCData*, GetISRCData*, GetSyncData*, int*,
-                      void*)) ngSpice_Init_Sync_handle1)(ng_VSRCData, ng_ISRCData, ng_SyncData, &dll1, NULL);
-
-    ret = ((int * (*)(GetVSRCData*, GetISRCData*, GetSyncData*, int*,
-                      void*)) ngSpice_Init_Sync_handle2)(ng_VSRCData, ng_ISRCData, ng_SyncData, &dll2, NULL);
-
-    ret = ((int * (*)(GetVSRCData*, GetISRCData*, GetSyncData*, int*,
-                      void*)) ngSpice_Init_Sync_handle3)(ng_VSRCData, ng_ISRCData, ng_SyncData, &dll3, NULL);
-
-
-    testnumber = 2;
-    printf("\n**  Test no. %d: Load three netlists, run synchronized **\n\n", testnumber);
-
-    ret = ((int * (*)(char*)) ngSpice_Command_handle1)("source ./examples/inv_oc1.cir");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle2)("source ./examples/inv_oc2.cir");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle3)("source ./examples/inv_oc3.cir");
-
-
-    ret = ((int * (*)(char*)) ngSpice_Command_handle1)("bg_run");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle2)("bg_run");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle3)("bg_run");
-
-    i = 0;
-    /* wait until simulation finishes */
-    for (;;) {
-#if defined(__MINGW32__) || defined(_MSC_VER)
-        Sleep (100);
-#else
-        usleep (100000);
-#endif
-        if (no_bg)
+    ngengine_free(e);
+    printf("\n****** End of simulation ******\n");
+    return ret;
+}
+
+/* Throughput of test 2 versus the number of partitions */
+static int
+scale(int nmax)
+{
+    double wall[32], pps[32];
+    uint64_t steps[32], points[32];
+    int nn[32], runs = 0, n, i;
+
+    for (n = 1; runs < 32; n = (n < nmax && 2 * n > nmax) ? nmax : 2 * n) {
+        ngengine_t *e = ngengine_new(n, sync_mode, sync_spin);
+        if (ngengine_couple(e, ngcoupling_chain(n, "./examples")) || ngengine_load(e))
+            exit(1);
+        ngengine_init(e, NGENGINE_SYNC);
+        ngengine_source(e);
+        run_engine(e);
+
+        nn[runs] = n;
+        wall[runs] = e->wall_ns / 1e9;
+        steps[runs] = ngengine_steps(e);
+        points[runs] = ngengine_points(e);
+        pps[runs] = wall[runs] > 0 ? points[runs] / wall[runs] : 0;
+        runs++;
+        ngengine_free(e);
+        if (n >= nmax)
             break;
-        /* handle out-of-sync */
-        if ((numthreads < 3) && (numthreads > 1)) {
-            if (i == 0)
-                fprintf(stderr, "\nWarning: if not during final step,\n   check for out-of-sync!\n\n");
-            ok1 = ok2 = true;
-            i++;
-            if (i > 100) {
-                fprintf(stderr, "\nWarning: premature end due to out-of-sync!\n\n");
-                break;
-            }
-        }
     }
 
-    ret = ((int * (*)(char*)) ngSpice_Command_handle1)("write nsynctest1.raw all");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle2)("write nsynctest2.raw all");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle3)("write nsynctest3.raw all");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle1)("rusage");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle2)("rusage");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle3)("rusage");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle1)("rusage trantime");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle2)("rusage trantime");
-    ret = ((int * (*)(char*)) ngSpice_Command_handle3)("rusage trantime");
-
-    dlclose(ngdllhandle1);
-    dlclose(ngdllhandle2);
-    dlclose(ngdllhandle3);
-    mutex_delete(&rt_cs);
-    mutex_delete(&sy_cs1);
-    mutex_delete(&sy_cs2);
-    mutex_delete(&sy_cs3);
-    printf("\n****** End of simulation ******\n");
+    printf("\n** Scaling of the partitioned inverter chain (%s) **\n",
+           sync_mode == SYNC_LEGACY ? "legacy" : sync_mode == SYNC_WR ? "waveform relaxation" :
+           sync_mode == SYNC_MULTIRATE ? "multirate" :
+           sync_mode == SYNC_OPTIMISTIC ? "optimistic" : "barrier");
+    printf("%10s %10s %10s %12s %14s %10s\n", "partitions", "wall [s]", "steps", "points",
+           "points/s", "speedup");
+    for (i = 0; i < runs; i++)
+        printf("%10d %10.3f %10llu %12llu %14.0f %10.2f\n", nn[i], wall[i],
+               (unsigned long long)steps[i], (unsigned long long)points[i], pps[i],
+               pps[0] > 0 ? pps[i] / pps[0] : 0);
     return 0;
 }
 
-
-/* Callback function called from bg thread in ngspice to transfer
-   any string created by printf or puts. Output to stdout in ngspice is
-   preceded by token stdout, same with stderr.*/
-int
-ng_getchar(char* outputreturn, int ident, void* userdata)
+/* test 2 results of a worker, written before it ends */
+static void
+write_results(ngpart_t *p)
 {
-    printf("lib %d: %s\n", ident, outputreturn);
-    return 0;
+    char cmd[64];
+
+    if (!p->engine->capture) {
+        sprintf(cmd, "write nsynctest%d.raw all", p->ident);
+        ngpart_command(p, cmd);
+    }
+    ngpart_command(p, "rusage");
+    ngpart_command(p, "rusage trantime");
 }
 
-/* Callback function called from bg thread in ngspice to transfer
-   simulation status (type and progress in percent. */
-int
-ng_getstat(char* outputreturn, int ident, void* userdata)
+/* Parameter sweep or Monte Carlo run of a sweep description */
+static int
+sweep(const char *file)
 {
-    printf("lib %d: %s\n", ident, outputreturn);
-    return 0;
+    ngsweep_t *s = ngsweep_read(file);
+    int ret;
+
+    if (!s)
+        return 1;
+    ret = ngsweep_run(s, sweepthreads > 0 ? sweepthreads : ng_ncpus());
+    if (ret >= 0) {
+        ngsweep_print(s);
+        if (sweepout && ngsweep_write(s, sweepout))
+            ret = 1;
+    }
+    ngsweep_free(s);
+    return ret != 0;
 }
 
-
-/* Callback function called from bg thread in ngspice if fcn controlled_exit()
-   is hit. Do not exit, but unload ngspice. */
-int
-ng_exit(int exitstatus, bool immediate, bool quitexit, int ident, void* userdata)
+/* Test 2 distributed: the hub, a node, or with --net both */
+static int
+netrun(ngcoupling_t *cpl)
 {
+    ngnethub_t *hub = NULL;
+    ngengine_t *e;
+    int i, ret = 0;
 
-    if(quitexit) {
-        printf("DNote: Returned quit from library %d with exit status %d\n", ident, exitstatus);
+    if (sync_mode != SYNC_BARRIER) {
+        fprintf(stderr, "Error: a distributed run is synchronized by barrier only\n");
+        return 1;
+    }
+    if (hubaddr) {
+        hub = ngnet_listen(hubaddr);
+        if (!hub)
+            return 1;
     }
-    if(immediate) {
-        printf("DNote: Unload ngspice%d\n", ident);
-        if (ident == 1) {
-            dlclose(ngdllhandle1);
-        }  else if (ident == 2) {
-            dlclose(ngdllhandle2);
-        }  else if (ident == 3) {
-            dlclose(ngdllhandle3);
+#if !defined(__MINGW32__) && !defined(_MSC_VER)
+    /* a node process per partition on this machine */
+    for (i = 0; loopback && i < cpl->nparts; i++) {
+        pid_t pid;
+        fflush(stdout);
+        pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0) {
+            ngnet_hub_drop(hub);
+            hub = NULL;
+            hubaddr = NULL;
+            nodepart = i + 1;
+            break;
         }
     }
+#endif
 
-    else {
-        printf("DNote: Prepare unloading ngspice%d\n", ident);
-        will_unload = true;
+    if (hubaddr) {
+        ret = ngnet_serve(hub, cpl) ? 1 : 0;
+        ngnet_hub_free(hub);
+        ngcoupling_free(cpl);
+#if !defined(__MINGW32__) && !defined(_MSC_VER)
+        while (loopback && wait(&i) > 0)
+            if (!WIFEXITED(i) || WEXITSTATUS(i) != 0)
+                ret = 1;
+#endif
+        printf("\n****** End of simulation ******\n");
+        return ret;
     }
 
-    return exitstatus;
+    if (nodepart < 1 || nodepart > cpl->nparts) {
+        fprintf(stderr, "Error: --part must be 1 ... %d\n", cpl->nparts);
+        return 1;
+    }
+    e = ngengine_new(cpl->nparts, sync_mode, sync_spin);
+    if (ngengine_couple(e, cpl))
+        return 1;
+    if (predictor)
+        e->pred = predictor;
+    ret = ngnet_node(e, nodepart - 1, nodeaddr);
+    if (e->net) {
+        ngnet_print(e);
+        write_results(&e->parts[nodepart - 1]);
+    }
+    ngengine_free(e);
+    return ret;
+}
 
+/* lockstep run, or waveform relaxation */
+static int
+run_engine(ngengine_t *e)
+{
+    if (sync_mode == SYNC_WR)
+        return ngengine_wr(e, &wropts);
+    e->mr_interval = mr_interval;
+    e->mr_interp = mr_interp;
+    e->opt_tol = opt_tol;
+    if (predictor)
+        e->pred = predictor;
+    if (e->workers)
+        return ngworkers_run(e, write_results) ? 1 : 0;
+    ngengine_run(e);
+    return ngengine_wait(e);
 }
 
-/* Callback function called from bg thread in ngspice once per accepted data point 
-   Set voltage data to in2out1 for transfer from 1 to 2 
-   and to in3out2 for transfer from 2 to 3 */
-int
-ng_data(pvecvaluesall vdata, int numvecs, int ident, void* userdata)
+/* Accuracy and speed of all schemes against the monolithic reference */
+static int
+bench(void)
 {
-    if (ident == 1)
-        in2out1 = vdata->vecsa[vecgetnumber1]->creal;
-    if (ident == 2)
-        in3out2 = vdata->vecsa[vecgetnumber2]->creal;
+    ngbench_opts o;
+
+    o.reference = reference;
+    o.couplingfile = couplingfile;
+    o.nparts = npartitions;
+    o.spin = sync_spin;
+    o.mr_interval = mr_interval;
+    o.opt_tol = opt_tol;
+    o.wr = wropts;
+    return ngbench_run(&o);
+}
 
-    return 0;
+/* Speedup of a generated circuit against its monolithic run */
+static int
+genbench(void)
+{
+    ngbench_opts o;
+
+    memset(&o, 0, sizeof(o));
+    o.spin = sync_spin;
+    o.mr_interval = mr_interval;
+    o.opt_tol = opt_tol;
+    o.wr = wropts;
+    o.gen = gen;
+    o.gen_size = gensize;
+    o.maxparts = npartitions;
+    o.gen_dir = gendir;
+    o.out = genout;
+    o.sync_mode = sync_mode;
+    o.pred = predictor;
+    o.mr_interp = mr_interp;
+    return ngbench_suite(&o);
+}
+
+/* Partition a flat netlist, write the partitions and their coupling */
+static int
+split(const char *file)
+{
+    ngnetlist_t *nl = ngnetlist_read(file);
+    ngsplit_t *s;
+    int ret;
+
+    if (!nl)
+        return 1;
+    s = ngsplit_new(nl, npartitions, splitcurrent);
+    if (!s) {
+        ngnetlist_free(nl);
+        return 1;
+    }
+    ngsplit_print(nl, s);
+    ret = ngsplit_write(nl, s, file, splitcpl, sizeof(splitcpl));
+    if (!ret)
+        printf("coupling written to %s\n", splitcpl);
+    ngsplit_free(s);
+    ngnetlist_free(nl);
+    return ret;
 }
 
+typedef struct loadres {
+    bool ok;
+    double load_ms, init_ms, rss_mb;
+} loadres_t;
 
-/* Callback function called from bg thread in ngspice once upon intialization
-   of the simulation vectors)*/
-int
-ng_initdata(pvecinfoall intdata, int ident, void* userdata)
+/* load and initialize n instances, the engine is returned for cleanup */
+static ngengine_t *
+load_measure(int method, int n, loadres_t *r)
 {
-    int i;
-    int vn;
-    if (ident == 1) {
-        vn = intdata->veccount;
-        for (i = 0; i < vn; i++) {
-            printf("Vector: %s\n", intdata->vecs[i]->vecname);
-            /* find the location of V(out) */
-            if (cieq(intdata->vecs[i]->vecname, "out1"))
-                vecgetnumber1 = i;
-        }
-    } else if  (ident == 2) {
-        vn = intdata->veccount;
-        for (i = 0; i < vn; i++) {
-            printf("Vector: %s\n", intdata->vecs[i]->vecname);
-            /* find the location of V(out) */
-            if (cieq(intdata->vecs[i]->vecname, "out2"))
-                vecgetnumber2 = i;
-        }
+    uint64_t rss0 = ngload_rss(), t0;
+    ngengine_t *e;
+
+    memset(r, 0, sizeof(*r));
+    ngengine_set_loader(method, libbase);
+    e = ngengine_new(n, SYNC_BARRIER, sync_spin);
+    if (!e || ngengine_load(e))
+        return e;
+    t0 = ng_now_ns();
+    ngengine_init(e, 0);
+    r->init_ms = (ng_now_ns() - t0) / 1e6;
+    r->load_ms = e->load_ns / 1e6;
+    r->rss_mb = (double)(ngload_rss() - rss0) / 1048576.0;
+    r->ok = true;
+    return e;
+}
+
+/* Call fn(mode, arg, res) in a fresh process, for its own peak memory
+   and without the libraries loaded before, and read back the size bytes
+   of res it has filled in. On MS Windows fn is called here. Returns 0 on
+   success. */
+typedef void (measure_fn)(int mode, void *arg, void *res);
+
+static int
+measure_forked(measure_fn *fn, int mode, void *arg, void *res, size_t size)
+{
+#if !defined(__MINGW32__) && !defined(_MSC_VER)
+    int fd[2], ret = 0;
+    pid_t pid;
+
+    if (pipe(fd))
+        return 1;
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0) {
+        close(fd[0]);
+        fn(mode, arg, res);
+        fflush(stdout);
+        if (write(fd[1], res, size) != (ssize_t)size)
+            _exit(1);
+        _exit(0);
     }
+    close(fd[1]);
+    if (pid < 0 || read(fd[0], res, size) != (ssize_t)size)
+        ret = 1;
+    close(fd[0]);
+    if (pid > 0)
+        waitpid(pid, NULL, 0);
+    return ret;
+#else
+    (void)size;
+    fn(mode, arg, res);
     return 0;
+#endif
 }
 
-/* Set the input voltages for the external voltage sources for
-   transfer from 1 --> 2 and 2 --> 3. */
-int ng_VSRCData(double* retvoltval, double acttime, char* nodename, int ident, void* userdata)
+static void
+load_child(int method, void *arg, void *res)
 {
-    if (ident == 3)
-        *retvoltval = in3out2;
-    else if (ident == 2)
-        *retvoltval = in2out1;
+    ngengine_free(load_measure(method, *(int *)arg, (loadres_t *)res));
+}
+
+/* Startup time and memory of n instances by every loader, each one
+   measured in a fresh process */
+static int
+loadbench(int n)
+{
+    loadres_t res[NGLOAD_DLMOPEN + 1];
+    int m;
 
+    for (m = NGLOAD_COPY; m <= NGLOAD_DLMOPEN; m++) {
+        printf("\n** Loading %d instances by %s **\n", n, ngload_name(m));
+        res[m].ok = false;
+#if defined(__MINGW32__) || defined(_MSC_VER)
+        if (m != NGLOAD_COPY)
+            continue;
+#endif
+        if (measure_forked(load_child, m, &n, &res[m], sizeof(res[m])))
+            res[m].ok = false;
+    }
+
+    printf("\n** Startup of %d instances **\n", n);
+    printf("%-10s %10s %10s %12s %14s\n", "loader", "load [ms]", "init [ms]", "memory [MB]",
+           "per inst. [MB]");
+    for (m = NGLOAD_COPY; m <= NGLOAD_DLMOPEN; m++) {
+        if (res[m].ok)
+            printf("%-10s %10.1f %10.1f %12.1f %14.2f\n", ngload_name(m), res[m].load_ms,
+                   res[m].init_ms, res[m].rss_mb, res[m].rss_mb / n);
+        else
+            printf("%-10s %10s\n", ngload_name(m), "failed");
+    }
     return 0;
 }
 
-/* Transfer data with currents not used */
-int ng_ISRCData(double* retcurrval, double acttime, char* nodename, int ident, void* userdata)
+typedef struct jobctx {
+    ngpool_t *pool;
+    mutexType cs;
+    int next, total, failed;
+    uint64_t startup_ns, max_startup_ns, run_ns, points;
+} jobctx_t;
+
+/* one run of test 2, loaded or leased */
+static int
+run_job(jobctx_t *c)
 {
+    ngcoupling_t *cpl = couplingfile ? ngcoupling_read(couplingfile)
+                                     : ngcoupling_chain(npartitions, "./examples");
+    ngengine_t *e;
+    uint64_t t0, startup;
+
+    if (!cpl)
+        return 1;
+    e = ngengine_new(cpl->nparts, sync_mode, sync_spin);
+    if (ngengine_couple(e, cpl)) {
+        ngengine_free(e);
+        return 1;
+    }
+    t0 = ng_now_ns();
+    if (c->pool ? ngengine_lease(e, c->pool) : ngengine_load(e)) {
+        ngengine_free(e);
+        return 1;
+    }
+    ngengine_init(e, NGENGINE_SYNC);
+    startup = ng_now_ns() - t0;
+    ngengine_source(e);
+    run_engine(e);
+
+    mutex_lock(&c->cs);
+    c->startup_ns += startup;
+    if (startup > c->max_startup_ns)
+        c->max_startup_ns = startup;
+    c->run_ns += e->wall_ns;
+    c->points += ngengine_points(e);
+    mutex_unlock(&c->cs);
+    ngengine_free(e);
     return 0;
 }
 
-#define MIN(a,b) ((a) < (b) ? (a) : (b))
-#define MAX(a,b) ((a) > (b) ? (a) : (b))
-#define FABS(a) ((a) > 0 ? (a) : (-a))
+static void *
+job_worker(void *arg)
+{
+    jobctx_t *c = (jobctx_t *)arg;
 
-int threadcount1 = 0, threadcount2 = 0;
-static double newdelta3[3];
-static double delt3[3];
-static double act3[3];
-static int redos3[3];
-static int loca3[3];
+    for (;;) {
+        int failed;
+        mutex_lock(&c->cs);
+        if (c->next == c->total) {
+            mutex_unlock(&c->cs);
+            return NULL;
+        }
+        c->next++;
+        mutex_unlock(&c->cs);
+        failed = run_job(c);
+        mutex_lock(&c->cs);
+        c->failed += failed;
+        mutex_unlock(&c->cs);
+    }
+}
 
-int ng_SyncData(double acttime, double* deltatime, double olddeltatime,
-                int redostep, int ident, int location, void* userdata)
+/* k runs of test 2, from jobthreads threads */
+static int
+jobs(int k)
 {
-    static int retval;
-    bool local_ok = false;
-    int ii, last_ident;
-    int iindex;
-
-    mutex_lock(&sy_cs1);
-    iindex = ident - 1;
-    threadcount1++;
-    /* collect data from all threads */
-    delt3[iindex] = *deltatime;
-    redos3[iindex] = redostep;
-    act3[iindex] = acttime;
-    loca3[iindex] = 1;
-
-	if (numthreads == 1) {
-        newdelta3[iindex] = delt3[iindex];
-		retval = redostep;
-		ok1 = ok2 = true;
-	}
-	else if (threadcount1 == numthreads) {
-        /* Simple synchronization: Find the minimum delta time
-        for the next time step derived from all threads' deltas and
-        impose it on all threads. 
-          This is done by the final thread in a time point
-        - calculate newdelta as the minum of all deltatime
-        - If one redostep is TRUE, return TRUE
-        - Set ok to TRUE to release the waiting threads
-        - Go directly behind the waiting zone to flag nowait */
-        double dmin = 1e30;
-        retval = 0;
-        for (ii = 0; ii < numthreads; ii++) {
-            dmin = MIN(delt3[ii], dmin);
-            retval = MAX(redos3[ii], retval);
-        }
-        for (ii = 0; ii < numthreads; ii++) {
-            newdelta3[ii] = dmin;
-        }
-//		printf("%g   %g   %g\n", act3[0], act3[1], act3[2]);
-        last_ident = ident;
-        ok1 = true;
-    }
-	else if  (threadcount1 > threadmax) {
-		fprintf(stderr, "Strange out-of-sync\n\n");
-	}
-    mutex_unlock(&sy_cs1);
-
-    /* collect all threads here and wait */
-    while ((!ok1) && (numthreads > 1)) {
-#if defined(__MINGW32__) || defined(_MSC_VER)
-        Sleep (0);
-#else
-        usleep (0);
-#endif
+    threadId_t tids[64];
+    jobctx_t c;
+    uint64_t t0;
+    int i, nthreads = jobthreads < 1 ? 1 : jobthreads > 64 ? 64 : jobthreads;
+
+    memset(&c, 0, sizeof(c));
+    mutex_init(&c.cs);
+    c.total = k;
+    if (poolsize > 0) {
+        c.pool = ngpool_new(poolsize);
+        if (!c.pool)
+            return 1;
+    }
+    else if (nthreads > 1 && loader == NGLOAD_COPY) {
+        /* concurrent jobs would open the same copies */
+        printf("Jobs without --pool run one after the other with --loader copy\n");
+        nthreads = 1;
     }
 
-    mutex_lock(&sy_cs3);
-    threadcount1--;
-    if (threadcount1 == 0)
-        ok1 = false;
-    threadcount2++;
-    if ((threadcount2 == threadmax) && (ok1 == false)) {
-        ok2 = true;
-	}
-    *deltatime = newdelta3[iindex];
-    mutex_unlock(&sy_cs3);
+    t0 = ng_now_ns();
+    for (i = 0; i < nthreads; i++)
+        if (ng_thread_start(&tids[i], job_worker, &c))
+            break;
+    nthreads = i;
+    for (i = 0; i < nthreads; i++)
+        ng_thread_join(tids[i]);
+
+    printf("\n** %d jobs, %d threads, instances %s **\n", k, nthreads,
+           c.pool ? "leased from the pool" : "loaded per job");
+    printf("failed jobs:         %d\n", c.failed);
+    if (k > c.failed) {
+        int done = k - c.failed;
+        printf("mean startup:        %.3f ms\n", c.startup_ns / 1e6 / done);
+        printf("max startup:         %.3f ms\n", c.max_startup_ns / 1e6);
+        printf("mean run:            %.3f ms\n", c.run_ns / 1e6 / done);
+        printf("points:              %llu\n", (unsigned long long)c.points);
+    }
+    printf("wall time:           %.3f s\n", (ng_now_ns() - t0) / 1e9);
+    if (c.pool) {
+        ngpool_print(c.pool);
+        ngpool_free(c.pool);
+    }
+    mutex_delete(&c.cs);
+    return c.failed > 0;
+}
 
-    /* collect all threads here and wait */
-    while ((!ok2) && (numthreads > 1)) {
-#if defined(__MINGW32__) || defined(_MSC_VER)
-        Sleep (0);
-#else
-        usleep (0);
-#endif
+/* Synchronization overhead per step, threads against worker processes */
+static int
+workerbench(void)
+{
+    double wall[2], us[2];
+    uint64_t steps[2], points[2];
+    int m;
+
+    for (m = 0; m < 2; m++) {
+        ngcoupling_t *cpl = couplingfile ? ngcoupling_read(couplingfile)
+                                         : ngcoupling_chain(npartitions, "./examples");
+        ngengine_t *e;
+
+        if (!cpl)
+            return 1;
+        printf("\n** Run with %s **\n", m ? "worker processes" : "threads");
+        e = m ? ngworkers_new(cpl->nparts, sync_mode, sync_spin)
+              : ngengine_new(cpl->nparts, sync_mode, sync_spin);
+        if (ngengine_couple(e, cpl))
+            return 1;
+        if (!m) {
+            if (ngengine_load(e))
+                return 1;
+            ngengine_init(e, NGENGINE_SYNC);
+            ngengine_source(e);
+            run_engine(e);
+        }
+        else {
+            ngworkers_run(e, NULL);
+        }
+        wall[m] = e->wall_ns / 1e9;
+        steps[m] = ngengine_steps(e);
+        points[m] = ngengine_points(e);
+        us[m] = steps[m] ? e->wall_ns / 1e3 / steps[m] : 0;
+        ngengine_free(e);
     }
 
-    mutex_lock(&sy_cs2);
-    threadcount2--;
-    if (threadcount2 == 0)
-        ok2 = false;
-    mutex_unlock(&sy_cs2);
+    printf("\n** Threads versus worker processes, %d partitions **\n", npartitions);
+    printf("%-10s %10s %10s %12s %12s\n", "mode", "wall [s]", "steps", "points", "us/step");
+    for (m = 0; m < 2; m++)
+        printf("%-10s %10.3f %10llu %12llu %12.2f\n", m ? "processes" : "threads", wall[m],
+               (unsigned long long)steps[m], (unsigned long long)points[m], us[m]);
+    return 0;
+}
 
-    return retval;
+/* time of loading the netlist into k instances, rounds times */
+static double
+circ_load_ms(ngengine_t *e, int k, const char *file, int rounds, bool flush)
+{
+    uint64_t ns = 0, t0;
+    int r, i;
+
+    for (r = 0; r < rounds; r++) {
+        if (flush)
+            ngcirc_flush();
+        t0 = ng_now_ns();
+        for (i = 0; i < k; i++)
+            ngpart_source(&e->parts[i], file);
+        ns += ng_now_ns() - t0;
+        for (i = 0; i < k; i++)
+            ngpart_command(&e->parts[i], "remcirc");
+    }
+    return ns / 1e6 / rounds;
 }
 
-static bool* norunsall;
-/* Callback function called from ngspice upon starting (returns false) or
-  leaving (returns true) the bg thread. */
-int
-ng_thread_runs(bool noruns, int ident, void* userdata)
+/* Netlist loading by "source" against the cache, for 1, 2, 4, ... n
+   instances; cold reads the files once per round, warm not at all */
+static int
+circbench(int n)
 {
-    int ii;
-    bool iruns = true;
-    int iindex = ident - 1;
-    if (!norunsall)
-        norunsall = (bool*)malloc(threadmax*sizeof(bool));
-
-    mutex_lock(&rt_cs);
-    norunsall[iindex] = noruns;
-    if (noruns) {
-        numthreads--;
-        ok1 = (threadcount1 == numthreads);
-    }
-
-    for (ii = 0; ii < threadmax; ii++)
-        iruns = iruns & norunsall[ii];
-    no_bg = iruns;
-    mutex_unlock(&rt_cs);
-
-    if (noruns)
-        printf("lib %d: bg not running\n", ident);
-    else
-        printf("lib %d: bg running\n", ident);
+    const char *file = "./examples/inv_oc1.cir";
+    const int rounds = 10;
+    const ngcirc_t *c;
+    ngengine_t *e = ngengine_new(n, SYNC_BARRIER, sync_spin);
+    int k;
+
+    if (!e)
+        return 1;
+    e->quiet = true;
+    if (ngengine_load(e)) {
+        ngengine_free(e);
+        return 1;
+    }
+    ngengine_init(e, 0);
+    if (!e->parts[0].api.ngSpice_Circ) {
+        fprintf(stderr, "Error: %s has no ngSpice_Circ\n", e->parts[0].libname);
+        ngengine_free(e);
+        return 1;
+    }
+    c = ngcirc_get(file);
+    if (!c) {
+        ngengine_free(e);
+        return 1;
+    }
+    printf("\n** Loading %s: %d lines, %d files, %zu bytes, read in %.3f ms **\n", file, c->nlines,
+           c->files, c->bytes, c->read_ns / 1e6);
+    printf("%-10s %12s %12s %12s %10s\n", "instances", "source [ms]", "cold [ms]", "warm [ms]",
+           "speedup");
+    for (k = 1; k <= n; k = k < n && 2 * k > n ? n : 2 * k) {
+        double src, cold, warm;
+
+        ngengine_set_circ_cache(false);
+        src = circ_load_ms(e, k, file, rounds, false);
+        ngengine_set_circ_cache(true);
+        cold = circ_load_ms(e, k, file, rounds, true);
+        warm = circ_load_ms(e, k, file, rounds, false);
+        printf("%-10d %12.3f %12.3f %12.3f %10.2f\n", k, src, cold, warm, warm > 0 ? src / warm : 0);
+    }
+    ngengine_free(e);
+    return 0;
+}
 
+/* Columns, points and range of every column of a capture file */
+static int
+captureread(const char *file)
+{
+    ngcapture_reader_t *r = ngcapture_read(file);
+    double *v;
+    uint64_t k;
+    int col;
+
+    if (!r)
+        return 1;
+    printf("\n** %s: %d columns, %llu points%s **\n", file, r->ncols,
+           (unsigned long long)r->npoints, r->hdr->complete ? "" : ", incomplete");
+    printf("%-24s %14s %14s %14s %14s\n", "vector", "first", "last", "min", "max");
+    v = (double *)malloc((size_t)(r->npoints ? r->npoints : 1) * sizeof(double));
+    for (col = 0; col < r->ncols && r->npoints > 0; col++) {
+        double lo, hi;
+        ngcapture_values(r, col, 0, r->npoints, v);
+        lo = hi = v[0];
+        for (k = 1; k < r->npoints; k++) {
+            if (v[k] < lo)
+                lo = v[k];
+            if (v[k] > hi)
+                hi = v[k];
+        }
+        printf("%-24s %14.6g %14.6g %14.6g %14.6g\n", ngcapture_name(r, col), v[0],
+               v[r->npoints - 1], lo, hi);
+    }
+    free(v);
+    ngcapture_reader_free(r);
     return 0;
 }
 
+typedef struct captureres {
+    bool ok;
+    double run_s, write_s, rss_mb, data_us;
+    uint64_t points;
+} captureres_t;
 
+/* test 2 with the rawfile written after the run (mode 0), with the
+   capture (1), or with the capture handed off (2) */
+static void
+capture_measure(int mode, captureres_t *r)
+{
+    bool stream = mode > 0;
+    ngcoupling_t *cpl = couplingfile ? ngcoupling_read(couplingfile)
+                                     : ngcoupling_chain(npartitions, "./examples");
+    ngengine_t *e;
+    char cmd[64];
+    uint64_t t0;
+    int i;
+
+    memset(r, 0, sizeof(*r));
+    if (!cpl)
+        return;
+    ngengine_set_capture(stream ? (capturevecs ? capturevecs : "all") : NULL);
+    ngengine_set_handoff(mode == 2 ? (handoff >= 0 ? handoff : HANDOFF_BLOCK) : -1, handoffsize);
+    e = ngengine_new(cpl->nparts, sync_mode, sync_spin);
+    if (ngengine_couple(e, cpl) || ngengine_load(e)) {
+        ngengine_free(e);
+        return;
+    }
+    e->quiet = true;
+    ngengine_init(e, NGENGINE_SYNC);
+    ngengine_source(e);
+    r->ok = run_engine(e) == 0;
+    r->run_s = e->wall_ns / 1e9;
+    r->points = ngengine_points(e);
+    for (i = 0; i < e->nparts; i++)
+        r->data_us += e->parts[i].data_ns / 1e3;
+    if (r->points)
+        r->data_us /= r->points;
+    t0 = ng_now_ns();
+    for (i = 0; i < e->nparts && !stream; i++) {
+        sprintf(cmd, "write nsynctest%d.raw all", e->parts[i].ident);
+        ngpart_command(&e->parts[i], cmd);
+    }
+    r->write_s = (ng_now_ns() - t0) / 1e9;
+#if !defined(__MINGW32__) && !defined(_MSC_VER)
+    {
+        struct rusage ru;
+        if (!getrusage(RUSAGE_SELF, &ru))
+            r->rss_mb = ru.ru_maxrss / 1024.0;
+    }
+#endif
+    ngengine_free(e);
+}
+
+static void
+capture_child(int mode, void *arg, void *res)
+{
+    (void)arg;
+    capture_measure(mode, (captureres_t *)res);
+}
+
+/* Test 2 writing the rawfile at the end against streaming the capture,
+   in ng_data() and handed off, each one in a fresh process for its peak
+   memory */
+static int
+capturebench(void)
+{
+    static const char *modes[] = { "rawfile", "capture", "handoff" };
+    captureres_t res[3];
+    int m;
+
+    for (m = 0; m < 3; m++) {
+        printf("\n** Test 2 with %s **\n", modes[m]);
+        if (measure_forked(capture_child, m, NULL, &res[m], sizeof(res[m])))
+            res[m].ok = false;
+    }
+
+    printf("\n** Results of test 2, %d partitions **\n", npartitions);
+    printf("%-10s %10s %10s %10s %12s %14s %14s\n", "output", "run [s]", "write [s]", "total [s]",
+           "points", "peak RSS [MB]", "ng_data [us]");
+    for (m = 0; m < 3; m++) {
+        if (res[m].ok)
+            printf("%-10s %10.3f %10.3f %10.3f %12llu %14.1f %14.3f\n", modes[m], res[m].run_s,
+                   res[m].write_s, res[m].run_s + res[m].write_s,
+                   (unsigned long long)res[m].points, res[m].rss_mb, res[m].data_us);
+        else
+            printf("%-10s %10s\n", modes[m], "failed");
+    }
+    return 0;
+}
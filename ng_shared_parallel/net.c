@@ -0,0 +1,542 @@
+/*
+Distributed run, see net.h: the hub consensus and the node side of
+ng_SyncData().
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "net.h"
+
+#if !defined(__MINGW32__) && !defined(_MSC_VER)
+#include <errno.h>
+#include <poll.h>
+#endif
+
+/* message types */
+#define NET_HELLO 1            /* node -> hub: net_hello */
+#define NET_STEP 2             /* node -> hub: net_step, samples of its outputs */
+#define NET_REPLY 3            /* hub -> node: net_step with the consensus, input samples */
+#define NET_LEAVE 4            /* node -> hub: net_stats, bg thread ended */
+
+/* how long a node waits for the hub to listen, ms */
+#define NET_CONNECT_MS 30000
+
+typedef struct net_hello {
+    int32_t part, nparts;
+} net_hello;
+
+typedef struct net_step {
+    double acttime, delta;
+    int32_t redo, nsamples;
+} net_step;
+
+typedef struct net_sample {
+    int32_t edge, pad;
+    double t, v;
+} net_sample;
+
+typedef struct net_stats {
+    uint64_t steps, rtt_ns, rtt_max_ns;
+    uint64_t samples_out, samples_in;
+    uint64_t bytes_sent, bytes_received;
+} net_stats;
+
+/* room for len bytes at *buf */
+static char *
+grow(char **buf, size_t *cap, size_t len)
+{
+    if (len > *cap) {
+        size_t n = *cap ? *cap : 1024;
+        while (n < len)
+            n *= 2;
+        *buf = (char *)realloc(*buf, n);
+        *cap = n;
+    }
+    return *buf;
+}
+
+int
+ngnet_node(ngengine_t *e, int part, const char *addr)
+{
+    ngpart_t *p = &e->parts[part];
+    ngnet_t *net;
+    net_hello hello;
+    int used;
+
+    if (e->sync_mode != SYNC_BARRIER) {
+        fprintf(stderr, "Error: a distributed run is synchronized by barrier only\n");
+        return 1;
+    }
+    if (!e->cpl) {
+        fprintf(stderr, "Error: a distributed run needs a coupling\n");
+        return 1;
+    }
+    if (ngpart_load(p, e->loader, &used))
+        return 1;
+    ngpart_init(p, NGENGINE_SYNC);
+
+    net = (ngnet_t *)calloc(1, sizeof(ngnet_t));
+    net->part = part;
+    net->tr = ngtransport_connect(addr, NET_CONNECT_MS);
+    hello.part = part;
+    hello.nparts = e->nparts;
+    if (!net->tr || ngtransport_send(net->tr, NET_HELLO, &hello, sizeof(hello))) {
+        ngtransport_close(net->tr);
+        free(net);
+        return 1;
+    }
+    e->net = net;
+    printf("Partition %d (%s) connected to %s\n", p->ident, p->netlist, addr);
+
+    ngpart_source(p, p->netlist);
+
+    /* as ngengine_run(), for the one partition of the node */
+    sync_prepare(e);
+    ngat_store_i(&p->state, NGPART_RUNNING);
+    p->points = 0;
+    e->numthreads = 1;
+    e->no_bg = false;
+    e->out_of_sync = false;
+    e->wall_ns = ng_now_ns();
+    e->cpu_ns = ng_cputime_ns();
+    ngpart_command(p, "bg_run");
+    if (ngengine_wait(e))
+        return 1;
+    return net->lost ? 1 : 0;
+}
+
+/* hub gone: the node goes on with the inputs it has */
+static int
+node_lost(ngnet_t *net, int redostep)
+{
+    fprintf(stderr, "Error: connection to the hub lost, partition %d runs on alone\n",
+            net->part + 1);
+    net->lost = true;
+    return redostep;
+}
+
+int
+ngnet_step(ngpart_t *p, double acttime, double *deltatime, int redostep)
+{
+    ngengine_t *e = p->engine;
+    ngnet_t *net = e->net;
+    ngedge_t *edges = e->cpl->edges;
+    net_step *st;
+    net_sample *ns;
+    ngsample_t w[64];
+    size_t len = sizeof(net_step), rlen;
+    uint64_t t0, dt;
+    int i, k, n, type;
+
+    if (net->lost)
+        return redostep;
+
+    /* all output samples since the last step, with the proposal */
+    for (i = 0; i < p->noutputs; i++) {
+        int edge = p->outputs[i].edge;
+        while ((n = ngchan_take(&edges[edge].chan, w, 64)) > 0) {
+            ns = (net_sample *)(grow(&net->msg, &net->cap, len + n * sizeof(net_sample)) + len);
+            for (k = 0; k < n; k++) {
+                ns[k].edge = edge;
+                ns[k].pad = 0;
+                ns[k].t = w[k].t;
+                ns[k].v = w[k].v;
+            }
+            len += n * sizeof(net_sample);
+        }
+    }
+    st = (net_step *)grow(&net->msg, &net->cap, len);
+    st->acttime = acttime;
+    st->delta = *deltatime;
+    st->redo = redostep;
+    st->nsamples = (int32_t)((len - sizeof(net_step)) / sizeof(net_sample));
+    net->samples_out += (uint64_t)st->nsamples;
+
+    t0 = ng_now_ns();
+    if (ngtransport_send(net->tr, NET_STEP, net->msg, len)
+        || ngtransport_recv(net->tr, &type, &rlen) || type != NET_REPLY
+        || rlen < sizeof(net_step))
+        return node_lost(net, redostep);
+    dt = ng_now_ns() - t0;
+    net->steps++;
+    net->rtt_ns += dt;
+    if (dt > net->rtt_max_ns)
+        net->rtt_max_ns = dt;
+
+    /* consensus, and the samples of the partitions driving this one */
+    st = (net_step *)net->tr->buf;
+    ns = (net_sample *)(st + 1);
+    for (k = 0; k < st->nsamples && (k + 1) * sizeof(net_sample) <= rlen - sizeof(net_step); k++)
+        if (ns[k].edge >= 0 && ns[k].edge < e->cpl->nedges
+            && edges[ns[k].edge].dst == net->part) {
+            ngchan_push(&edges[ns[k].edge].chan, ns[k].t, ns[k].v);
+            net->samples_in++;
+        }
+    *deltatime = st->delta;
+    return st->redo;
+}
+
+void
+ngnet_leave(ngpart_t *p)
+{
+    ngnet_t *net = p->engine->net;
+    net_stats s;
+
+    if (net->lost)
+        return;
+    s.steps = net->steps;
+    s.rtt_ns = net->rtt_ns;
+    s.rtt_max_ns = net->rtt_max_ns;
+    s.samples_out = net->samples_out;
+    s.samples_in = net->samples_in;
+    s.bytes_sent = net->tr->bytes_sent;
+    s.bytes_received = net->tr->bytes_received;
+    if (ngtransport_send(net->tr, NET_LEAVE, &s, sizeof(s)))
+        net->lost = true;
+}
+
+void
+ngnet_print(ngengine_t *e)
+{
+    ngnet_t *net = e->net;
+
+    printf("\n** Partition %d of a distributed run over %s **\n", net->part + 1,
+           net->tr->ops->name);
+    printf("round trips:         %llu\n", (unsigned long long)net->steps);
+    if (net->steps)
+        printf("mean round trip:     %.3f us\n", net->rtt_ns / 1e3 / net->steps);
+    printf("max round trip:      %.3f us\n", net->rtt_max_ns / 1e3);
+    printf("samples sent:        %llu, received: %llu\n",
+           (unsigned long long)net->samples_out, (unsigned long long)net->samples_in);
+    printf("bytes sent:          %llu, received: %llu\n",
+           (unsigned long long)net->tr->bytes_sent,
+           (unsigned long long)net->tr->bytes_received);
+    printf("wall time:           %.3f s\n", e->wall_ns / 1e9);
+}
+
+void
+ngnet_close(ngengine_t *e)
+{
+    ngnet_t *net = e->net;
+
+    if (!net)
+        return;
+    ngtransport_close(net->tr);
+    free(net->msg);
+    free(net);
+    e->net = NULL;
+}
+
+#if defined(__MINGW32__) || defined(_MSC_VER)
+
+ngnethub_t *
+ngnet_listen(const char *addr)
+{
+    fprintf(stderr, "Error: no hub on %s, not available on MS Windows\n", addr);
+    return NULL;
+}
+
+int
+ngnet_serve(ngnethub_t *h, ngcoupling_t *cpl)
+{
+    (void)h;
+    return cpl->nparts;
+}
+
+void
+ngnet_hub_free(ngnethub_t *h)
+{
+    (void)h;
+}
+
+void
+ngnet_hub_drop(ngnethub_t *h)
+{
+    (void)h;
+}
+
+#else
+
+/* a node as seen by the hub */
+typedef struct hubnode {
+    ngtransport_t *tr;
+    bool live, arrived, reported;
+    double delta;
+    int redo;
+    net_sample *in;            /* samples for it in the current step */
+    int nin, capin;
+    net_stats stats;
+} hubnode_t;
+
+struct ngnethub {
+    ngtransport_t *listen;
+    hubnode_t *nodes;
+    int nparts;
+    char *reply;
+    size_t cap;
+    uint64_t steps;
+    uint64_t skew_ns, skew_max_ns;  /* first to last message of a step */
+};
+
+ngnethub_t *
+ngnet_listen(const char *addr)
+{
+    ngnethub_t *h;
+    ngtransport_t *l = ngtransport_listen(addr);
+
+    if (!l)
+        return NULL;
+    h = (ngnethub_t *)calloc(1, sizeof(ngnethub_t));
+    h->listen = l;
+    return h;
+}
+
+/* node i failed, it takes no more part in the steps */
+static void
+hub_lose(ngnethub_t *h, ngcoupling_t *cpl, int i, const char *why)
+{
+    fprintf(stderr, "Hub: partition %s lost%s\n", cpl->parts[i].name, why);
+    h->nodes[i].live = false;
+    ngtransport_close(h->nodes[i].tr);
+    h->nodes[i].tr = NULL;
+}
+
+/* accept a node for every partition */
+static int
+hub_join(ngnethub_t *h, ngcoupling_t *cpl)
+{
+    int joined = 0, type;
+    size_t len;
+
+    while (joined < cpl->nparts) {
+        ngtransport_t *tr = ngtransport_accept(h->listen);
+        net_hello *hello;
+
+        if (!tr)
+            return 1;
+        if (ngtransport_recv(tr, &type, &len) || type != NET_HELLO || len != sizeof(net_hello)) {
+            fprintf(stderr, "Error: node without hello, dropped\n");
+            ngtransport_close(tr);
+            continue;
+        }
+        hello = (net_hello *)tr->buf;
+        if (hello->nparts != cpl->nparts || hello->part < 0 || hello->part >= cpl->nparts
+            || h->nodes[hello->part].tr) {
+            fprintf(stderr, "Error: node for partition %d of %d refused\n", hello->part + 1,
+                    hello->nparts);
+            ngtransport_close(tr);
+            continue;
+        }
+        h->nodes[hello->part].tr = tr;
+        h->nodes[hello->part].live = true;
+        joined++;
+        printf("Hub: partition %s joined\n", cpl->parts[hello->part].name);
+    }
+    return 0;
+}
+
+/* route the output samples of node src to the nodes they drive */
+static void
+hub_route(ngnethub_t *h, ngcoupling_t *cpl, int src, net_sample *ns, int n)
+{
+    int k;
+
+    for (k = 0; k < n; k++) {
+        hubnode_t *dst;
+        if (ns[k].edge < 0 || ns[k].edge >= cpl->nedges || cpl->edges[ns[k].edge].src != src)
+            continue;
+        dst = &h->nodes[cpl->edges[ns[k].edge].dst];
+        if (!dst->live)
+            continue;
+        if (dst->nin == dst->capin) {
+            dst->capin = dst->capin ? 2 * dst->capin : 64;
+            dst->in = (net_sample *)realloc(dst->in, (size_t)dst->capin * sizeof(net_sample));
+        }
+        dst->in[dst->nin++] = ns[k];
+    }
+}
+
+/* all nodes still running have sent their step: answer them */
+static void
+hub_consensus(ngnethub_t *h)
+{
+    double dmin = 1e30;
+    int i, retval = 0;
+
+    for (i = 0; i < h->nparts; i++)
+        if (h->nodes[i].live) {
+            if (h->nodes[i].delta < dmin)
+                dmin = h->nodes[i].delta;
+            if (h->nodes[i].redo > retval)
+                retval = h->nodes[i].redo;
+        }
+    for (i = 0; i < h->nparts; i++) {
+        hubnode_t *nd = &h->nodes[i];
+        size_t len = sizeof(net_step) + (size_t)nd->nin * sizeof(net_sample);
+        net_step *st;
+
+        if (!nd->live)
+            continue;
+        st = (net_step *)grow(&h->reply, &h->cap, len);
+        st->acttime = 0;
+        st->delta = dmin;
+        st->redo = retval;
+        st->nsamples = nd->nin;
+        memcpy(st + 1, nd->in, (size_t)nd->nin * sizeof(net_sample));
+        /* a lost node is seen at its next receive */
+        ngtransport_send(nd->tr, NET_REPLY, h->reply, len);
+        nd->nin = 0;
+        nd->arrived = false;
+    }
+    h->steps++;
+}
+
+static void
+hub_print(ngnethub_t *h, ngcoupling_t *cpl, uint64_t wall_ns)
+{
+    uint64_t sent = 0, received = 0;
+    int i;
+
+    printf("\n** Distributed run over %s, %d nodes **\n", h->listen->ops->name, h->nparts);
+    printf("time steps:          %llu\n", (unsigned long long)h->steps);
+    if (h->steps)
+        printf("mean arrival skew:   %.3f us\n", h->skew_ns / 1e3 / h->steps);
+    printf("max arrival skew:    %.3f us\n", h->skew_max_ns / 1e3);
+    for (i = 0; i < h->nparts; i++) {
+        hubnode_t *nd = &h->nodes[i];
+        if (!nd->reported) {
+            printf("  %-16s   lost\n", cpl->parts[i].name);
+            continue;
+        }
+        printf("  %-16s   %llu steps, round trip mean %.3f us, max %.3f us,"
+               " %llu samples out, %llu in\n", cpl->parts[i].name,
+               (unsigned long long)nd->stats.steps,
+               nd->stats.steps ? nd->stats.rtt_ns / 1e3 / nd->stats.steps : 0.0,
+               nd->stats.rtt_max_ns / 1e3, (unsigned long long)nd->stats.samples_out,
+               (unsigned long long)nd->stats.samples_in);
+        sent += nd->stats.bytes_sent;
+        received += nd->stats.bytes_received;
+    }
+    printf("bytes from nodes:    %llu, to nodes: %llu\n", (unsigned long long)sent,
+           (unsigned long long)received);
+    printf("wall time:           %.3f s\n", wall_ns / 1e9);
+}
+
+int
+ngnet_serve(ngnethub_t *h, ngcoupling_t *cpl)
+{
+    struct pollfd fds[NGENGINE_MAXPARTS];
+    int idx[NGENGINE_MAXPARTS];
+    int i, live, lost = 0;
+    uint64_t t0, first = 0;
+
+    h->nparts = cpl->nparts;
+    h->nodes = (hubnode_t *)calloc((size_t)cpl->nparts, sizeof(hubnode_t));
+    printf("Hub: waiting for %d nodes on %s:%s\n", cpl->nparts, h->listen->ops->name,
+           h->listen->where);
+    if (hub_join(h, cpl))
+        return cpl->nparts;
+    t0 = ng_now_ns();
+
+    for (live = cpl->nparts; live > 0;) {
+        int n = 0, arrived = 0;
+
+        for (i = 0; i < cpl->nparts; i++)
+            if (h->nodes[i].live && !h->nodes[i].arrived) {
+                fds[n].fd = h->nodes[i].tr->fd;
+                fds[n].events = POLLIN;
+                idx[n++] = i;
+            }
+        if (poll(fds, (nfds_t)n, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("Hub: poll");
+            lost += live;
+            break;
+        }
+
+        for (i = 0; i < n; i++) {
+            hubnode_t *nd = &h->nodes[idx[i]];
+            net_step *st;
+            size_t len;
+            int type;
+
+            if (!fds[i].revents)
+                continue;
+            if (ngtransport_recv(nd->tr, &type, &len)) {
+                hub_lose(h, cpl, idx[i], "");
+                live--;
+                lost++;
+                continue;
+            }
+            if (type == NET_LEAVE && len == sizeof(net_stats)) {
+                memcpy(&nd->stats, nd->tr->buf, sizeof(net_stats));
+                nd->reported = true;
+                nd->live = false;
+                live--;
+                continue;
+            }
+            st = (net_step *)nd->tr->buf;
+            if (type != NET_STEP || len < sizeof(net_step)
+                || len != sizeof(net_step) + (size_t)st->nsamples * sizeof(net_sample)) {
+                hub_lose(h, cpl, idx[i], ", bad message");
+                live--;
+                lost++;
+                continue;
+            }
+            nd->delta = st->delta;
+            nd->redo = st->redo;
+            nd->arrived = true;
+            hub_route(h, cpl, idx[i], (net_sample *)(st + 1), st->nsamples);
+        }
+
+        /* the step is complete when all nodes still running are in */
+        for (i = 0; i < cpl->nparts; i++)
+            if (h->nodes[i].live && h->nodes[i].arrived)
+                arrived++;
+        if (arrived > 0 && first == 0)
+            first = ng_now_ns();
+        if (live > 0 && arrived == live) {
+            uint64_t skew = ng_now_ns() - first;
+            h->skew_ns += skew;
+            if (skew > h->skew_max_ns)
+                h->skew_max_ns = skew;
+            first = 0;
+            hub_consensus(h);
+        }
+    }
+
+    hub_print(h, cpl, ng_now_ns() - t0);
+    return lost;
+}
+
+void
+ngnet_hub_free(ngnethub_t *h)
+{
+    int i;
+
+    if (!h)
+        return;
+    for (i = 0; h->nodes && i < h->nparts; i++) {
+        ngtransport_close(h->nodes[i].tr);
+        free(h->nodes[i].in);
+    }
+    ngtransport_close(h->listen);
+    free(h->nodes);
+    free(h->reply);
+    free(h);
+}
+
+void
+ngnet_hub_drop(ngnethub_t *h)
+{
+    if (!h)
+        return;
+    /* the unix socket file is the hub's */
+    h->listen->listening = false;
+    ngnet_hub_free(h);
+}
+
+#endif
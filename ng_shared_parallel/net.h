@@ -0,0 +1,68 @@
+/*
+Distributed run: partitions on different hosts, coupled through a
+transport (transport.h) instead of shared memory.
+
+Every partition runs in a node process of its own, on any host, all
+connected to one hub process that takes the place of the barrier. In
+ng_SyncData() a node sends a single message per step: its accepted
+time, the proposed delta time, redostep and the samples of its output
+vectors accepted since the last step. When the messages of all nodes
+still running are in, the hub takes the minimum delta time and the
+maximum redostep as the threaded barrier does (sync.c), and answers
+every node with the consensus and the samples of the edges driving it.
+The node pushes them into its input channels, the predictors (pred.h)
+find them there as with threads.
+
+An input is thus known up to the accepted time of the last step, never
+beyond, as may happen with threads. Each node measures the round trip
+of its steps, including the wait for the slowest partition, and reports
+it to the hub when its bg thread ends; the hub prints the statistics of
+all nodes. Lockstep (SYNC_BARRIER) only.
+
+The messages are the structs of net.c as they are in memory, of fixed
+size fields but not encoded: all hosts of a run need the same byte
+order, double format and struct layout (the same ABI), see transport.h.
+*/
+
+#ifndef NG_NET_H
+#define NG_NET_H
+
+#include "partition.h"
+#include "transport.h"
+
+/* node side, ngengine_t.net */
+typedef struct ngnet {
+    ngtransport_t *tr;
+    int part;                  /* index of the partition run by the node */
+    char *msg;                 /* message being built */
+    size_t cap;
+    bool lost;                 /* hub gone, running on alone */
+    uint64_t steps;
+    uint64_t rtt_ns, rtt_max_ns;
+    uint64_t samples_out, samples_in;
+} ngnet_t;
+
+typedef struct ngnethub ngnethub_t;
+
+/* Node: load, initialize and source partition part of e, connect to the
+   hub at addr, run and wait for the end. Returns 0 on success. */
+int ngnet_node(ngengine_t *e, int part, const char *addr);
+
+/* ng_SyncData() and sync_leave() of a node */
+int ngnet_step(ngpart_t *p, double acttime, double *deltatime, int redostep);
+void ngnet_leave(ngpart_t *p);
+
+void ngnet_print(ngengine_t *e);
+void ngnet_close(ngengine_t *e);
+
+/* Hub: listen on addr, then serve the nodes of the partitions in cpl
+   until all have left. ngnet_serve() returns the number of nodes lost. */
+ngnethub_t *ngnet_listen(const char *addr);
+int ngnet_serve(ngnethub_t *h, ngcoupling_t *cpl);
+void ngnet_hub_free(ngnethub_t *h);
+
+/* in a process forked from the hub: close the sockets inherited, which
+   would keep a connection to a dead hub open */
+void ngnet_hub_drop(ngnethub_t *h);
+
+#endif
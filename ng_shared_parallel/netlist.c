@@ -0,0 +1,523 @@
+/*
+Netlist reader and flattener for the partitioner.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "netlist.h"
+
+#define NL_MAXTOK 256
+#define NL_MAXDEPTH 32
+
+typedef struct strvec {
+    int n, size;
+    char **v;
+} strvec_t;
+
+typedef struct subckt {
+    char *name;
+    int nports;
+    char **ports;
+    strvec_t body;
+} subckt_t;
+
+typedef struct reader {
+    const char *file;
+    ngnetlist_t *nl;
+    strvec_t globals;
+    strvec_t models;
+    int nsub;
+    subckt_t *sub;
+    int *hash;                 /* node name -> index + 1, open addressing */
+    unsigned hmask;
+    bool warned_params;
+} reader_t;
+
+static void
+sv_push(strvec_t *s, char *str)
+{
+    if (s->n == s->size) {
+        s->size = s->size ? 2 * s->size : 16;
+        s->v = (char **)realloc(s->v, s->size * sizeof(char *));
+    }
+    s->v[s->n++] = str;
+}
+
+static void
+sv_free(strvec_t *s)
+{
+    int i;
+
+    for (i = 0; i < s->n; i++)
+        free(s->v[i]);
+    free(s->v);
+}
+
+static bool
+sv_find(const strvec_t *s, const char *str)
+{
+    int i;
+
+    for (i = 0; i < s->n; i++)
+        if (!strcmp(s->v[i], str))
+            return true;
+    return false;
+}
+
+/* case insensitive prefix */
+static bool
+ciprefix(const char *s, const char *pre)
+{
+    for (; *pre; s++, pre++)
+        if (tolower((unsigned char)*s) != *pre)
+            return false;
+    return true;
+}
+
+static void
+lower(char *s)
+{
+    for (; *s; s++)
+        *s = (char)tolower((unsigned char)*s);
+}
+
+/* split into tokens in place, '=' and parentheses stay inside tokens */
+static int
+tokenize(char *s, char **tok)
+{
+    int n = 0;
+
+    while (*s && n < NL_MAXTOK) {
+        while (*s && isspace((unsigned char)*s))
+            s++;
+        if (!*s)
+            break;
+        tok[n++] = s;
+        while (*s && !isspace((unsigned char)*s))
+            s++;
+        if (*s)
+            *s++ = '\0';
+    }
+    return n;
+}
+
+static unsigned
+strhash(const char *s)
+{
+    unsigned h = 2166136261u;
+
+    for (; *s; s++)
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+/* index of node name, added if new */
+static int
+node_index(reader_t *rd, const char *name)
+{
+    ngnetlist_t *nl = rd->nl;
+    unsigned h;
+
+    if ((unsigned)nl->nnets * 2 >= rd->hmask) {
+        unsigned size = rd->hmask ? 2 * (rd->hmask + 1) : 256;
+        int i;
+        free(rd->hash);
+        rd->hash = (int *)calloc(size, sizeof(int));
+        rd->hmask = size - 1;
+        for (i = 0; i < nl->nnets; i++) {
+            h = strhash(nl->nets[i]) & rd->hmask;
+            while (rd->hash[h])
+                h = (h + 1) & rd->hmask;
+            rd->hash[h] = i + 1;
+        }
+    }
+    h = strhash(name) & rd->hmask;
+    while (rd->hash[h]) {
+        if (!strcmp(nl->nets[rd->hash[h] - 1], name))
+            return rd->hash[h] - 1;
+        h = (h + 1) & rd->hmask;
+    }
+    nl->nets = (char **)realloc(nl->nets, (nl->nnets + 1) * sizeof(char *));
+    nl->nets[nl->nnets] = strdup(name);
+    rd->hash[h] = ++nl->nnets;
+    return nl->nnets - 1;
+}
+
+static subckt_t *
+find_subckt(reader_t *rd, const char *name)
+{
+    int i;
+
+    for (i = 0; i < rd->nsub; i++)
+        if (!strcmp(rd->sub[i].name, name))
+            return &rd->sub[i];
+    return NULL;
+}
+
+/* Read the cards of file: title, continuation lines joined, comments
+   and .control blocks removed, all but file names in lower case. */
+static bool
+read_cards(const char *file, char **title, strvec_t *cards)
+{
+    char line[4096];
+    bool control = false;
+    FILE *fp = fopen(file, "r");
+
+    if (!fp) {
+        fprintf(stderr, "Error: cannot open netlist %s\n", file);
+        return false;
+    }
+    *title = NULL;
+    while (fgets(line, sizeof(line), fp)) {
+        char *s = line, *c;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!*title) {
+            *title = strdup(line);
+            continue;
+        }
+        while (isspace((unsigned char)*s))
+            s++;
+        if (!*s || *s == '*')
+            continue;
+        if ((c = strchr(s, ';')) != NULL)
+            *c = '\0';
+        if ((c = strstr(s, " $")) != NULL || (c = strstr(s, "\t$")) != NULL)
+            *c = '\0';
+        if (ciprefix(s, ".control")) {
+            control = true;
+            continue;
+        }
+        if (control) {
+            control = !ciprefix(s, ".endc");
+            continue;
+        }
+        if (!ciprefix(s, ".inc") && !ciprefix(s, ".lib"))
+            lower(s);
+        if (*s == '+') {
+            if (cards->n > 0) {
+                char *prev = cards->v[cards->n - 1];
+                size_t len = strlen(prev);
+                prev = (char *)realloc(prev, len + strlen(s) + 1);
+                prev[len] = ' ';
+                strcpy(prev + len + 1, s + 1);
+                cards->v[cards->n - 1] = prev;
+            }
+            continue;
+        }
+        if (!strncmp(s, ".end", 4) && (s[4] == '\0' || isspace((unsigned char)s[4])))
+            break;
+        sv_push(cards, strdup(s));
+    }
+    fclose(fp);
+    if (!*title)
+        *title = strdup("");
+    return true;
+}
+
+/* Sort the cards into subcircuit definitions and top level cards,
+   collect model names and .global nodes. Nested definitions are
+   treated as global ones. */
+static bool
+collect(reader_t *rd, strvec_t *cards, strvec_t *top)
+{
+    int stack[NL_MAXDEPTH], depth = 0, i, n;
+    char *tok[NL_MAXTOK];
+
+    for (i = 0; i < cards->n; i++) {
+        char *card = cards->v[i], buf[4096];
+        snprintf(buf, sizeof(buf), "%s", card);
+        n = tokenize(buf, tok);
+        if (n == 0)
+            continue;
+        if (!strcmp(tok[0], ".subckt")) {
+            subckt_t *sc;
+            int k;
+            if (n < 2 || depth == NL_MAXDEPTH) {
+                fprintf(stderr, "%s: bad .subckt card: %s\n", rd->file, card);
+                return false;
+            }
+            rd->sub = (subckt_t *)realloc(rd->sub, (rd->nsub + 1) * sizeof(subckt_t));
+            sc = &rd->sub[rd->nsub];
+            memset(sc, 0, sizeof(*sc));
+            sc->name = strdup(tok[1]);
+            sc->ports = (char **)malloc(n * sizeof(char *));
+            for (k = 2; k < n && !strchr(tok[k], '=') && strcmp(tok[k], "params:"); k++)
+                sc->ports[sc->nports++] = strdup(tok[k]);
+            stack[depth++] = rd->nsub++;
+        }
+        else if (!strcmp(tok[0], ".ends")) {
+            if (depth == 0) {
+                fprintf(stderr, "%s: .ends without .subckt\n", rd->file);
+                return false;
+            }
+            depth--;
+        }
+        else {
+            if (!strcmp(tok[0], ".model") && n > 1)
+                sv_push(&rd->models, strdup(tok[1]));
+            if (!strcmp(tok[0], ".global")) {
+                int k;
+                for (k = 1; k < n; k++)
+                    sv_push(&rd->globals, strdup(tok[k]));
+            }
+            /* models defined in subcircuits are global here */
+            if (depth > 0 && card[0] != '.')
+                sv_push(&rd->sub[stack[depth - 1]].body, strdup(card));
+            else
+                sv_push(top, strdup(card));
+        }
+    }
+    if (depth > 0) {
+        fprintf(stderr, "%s: .subckt %s without .ends\n", rd->file, rd->sub[stack[depth - 1]].name);
+        return false;
+    }
+    return true;
+}
+
+/* node name of a subcircuit node at prefix, ports mapped */
+static int
+map_node(reader_t *rd, const char *node, const char *prefix, const subckt_t *sc, int *portnets)
+{
+    char buf[512];
+    int k;
+
+    if (!strcmp(node, "0") || !strcmp(node, "gnd"))
+        return 0;
+    if (sv_find(&rd->globals, node))
+        return node_index(rd, node);
+    if (sc)
+        for (k = 0; k < sc->nports; k++)
+            if (!strcmp(sc->ports[k], node))
+                return portnets[k];
+    snprintf(buf, sizeof(buf), "%s%s", prefix, node);
+    return node_index(rd, buf);
+}
+
+/* number of nodes of a device card */
+static int
+device_nodes(reader_t *rd, char **tok, int n)
+{
+    switch (tok[0][0]) {
+    case 'r': case 'c': case 'l': case 'd': case 'v': case 'i':
+        return 2;
+    case 'j': case 'z':
+        return 3;
+    case 'm': case 's':
+        return 4;
+    case 'e': case 'g':
+        return (n > 3 && !strncmp(tok[3], "poly", 4)) ? -1 : 4;
+    case 'q':
+        /* optional substrate node: q c b e [s] model */
+        return (n > 5 && sv_find(&rd->models, tok[5])) ? 4 : 3;
+    default:
+        return -1;
+    }
+}
+
+static bool
+expand(reader_t *rd, const char *card, const char *prefix, const subckt_t *sc, int *portnets,
+       int depth)
+{
+    ngnetlist_t *nl = rd->nl;
+    char buf[4096], *tok[NL_MAXTOK];
+    int n, nn, k;
+
+    snprintf(buf, sizeof(buf), "%s", card);
+    n = tokenize(buf, tok);
+    if (n == 0)
+        return true;
+
+    if (tok[0][0] == 'x') {
+        char subprefix[512];
+        subckt_t *x;
+        int last = n - 1, *nets, i;
+        bool ok = true;
+        while (last > 0 && strchr(tok[last], '='))
+            last--;
+        if (last < n - 1 && !rd->warned_params) {
+            fprintf(stderr, "Warning: subcircuit instance parameters are ignored (%s%s)\n",
+                    prefix, tok[0]);
+            rd->warned_params = true;
+        }
+        x = last > 0 ? find_subckt(rd, tok[last]) : NULL;
+        if (!x || x->nports != last - 1 || depth >= NL_MAXDEPTH) {
+            fprintf(stderr, "%s: cannot expand %s%s: %s\n", rd->file, prefix, tok[0],
+                    !x ? "unknown subcircuit" : x->nports != last - 1 ? "port count" : "too deep");
+            return false;
+        }
+        nets = (int *)malloc((x->nports + 1) * sizeof(int));
+        for (i = 0; i < x->nports; i++)
+            nets[i] = map_node(rd, tok[i + 1], prefix, sc, portnets);
+        snprintf(subprefix, sizeof(subprefix), "%s%s.", prefix, tok[0]);
+        for (i = 0; i < x->body.n && ok; i++)
+            ok = expand(rd, x->body.v[i], subprefix, x, nets, depth + 1);
+        free(nets);
+        return ok;
+    }
+
+    nn = device_nodes(rd, tok, n);
+    if (nn < 0 || n < nn + 1) {
+        fprintf(stderr, "%s: device not supported by the partitioner: %s%s\n", rd->file,
+                prefix, card);
+        return false;
+    }
+
+    nl->devs = (ngdev_t *)realloc(nl->devs, (nl->ndevs + 1) * sizeof(ngdev_t));
+    {
+        ngdev_t *d = &nl->devs[nl->ndevs++];
+        char name[512], rest[4096];
+        size_t len = 0;
+        if (*prefix)
+            snprintf(name, sizeof(name), "%c.%s%s", tok[0][0], prefix, tok[0]);
+        else
+            snprintf(name, sizeof(name), "%s", tok[0]);
+        d->name = strdup(name);
+        d->nnets = nn;
+        d->nets = (int *)malloc(nn * sizeof(int));
+        for (k = 0; k < nn; k++)
+            d->nets[k] = map_node(rd, tok[k + 1], prefix, sc, portnets);
+        rest[0] = '\0';
+        for (k = nn + 1; k < n && len < sizeof(rest) - 1; k++)
+            len += snprintf(rest + len, sizeof(rest) - len, "%s%s", k > nn + 1 ? " " : "", tok[k]);
+        d->rest = strdup(rest);
+        d->shared = tok[0][0] == 'v' && (d->nets[0] == 0) != (d->nets[1] == 0)
+                    && !strstr(d->rest, "external");
+    }
+    return true;
+}
+
+/* nodes of .save v(a) v(b) ..., anything else saves all */
+static void
+save_nodes(reader_t *rd, char *card)
+{
+    ngnetlist_t *nl = rd->nl;
+    char *tok[NL_MAXTOK];
+    int n = tokenize(card, tok), k;
+
+    for (k = 1; k < n; k++) {
+        size_t len = strlen(tok[k]);
+        if (!strcmp(tok[k], "all"))
+            nl->saveall = true;
+        else if (len > 3 && tok[k][0] == 'v' && tok[k][1] == '(' && tok[k][len - 1] == ')') {
+            tok[k][len - 1] = '\0';
+            nl->saves = (int *)realloc(nl->saves, (nl->nsaves + 1) * sizeof(int));
+            nl->saves[nl->nsaves++] = map_node(rd, tok[k] + 2, "", NULL, NULL);
+        }
+        else if (tok[k][0] != '@' && !strchr(tok[k], '(')) {
+            nl->saves = (int *)realloc(nl->saves, (nl->nsaves + 1) * sizeof(int));
+            nl->saves[nl->nsaves++] = map_node(rd, tok[k], "", NULL, NULL);
+        }
+    }
+}
+
+static bool
+dropped_card(const char *card)
+{
+    static const char *drop[] = { ".print", ".plot", ".ic", ".nodeset", ".meas", ".four",
+                                  ".probe", ".width" };
+    size_t i;
+
+    for (i = 0; i < sizeof(drop) / sizeof(drop[0]); i++) {
+        size_t len = strlen(drop[i]);
+        if (!strncmp(card, drop[i], len) && !isalnum((unsigned char)card[len]))
+            return true;
+    }
+    return !strncmp(card, ".measure", 8);
+}
+
+ngnetlist_t *
+ngnetlist_read(const char *file)
+{
+    reader_t rd;
+    strvec_t cards = { 0, 0, NULL }, top = { 0, 0, NULL };
+    ngnetlist_t *nl = (ngnetlist_t *)calloc(1, sizeof(ngnetlist_t));
+    bool ok;
+    int i, k;
+
+    memset(&rd, 0, sizeof(rd));
+    rd.file = file;
+    rd.nl = nl;
+    node_index(&rd, "0");
+
+    ok = read_cards(file, &nl->title, &cards) && collect(&rd, &cards, &top);
+    nl->saveall = true;
+    for (i = 0; ok && i < top.n; i++) {
+        char *card = top.v[i];
+        if (card[0] != '.') {
+            ok = expand(&rd, card, "", NULL, NULL, 0);
+        }
+        else if (!strncmp(card, ".save", 5)) {
+            char buf[4096];
+            if (nl->saveall && nl->nsaves == 0)
+                nl->saveall = false;
+            snprintf(buf, sizeof(buf), "%s", card);
+            save_nodes(&rd, buf);
+        }
+        else if (dropped_card(card)) {
+            nl->ndropped++;
+        }
+        else {
+            nl->cards = (char **)realloc(nl->cards, (nl->ncards + 1) * sizeof(char *));
+            nl->cards[nl->ncards++] = strdup(card);
+        }
+    }
+
+    sv_free(&cards);
+    sv_free(&top);
+    sv_free(&rd.globals);
+    sv_free(&rd.models);
+    for (i = 0; i < rd.nsub; i++) {
+        free(rd.sub[i].name);
+        for (k = 0; k < rd.sub[i].nports; k++)
+            free(rd.sub[i].ports[k]);
+        free(rd.sub[i].ports);
+        sv_free(&rd.sub[i].body);
+    }
+    free(rd.sub);
+    free(rd.hash);
+    if (!ok) {
+        ngnetlist_free(nl);
+        return NULL;
+    }
+    return nl;
+}
+
+void
+ngnetlist_free(ngnetlist_t *nl)
+{
+    int i;
+
+    if (!nl)
+        return;
+    for (i = 0; i < nl->ndevs; i++) {
+        free(nl->devs[i].name);
+        free(nl->devs[i].nets);
+        free(nl->devs[i].rest);
+    }
+    for (i = 0; i < nl->ncards; i++)
+        free(nl->cards[i]);
+    for (i = 0; i < nl->nnets; i++)
+        free(nl->nets[i]);
+    free(nl->devs);
+    free(nl->cards);
+    free(nl->nets);
+    free(nl->saves);
+    free(nl->title);
+    free(nl);
+}
+
+bool
+ngnetlist_drives(const ngdev_t *d, int pin)
+{
+    switch (d->name[0]) {
+    case 'm': case 'j': case 'z': case 'q':
+        return pin != 1;
+    case 'e': case 'g': case 's':
+        return pin < 2;
+    default:
+        return true;
+    }
+}
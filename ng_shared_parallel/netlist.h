@@ -0,0 +1,57 @@
+/*
+Flat device list of a SPICE netlist.
+
+The netlist is read with continuation lines joined, comments and
+.control blocks removed. All subcircuit instances are expanded
+recursively, named as ngspice does: device m1 in instance x2 of x1
+becomes m.x1.x2.m1, its internal node 7 becomes x1.x2.7. Ground (0,
+gnd) and .global nodes keep their names.
+
+Supported devices are R, C, L, D, V, I, E, G, M, Q, J, Z and S. Devices
+referring to others by name (K, F, H, W, B) and XSPICE models are
+rejected, as are POLY sources and subcircuit instance parameters.
+
+Independent voltage sources with one terminal at ground are flagged as
+shared: a partitioned circuit gets a copy of them in every partition
+using their node, so supply and input nets never have to be coupled.
+
+The control cards (.model, .include, .option, .tran ...) are kept in
+their order for the partition netlists. .save is resolved into a list
+of nets, .print, .plot, .ic, .nodeset, .meas and .four are dropped.
+*/
+
+#ifndef NG_NETLIST_H
+#define NG_NETLIST_H
+
+#include "port.h"
+
+typedef struct ngdev {
+    char *name;                /* flattened, lower case */
+    int nnets;
+    int *nets;                 /* node indices, 0 is ground */
+    char *rest;                /* model and parameters */
+    bool shared;               /* grounded independent voltage source */
+} ngdev_t;
+
+typedef struct ngnetlist {
+    char *title;
+    int ncards;
+    char **cards;              /* control cards for all partitions */
+    int ndevs;
+    ngdev_t *devs;
+    int nnets;
+    char **nets;               /* node names, nets[0] is "0" */
+    int nsaves;
+    int *saves;                /* nodes of .save v(...) */
+    bool saveall;              /* no .save, or .save all */
+    int ndropped;              /* cards not taken over */
+} ngnetlist_t;
+
+/* read and flatten file, NULL on error */
+ngnetlist_t *ngnetlist_read(const char *file);
+void ngnetlist_free(ngnetlist_t *nl);
+
+/* false if pin of device d does not drive its node (MOS gate ...) */
+bool ngnetlist_drives(const ngdev_t *d, int pin);
+
+#endif
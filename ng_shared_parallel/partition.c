@@ -0,0 +1,791 @@
+/*
+Partition engine for shared ngspice: loading, initialization and
+running of N ngspice instances, and the output callbacks.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wr.h"
+#include "pool.h"
+#include "worker.h"
+#include "net.h"
+#include "circ.h"
+#include "capture.h"
+#include "handoff.h"
+#include "log.h"
+#include "watchdog.h"
+#include "prof.h"
+#include "trace.h"
+
+/* loader of new engines, ngengine_set_loader() */
+static int loader_method = NGLOAD_COPY;
+static const char *loader_base = "libngspice.so";
+
+void
+ngengine_set_loader(int method, const char *base)
+{
+    loader_method = method;
+    if (base)
+        loader_base = base;
+}
+
+/* netlists through the cache, ngengine_set_circ_cache() */
+static bool circ_cache = true;
+
+void
+ngengine_set_circ_cache(bool on)
+{
+    circ_cache = on;
+}
+
+/* vectors captured by new engines, ngengine_set_capture() */
+static const char *capture_vectors = NULL;
+
+void
+ngengine_set_capture(const char *vectors)
+{
+    capture_vectors = vectors;
+}
+
+/* handoff of new engines, ngengine_set_handoff() */
+static int handoff_policy = -1;
+static int handoff_size = 0;
+
+void
+ngengine_set_handoff(int policy, int size)
+{
+    handoff_policy = policy;
+    handoff_size = size;
+}
+
+/* watchdog of new engines, ngengine_set_watchdog(); off by default, a
+   watched run takes the slow path of ng_SyncData() */
+static int watchdog_ms = 0;
+static int watchdog_action = WATCHDOG_REPORT;
+
+void
+ngengine_set_watchdog(int ms, int action)
+{
+    watchdog_ms = ms;
+    watchdog_action = action;
+}
+
+/* instrumentation of new engines, ngengine_set_profile() */
+static bool profile = false;
+
+void
+ngengine_set_profile(bool on)
+{
+    profile = on;
+}
+
+ngengine_t *
+ngengine_new(int nparts, int sync_mode, int spin)
+{
+    ngengine_t *e;
+    int i;
+
+    if (nparts < 1 || nparts > NGENGINE_MAXPARTS) {
+        fprintf(stderr, "Error: number of partitions must be 1 ... %d\n", NGENGINE_MAXPARTS);
+        return NULL;
+    }
+
+    e = (ngengine_t *)calloc(1, sizeof(ngengine_t));
+    e->parts = (ngpart_t *)calloc((size_t)nparts, sizeof(ngpart_t));
+    e->nparts = nparts;
+    e->sync_mode = sync_mode;
+    e->spin = spin;
+    e->capture = capture_vectors;
+    e->handoff_policy = handoff_policy;
+    e->handoff_size = handoff_size;
+    e->wd_ms = watchdog_ms;
+    e->wd_action = watchdog_action;
+    e->profile = profile;
+    e->mr_interval = 1e-9;
+    e->mr_interp = MR_HOLD;
+    e->pred = ngpred_find("linear");
+    e->pred_interp = ngpred_find("linear");
+    e->opt_tol = 1e-2;
+    e->loader = loader_method;
+    e->libbase = loader_base;
+    e->no_bg = true;
+
+    for (i = 0; i < nparts; i++) {
+        ngpart_t *p = &e->parts[i];
+        p->ident = i + 1;
+        p->engine = e;
+        p->state = NGPART_IDLE;
+        p->slot = -1;
+        ngwake_init(&p->progress);
+    }
+
+    mutex_init(&e->rt_cs);
+    cond_init(&e->rt_cond);
+    mutex_init(&e->sy_cs1);
+    mutex_init(&e->sy_cs2);
+    mutex_init(&e->sy_cs3);
+
+    /* Spinning only pays off if every waiting thread owns a core */
+    if (e->spin < 0 && nparts > ng_ncpus())
+        e->spin = 0;
+    ngbarrier_init(&e->barrier, nparts, e->spin);
+
+    return e;
+}
+
+/* A bg thread still returns through ngspice after ng_thread_runs(), the
+   library must not be unmapped or handed back to the pool under it, nor
+   its trace ring freed. For an ended thread bg_halt halts nothing, but
+   ngspice joins it; ngSpice_running() is false from then on. */
+static void
+part_join(ngpart_t *p)
+{
+    if (ngat_load_i(&p->state) != NGPART_DONE)
+        return;
+    ngpart_command(p, "bg_halt");
+    while (p->api.ngSpice_running && p->api.ngSpice_running())
+        ng_yield();
+}
+
+/* true if a bg thread of e is still in ngspice; reported */
+static bool
+still_running(ngengine_t *e, const char *what)
+{
+    bool running = false;
+    int i;
+
+    for (i = 0; i < e->nparts; i++)
+        if (ngat_load_i(&e->parts[i].state) == NGPART_RUNNING) {
+            fprintf(stderr, "Error: partition %d has not stopped, %s\n", e->parts[i].ident,
+                    what);
+            running = true;
+        }
+    return running;
+}
+
+void
+ngengine_free(ngengine_t *e)
+{
+    int i;
+
+    if (!e)
+        return;
+    if (e->workers) {
+        ngworkers_free(e);
+        return;
+    }
+    /* a bg thread stuck in ngspice still uses the engine and the library */
+    if (still_running(e, "its engine is not freed"))
+        return;
+    for (i = 0; i < e->nparts; i++)
+        if (e->parts[i].dllhandle)
+            part_join(&e->parts[i]);
+    if (e->pool)
+        ngpool_release(e);
+    ngnet_close(e);
+    nghandoff_free(e);
+    ngwatchdog_free(e);
+    ngprof_free(e);
+    for (i = 0; i < e->nparts; i++) {
+        if (e->parts[i].dllhandle)
+            ngload_close(e->parts[i].dllhandle);
+        ngcapture_close(e->parts[i].capture);
+        ngtrace_detach(e->parts[i].trace);
+        free(e->parts[i].outputs);
+        free(e->parts[i].inputs);
+        free(e->parts[i].srccache);
+        ngwake_destroy(&e->parts[i].progress);
+    }
+    ngcoupling_free(e->cpl);
+    wr_free(e->wr);
+    mutex_delete(&e->rt_cs);
+    cond_delete(&e->rt_cond);
+    mutex_delete(&e->sy_cs1);
+    mutex_delete(&e->sy_cs2);
+    mutex_delete(&e->sy_cs3);
+    ngbarrier_destroy(&e->barrier);
+    free(e->parts);
+    free(e);
+}
+
+/* Load the ngspice library of p by method and resolve its exported
+   functions. Returns 0 on success. */
+int
+ngpart_load(ngpart_t *p, int method, int *used)
+{
+    ngengine_t *e = p->engine;
+    const char *missing;
+
+    printf("Load instance %d (%s)\n", p->ident, ngload_name(method));
+    p->dllhandle = ngload_open(method, e->libbase, p->ident, used, p->libname,
+                               sizeof(p->libname));
+    if (!p->dllhandle) {
+        fprintf(stderr, "%s not loaded !\n", p->libname);
+        return 1;
+    }
+    printf("%s loaded\n", p->libname);
+
+    if (ngload_resolve(p->dllhandle, &p->api, &missing)) {
+        fprintf(stderr, "Error: %s has no %s\n", p->libname, missing);
+        return 1;
+    }
+    if (e->sync_mode == SYNC_MULTIRATE && !p->api.ngSpice_SetBkpt) {
+        fprintf(stderr, "Error: %s has no ngSpice_SetBkpt, needed by multirate\n",
+                p->libname);
+        return 1;
+    }
+    return 0;
+}
+
+/* Load all ngspice libraries. Returns 0 on success. */
+int
+ngengine_load(ngengine_t *e)
+{
+    uint64_t t0 = ng_now_ns(), rss0 = ngload_rss(), rss;
+    int i, used = e->loader;
+
+    if (e->loader == NGLOAD_PLAIN && e->nparts > 1) {
+        fprintf(stderr, "Error: loader plain gives one instance per process\n");
+        return 1;
+    }
+    for (i = 0; i < e->nparts; i++) {
+        if (ngpart_load(&e->parts[i], e->loader, &used))
+            return 1;
+        e->numthreads++;
+    }
+    e->load_ns = ng_now_ns() - t0;
+    rss = ngload_rss();
+    e->load_rss = rss > rss0 ? rss - rss0 : 0;
+    printf("%d instances loaded by %s%s%s in %.1f ms, resident memory +%.1f MB\n", e->nparts,
+           ngload_name(e->loader), used != e->loader ? "/" : "",
+           used != e->loader ? ngload_name(used) : "", e->load_ns / 1e6,
+           e->load_rss / 1048576.0);
+    return 0;
+}
+
+/* Initialize the library of p. With NGENGINE_SYNC the data callbacks and
+   the synchronization callbacks are registered, otherwise only the
+   library identifier is sent. */
+void
+ngpart_init(ngpart_t *p, int flags)
+{
+    bool sync = (flags & NGENGINE_SYNC) != 0;
+
+    /* a leased instance is initialized, only bound to p */
+    if (p->slot < 0)
+        p->api.ngSpice_Init(ng_getchar, ng_getstat, ng_exit, sync ? ng_data : NULL,
+                            ng_initdata, ng_thread_runs, p);
+
+    if (p->api.ngSpice_Init_Sync)
+        p->api.ngSpice_Init_Sync(sync ? ng_VSRCData : NULL, sync ? ng_ISRCData : NULL,
+                                 sync ? ng_SyncData : NULL, &p->ident, p);
+    else if (sync)
+        fprintf(stderr, "Warning: %s has no ngSpice_Init_Sync, not synchronized\n",
+                p->libname);
+}
+
+/* Initialize all libraries, see ngpart_init() */
+void
+ngengine_init(ngengine_t *e, int flags)
+{
+    int i;
+
+    for (i = 0; i < e->nparts; i++)
+        ngpart_init(&e->parts[i], flags);
+}
+
+void
+ngengine_source(ngengine_t *e)
+{
+    int i;
+
+    for (i = 0; i < e->nparts; i++)
+        ngpart_source(&e->parts[i], e->parts[i].netlist);
+}
+
+void
+ngengine_command_all(ngengine_t *e, const char *cmd)
+{
+    int i;
+
+    for (i = 0; i < e->nparts; i++)
+        ngpart_command(&e->parts[i], cmd);
+}
+
+/* start all background threads */
+void
+ngengine_run(ngengine_t *e)
+{
+    int i;
+
+    sync_prepare(e);
+    for (i = 0; i < e->nparts; i++) {
+        ngat_store_i(&e->parts[i].state, NGPART_RUNNING);
+        e->parts[i].waited = false;
+        e->parts[i].points = 0;
+        e->parts[i].data_ns = e->parts[i].data_max_ns = 0;
+    }
+    e->numthreads = e->nparts;
+    e->no_bg = false;
+    e->out_of_sync = false;
+    e->wall_ns = ng_now_ns();
+    e->cpu_ns = ng_cputime_ns();
+
+    /* of a run not waited for, the consumer ends before its captures;
+       they are opened anew by the first ng_initdata() of this run */
+    nghandoff_stop(e);
+    ngengine_capture_close(e);
+    nghandoff_start(e);
+    ngengine_command_all(e, "bg_run");
+}
+
+/* Wait until all simulations have finished. Returns 1 if the run has
+   failed: the watchdog has aborted it (watchdog.h), or interface
+   samples were lost. */
+int
+ngengine_wait(ngengine_t *e)
+{
+    /* the watchdog looks at the partitions between the waits */
+    while (ngengine_wait_all(e, ngwatchdog_period(e)))
+        if (ngwatchdog_check(e)) {
+            /* halted, they still have to come out of ngspice; one stuck
+               there may yet call ng_data(), its capture stays open */
+            if (ngengine_wait_all(e, e->wd_ms) && still_running(e, "its capture is kept"))
+                return 1;
+            break;
+        }
+
+    /* the points still in the rings are part of the run */
+    nghandoff_stop(e);
+    ngengine_capture_close(e);
+    e->wall_ns = ng_now_ns() - e->wall_ns;
+    e->cpu_ns = ng_cputime_ns() - e->cpu_ns;
+    return e->out_of_sync ? 1 : 0;
+}
+
+/* deadline of a wait, 0 for none */
+static uint64_t
+deadline(int timeout_ms)
+{
+    return timeout_ms < 0 ? 0 : ng_now_ns() + (uint64_t)timeout_ms * 1000000ull;
+}
+
+/* wait on rt_cond until the deadline, rt_cs locked; false when it has passed */
+static bool
+wait_until(ngengine_t *e, uint64_t end)
+{
+    uint64_t now;
+
+    if (!end) {
+        cond_wait(&e->rt_cond, &e->rt_cs);
+        return true;
+    }
+    now = ng_now_ns();
+    if (now >= end)
+        return false;
+    cond_wait_ms(&e->rt_cond, &e->rt_cs, (int)((end - now + 999999) / 1000000));
+    return true;
+}
+
+int
+ngengine_wait_all(ngengine_t *e, int timeout_ms)
+{
+    uint64_t end = deadline(timeout_ms);
+    int ret = 0;
+
+    mutex_lock(&e->rt_cs);
+    while (!e->no_bg)
+        if (!wait_until(e, end)) {
+            ret = 1;
+            break;
+        }
+    mutex_unlock(&e->rt_cs);
+    return ret;
+}
+
+int
+ngengine_wait_any(ngengine_t *e, int timeout_ms)
+{
+    uint64_t end = deadline(timeout_ms);
+    int i, ret = -1;
+
+    mutex_lock(&e->rt_cs);
+    for (;;) {
+        bool pending = false;
+        for (i = 0; i < e->nparts; i++) {
+            ngpart_t *p = &e->parts[i];
+            if (p->state == NGPART_DONE && !p->waited) {
+                p->waited = true;
+                ret = i;
+                break;
+            }
+            if (p->state == NGPART_RUNNING)
+                pending = true;
+        }
+        if (ret >= 0 || !pending || !wait_until(e, end))
+            break;
+    }
+    mutex_unlock(&e->rt_cs);
+    return ret;
+}
+
+int
+ngpart_wait(ngpart_t *p, int timeout_ms)
+{
+    ngengine_t *e = p->engine;
+    uint64_t end = deadline(timeout_ms);
+    int ret = 0;
+
+    mutex_lock(&e->rt_cs);
+    while (p->state == NGPART_RUNNING)
+        if (!wait_until(e, end)) {
+            ret = 1;
+            break;
+        }
+    mutex_unlock(&e->rt_cs);
+    return ret;
+}
+
+/* number of synchronized time steps of the last run */
+uint64_t
+ngengine_steps(ngengine_t *e)
+{
+    ngbarrier_stats st;
+
+    if (e->sync_mode == SYNC_LEGACY)
+        return e->legacy_stats.completions;
+    ngbarrier_get_stats(&e->barrier, &st);
+    return st.completions;
+}
+
+/* accepted time points of the last run, summed over all partitions */
+uint64_t
+ngengine_points(ngengine_t *e)
+{
+    uint64_t n = 0;
+    int i;
+
+    for (i = 0; i < e->nparts; i++)
+        n += e->parts[i].points;
+    return n;
+}
+
+/* Print barrier latency and cpu load of the synchronized run */
+void
+ngengine_print_stats(ngengine_t *e)
+{
+    ngbarrier_stats st;
+    int i;
+
+    if (e->sync_mode == SYNC_LEGACY)
+        st = e->legacy_stats;
+    else
+        ngbarrier_get_stats(&e->barrier, &st);
+
+    printf("\n** Synchronization of %d partitions (%s", e->nparts,
+           e->sync_mode == SYNC_LEGACY ? "legacy ok1/ok2" :
+           e->sync_mode == SYNC_MULTIRATE ? "multirate" :
+           e->sync_mode == SYNC_OPTIMISTIC ? "optimistic" : "barrier");
+    if (e->sync_mode == SYNC_MULTIRATE)
+        printf(", interval %g s, %s", e->mr_interval, e->mr_interp == MR_LINEAR ? "linear" : "hold");
+    else if (e->sync_mode == SYNC_OPTIMISTIC)
+        printf(", %s, tolerance %g V", e->pred->name, e->opt_tol);
+    else
+        printf(", %s", e->pred->name);
+    if (e->sync_mode != SYNC_LEGACY && e->sync_mode != SYNC_OPTIMISTIC)
+        printf(", spin %d", e->barrier.spin);
+    printf(") **\n");
+    if (e->sync_mode == SYNC_MULTIRATE)
+        printf("rendezvous:          %llu\n", (unsigned long long)st.completions);
+    else if (e->sync_mode != SYNC_OPTIMISTIC)
+        printf("time steps:          %llu\n", (unsigned long long)st.completions);
+    printf("accepted points:     %llu\n", (unsigned long long)ngengine_points(e));
+    if (e->sync_mode != SYNC_OPTIMISTIC)
+        printf("waits:               %llu\n", (unsigned long long)st.waits);
+    for (i = 0; i < e->nparts && i < 16; i++)
+        printf("  partition %3d:     %llu points, %llu sync calls, %llu redone\n", e->parts[i].ident,
+               (unsigned long long)e->parts[i].points, (unsigned long long)e->parts[i].syncs,
+               (unsigned long long)e->parts[i].redos);
+    for (i = 0; i < e->nparts && i < 16; i++)
+        if (e->parts[i].points)
+            printf("  partition %3d:     ng_data() mean %.3f us, max %.3f us\n", e->parts[i].ident,
+                   e->parts[i].data_ns / 1e3 / e->parts[i].points, e->parts[i].data_max_ns / 1e3);
+    if (e->sync_mode == SYNC_OPTIMISTIC)
+        for (i = 0; i < e->nparts && i < 16; i++) {
+            ngpart_t *p = &e->parts[i];
+            printf("  partition %3d:     %llu rollbacks, %llu unverified, wasted %.3f ms / %g s sim,"
+                   " verify wait %.3f ms, blocked %.3f ms\n", p->ident,
+                   (unsigned long long)p->rollbacks, (unsigned long long)p->unverified,
+                   p->wasted_ns / 1e6, p->wasted_t, p->verify_ns / 1e6, p->blocked_ns / 1e6);
+        }
+    if (e->sync_mode != SYNC_LEGACY && e->sync_mode != SYNC_OPTIMISTIC)
+        printf("released spinning:   %llu, sleeping: %llu\n",
+               (unsigned long long)st.spun, (unsigned long long)st.blocked);
+    if (st.waits > 0)
+        printf("mean wait:           %.3f us\n", st.wait_ns / 1e3 / st.waits);
+    if (e->sync_mode != SYNC_OPTIMISTIC)
+        printf("max wait:            %.3f us\n", st.wait_max_ns / 1e3);
+    for (i = 0; e->cpl && i < e->cpl->nedges; i++)
+        if (e->cpl->edges[i].chan.overflows)
+            printf("channel %s -> %s:    %llu samples dropped\n", e->cpl->parts[e->cpl->edges[i].src].name,
+                   e->cpl->parts[e->cpl->edges[i].dst].name,
+                   (unsigned long long)e->cpl->edges[i].chan.overflows);
+    ngwatchdog_print(e);
+    printf("wall time:           %.3f s\n", e->wall_ns / 1e9);
+    if (e->wall_ns > 0)
+        printf("cpu load:            %.1f %% of one core\n", 100.0 * e->cpu_ns / e->wall_ns);
+    nghandoff_print(e);
+    ngprof_print(e);
+}
+
+int
+ngpart_command(ngpart_t *p, const char *cmd)
+{
+    if (!strncmp(cmd, "source ", 7))
+        p->circuits++;
+    return p->api.ngSpice_Command((char *)cmd);
+}
+
+/* Load a netlist: from the cache by ngSpice_Circ(), or by "source" if
+   the cache is off or the library has no ngSpice_Circ(). */
+int
+ngpart_source(ngpart_t *p, const char *file)
+{
+    const ngcirc_t *c;
+    char cmd[300];
+
+    if (circ_cache && p->api.ngSpice_Circ) {
+        c = ngcirc_get(file);
+        if (!c)
+            return 1;
+        p->circuits++;
+        return p->api.ngSpice_Circ(c->lines);
+    }
+    snprintf(cmd, sizeof(cmd), "source %s", file);
+    return ngpart_command(p, cmd);
+}
+
+void
+ngpart_capture_close(ngpart_t *p)
+{
+    if (!p->capture)
+        return;
+    if (!p->engine->quiet)
+        printf("lib %d: %llu points captured in %s\n", p->ident,
+               (unsigned long long)p->capture->npoints, p->capture->file);
+    ngcapture_close(p->capture);
+    p->capture = NULL;
+}
+
+/* captures of the run, after the end of the bg threads and the consumer */
+void
+ngengine_capture_close(ngengine_t *e)
+{
+    int i;
+
+    for (i = 0; i < e->nparts; i++)
+        ngpart_capture_close(&e->parts[i]);
+}
+
+char *
+ngpart_curplot(ngpart_t *p)
+{
+    return p->api.ngSpice_CurPlot();
+}
+
+char **
+ngpart_allvecs(ngpart_t *p, char *plot)
+{
+    return p->api.ngSpice_AllVecs(plot);
+}
+
+pvector_info
+ngpart_vecinfo(ngpart_t *p, char *vecname)
+{
+    return p->api.ngGet_Vec_Info(vecname);
+}
+
+
+/* Callback function called from bg thread in ngspice to transfer
+   any string created by printf or puts. Output to stdout in ngspice is
+   preceded by token stdout, same with stderr.*/
+int
+ng_getchar(char* outputreturn, int ident, void* userdata)
+{
+    if (((ngpart_t *)userdata)->engine->quiet)
+        return 0;
+    nglog_put(ident, strncmp(outputreturn, "stderr", 6) ? NGLOG_STDOUT : NGLOG_STDERR, outputreturn);
+    return 0;
+}
+
+/* Callback function called from bg thread in ngspice to transfer
+   simulation status (type and progress in percent. */
+int
+ng_getstat(char* outputreturn, int ident, void* userdata)
+{
+    if (((ngpart_t *)userdata)->engine->quiet)
+        return 0;
+    nglog_put(ident, NGLOG_STATUS, outputreturn);
+    return 0;
+}
+
+/* Callback function called from bg thread in ngspice if fcn controlled_exit()
+   is hit. Do not exit, but unload ngspice. */
+int
+ng_exit(int exitstatus, bool immediate, bool quitexit, int ident, void* userdata)
+{
+    ngpart_t *p = (ngpart_t *)userdata;
+
+    if(quitexit) {
+        printf("DNote: Returned quit from library %d with exit status %d\n", ident, exitstatus);
+    }
+    if(immediate) {
+        printf("DNote: Unload ngspice%d\n", ident);
+        ngload_close(p->dllhandle);
+        /* a worker waits for the bg thread or for this */
+        mutex_lock(&p->engine->rt_cs);
+        p->dllhandle = NULL;
+        cond_broadcast(&p->engine->rt_cond);
+        mutex_unlock(&p->engine->rt_cs);
+        memset(&p->api, 0, sizeof(p->api));
+    }
+
+    else {
+        printf("DNote: Prepare unloading ngspice%d\n", ident);
+        p->engine->will_unload = true;
+    }
+
+    return exitstatus;
+
+}
+
+/* Send the values of the output vectors to the coupled partitions, and
+   capture the point or hand it off */
+static void
+data_accepted(ngpart_t *p, pvecvaluesall vdata)
+{
+    ngedge_t *edges;
+    double t;
+    int i;
+
+    p->points++;
+    if (p->handoff)
+        nghandoff_push(p->handoff, vdata);
+    else if (p->capture)
+        ngcapture_push(p->capture, vdata);
+    /* registered for pool instances, whatever the job is */
+    if (!p->engine->cpl)
+        return;
+    edges = p->engine->cpl->edges;
+    /* time is the scale vector */
+    if (p->scaleindex < 0) {
+        for (i = 0; i < vdata->veccount; i++)
+            if (vdata->vecsa[i]->is_scale)
+                p->scaleindex = i;
+        if (p->scaleindex < 0)
+            return;
+    }
+    t = vdata->vecsa[p->scaleindex]->creal;
+
+    if (p->engine->wr) {
+        wr_record(p, vdata, t);
+        return;
+    }
+    if (p->engine->sync_mode == SYNC_OPTIMISTIC) {
+        for (i = 0; i < p->noutputs; i++) {
+            ngoutput_t *o = &p->outputs[i];
+            if (o->vecindex >= 0)
+                sync_push_optimistic(p, &edges[o->edge], t, vdata->vecsa[o->vecindex]->creal);
+        }
+        sync_progress(p);
+        return;
+    }
+    for (i = 0; i < p->noutputs; i++) {
+        ngoutput_t *o = &p->outputs[i];
+        if (o->vecindex >= 0)
+            sync_push(p, &edges[o->edge], t, vdata->vecsa[o->vecindex]->creal);
+    }
+}
+
+/* Callback function called from bg thread in ngspice once per accepted data point,
+   timed: the bg thread does nothing else meanwhile. */
+int
+ng_data(pvecvaluesall vdata, int numvecs, int ident, void* userdata)
+{
+    ngpart_t *p = (ngpart_t *)userdata;
+    uint64_t t0 = ng_now_ns(), dt;
+
+    (void)numvecs;
+    (void)ident;
+    data_accepted(p, vdata);
+    dt = ng_now_ns() - t0;
+    p->data_ns += dt;
+    if (dt > p->data_max_ns)
+        p->data_max_ns = dt;
+    if (p->trace)
+        ngtrace_put(p->trace, NGTRACE_DATA, t0, t0 + dt,
+                    p->scaleindex >= 0 ? vdata->vecsa[p->scaleindex]->creal : p->acttime, 0);
+    return 0;
+}
+
+
+/* Callback function called from bg thread in ngspice once upon intialization
+   of the simulation vectors)*/
+int
+ng_initdata(pvecinfoall intdata, int ident, void* userdata)
+{
+    ngpart_t *p = (ngpart_t *)userdata;
+    int i;
+    int vn = intdata->veccount;
+
+    (void)ident;
+    for (i = 0; i < vn && !p->engine->quiet; i++)
+        printf("Vector: %s\n", intdata->vecs[i]->vecname);
+    /* find the locations of the output vectors */
+    p->scaleindex = -1;
+    if (p->engine->cpl)
+        coupling_resolve_outputs(p, intdata);
+    /* once per run, a waveform relaxation run sends a plot per iteration */
+    if (p->engine->capture && !p->capture) {
+        char file[64];
+        sprintf(file, "nsynctest%d.ngc", p->ident);
+        p->capture = ngcapture_open(file, intdata, p->engine->capture);
+        nghandoff_attach(p);
+    }
+    return 0;
+}
+
+/* Callback function called from ngspice upon starting (returns false) or
+  leaving (returns true) the bg thread. */
+int
+ng_thread_runs(bool noruns, int ident, void* userdata)
+{
+    ngpart_t *p = (ngpart_t *)userdata;
+    ngengine_t *e = p->engine;
+    int ii, running = NGPART_RUNNING;
+    bool iruns = true;
+
+    mutex_lock(&e->rt_cs);
+    if (!noruns) {
+        ngat_store_i(&p->state, NGPART_RUNNING);
+        p->waited = false;
+    }
+    /* only once per run, the end may also be told by the caller */
+    else if (ngat_cas_i(&p->state, &running, NGPART_DONE) && !ngat_load_i(&p->unsynced)) {
+        e->numthreads--;
+        sync_leave(p);
+    }
+
+    for (ii = 0; ii < e->nparts; ii++)
+        iruns = iruns && e->parts[ii].state != NGPART_RUNNING;
+    e->no_bg = iruns;
+    cond_broadcast(&e->rt_cond);
+    mutex_unlock(&e->rt_cs);
+
+    if (!e->quiet)
+        printf("lib %d: bg %s\n", ident, noruns ? "not running" : "running");
+
+    return 0;
+}
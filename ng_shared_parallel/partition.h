@@ -0,0 +1,230 @@
+/*
+Partition engine for shared ngspice.
+
+A circuit is split into N partitions, each one simulated by its own
+ngspice shared library instance. The engine loads and initializes the
+libraries, sources the netlists and runs them in their background
+threads, synchronized by ng_SyncData(). All per-partition state is kept
+in an array of ngpart_t; ngspice hands the partition back to every
+callback as userdata, so no callback has to branch on ident. Which
+partition drives which is given by the coupling graph (coupling.h).
+
+ngspice tells the start and the end of a bg thread by ng_thread_runs().
+There the state of the partition is changed and the condition variable
+of the engine is signalled, so ngengine_wait() and the wait functions
+below return as soon as the runs have ended, without polling.
+*/
+
+#ifndef NG_PARTITION_H
+#define NG_PARTITION_H
+
+#include "port.h"
+#include "../include/sharedspice.h"
+#include "barrier.h"
+#include "coupling.h"
+#include "pred.h"
+#include "loader.h"
+
+#define NGENGINE_MAXPARTS 256
+
+/* synchronization scheme used in ng_SyncData() */
+#define SYNC_BARRIER 0
+#define SYNC_LEGACY 1
+#define SYNC_WR 2         /* no lockstep, waveform relaxation (wr.h) */
+#define SYNC_MULTIRATE 3  /* own time steps, barrier at rendezvous times only */
+#define SYNC_OPTIMISTIC 4 /* no barrier, predicted inputs, redo on misprediction */
+
+/* interface values between two rendezvous, SYNC_MULTIRATE */
+#define MR_HOLD 0         /* value of the last rendezvous */
+#define MR_LINEAR 1       /* extrapolated from the last two rendezvous */
+
+/* run state of a partition; it is RUNNING from ngengine_run() until
+   its bg thread has ended, and DONE only once per run */
+#define NGPART_IDLE 0     /* loaded, not started */
+#define NGPART_RUNNING 1  /* started, or bg thread running */
+#define NGPART_DONE 2     /* bg thread ended */
+
+/* flags for ngengine_init() */
+#define NGENGINE_SYNC 1   /* register data and synchronization callbacks */
+
+typedef struct ngengine ngengine_t;
+
+typedef struct ngpart {
+    int ident;                 /* library identifier, 1 ... N */
+    ngengine_t *engine;
+    char libname[256];         /* the library file, or how it was loaded */
+    char netlist[256];
+    void *dllhandle;
+
+    ngspice_api_t api;         /* functions exported by ngspice */
+    int slot;                  /* pool instance (pool.h), -1 if loaded */
+    int circuits;              /* sourced, removed when given back */
+    int crashed;               /* signal ending its worker process, worker.h */
+
+    /* interface, compiled from the coupling graph */
+    ngoutput_t *outputs;       /* vectors driving other partitions */
+    int noutputs;
+    nginput_t *inputs;         /* EXTERNAL sources driven by others */
+    int ninputs;
+    ngsrccache_t *srccache;    /* source name pointer -> edge */
+    unsigned srcmask;
+    int nsrccached;
+    int scaleindex;            /* index of time in the SendData array */
+    uint64_t points;           /* accepted time points */
+    struct ngcapture *capture; /* streaming capture, capture.h */
+    struct nghandoffq *handoff;/* ring to the consumer thread, handoff.h */
+    uint64_t data_ns;          /* time spent in ng_data() */
+    uint64_t data_max_ns;
+
+    /* data deposited in ng_SyncData() */
+    double delta, newdelta, acttime;
+    int redo, location;
+    bool arrived;
+    volatile int state;        /* NGPART_IDLE ..., changed in ng_thread_runs() */
+    bool waited;               /* returned by ngengine_wait_any() */
+    volatile int insync;       /* in ng_SyncData(), if watched or instrumented */
+    volatile int unsynced;     /* taken out of the synchronization by the watchdog */
+    volatile uint64_t sync_ns; /* came into or went out of ng_SyncData() */
+    uint64_t syncs, redos;     /* calls of ng_SyncData(), with redostep */
+    struct ngtraceq *trace;    /* events of the timeline, trace.h */
+
+    /* SYNC_OPTIMISTIC */
+    volatile int waiting;      /* 1 for a driving partition, 2 on a full channel */
+    ngwake_t progress;         /* samples pushed or retired, waiting, left the run */
+    uint64_t blocked_ns;       /* wall time blocked on a full channel */
+    uint64_t step_ns;          /* start of the current step */
+    uint64_t rollbacks;        /* steps redone after a misprediction */
+    uint64_t unverified;       /* steps accepted without the driver's data */
+    uint64_t wasted_ns;        /* wall time of the redone steps */
+    uint64_t verify_ns;        /* wall time waiting for the drivers */
+    double wasted_t;           /* simulated time of the redone steps */
+} ngpart_t;
+
+struct ngengine {
+    int nparts;
+    ngpart_t *parts;
+    ngcoupling_t *cpl;
+    struct ngwr *wr;           /* state of the waveform relaxation */
+    struct ngpool *pool;       /* instances leased from, or NULL */
+    bool workers;              /* one process per partition, worker.h */
+    void *shm_edges;           /* coupling edges in shared memory, workers */
+    size_t shm_edges_len;
+    struct ngnet *net;         /* node of a distributed run, net.h */
+    bool quiet;                /* output of ngspice not printed, sweep.h */
+    const char *capture;       /* vectors captured, or NULL, capture.h */
+    int handoff_policy;        /* capture by a consumer thread, -1 for none */
+    int handoff_size;
+    struct nghandoff *handoff;
+    int wd_ms;                 /* watchdog timeout, 0 for none, watchdog.h */
+    int wd_action;
+    struct ngwatchdog *wd;
+    bool profile;              /* instrument ng_SyncData(), prof.h */
+    struct ngprof *prof;
+    int trace_pid;             /* process in the timeline, trace.h */
+
+    int sync_mode;
+    int spin;                  /* barrier spin iterations, -1 for default */
+    ngbarrier_t barrier;       /* used in ng_SyncData() with SYNC_BARRIER */
+    int sync_retval;
+    const ngpredictor_t *pred; /* EXTERNAL source values, lockstep schemes */
+
+    /* SYNC_MULTIRATE */
+    double mr_interval;        /* distance of the rendezvous times */
+    int mr_interp;             /* MR_HOLD or MR_LINEAR */
+    double mr_next;            /* next rendezvous time */
+
+    /* SYNC_OPTIMISTIC */
+    double opt_tol;            /* accepted misprediction in V */
+    const ngpredictor_t *pred_interp; /* actual values checked against */
+
+    /* instance loading, loader.h */
+    int loader;                /* NGLOAD_* */
+    const char *libbase;       /* original library for memfd, dlmopen */
+    uint64_t load_ns;          /* wall time of ngengine_load() */
+    uint64_t load_rss;         /* resident memory it added */
+
+    /* the original scheme, SYNC_LEGACY */
+    mutexType sy_cs1, sy_cs2, sy_cs3;
+    volatile bool ok1, ok2;
+    int threadcount1, threadcount2;
+    ngbarrier_stats legacy_stats;
+
+    mutexType rt_cs;           /* used in ng_thread_runs() */
+    condType rt_cond;          /* signalled when a bg thread ends */
+    volatile int numthreads;   /* bg threads still running */
+    volatile bool no_bg;
+    bool will_unload;
+    bool out_of_sync;          /* aborted by the watchdog, or samples lost */
+
+    uint64_t wall_ns, cpu_ns;  /* of the last run */
+};
+
+/* engine life cycle */
+ngengine_t *ngengine_new(int nparts, int sync_mode, int spin);
+void ngengine_free(ngengine_t *e);
+void ngengine_set_loader(int method, const char *base);
+void ngengine_set_circ_cache(bool on);
+void ngengine_set_capture(const char *vectors);
+void ngengine_set_handoff(int policy, int size);
+void ngengine_set_watchdog(int ms, int action);
+void ngengine_set_profile(bool on);
+int ngengine_load(ngengine_t *e);
+void ngengine_init(ngengine_t *e, int flags);
+int ngengine_couple(ngengine_t *e, ngcoupling_t *c);
+void ngengine_source(ngengine_t *e);
+void ngengine_run(ngengine_t *e);
+int ngengine_wait(ngengine_t *e);
+void ngengine_command_all(ngengine_t *e, const char *cmd);
+void ngengine_print_stats(ngengine_t *e);
+void ngengine_capture_close(ngengine_t *e);
+uint64_t ngengine_steps(ngengine_t *e);
+uint64_t ngengine_points(ngengine_t *e);
+
+/* Completion of the bg threads, signalled by ng_thread_runs(); timeout
+   in ms, -1 for none. wait_all returns 0 when all partitions are done,
+   1 on timeout. wait_any returns the index of a partition done and not
+   returned before in this run, -1 on timeout or if there is none. */
+int ngengine_wait_all(ngengine_t *e, int timeout_ms);
+int ngengine_wait_any(ngengine_t *e, int timeout_ms);
+int ngpart_wait(ngpart_t *p, int timeout_ms);
+
+/* calls into a single ngspice instance */
+int ngpart_load(ngpart_t *p, int method, int *used);
+void ngpart_init(ngpart_t *p, int flags);
+int ngpart_command(ngpart_t *p, const char *cmd);
+int ngpart_source(ngpart_t *p, const char *file);
+void ngpart_capture_close(ngpart_t *p);
+char *ngpart_curplot(ngpart_t *p);
+char **ngpart_allvecs(ngpart_t *p, char *plot);
+pvector_info ngpart_vecinfo(ngpart_t *p, char *vecname);
+
+/* callback functions used by ngspice, initialized by ngSpice_Init() */
+int ng_getchar(char* outputreturn, int ident, void* userdata);
+int ng_getstat(char* outputreturn, int ident, void* userdata);
+int ng_thread_runs(bool noruns, int ident, void* userdata);
+ControlledExit ng_exit;
+SendData ng_data;
+SendInitData ng_initdata;
+
+/* callback functions used by ngspice, initialized by ngSpice_Init_Sync() */
+GetVSRCData ng_VSRCData;
+GetISRCData ng_ISRCData;
+GetSyncData ng_SyncData;
+
+/* coupling.c: index tables used by the callbacks */
+void coupling_resolve_outputs(ngpart_t *p, pvecinfoall intdata);
+int coupling_input_edge(ngpart_t *p, const char *name);
+
+/* sync.c: prepare a run, and drop a partition whose bg thread ended */
+void sync_prepare(ngengine_t *e);
+void sync_leave(ngpart_t *p);
+
+/* sync.c: push a sample of p into ed, a lost one fails the run */
+void sync_push(ngpart_t *p, ngedge_t *ed, double t, double v);
+
+/* sync.c, SYNC_OPTIMISTIC: push a sample of p into ed, waiting while the
+   channel is full, and wake up the partitions waiting for p */
+void sync_push_optimistic(ngpart_t *p, ngedge_t *ed, double t, double v);
+void sync_progress(ngpart_t *p);
+
+#endif
@@ -0,0 +1,182 @@
+/*
+Pool of warm ngspice instances, see pool.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+
+ngpool_t *
+ngpool_new(int size)
+{
+    ngpool_t *pool;
+    ngengine_t *idle = ngengine_new(size, SYNC_BARRIER, -1);
+    int i;
+
+    if (!idle || ngengine_load(idle)) {
+        ngengine_free(idle);
+        return NULL;
+    }
+    for (i = 0; i < size; i++)
+        if (!idle->parts[i].api.ngSpice_Init_Sync) {
+            fprintf(stderr, "Error: %s has no ngSpice_Init_Sync, needed by the pool\n",
+                    idle->parts[i].libname);
+            ngengine_free(idle);
+            return NULL;
+        }
+    /* all callbacks, a job may need them */
+    ngengine_init(idle, NGENGINE_SYNC);
+
+    pool = (ngpool_t *)calloc(1, sizeof(ngpool_t));
+    pool->idle = idle;
+    pool->leased = (bool *)calloc((size_t)size, sizeof(bool));
+    pool->nfree = size;
+    mutex_init(&pool->cs);
+    cond_init(&pool->cv);
+    return pool;
+}
+
+void
+ngpool_free(ngpool_t *pool)
+{
+    if (!pool)
+        return;
+    ngengine_free(pool->idle);
+    mutex_delete(&pool->cs);
+    cond_delete(&pool->cv);
+    free(pool->leased);
+    free(pool);
+}
+
+int
+ngengine_lease(ngengine_t *e, ngpool_t *pool)
+{
+    uint64_t t0 = ng_now_ns(), dt;
+    int i, k = 0;
+
+    if (e->nparts > pool->idle->nparts) {
+        fprintf(stderr, "Error: %d partitions, pool of %d instances\n", e->nparts,
+                pool->idle->nparts);
+        return 1;
+    }
+    /* the instances are copies of one library, the first one tells */
+    if (e->sync_mode == SYNC_MULTIRATE && !pool->idle->parts[0].api.ngSpice_SetBkpt) {
+        fprintf(stderr, "Error: %s has no ngSpice_SetBkpt, needed by multirate\n",
+                pool->idle->parts[0].libname);
+        return 1;
+    }
+
+    /* all instances at once, two waiting engines never hold some each */
+    mutex_lock(&pool->cs);
+    if (pool->nfree < e->nparts)
+        pool->waits++;
+    while (pool->nfree < e->nparts)
+        cond_wait(&pool->cv, &pool->cs);
+    for (i = 0; i < e->nparts; i++) {
+        ngpart_t *p = &e->parts[i];
+        ngpart_t *q;
+
+        while (pool->leased[k])
+            k++;
+        pool->leased[k] = true;
+        q = &pool->idle->parts[k];
+        p->slot = k;
+        p->dllhandle = q->dllhandle;
+        p->api = q->api;
+        p->circuits = 0;
+        snprintf(p->libname, sizeof(p->libname), "%s", q->libname);
+        e->numthreads++;
+    }
+    pool->nfree -= e->nparts;
+    pool->leases++;
+    dt = ng_now_ns() - t0;
+    pool->wait_ns += dt;
+    if (dt > pool->max_wait_ns)
+        pool->max_wait_ns = dt;
+    mutex_unlock(&pool->cs);
+
+    e->pool = pool;
+    return 0;
+}
+
+/* true if nothing of the last job is left in the instance */
+static bool
+is_clean(ngpart_t *q)
+{
+    char *plot;
+    char **plots;
+
+    if (q->api.ngSpice_running && q->api.ngSpice_running())
+        return false;
+    plot = q->api.ngSpice_CurPlot();
+    if (!plot || !cieq(plot, "const"))
+        return false;
+    plots = q->api.ngSpice_AllPlots ? q->api.ngSpice_AllPlots() : NULL;
+    for (; plots && *plots; plots++)
+        if (!cieq(*plots, "const"))
+            return false;
+    return true;
+}
+
+void
+ngpool_release(ngengine_t *e)
+{
+    ngpool_t *pool = e->pool;
+    uint64_t t0 = ng_now_ns();
+    int i, leaks = 0;
+
+    for (i = 0; i < e->nparts; i++) {
+        ngpart_t *p = &e->parts[i];
+        ngpart_t *q;
+
+        if (p->slot < 0)
+            continue;
+        q = &pool->idle->parts[p->slot];
+        /* callbacks of the reset go to the parked partition */
+        q->api.ngSpice_Init_Sync(ng_VSRCData, ng_ISRCData, ng_SyncData, &q->ident, q);
+        for (; p->circuits > 0; p->circuits--)
+            q->api.ngSpice_Command("remcirc");
+        q->api.ngSpice_Command("destroy all");
+        if (!is_clean(q)) {
+            fprintf(stderr, "Warning: %s not clean after the job, initialized anew\n",
+                    q->libname);
+            q->api.ngSpice_Init(ng_getchar, ng_getstat, ng_exit, ng_data, ng_initdata,
+                                ng_thread_runs, q);
+            q->api.ngSpice_Init_Sync(ng_VSRCData, ng_ISRCData, ng_SyncData, &q->ident, q);
+            leaks++;
+        }
+        p->dllhandle = NULL;
+    }
+
+    mutex_lock(&pool->cs);
+    for (i = 0; i < e->nparts; i++)
+        if (e->parts[i].slot >= 0) {
+            pool->leased[e->parts[i].slot] = false;
+            e->parts[i].slot = -1;
+            pool->nfree++;
+            pool->resets++;
+        }
+    pool->leaks += leaks;
+    pool->reset_ns += ng_now_ns() - t0;
+    cond_broadcast(&pool->cv);
+    mutex_unlock(&pool->cs);
+    e->pool = NULL;
+}
+
+void
+ngpool_print(ngpool_t *pool)
+{
+    printf("\n** Instance pool **\n");
+    printf("instances:           %d\n", pool->idle->nparts);
+    printf("leases:              %llu\n", (unsigned long long)pool->leases);
+    printf("leases waiting:      %llu\n", (unsigned long long)pool->waits);
+    printf("mean lease wait:     %.3f ms\n",
+           pool->leases ? pool->wait_ns / 1e6 / pool->leases : 0.0);
+    printf("max lease wait:      %.3f ms\n", pool->max_wait_ns / 1e6);
+    printf("instances reset:     %llu\n", (unsigned long long)pool->resets);
+    printf("mean reset:          %.3f ms\n",
+           pool->resets ? pool->reset_ns / 1e6 / pool->resets : 0.0);
+    printf("not clean, re-init:  %llu\n", (unsigned long long)pool->leaks);
+}
@@ -0,0 +1,49 @@
+/*
+Pool of warm ngspice instances.
+
+Loading and ngSpice_Init() of an instance may take longer than a short
+simulation. The pool loads and initializes its instances once, parked
+in an engine of its own. A job engine leases instances instead of
+loading them: ngengine_lease() takes all it needs at once, waiting
+until enough are free, and ngengine_init() only binds them to the job
+partitions by ngSpice_Init_Sync(). ngengine_free() gives them back.
+
+On return each instance is reset: its circuits are removed (remcirc,
+as often as circuits were sourced) and its plots destroyed. Then it is
+checked that nothing of the job is left, no bg thread running, and no
+plot but const. An instance failing the check is counted as a leak and
+initialized anew by ngSpice_Init().
+*/
+
+#ifndef NG_POOL_H
+#define NG_POOL_H
+
+#include "partition.h"
+
+typedef struct ngpool {
+    ngengine_t *idle;          /* the instances, parked, no coupling */
+    bool *leased;
+    int nfree;
+    mutexType cs;
+    condType cv;
+
+    uint64_t leases;           /* engines served */
+    uint64_t waits;            /* leases which had to wait */
+    uint64_t wait_ns, max_wait_ns;
+    uint64_t resets;           /* instances returned */
+    uint64_t leaks;            /* of them not clean after the reset */
+    uint64_t reset_ns;         /* wall time of the resets */
+} ngpool_t;
+
+/* load and initialize size instances with the current loader */
+ngpool_t *ngpool_new(int size);
+void ngpool_free(ngpool_t *pool);
+void ngpool_print(ngpool_t *pool);
+
+/* lease e->nparts instances instead of ngengine_load(); 0 on success */
+int ngengine_lease(ngengine_t *e, ngpool_t *pool);
+
+/* reset the leased instances of e and return them, by ngengine_free() */
+void ngpool_release(ngengine_t *e);
+
+#endif
@@ -0,0 +1,276 @@
+/*
+Platform layer for the shared ngspice parallel test program:
+dynamic library handling for MS Windows and some small helpers.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include "port.h"
+
+#if defined(__linux__)
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#define int64_min (((int64_t) -1) << 63)
+#ifdef _MSC_VER
+#define llabs(x) ((x) < 0 ? -(x) : (x))
+#endif
+
+#if defined(__linux__)
+void
+ng_futex_wait(volatile int *addr, int val, bool shared)
+{
+    syscall(SYS_futex, addr, shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+void
+ng_futex_wake(volatile int *addr, bool shared)
+{
+    syscall(SYS_futex, addr, shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+#endif
+
+void
+ngwake_init(ngwake_t *w)
+{
+    memset(w, 0, sizeof(*w));
+#if !defined(__linux__)
+    mutex_init(&w->lock);
+    cond_init(&w->cond);
+#endif
+}
+
+void
+ngwake_init_shared(ngwake_t *w)
+{
+    memset(w, 0, sizeof(*w));
+    w->shared = true;
+#if defined(__MINGW32__) || defined(_MSC_VER)
+    mutex_init(&w->lock);
+    cond_init(&w->cond);
+#elif !defined(__linux__)
+    mutex_init_shared(&w->lock);
+    cond_init_shared(&w->cond);
+#endif
+}
+
+void
+ngwake_destroy(ngwake_t *w)
+{
+#if !defined(__linux__)
+    mutex_delete(&w->lock);
+    cond_delete(&w->cond);
+#else
+    (void)w;
+#endif
+}
+
+/* The sleeper is counted before it looks for work a last time, the
+   signaller publishes before it looks for sleepers, the fences on
+   both sides make sure at least one of them sees the other. */
+int
+ngwake_prepare(ngwake_t *w)
+{
+    int key = ngat_load_i(&w->seq);
+    ngat_add_i(&w->sleepers, 1);
+    ngat_fence();
+    return key;
+}
+
+void
+ngwake_cancel(ngwake_t *w)
+{
+    ngat_add_i(&w->sleepers, -1);
+}
+
+void
+ngwake_wait(ngwake_t *w, int key)
+{
+#if defined(__linux__)
+    while (ngat_load_i(&w->seq) == key)
+        ng_futex_wait(&w->seq, key, w->shared);
+#else
+    mutex_lock(&w->lock);
+    while (ngat_load_i(&w->seq) == key)
+        cond_wait(&w->cond, &w->lock);
+    mutex_unlock(&w->lock);
+#endif
+    ngat_add_i(&w->sleepers, -1);
+}
+
+void
+ngwake_signal(ngwake_t *w)
+{
+    ngat_fence();
+    if (ngat_load_i(&w->sleepers) == 0)
+        return;
+#if defined(__linux__)
+    ngat_add_i(&w->seq, 1);
+    ng_futex_wake(&w->seq, w->shared);
+#else
+    mutex_lock(&w->lock);
+    ngat_add_i(&w->seq, 1);
+    cond_broadcast(&w->cond);
+    mutex_unlock(&w->lock);
+#endif
+}
+
+bool AlmostEqualUlps(double A, double B, int maxUlps)
+{
+    int64_t aInt, bInt, intDiff;
+
+    union {
+        double d;
+        int64_t i;
+    } uA, uB;
+
+    if (A == B)
+        return true;
+
+    /* If not - the entire method can not work */
+    assert(sizeof(double) == sizeof(int64_t));
+
+    /* Make sure maxUlps is non-negative and small enough that the */
+    /* default NAN won't compare as equal to anything. */
+    assert(maxUlps > 0 && maxUlps < 4 * 1024 * 1024);
+
+    uA.d = A;
+    aInt = uA.i;
+    /* Make aInt lexicographically ordered as a twos-complement int */
+    if (aInt < 0)
+        aInt = int64_min - aInt;
+
+    uB.d = B;
+    bInt = uB.i;
+    /* Make bInt lexicographically ordered as a twos-complement int */
+    if (bInt < 0)
+        bInt = int64_min - bInt;
+
+    intDiff = llabs(aInt - bInt);
+
+    /* printf("A:%e B:%e aInt:%d bInt:%d  diff:%d\n", A, B, aInt, bInt, intDiff); */
+
+    if (intDiff <= maxUlps)
+        return true;
+    return false;
+}
+
+
+/* Case insensitive str eq. */
+/* Like strcasecmp( ) XXX */
+/* ASCII only, without the locale: called in the bg threads, which
+   may have been started by the C library of another namespace
+   (loader.h), where the ctype tables of ours are not set up */
+#define ASCII_LOWER(c) ((c) >= 'A' && (c) <= 'Z' ? (c) - 'A' + 'a' : (c))
+
+int
+cieq(const char *p, const char *s)
+{
+    while (*p) {
+        if (ASCII_LOWER(*p) != ASCII_LOWER(*s))
+            return(false);
+        p++;
+        s++;
+    }
+    return (*s ? false : true);
+}
+
+
+#if defined(__MINGW32__) || defined(_MSC_VER)
+typedef struct thread_arg {
+    void *(*fn)(void *);
+    void *arg;
+} thread_arg;
+
+static DWORD WINAPI
+thread_main(LPVOID p)
+{
+    thread_arg a = *(thread_arg *)p;
+    free(p);
+    a.fn(a.arg);
+    return 0;
+}
+
+int
+ng_thread_start(threadId_t *tid, void *(*fn)(void *), void *arg)
+{
+    thread_arg *a = (thread_arg *)malloc(sizeof(thread_arg));
+    a->fn = fn;
+    a->arg = arg;
+    *tid = CreateThread(NULL, 0, thread_main, a, 0, NULL);
+    if (!*tid) {
+        free(a);
+        return 1;
+    }
+    return 0;
+}
+
+void
+ng_thread_join(threadId_t tid)
+{
+    WaitForSingleObject(tid, INFINITE);
+    CloseHandle(tid);
+}
+#else
+int
+ng_thread_start(threadId_t *tid, void *(*fn)(void *), void *arg)
+{
+    return pthread_create(tid, NULL, fn, arg) != 0;
+}
+
+void
+ng_thread_join(threadId_t tid)
+{
+    pthread_join(tid, NULL);
+}
+#endif
+
+/* Unify LINUX and Windows dynamic library handling */
+#if defined(__MINGW32__) ||  defined(_MSC_VER)
+
+static char errstr[128];
+
+void *dlopen(const char *name,int type)
+{
+    return LoadLibrary((LPCSTR)name);
+}
+
+funptr_t dlsym(void *hDll, const char *funcname)
+{
+    return GetProcAddress(hDll, funcname);
+}
+
+char *dlerror(void)
+{
+    LPVOID lpMsgBuf;
+    char * testerr;
+    DWORD dw = GetLastError();
+
+    FormatMessage(
+        FORMAT_MESSAGE_ALLOCATE_BUFFER |
+        FORMAT_MESSAGE_FROM_SYSTEM |
+        FORMAT_MESSAGE_IGNORE_INSERTS,
+        NULL,
+        dw,
+        MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
+        (LPTSTR) &lpMsgBuf,
+        0,
+        NULL
+    );
+    testerr = (char*)lpMsgBuf;
+    strcpy(errstr,lpMsgBuf);
+    LocalFree(lpMsgBuf);
+    return errstr;
+}
+
+int dlclose (void *lhandle)
+{
+    return (int)FreeLibrary(lhandle);
+}
+#endif
@@ -0,0 +1,317 @@
+/*
+Platform layer for the shared ngspice parallel test program.
+Unified interface for threads, mutexes, condition variables,
+atomics and timers on pthreads and MS Windows.
+*/
+
+#ifndef NG_PORT_H
+#define NG_PORT_H
+
+#ifndef _MSC_VER
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdint.h>
+#else
+#define bool int
+#define true 1
+#define false 0
+#define strdup _strdup
+#define inline __inline
+typedef signed __int64       int64_t;
+typedef unsigned __int64     uint64_t;
+#endif
+
+#if defined(__MINGW32__) ||  defined(_MSC_VER)
+#undef BOOLEAN
+#include <windows.h>
+#else
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+/* Unify LINUX and Windows dynamic library handling */
+#if defined(__MINGW32__) ||  defined(_MSC_VER)
+typedef FARPROC funptr_t;
+void *dlopen (const char *, int);
+funptr_t dlsym (void *, const char *);
+int dlclose (void *);
+char *dlerror (void);
+#define RTLD_LAZY	1	/* lazy function call binding */
+#define RTLD_NOW	2	/* immediate function call binding */
+#define RTLD_GLOBAL	4	/* symbols in this dlopen'ed obj are visible to other dlopen'ed objs */
+#else
+#include <dlfcn.h> /* to load libraries*/
+typedef void *  funptr_t;
+#endif
+
+/* Defines for thread handling, as a unified interface for pthreads
+   and MS Windows threads*/
+/* MS Windows */
+#if defined(__MINGW32__) || defined(_MSC_VER)
+#define mutex_lock(a) EnterCriticalSection(a)
+#define mutex_unlock(a) LeaveCriticalSection(a)
+#define mutex_init(a) InitializeCriticalSection(a)
+#define mutex_delete(a) DeleteCriticalSection(a)
+#define cond_init(a) InitializeConditionVariable(a)
+#define cond_wait(a, m) SleepConditionVariableCS(a, m, INFINITE)
+#define cond_broadcast(a) WakeAllConditionVariable(a)
+#define cond_delete(a)
+typedef CRITICAL_SECTION mutexType;
+typedef CONDITION_VARIABLE condType;
+#define thread_self() GetCurrentThread()
+#define threadid_self() GetThreadId(GetCurrentThread())
+typedef HANDLE threadId_t;
+/* LINUX, CYGWIN, etc. */
+#else
+#define mutex_lock(a) ng_mutex_owned(a, pthread_mutex_lock(a))
+#define mutex_unlock(a) pthread_mutex_unlock(a)
+#define mutex_init(a) pthread_mutex_init(a, NULL)
+#define mutex_delete(a) pthread_mutex_destroy(a)
+#define cond_init(a) pthread_cond_init(a, NULL)
+#define cond_wait(a, m) ng_mutex_owned(m, pthread_cond_wait(a, m))
+#define cond_broadcast(a) pthread_cond_broadcast(a)
+#define cond_delete(a) pthread_cond_destroy(a)
+#define thread_self() pthread_self()
+typedef pthread_mutex_t mutexType;
+typedef pthread_cond_t condType;
+typedef pthread_t threadId_t;
+
+/* Mutex locked with result r. A shared mutex is robust: if its owner
+   has died holding it (a crashed worker process), the next one locking
+   it gets EOWNERDEAD and takes it over, with the data it protects as
+   the owner has left them. */
+static inline int ng_mutex_owned(mutexType *m, int r)
+{
+#if defined(__linux__)
+    if (r == EOWNERDEAD) {
+        pthread_mutex_consistent(m);
+        r = 0;
+    }
+#else
+    (void)m;
+#endif
+    return r;
+}
+
+/* mutex and condition variable in memory shared by processes */
+static inline void mutex_init_shared(mutexType *m)
+{
+    pthread_mutexattr_t a;
+    pthread_mutexattr_init(&a);
+    pthread_mutexattr_setpshared(&a, PTHREAD_PROCESS_SHARED);
+#if defined(__linux__)
+    pthread_mutexattr_setrobust(&a, PTHREAD_MUTEX_ROBUST);
+#endif
+    pthread_mutex_init(m, &a);
+    pthread_mutexattr_destroy(&a);
+}
+static inline void cond_init_shared(condType *c)
+{
+    pthread_condattr_t a;
+    pthread_condattr_init(&a);
+    pthread_condattr_setpshared(&a, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(c, &a);
+    pthread_condattr_destroy(&a);
+}
+#endif
+
+/* cond_wait() for at most ms milliseconds, false on timeout */
+static inline bool cond_wait_ms(condType *c, mutexType *m, int ms)
+{
+#if defined(__MINGW32__) || defined(_MSC_VER)
+    return SleepConditionVariableCS(c, m, (DWORD)ms) != 0;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ng_mutex_owned(m, pthread_cond_timedwait(c, m, &ts)) == 0;
+#endif
+}
+
+/* Atomic operations on int and 64 bit counters. Loads acquire,
+   stores release, read-modify-write is sequentially consistent. */
+#if defined(_MSC_VER)
+#include <intrin.h>
+static inline int ngat_load_i(volatile int *p)
+{ int v = *p; _ReadWriteBarrier(); return v; }
+static inline void ngat_store_i(volatile int *p, int v)
+{ _ReadWriteBarrier(); *p = v; MemoryBarrier(); }
+static inline int ngat_add_i(volatile int *p, int v)
+{ return (int)InterlockedExchangeAdd((volatile LONG *)p, (LONG)v); }
+static inline bool ngat_cas_i(volatile int *p, int *expected, int desired)
+{
+    int old = (int)InterlockedCompareExchange((volatile LONG *)p, (LONG)desired, (LONG)*expected);
+    if (old == *expected)
+        return true;
+    *expected = old;
+    return false;
+}
+static inline uint64_t ngat_load_u64(volatile uint64_t *p)
+{ return (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)p, 0, 0); }
+static inline void ngat_store_u64(volatile uint64_t *p, uint64_t v)
+{ InterlockedExchange64((volatile LONG64 *)p, (LONG64)v); }
+static inline uint64_t ngat_add_u64(volatile uint64_t *p, uint64_t v)
+{ return (uint64_t)InterlockedExchangeAdd64((volatile LONG64 *)p, (LONG64)v); }
+static inline bool ngat_cas_u64(volatile uint64_t *p, uint64_t *expected, uint64_t desired)
+{
+    uint64_t old = (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)p,
+                   (LONG64)desired, (LONG64)*expected);
+    if (old == *expected)
+        return true;
+    *expected = old;
+    return false;
+}
+#define ngat_fence() MemoryBarrier()
+#define ng_cpu_relax() YieldProcessor()
+#else
+#define ngat_load_i(p)           __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ngat_store_i(p, v)       __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ngat_add_i(p, v)         __atomic_fetch_add((p), (v), __ATOMIC_SEQ_CST)
+#define ngat_cas_i(p, e, d)      __atomic_compare_exchange_n((p), (e), (d), false, \
+                                     __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE)
+#define ngat_load_u64(p)         __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ngat_store_u64(p, v)     __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ngat_add_u64(p, v)       __atomic_fetch_add((p), (v), __ATOMIC_SEQ_CST)
+#define ngat_cas_u64(p, e, d)    __atomic_compare_exchange_n((p), (e), (d), false, \
+                                     __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE)
+#define ngat_fence()             __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#if defined(__i386__) || defined(__x86_64__)
+#define ng_cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define ng_cpu_relax() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define ng_cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+#endif
+
+/* raise a 64 bit maximum, e.g. for worst case latencies */
+static inline void ngat_max_u64(volatile uint64_t *p, uint64_t v)
+{
+    uint64_t old = ngat_load_u64(p);
+    while (old < v && !ngat_cas_u64(p, &old, v))
+        ;
+}
+
+/* monotonic wall clock in nanoseconds */
+static inline uint64_t ng_now_ns(void)
+{
+#if defined(__MINGW32__) || defined(_MSC_VER)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER cnt;
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&cnt);
+    return (uint64_t)((double)cnt.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/* user + system cpu time of the whole process in nanoseconds */
+static inline uint64_t ng_cputime_ns(void)
+{
+#if defined(__MINGW32__) || defined(_MSC_VER)
+    FILETIME ct, et, kt, ut;
+    ULARGE_INTEGER k, u;
+    GetProcessTimes(GetCurrentProcess(), &ct, &et, &kt, &ut);
+    k.LowPart = kt.dwLowDateTime;
+    k.HighPart = kt.dwHighDateTime;
+    u.LowPart = ut.dwLowDateTime;
+    u.HighPart = ut.dwHighDateTime;
+    return (k.QuadPart + u.QuadPart) * 100;
+#else
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ((uint64_t)ru.ru_utime.tv_sec + (uint64_t)ru.ru_stime.tv_sec) * 1000000000ull
+           + ((uint64_t)ru.ru_utime.tv_usec + (uint64_t)ru.ru_stime.tv_usec) * 1000ull;
+#endif
+}
+
+/* give up the time slice */
+static inline void ng_yield(void)
+{
+#if defined(__MINGW32__) || defined(_MSC_VER)
+    Sleep(0);
+#else
+    sched_yield();
+#endif
+}
+
+/* number of online processors */
+static inline int ng_ncpus(void)
+{
+#if defined(__MINGW32__) || defined(_MSC_VER)
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return (int)si.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+/* sleep for some milliseconds */
+static inline void ng_msleep(int ms)
+{
+#if defined(__MINGW32__) || defined(_MSC_VER)
+    Sleep(ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+#endif
+}
+
+#if defined(__linux__)
+/* Sleep while *addr is val, wake up all sleeping on addr. The private
+   futexes are faster, shared ones work across processes. */
+void ng_futex_wait(volatile int *addr, int val, bool shared);
+void ng_futex_wake(volatile int *addr, bool shared);
+#endif
+
+/* Wakeup of a thread sleeping until another one has published some
+   work, e.g. the consumer of a ring (ring.h). The sleeper announces
+   itself by ngwake_prepare(), looks for work once more, then calls
+   ngwake_cancel() if it found some, else ngwake_wait() with the key
+   returned. ngwake_signal() after publishing costs a fence and a load
+   as long as nobody sleeps, so it may be called for every item. */
+typedef struct ngwake {
+    volatile int seq;          /* bumped by a signal with sleepers */
+    volatile int sleepers;
+    bool shared;               /* sleepers in several processes */
+#if !defined(__linux__)
+    mutexType lock;
+    condType cond;
+#endif
+} ngwake_t;
+
+void ngwake_init(ngwake_t *w);
+void ngwake_init_shared(ngwake_t *w);
+void ngwake_destroy(ngwake_t *w);
+int ngwake_prepare(ngwake_t *w);
+void ngwake_cancel(ngwake_t *w);
+void ngwake_wait(ngwake_t *w, int key);
+void ngwake_signal(ngwake_t *w);
+
+/* start a thread of our own, and wait for its end; 0 on success */
+int ng_thread_start(threadId_t *tid, void *(*fn)(void *), void *arg);
+void ng_thread_join(threadId_t tid);
+
+/* case insensitive string comparison */
+int cieq(const char *p, const char *s);
+/* comparing two double numbers */
+bool AlmostEqualUlps(double A, double B, int maxUlps);
+
+#endif
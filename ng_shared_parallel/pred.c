@@ -0,0 +1,112 @@
+/*
+Interface predictors for ng_VSRCData().
+*/
+
+#include "pred.h"
+
+/* index of the last sample at or before t, -1 if t is before all */
+static int
+last_before(const ngsample_t *s, int n, double t)
+{
+    int i = n - 1;
+
+    while (i >= 0 && s[i].t > t)
+        i--;
+    return i;
+}
+
+static double
+lerp(const ngsample_t *a, const ngsample_t *b, double t)
+{
+    if (b->t <= a->t)
+        return b->v;
+    return a->v + (b->v - a->v) * (t - a->t) / (b->t - a->t);
+}
+
+static double
+pred_hold(const ngsample_t *s, int n, double t, int order)
+{
+    int i = last_before(s, n, t);
+
+    (void)order;
+    return s[i < 0 ? 0 : i].v;
+}
+
+static double
+pred_linear(const ngsample_t *s, int n, double t, int order)
+{
+    int i = last_before(s, n, t);
+
+    (void)order;
+    if (i < 0)
+        return s[0].v;
+    if (i < n - 1)
+        return lerp(&s[i], &s[i + 1], t);
+    if (n < 2)
+        return s[i].v;
+    return lerp(&s[n - 2], &s[n - 1], t);
+}
+
+/* Lagrange polynomial through the last order+1 samples */
+static double
+pred_poly(const ngsample_t *s, int n, double t, int order)
+{
+    int i = last_before(s, n, t), j, k, m;
+    double v = 0;
+
+    if (i < 0)
+        return s[0].v;
+    if (i < n - 1)
+        return lerp(&s[i], &s[i + 1], t);
+    m = (order + 1 < n) ? order + 1 : n;
+    if (m < 3)
+        return pred_linear(s, n, t, 1);
+    s += n - m;
+    for (j = 0; j < m; j++) {
+        double l = 1;
+        for (k = 0; k < m; k++) {
+            if (k == j)
+                continue;
+            /* samples too close for a stable polynomial */
+            if (s[j].t == s[k].t)
+                return pred_linear(s, m, t, 1);
+            l *= (t - s[k].t) / (s[j].t - s[k].t);
+        }
+        v += l * s[j].v;
+    }
+    return v;
+}
+
+static const ngpredictor_t predictors[] = {
+    { "hold",   pred_hold,   0 },
+    { "linear", pred_linear, 1 },
+    { "poly2",  pred_poly,   2 },
+    { "poly3",  pred_poly,   3 },
+    { "poly4",  pred_poly,   4 },
+    { "poly5",  pred_poly,   5 },
+    { "poly6",  pred_poly,   6 },
+};
+
+const ngpredictor_t *
+ngpred_find(const char *name)
+{
+    size_t i;
+
+    if (cieq(name, "poly"))
+        name = "poly2";
+    for (i = 0; i < sizeof(predictors) / sizeof(predictors[0]); i++)
+        if (cieq(predictors[i].name, name) && predictors[i].order <= NGPRED_MAXORDER)
+            return &predictors[i];
+    return NULL;
+}
+
+double
+ngpred_value(const ngpredictor_t *pr, ngchan_t *c, double t)
+{
+    ngsample_t w[NGCHAN_HISTORY + 1];
+    int n = ngchan_window(c, t, w, NGCHAN_HISTORY + 1);
+
+    if (n == 0)
+        return 0;
+    return pr->fn(w, n, t, pr->order);
+}
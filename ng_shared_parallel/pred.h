@@ -0,0 +1,41 @@
+/*
+Interface predictors: the value of an EXTERNAL source at the time asked
+for by ngspice, calculated from the samples of the driving partition.
+
+If the driving partition has already passed that time, the value is
+interpolated. Otherwise it is predicted from the recent history:
+
+    hold     zero-order hold, the last sample at or before the time
+    linear   linear interpolation, linear extrapolation from the
+             last two samples
+    polyN    linear interpolation, extrapolation by the polynomial
+             through the last N+1 samples (Adams-Bashforth style),
+             N = 2 ... NGPRED_MAXORDER, poly is poly2
+
+A better prediction lets the partitions run with looser synchronization
+and larger consensus steps at the same accuracy.
+*/
+
+#ifndef NG_PRED_H
+#define NG_PRED_H
+
+#include "chan.h"
+
+#define NGPRED_MAXORDER (NGCHAN_HISTORY - 2)
+
+/* samples s[0 ... n-1] in increasing time, n > 0 */
+typedef double (ngpredict_fn)(const ngsample_t *s, int n, double t, int order);
+
+typedef struct ngpredictor {
+    char name[16];
+    ngpredict_fn *fn;
+    int order;
+} ngpredictor_t;
+
+/* predictor by name, NULL if unknown */
+const ngpredictor_t *ngpred_find(const char *name);
+
+/* value of the channel at time t, 0 V if it is empty */
+double ngpred_value(const ngpredictor_t *pr, ngchan_t *c, double t);
+
+#endif
@@ -0,0 +1,246 @@
+/*
+Instrumentation of the synchronization, see prof.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "prof.h"
+
+void
+ngprof_start(ngengine_t *e)
+{
+    ngprof_t *pf = e->prof;
+
+    if (!e->profile || e->workers)
+        return;
+    if (!pf) {
+        pf = (ngprof_t *)calloc(1, sizeof(ngprof_t));
+        pf->parts = (ngprof_part_t *)calloc((size_t)e->nparts, sizeof(ngprof_part_t));
+        e->prof = pf;
+    }
+    memset(pf->parts, 0, (size_t)e->nparts * sizeof(ngprof_part_t));
+    pf->barriers = pf->critical_ns = pf->compute_ns = pf->slack_ns = 0;
+    pf->deltas = 0;
+    pf->dmin = pf->dmax = pf->dsum = 0;
+    memset(pf->decade, 0, sizeof(pf->decade));
+}
+
+void
+ngprof_free(ngengine_t *e)
+{
+    if (!e->prof)
+        return;
+    free(e->prof->parts);
+    free(e->prof);
+    e->prof = NULL;
+}
+
+static int
+bucket(uint64_t ns)
+{
+    int k;
+
+    if (!ns)
+        return 0;
+#if defined(__GNUC__)
+    k = 63 - __builtin_clzll(ns);
+#else
+    for (k = 0; ns > 1; k++)
+        ns >>= 1;
+#endif
+    return k < NGPROF_BUCKETS ? k : NGPROF_BUCKETS - 1;
+}
+
+static void
+hist_add(ngprof_hist_t *h, uint64_t ns)
+{
+    h->n++;
+    h->sum += ns;
+    if (ns > h->max)
+        h->max = ns;
+    h->bucket[bucket(ns)]++;
+}
+
+/* upper end of the bucket holding the q quantile, at most the maximum */
+static uint64_t
+hist_quantile(const ngprof_hist_t *h, double q)
+{
+    uint64_t need = (uint64_t)(q * h->n), n = 0;
+    int k;
+
+    for (k = 0; k < NGPROF_BUCKETS; k++) {
+        n += h->bucket[k];
+        if (n > need)
+            break;
+    }
+    if (k >= NGPROF_BUCKETS - 1)
+        return h->max;
+    return (2ull << k) - 1 < h->max ? (2ull << k) - 1 : h->max;
+}
+
+void
+ngprof_in(ngprof_t *pf, ngpart_t *p, uint64_t t_in)
+{
+    ngprof_part_t *pp = &pf->parts[p - p->engine->parts];
+
+    /* the first step includes the setup of the run */
+    if (!pp->out_ns)
+        return;
+    hist_add(&pp->compute, t_in - pp->out_ns);
+    pp->pending += t_in - pp->out_ns;
+}
+
+void
+ngprof_out(ngprof_t *pf, ngpart_t *p, uint64_t t_in, uint64_t t_out)
+{
+    ngprof_part_t *pp = &pf->parts[p - p->engine->parts];
+
+    hist_add(&pp->wait, t_out - t_in);
+    pp->out_ns = t_out;
+}
+
+void
+ngprof_last(ngprof_t *pf, ngpart_t *p)
+{
+    pf->parts[p - p->engine->parts].last++;
+}
+
+void
+ngprof_barrier(ngengine_t *e, double delta)
+{
+    ngprof_t *pf = e->prof;
+    uint64_t max = 0, sum = 0;
+    int i, n = 0, k;
+
+    if (!pf)
+        return;
+    for (i = 0; i < e->nparts; i++) {
+        ngpart_t *p = &e->parts[i];
+        ngprof_part_t *pp = &pf->parts[i];
+        if (!ngat_load_i(&p->insync) || ngat_load_i(&p->unsynced))
+            continue;
+        n++;
+        sum += pp->pending;
+        if (pp->pending > max)
+            max = pp->pending;
+        pp->pending = 0;
+        if (delta > 0 && p->delta == delta)
+            pp->limiting++;
+    }
+    pf->barriers++;
+    pf->critical_ns += max;
+    pf->compute_ns += sum;
+    pf->slack_ns += (uint64_t)n * max - sum;
+    if (delta <= 0)
+        return;
+    if (!pf->deltas || delta < pf->dmin)
+        pf->dmin = delta;
+    if (delta > pf->dmax)
+        pf->dmax = delta;
+    pf->dsum += delta;
+    pf->deltas++;
+    k = (int)floor(log10(delta)) + 18;
+    pf->decade[k < 0 ? 0 : k >= NGPROF_DECADES ? NGPROF_DECADES - 1 : k]++;
+}
+
+/* ns as text, in the unit fitting best */
+static const char *
+fmt_ns(char *buf, double ns)
+{
+    if (ns < 1e3)
+        sprintf(buf, "%.0f ns", ns);
+    else if (ns < 1e6)
+        sprintf(buf, "%.1f us", ns / 1e3);
+    else if (ns < 1e9)
+        sprintf(buf, "%.1f ms", ns / 1e6);
+    else
+        sprintf(buf, "%.2f s", ns / 1e9);
+    return buf;
+}
+
+static void
+print_hist(ngengine_t *e, const char *title, int which)
+{
+    ngprof_t *pf = e->prof;
+    int i, k, lo = NGPROF_BUCKETS, hi = -1, n = e->nparts < 16 ? e->nparts : 16;
+    char buf[32];
+
+    for (i = 0; i < n; i++)
+        for (k = 0; k < NGPROF_BUCKETS; k++)
+            if ((which ? pf->parts[i].wait : pf->parts[i].compute).bucket[k]) {
+                lo = k < lo ? k : lo;
+                hi = k > hi ? k : hi;
+            }
+    if (hi < 0)
+        return;
+    printf("%-21s", title);
+    for (i = 0; i < n; i++)
+        printf(" %9s %d", "part", e->parts[i].ident);
+    printf("\n");
+    for (k = lo; k <= hi; k++) {
+        printf("  < %-16s", k < NGPROF_BUCKETS - 1 ? fmt_ns(buf, (double)(2ull << k)) : "more");
+        for (i = 0; i < n; i++)
+            printf(" %11llu", (unsigned long long)(which ? pf->parts[i].wait
+                                                         : pf->parts[i].compute).bucket[k]);
+        printf("\n");
+    }
+}
+
+void
+ngprof_print(ngengine_t *e)
+{
+    ngprof_t *pf = e->prof;
+    char b1[32], b2[32], b3[32];
+    int i, k, bound = -1;
+
+    if (!pf)
+        return;
+    printf("\n** Instrumentation of the synchronization (%llu barriers) **\n",
+           (unsigned long long)pf->barriers);
+    if (pf->barriers) {
+        printf("critical path:       %s of compute, %s wall\n", fmt_ns(b1, (double)pf->critical_ns),
+               fmt_ns(b2, (double)e->wall_ns));
+        if (pf->compute_ns + pf->slack_ns > 0)
+            printf("load imbalance:      %.1f %% of the compute time lost waiting for the slowest\n",
+                   100.0 * pf->slack_ns / (pf->compute_ns + pf->slack_ns));
+    }
+    if (pf->deltas) {
+        printf("consensus delta:     min %g, mean %g, max %g s\n", pf->dmin, pf->dsum / pf->deltas,
+               pf->dmax);
+        printf("  per decade:       ");
+        for (k = 0; k < NGPROF_DECADES; k++)
+            if (pf->decade[k])
+                printf(" 1e%d: %llu", k - 18, (unsigned long long)pf->decade[k]);
+        printf("\n");
+    }
+    for (i = 0; i < e->nparts && i < 16; i++) {
+        ngprof_part_t *pp = &pf->parts[i];
+        if (!pp->compute.n)
+            continue;
+        printf("  partition %3d:     compute mean %s, p99 %s, max %s\n", e->parts[i].ident,
+               fmt_ns(b1, (double)pp->compute.sum / pp->compute.n),
+               fmt_ns(b2, (double)hist_quantile(&pp->compute, 0.99)),
+               fmt_ns(b3, (double)pp->compute.max));
+        printf("  partition %3d:     wait mean %s, p99 %s, max %s\n", e->parts[i].ident,
+               fmt_ns(b1, (double)pp->wait.sum / pp->wait.n),
+               fmt_ns(b2, (double)hist_quantile(&pp->wait, 0.99)), fmt_ns(b3, (double)pp->wait.max));
+        if (pf->deltas)
+            printf("  partition %3d:     last arriver %.1f %%, delta limiting %.1f %%, redone %llu\n",
+                   e->parts[i].ident, 100.0 * pp->last / pf->barriers,
+                   100.0 * pp->limiting / pf->deltas, (unsigned long long)e->parts[i].redos);
+        else if (pf->barriers)
+            printf("  partition %3d:     last arriver %.1f %%, redone %llu\n", e->parts[i].ident,
+                   100.0 * pp->last / pf->barriers, (unsigned long long)e->parts[i].redos);
+    }
+    for (i = 0; i < e->nparts; i++)
+        if (pf->parts[i].last && (bound < 0 || pf->parts[i].last > pf->parts[bound].last))
+            bound = i;
+    if (bound >= 0)
+        printf("bounding partition:  %d, last arriver at %.1f %% of the barriers\n",
+               e->parts[bound].ident, 100.0 * pf->parts[bound].last / pf->barriers);
+    print_hist(e, "compute per step:", 0);
+    print_hist(e, "wait per step:", 1);
+}
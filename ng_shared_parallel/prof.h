@@ -0,0 +1,74 @@
+/*
+Instrumentation of the synchronization.
+
+Where a partitioned run spends its time is decided in ng_SyncData():
+every partition computes its step, then waits at the barrier for the
+slowest one. With the instrumentation on, ng_SyncData() takes the time
+when a partition comes in and goes out, and per partition it keeps
+
+    compute     from leaving ng_SyncData() to coming in again
+    wait        in ng_SyncData(), at the barrier or verifying inputs
+
+in log2 histograms, so the cost is a few adds per step and nothing is
+shared between the bg threads. The thread completing a barrier (a time
+step in lockstep, a rendezvous in multirate) adds up the compute times
+since the last one: the longest is on the critical path, the difference
+of the others to it is lost to load imbalance. It also keeps the
+consensus delta and which partition's delta it was. A partition which
+is the last arriver most of the time bounds the critical path.
+
+The summary is printed by ngengine_print_stats(). Worker processes are
+not instrumented.
+*/
+
+#ifndef NG_PROF_H
+#define NG_PROF_H
+
+#include "partition.h"
+
+/* bucket k holds 2^k ... 2^(k+1) - 1 ns, the last one all above */
+#define NGPROF_BUCKETS 32
+/* consensus delta, bucket k holds 10^(k-18) ... 10^(k-17) s */
+#define NGPROF_DECADES 18
+
+typedef struct ngprof_hist {
+    uint64_t n, sum, max;
+    uint64_t bucket[NGPROF_BUCKETS];
+} ngprof_hist_t;
+
+typedef struct ngprof_part {
+    ngprof_hist_t compute, wait;
+    uint64_t out_ns;           /* went out of ng_SyncData(), 0 before the first */
+    uint64_t pending;          /* compute since the last barrier */
+    uint64_t last;             /* times it completed the barrier */
+    uint64_t limiting;         /* times its delta was the consensus */
+} ngprof_part_t;
+
+typedef struct ngprof {
+    ngprof_part_t *parts;
+    uint64_t barriers;
+    uint64_t critical_ns;      /* longest compute per barrier, summed */
+    uint64_t compute_ns;       /* all compute between barriers */
+    uint64_t slack_ns;         /* waiting for the longest */
+    uint64_t deltas;
+    double dmin, dmax, dsum;
+    uint64_t decade[NGPROF_DECADES];
+} ngprof_t;
+
+/* sync_prepare(): instrument the run if e->profile */
+void ngprof_start(ngengine_t *e);
+void ngprof_free(ngengine_t *e);
+void ngprof_print(ngengine_t *e);
+
+/* ng_SyncData(): p comes in at t_in, goes out at t_out */
+void ngprof_in(ngprof_t *pf, ngpart_t *p, uint64_t t_in);
+void ngprof_out(ngprof_t *pf, ngpart_t *p, uint64_t t_in, uint64_t t_out);
+
+/* p has completed the barrier */
+void ngprof_last(ngprof_t *pf, ngpart_t *p);
+
+/* called by the thread completing a barrier, all partitions in it;
+   delta is the consensus, 0 if there is none */
+void ngprof_barrier(ngengine_t *e, double delta);
+
+#endif
@@ -0,0 +1,79 @@
+/*
+Single producer, single consumer ring.
+
+The sample channels (chan.h), the handoff of points (handoff.h) and the
+timeline (trace.h) pass items from one thread to exactly one other:
+the bg thread of a partition to another bg thread or to a consumer
+thread. ngring_t is the index part of such a ring, the items are in an
+array of the user, item i in slot i & mask. Only the producer writes the
+head and only the consumer the tail, each on a cache line of its own,
+published with release and read with acquire semantics, so neither side
+takes a lock. What happens on a full ring is up to the user.
+
+A consumer thread emptying rings sleeps on an ngwake_t (port.h) while
+they are all empty, the producers signal it after ngring_push().
+*/
+
+#ifndef NG_RING_H
+#define NG_RING_H
+
+#include "port.h"
+
+typedef struct ngring {
+    volatile uint64_t head;    /* next item to be written, producer */
+    char pad1[64 - sizeof(uint64_t)];
+    volatile uint64_t tail;    /* oldest item not yet consumed, consumer */
+    char pad2[64 - sizeof(uint64_t)];
+    uint64_t mask;             /* slots - 1 */
+} ngring_t;
+
+/* an empty ring of at least size slots, a power of 2; returns the slots */
+static inline uint64_t ngring_init(ngring_t *r, uint64_t size)
+{
+    uint64_t n = 2;
+
+    while (n < size)
+        n *= 2;
+    r->head = r->tail = 0;
+    r->mask = n - 1;
+    return n;
+}
+
+/* empty the ring, only while neither side runs */
+static inline void ngring_reset(ngring_t *r)
+{
+    ngat_store_u64(&r->head, 0);
+    ngat_store_u64(&r->tail, 0);
+}
+
+/* producer: items in the ring, and the slot of the next one */
+static inline uint64_t ngring_depth(ngring_t *r)
+{
+    return r->head - ngat_load_u64(&r->tail);
+}
+static inline bool ngring_full(ngring_t *r)
+{
+    return ngring_depth(r) > r->mask;
+}
+static inline uint64_t ngring_slot(ngring_t *r)
+{
+    return r->head & r->mask;
+}
+/* producer: publish the item written to ngring_slot() */
+static inline void ngring_push(ngring_t *r)
+{
+    ngat_store_u64(&r->head, r->head + 1);
+}
+
+/* consumer: index of the first item after the ones published */
+static inline uint64_t ngring_end(ngring_t *r)
+{
+    return ngat_load_u64(&r->head);
+}
+/* consumer: release the slots before item i */
+static inline void ngring_pop_to(ngring_t *r, uint64_t i)
+{
+    ngat_store_u64(&r->tail, i);
+}
+
+#endif
@@ -0,0 +1,823 @@
+/*
+Netlist partitioner: recursive Fiduccia-Mattheyses bisection and
+writing of the partition netlists.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "split.h"
+#include "coupling.h"
+
+/* hypergraph of the partitioned devices, compressed rows */
+typedef struct graph {
+    int nv;
+    int *cluster;              /* vertex of each device, -1 if shared */
+    int *weight;               /* devices per vertex */
+    char *rail;                /* ground and the nodes of shared sources */
+    int *vstart, *vnets;       /* nodes of vertex */
+    int nn;
+    int *nstart, *npins;       /* vertices of node */
+} graph_t;
+
+/* state of one bisection, local indices */
+typedef struct fm {
+    int nv, nn, pmax;
+    int *vw;                   /* vertex weights */
+    int *vstart, *vnets;
+    int *nstart, *npins;
+    int *side, *gain, *locked, *moves;
+    int *cnt;                  /* cnt[2 * net + side] */
+    int *head, *next, *prev;   /* gain buckets per side */
+    int maxg[2];
+    int w0, target0, tol;      /* weight of side 0 */
+} fm_t;
+
+typedef struct ctx {
+    const ngnetlist_t *nl;
+    graph_t g;
+    ngsplit_t *s;
+    int *lnet;                 /* scratch, node -> local node */
+    int *vpart;                /* partition of each vertex */
+} ctx_t;
+
+static int
+find_root(int *up, int i)
+{
+    while (up[i] != i)
+        i = up[i] = up[up[i]];
+    return i;
+}
+
+static void
+graph_build(graph_t *g, const ngnetlist_t *nl, bool current)
+{
+    int *up = (int *)malloc((nl->ndevs + 1) * sizeof(int));
+    int *first = (int *)malloc((nl->nnets + 1) * sizeof(int));
+    int *order = (int *)malloc((nl->ndevs + 1) * sizeof(int));
+    int *mark = (int *)malloc((nl->nnets + 1) * sizeof(int));
+    int *pos, i, k, n, v, total = 0;
+
+    /* ground and the nodes of shared sources are everywhere */
+    g->rail = (char *)calloc(nl->nnets, 1);
+    g->rail[0] = 1;
+    for (i = 0; i < nl->ndevs; i++)
+        if (nl->devs[i].shared)
+            for (k = 0; k < nl->devs[i].nnets; k++)
+                g->rail[nl->devs[i].nets[k]] = 1;
+
+    /* Devices connected by driving pins form one vertex, the transistors
+       of a gate are never cut apart. With the load currents coupled back
+       every device is a vertex of its own. */
+    for (n = 0; n < nl->nnets; n++)
+        first[n] = -1;
+    for (i = 0; i < nl->ndevs; i++)
+        up[i] = i;
+    for (i = 0; i < nl->ndevs; i++) {
+        const ngdev_t *d = &nl->devs[i];
+        if (d->shared)
+            continue;
+        total += d->nnets;
+        for (k = 0; k < d->nnets && !current; k++) {
+            n = d->nets[k];
+            if (g->rail[n] || !ngnetlist_drives(d, k))
+                continue;
+            if (first[n] < 0)
+                first[n] = i;
+            else
+                up[find_root(up, i)] = find_root(up, first[n]);
+        }
+    }
+
+    g->nv = 0;
+    g->cluster = (int *)malloc((nl->ndevs + 1) * sizeof(int));
+    for (i = 0; i < nl->ndevs; i++)
+        order[i] = -1;
+    for (i = 0; i < nl->ndevs; i++) {
+        int r;
+        g->cluster[i] = -1;
+        if (nl->devs[i].shared)
+            continue;
+        r = find_root(up, i);
+        if (order[r] < 0)
+            order[r] = g->nv++;
+        g->cluster[i] = order[r];
+    }
+    g->weight = (int *)calloc(g->nv + 1, sizeof(int));
+    for (i = 0; i < nl->ndevs; i++)
+        if (g->cluster[i] >= 0)
+            g->weight[g->cluster[i]]++;
+
+    /* devices sorted by vertex */
+    pos = (int *)calloc(g->nv + 1, sizeof(int));
+    for (v = 0; v < g->nv; v++)
+        pos[v + 1] = pos[v] + g->weight[v];
+    for (i = 0; i < nl->ndevs; i++)
+        if (g->cluster[i] >= 0)
+            order[pos[g->cluster[i]]++] = i;
+
+    /* nodes of every vertex, without rails and duplicates */
+    g->vstart = (int *)malloc((g->nv + 1) * sizeof(int));
+    g->vnets = (int *)malloc((total + 1) * sizeof(int));
+    for (n = 0; n < nl->nnets; n++)
+        mark[n] = -1;
+    for (v = 0, k = 0, i = 0; v < g->nv; v++) {
+        int end = i + g->weight[v];
+        g->vstart[v] = k;
+        for (; i < end; i++) {
+            const ngdev_t *d = &nl->devs[order[i]];
+            int m;
+            for (m = 0; m < d->nnets; m++) {
+                n = d->nets[m];
+                if (!g->rail[n] && mark[n] != v) {
+                    mark[n] = v;
+                    g->vnets[k++] = n;
+                }
+            }
+        }
+    }
+    g->vstart[g->nv] = k;
+
+    /* and the vertices of every node */
+    g->nn = nl->nnets;
+    g->nstart = (int *)calloc(g->nn + 1, sizeof(int));
+    g->npins = (int *)malloc((g->vstart[g->nv] + 1) * sizeof(int));
+    for (k = 0; k < g->vstart[g->nv]; k++)
+        g->nstart[g->vnets[k] + 1]++;
+    for (i = 0; i < g->nn; i++)
+        g->nstart[i + 1] += g->nstart[i];
+    {
+        int *fill = (int *)malloc(g->nn * sizeof(int));
+        memcpy(fill, g->nstart, g->nn * sizeof(int));
+        for (i = 0; i < g->nv; i++)
+            for (k = g->vstart[i]; k < g->vstart[i + 1]; k++)
+                g->npins[fill[g->vnets[k]]++] = i;
+        free(fill);
+    }
+    free(up);
+    free(first);
+    free(order);
+    free(mark);
+    free(pos);
+}
+
+static void
+graph_free(graph_t *g)
+{
+    free(g->cluster);
+    free(g->weight);
+    free(g->rail);
+    free(g->vstart);
+    free(g->vnets);
+    free(g->nstart);
+    free(g->npins);
+}
+
+/* subgraph of the vertices verts, nodes with at least two pins in it */
+static void
+fm_build(fm_t *f, ctx_t *c, const int *verts, int nv)
+{
+    const graph_t *g = &c->g;
+    int *touched, ntouched = 0, total = 0, i, k, n;
+
+    memset(f, 0, sizeof(*f));
+    f->nv = nv;
+    f->vw = (int *)malloc((nv + 1) * sizeof(int));
+    for (i = 0; i < nv; i++)
+        f->vw[i] = g->weight[verts[i]];
+    for (i = 0; i < nv; i++)
+        total += g->vstart[verts[i] + 1] - g->vstart[verts[i]];
+    touched = (int *)malloc((total + 1) * sizeof(int));
+    for (i = 0; i < nv; i++)
+        for (k = g->vstart[verts[i]]; k < g->vstart[verts[i] + 1]; k++)
+            if (c->lnet[g->vnets[k]]++ == 0)
+                touched[ntouched++] = g->vnets[k];
+    for (i = 0; i < ntouched; i++) {
+        n = touched[i];
+        c->lnet[n] = c->lnet[n] >= 2 ? f->nn++ : -1;
+    }
+
+    f->vstart = (int *)malloc((nv + 1) * sizeof(int));
+    f->vnets = (int *)malloc((total + 1) * sizeof(int));
+    f->nstart = (int *)calloc(f->nn + 1, sizeof(int));
+    f->npins = (int *)malloc((total + 1) * sizeof(int));
+    f->vstart[0] = 0;
+    for (i = 0; i < nv; i++) {
+        int m = f->vstart[i];
+        for (k = g->vstart[verts[i]]; k < g->vstart[verts[i] + 1]; k++)
+            if ((n = c->lnet[g->vnets[k]]) >= 0) {
+                f->vnets[m++] = n;
+                f->nstart[n + 1]++;
+            }
+        f->vstart[i + 1] = m;
+        if (m - f->vstart[i] > f->pmax)
+            f->pmax = m - f->vstart[i];
+    }
+    for (n = 0; n < f->nn; n++)
+        f->nstart[n + 1] += f->nstart[n];
+    {
+        int *fill = (int *)malloc((f->nn + 1) * sizeof(int));
+        memcpy(fill, f->nstart, (f->nn + 1) * sizeof(int));
+        for (i = 0; i < nv; i++)
+            for (k = f->vstart[i]; k < f->vstart[i + 1]; k++)
+                f->npins[fill[f->vnets[k]]++] = i;
+        free(fill);
+    }
+
+    /* leave the scratch arrays clean for the next bisection */
+    for (i = 0; i < ntouched; i++)
+        c->lnet[touched[i]] = 0;
+    free(touched);
+
+    if (f->pmax == 0)
+        f->pmax = 1;
+    f->side = (int *)malloc((nv + 1) * sizeof(int));
+    f->gain = (int *)malloc((nv + 1) * sizeof(int));
+    f->locked = (int *)malloc((nv + 1) * sizeof(int));
+    f->moves = (int *)malloc((nv + 1) * sizeof(int));
+    f->next = (int *)malloc((nv + 1) * sizeof(int));
+    f->prev = (int *)malloc((nv + 1) * sizeof(int));
+    f->cnt = (int *)malloc((2 * f->nn + 1) * sizeof(int));
+    f->head = (int *)malloc(2 * (2 * f->pmax + 1) * sizeof(int));
+}
+
+static void
+fm_free(fm_t *f)
+{
+    free(f->vw);
+    free(f->vstart);
+    free(f->vnets);
+    free(f->nstart);
+    free(f->npins);
+    free(f->side);
+    free(f->gain);
+    free(f->locked);
+    free(f->moves);
+    free(f->next);
+    free(f->prev);
+    free(f->cnt);
+    free(f->head);
+}
+
+/* initial bisection: grow side 0 breadth first up to its target */
+static void
+fm_grow(fm_t *f)
+{
+    int *queue = (int *)malloc((f->nv + 1) * sizeof(int));
+    int qh = 0, qt = 0, seed = 0, i, k;
+
+    for (i = 0; i < f->nv; i++)
+        f->side[i] = 1;
+    f->w0 = 0;
+    while (f->w0 < f->target0) {
+        int v;
+        if (qh == qt) {
+            /* next component */
+            while (seed < f->nv && f->side[seed] == 0)
+                seed++;
+            f->side[seed] = 0;
+            f->w0 += f->vw[seed];
+            queue[qt++] = seed;
+            continue;
+        }
+        v = queue[qh++];
+        for (k = f->vstart[v]; k < f->vstart[v + 1] && f->w0 < f->target0; k++) {
+            int n = f->vnets[k], m;
+            for (m = f->nstart[n]; m < f->nstart[n + 1] && f->w0 < f->target0; m++) {
+                int u = f->npins[m];
+                if (f->side[u] == 1) {
+                    f->side[u] = 0;
+                    f->w0 += f->vw[u];
+                    queue[qt++] = u;
+                }
+            }
+        }
+    }
+    free(queue);
+}
+
+static int *
+bucket(fm_t *f, int side, int gain)
+{
+    return &f->head[side * (2 * f->pmax + 1) + gain + f->pmax];
+}
+
+static void
+bucket_insert(fm_t *f, int v)
+{
+    int *h = bucket(f, f->side[v], f->gain[v]);
+
+    f->prev[v] = -1;
+    f->next[v] = *h;
+    if (*h >= 0)
+        f->prev[*h] = v;
+    *h = v;
+    if (f->gain[v] > f->maxg[f->side[v]])
+        f->maxg[f->side[v]] = f->gain[v];
+}
+
+static void
+bucket_remove(fm_t *f, int v)
+{
+    if (f->prev[v] >= 0)
+        f->next[f->prev[v]] = f->next[v];
+    else
+        *bucket(f, f->side[v], f->gain[v]) = f->next[v];
+    if (f->next[v] >= 0)
+        f->prev[f->next[v]] = f->prev[v];
+}
+
+static void
+adjust(fm_t *f, int v, int d)
+{
+    if (f->locked[v])
+        return;
+    bucket_remove(f, v);
+    f->gain[v] += d;
+    bucket_insert(f, v);
+}
+
+/* free vertex of highest gain on side, -1 if none */
+static int
+bucket_top(fm_t *f, int side)
+{
+    while (f->maxg[side] >= -f->pmax && *bucket(f, side, f->maxg[side]) < 0)
+        f->maxg[side]--;
+    return f->maxg[side] >= -f->pmax ? *bucket(f, side, f->maxg[side]) : -1;
+}
+
+static int
+imbalance(const fm_t *f, int w0)
+{
+    return w0 > f->target0 ? w0 - f->target0 : f->target0 - w0;
+}
+
+/* may vertex v change sides without breaking the balance */
+static bool
+movable(const fm_t *f, int v)
+{
+    int w0 = f->w0 + (f->side[v] == 0 ? -f->vw[v] : f->vw[v]);
+
+    return imbalance(f, w0) <= f->tol || imbalance(f, w0) < imbalance(f, f->w0);
+}
+
+static void
+fm_move(fm_t *f, int v)
+{
+    int from = f->side[v], to = 1 - from, k, m;
+
+    bucket_remove(f, v);
+    f->locked[v] = 1;
+    for (k = f->vstart[v]; k < f->vstart[v + 1]; k++) {
+        int n = f->vnets[k];
+        int *cf = &f->cnt[2 * n + from], *ct = &f->cnt[2 * n + to];
+        if (*ct == 0) {
+            for (m = f->nstart[n]; m < f->nstart[n + 1]; m++)
+                adjust(f, f->npins[m], 1);
+        }
+        else if (*ct == 1) {
+            for (m = f->nstart[n]; m < f->nstart[n + 1]; m++)
+                if (f->side[f->npins[m]] == to)
+                    adjust(f, f->npins[m], -1);
+        }
+        (*cf)--;
+        (*ct)++;
+        if (*cf == 0) {
+            for (m = f->nstart[n]; m < f->nstart[n + 1]; m++)
+                adjust(f, f->npins[m], -1);
+        }
+        else if (*cf == 1) {
+            for (m = f->nstart[n]; m < f->nstart[n + 1]; m++)
+                if (f->side[f->npins[m]] == from && f->npins[m] != v)
+                    adjust(f, f->npins[m], 1);
+        }
+    }
+    f->side[v] = to;
+    f->w0 += from == 0 ? -f->vw[v] : f->vw[v];
+}
+
+/* one Fiduccia-Mattheyses pass, returns the cut reduction */
+static int
+fm_pass(fm_t *f)
+{
+    int i, k, n, nmoves = 0, sum = 0, best = 0, bestk = 0;
+    int bestbal = imbalance(f, f->w0);
+
+    memset(f->cnt, 0, 2 * f->nn * sizeof(int));
+    for (n = 0; n < f->nn; n++)
+        for (k = f->nstart[n]; k < f->nstart[n + 1]; k++)
+            f->cnt[2 * n + f->side[f->npins[k]]]++;
+    for (i = 0; i < 2 * (2 * f->pmax + 1); i++)
+        f->head[i] = -1;
+    f->maxg[0] = f->maxg[1] = -f->pmax;
+    for (i = 0; i < f->nv; i++) {
+        int g = 0, s = f->side[i];
+        for (k = f->vstart[i]; k < f->vstart[i + 1]; k++) {
+            n = f->vnets[k];
+            if (f->cnt[2 * n + s] == 1)
+                g++;
+            if (f->cnt[2 * n + 1 - s] == 0)
+                g--;
+        }
+        f->gain[i] = g;
+        f->locked[i] = 0;
+        bucket_insert(f, i);
+    }
+
+    for (;;) {
+        int v0 = bucket_top(f, 0), v1 = bucket_top(f, 1), v, bal;
+        if (v0 >= 0 && !movable(f, v0))
+            v0 = -1;
+        if (v1 >= 0 && !movable(f, v1))
+            v1 = -1;
+        if (v0 < 0 && v1 < 0)
+            break;
+        if (v0 < 0 || (v1 >= 0 && f->gain[v1] > f->gain[v0]))
+            v = v1;
+        else if (v1 < 0 || f->gain[v0] > f->gain[v1])
+            v = v0;
+        else
+            v = f->w0 > f->target0 ? v0 : v1;
+        sum += f->gain[v];
+        fm_move(f, v);
+        f->moves[nmoves++] = v;
+        bal = imbalance(f, f->w0);
+        if (sum > best || (sum == best && bal < bestbal)) {
+            best = sum;
+            bestk = nmoves;
+            bestbal = bal;
+        }
+    }
+
+    /* undo the moves after the best prefix */
+    for (k = nmoves - 1; k >= bestk; k--) {
+        int v = f->moves[k];
+        f->w0 += f->side[v] == 0 ? -f->vw[v] : f->vw[v];
+        f->side[v] = 1 - f->side[v];
+    }
+    return best;
+}
+
+static void
+bisect(ctx_t *c, int *verts, int nv, int k, int first)
+{
+    fm_t f;
+    int *tmp, k0 = k / 2, i, m, n0 = 0, pass, wtotal = 0, wmax = 1;
+
+    if (k == 1 || nv == 0) {
+        for (i = 0; i < nv; i++)
+            c->vpart[verts[i]] = first;
+        return;
+    }
+
+    fm_build(&f, c, verts, nv);
+    for (i = 0; i < nv; i++) {
+        wtotal += f.vw[i];
+        if (f.vw[i] > wmax)
+            wmax = f.vw[i];
+    }
+    /* 2 %, but at least the largest vertex */
+    f.target0 = (int)((long long)wtotal * k0 / k);
+    f.tol = wtotal / 50 > wmax ? wtotal / 50 : wmax;
+    fm_grow(&f);
+    for (pass = 0; pass < 20; pass++)
+        if (fm_pass(&f) <= 0 && imbalance(&f, f.w0) <= f.tol)
+            break;
+
+    tmp = (int *)malloc(nv * sizeof(int));
+    for (i = 0; i < nv; i++)
+        if (f.side[i] == 0)
+            tmp[n0++] = verts[i];
+    for (i = 0, m = n0; i < nv; i++)
+        if (f.side[i] == 1)
+            tmp[m++] = verts[i];
+    memcpy(verts, tmp, nv * sizeof(int));
+    free(tmp);
+    fm_free(&f);
+
+    bisect(c, verts, n0, k0, first);
+    bisect(c, verts + n0, nv - n0, k - k0, first + k0);
+}
+
+/* driving partition of every cut node */
+static void
+find_owners(ctx_t *c)
+{
+    const ngnetlist_t *nl = c->nl;
+    ngsplit_t *s = c->s;
+    int *pins = (int *)calloc(s->nparts, sizeof(int));
+    int *drv = (int *)calloc(s->nparts, sizeof(int));
+    int *start = (int *)calloc(nl->nnets + 1, sizeof(int));
+    int *pin, *fill, i, n, m, k;
+
+    /* pins of the partitioned devices per node, device * 2 + drives */
+    for (i = 0; i < nl->ndevs; i++)
+        for (k = 0; s->part[i] >= 0 && k < nl->devs[i].nnets; k++)
+            start[nl->devs[i].nets[k] + 1]++;
+    for (n = 0; n < nl->nnets; n++)
+        start[n + 1] += start[n];
+    pin = (int *)malloc((start[nl->nnets] + 1) * sizeof(int));
+    fill = (int *)malloc((nl->nnets + 1) * sizeof(int));
+    memcpy(fill, start, nl->nnets * sizeof(int));
+    for (i = 0; i < nl->ndevs; i++)
+        for (k = 0; s->part[i] >= 0 && k < nl->devs[i].nnets; k++)
+            pin[fill[nl->devs[i].nets[k]]++] = 2 * i + ngnetlist_drives(&nl->devs[i], k);
+
+    for (n = 0; n < nl->nnets; n++) {
+        int nused = 0, ndrv = 0, best = -1;
+        s->owner[n] = -1;
+        if (c->g.rail[n])
+            continue;
+        for (m = start[n]; m < start[n + 1]; m++) {
+            int p = s->part[pin[m] / 2];
+            if (pins[p]++ == 0)
+                nused++;
+            if ((pin[m] & 1) && drv[p]++ == 0)
+                ndrv++;
+        }
+        for (k = 0; k < s->nparts; k++) {
+            if (pins[k] && (best < 0 || drv[k] > drv[best] ||
+                            (drv[k] == drv[best] && drv[k] == 0 && pins[k] > pins[best])))
+                best = k;
+        }
+        if (nused > 1) {
+            s->owner[n] = best;
+            s->cutnets++;
+            s->couplings += nused - 1;
+            s->outputs[best]++;
+            for (k = 0; k < s->nparts; k++)
+                if (pins[k] && k != best)
+                    s->inputs[k]++;
+            if (ndrv > 1)
+                s->multidriven++;
+        }
+        for (k = 0; k < s->nparts; k++)
+            pins[k] = drv[k] = 0;
+    }
+    free(pins);
+    free(drv);
+    free(start);
+    free(pin);
+    free(fill);
+}
+
+ngsplit_t *
+ngsplit_new(const ngnetlist_t *nl, int nparts, bool current)
+{
+    ctx_t c;
+    ngsplit_t *s;
+    int *verts, i;
+
+    memset(&c, 0, sizeof(c));
+    c.nl = nl;
+    graph_build(&c.g, nl, current);
+    if (nparts < 1 || c.g.nv < nparts) {
+        fprintf(stderr, "Error: %d device groups cannot be split into %d partitions\n",
+                c.g.nv, nparts);
+        graph_free(&c.g);
+        return NULL;
+    }
+
+    s = (ngsplit_t *)calloc(1, sizeof(ngsplit_t));
+    s->nparts = nparts;
+    s->current = current;
+    s->part = (int *)malloc((nl->ndevs + 1) * sizeof(int));
+    s->owner = (int *)malloc((nl->nnets + 1) * sizeof(int));
+    s->devcount = (int *)calloc(nparts, sizeof(int));
+    s->inputs = (int *)calloc(nparts, sizeof(int));
+    s->outputs = (int *)calloc(nparts, sizeof(int));
+    for (i = 0; i < nl->ndevs; i++)
+        s->part[i] = -1;
+
+    c.s = s;
+    c.lnet = (int *)calloc(c.g.nn + 1, sizeof(int));
+    c.vpart = (int *)malloc((c.g.nv + 1) * sizeof(int));
+    verts = (int *)malloc((c.g.nv + 1) * sizeof(int));
+    for (i = 0; i < c.g.nv; i++)
+        verts[i] = i;
+    bisect(&c, verts, c.g.nv, nparts, 0);
+    for (i = 0; i < nl->ndevs; i++)
+        if (c.g.cluster[i] >= 0) {
+            s->part[i] = c.vpart[c.g.cluster[i]];
+            s->devcount[s->part[i]]++;
+        }
+    find_owners(&c);
+
+    free(verts);
+    free(c.lnet);
+    free(c.vpart);
+    graph_free(&c.g);
+    return s;
+}
+
+void
+ngsplit_free(ngsplit_t *s)
+{
+    if (!s)
+        return;
+    free(s->part);
+    free(s->owner);
+    free(s->devcount);
+    free(s->inputs);
+    free(s->outputs);
+    free(s);
+}
+
+static void
+write_device(FILE *fp, const ngnetlist_t *nl, const ngdev_t *d)
+{
+    int k;
+
+    fprintf(fp, "%s", d->name);
+    for (k = 0; k < d->nnets; k++)
+        fprintf(fp, " %s", nl->nets[d->nets[k]]);
+    fprintf(fp, "%s%s\n", *d->rest ? " " : "", d->rest);
+}
+
+/* vector on .save cards of up to 8 */
+static void
+write_save(FILE *fp, const char *vec, const char *name, int *nsaved)
+{
+    if (*nsaved % 8 == 0)
+        fprintf(fp, "%s.save", *nsaved ? "\n" : "");
+    fprintf(fp, " %s(%s)", vec, name);
+    (*nsaved)++;
+}
+
+/* users[n * nparts + k]: partition k has a device at node n */
+static int
+write_partition(const ngnetlist_t *nl, const ngsplit_t *s, int k, const char *file,
+                const char *src, const char *users)
+{
+    char *used = (char *)calloc(nl->nnets, 1), *saved = (char *)calloc(nl->nnets, 1);
+    char name[80];
+    int i, n, m, nsaved = 0;
+    FILE *fp = fopen(file, "w");
+
+    if (!fp) {
+        fprintf(stderr, "Error: cannot write %s\n", file);
+        free(used);
+        free(saved);
+        return 1;
+    }
+    for (i = 0; i < nl->ndevs; i++)
+        if (s->part[i] == k)
+            for (m = 0; m < nl->devs[i].nnets; m++)
+                used[nl->devs[i].nets[m]] = 1;
+
+    fprintf(fp, "%s (partition %d of %d)\n", nl->title, k + 1, s->nparts);
+    fprintf(fp, "* written by --split from %s\n\n", src);
+    for (i = 0; i < nl->ncards; i++)
+        fprintf(fp, "%s\n", nl->cards[i]);
+
+    fprintf(fp, "\n* shared sources\n");
+    for (i = 0; i < nl->ndevs; i++) {
+        const ngdev_t *d = &nl->devs[i];
+        if (d->shared && used[d->nets[0] ? d->nets[0] : d->nets[1]])
+            write_device(fp, nl, d);
+    }
+    fprintf(fp, "\n* devices\n");
+    for (i = 0; i < nl->ndevs; i++)
+        if (s->part[i] == k)
+            write_device(fp, nl, &nl->devs[i]);
+    fprintf(fp, "\n* interface\n");
+    for (n = 1; n < nl->nnets; n++) {
+        if (!used[n] || s->owner[n] < 0)
+            continue;
+        if (s->owner[n] != k)
+            fprintf(fp, "vcpl%d %s 0 dc 0 external\n", n, nl->nets[n]);
+        else if (s->current)
+            for (m = 0; m < s->nparts; m++)
+                if (m != k && users[n * s->nparts + m])
+                    fprintf(fp, "icpl%d_%d 0 %s dc 0 external\n", n, m + 1, nl->nets[n]);
+    }
+
+    /* the driven cut nodes and the load currents are needed as vectors */
+    if (!nl->saveall) {
+        fprintf(fp, "\n");
+        for (n = 1; n < nl->nnets; n++) {
+            if (!used[n] || s->owner[n] < 0)
+                continue;
+            if (s->owner[n] == k) {
+                write_save(fp, "v", nl->nets[n], &nsaved);
+                saved[n] = 1;
+            }
+            else if (s->current) {
+                snprintf(name, sizeof(name), "vcpl%d", n);
+                write_save(fp, "i", name, &nsaved);
+            }
+        }
+        for (i = 0; i < nl->nsaves; i++) {
+            n = nl->saves[i];
+            if (used[n] && !saved[n] && (s->owner[n] < 0 || s->owner[n] == k)) {
+                write_save(fp, "v", nl->nets[n], &nsaved);
+                saved[n] = 1;
+            }
+        }
+        if (nsaved)
+            fprintf(fp, "\n");
+    }
+    fprintf(fp, "\n.end\n");
+    fclose(fp);
+    free(used);
+    free(saved);
+    return 0;
+}
+
+int
+ngsplit_write(const ngnetlist_t *nl, const ngsplit_t *s, const char *file,
+              char *cplfile, size_t len)
+{
+    char base[256], path[300], *dot, *slash, *users;
+    FILE *fp;
+    int k, n, m, i;
+
+    snprintf(base, sizeof(base), "%s", file);
+    slash = strrchr(base, '/');
+    if (!slash)
+        slash = strrchr(base, '\\');
+    dot = strrchr(base, '.');
+    if (dot && (!slash || dot > slash))
+        *dot = '\0';
+
+    snprintf(cplfile, len, "%s.cpl", base);
+    fp = fopen(cplfile, "w");
+    if (!fp) {
+        fprintf(stderr, "Error: cannot write %s\n", cplfile);
+        return 1;
+    }
+    fprintf(fp, "# %s split into %d partitions, %d cut nodes.\n", file, s->nparts, s->cutnets);
+    fprintf(fp, "# partition <name> <netlist, relative to this file>\n");
+    fprintf(fp, "# couple <partition> <output vector> -> <partition> <EXTERNAL source>\n");
+    if (s->current)
+        fprintf(fp, "# couple <partition> <node> <-> <partition> <vsource> <isource>\n");
+    fprintf(fp, "\n");
+
+    users = (char *)calloc((size_t)nl->nnets * s->nparts, 1);
+    for (m = 0; m < nl->ndevs; m++)
+        for (i = 0; s->part[m] >= 0 && i < nl->devs[m].nnets; i++)
+            users[nl->devs[m].nets[i] * s->nparts + s->part[m]] = 1;
+
+    for (k = 0; k < s->nparts; k++) {
+        snprintf(path, sizeof(path), "%s_p%d.cir", base, k + 1);
+        if (write_partition(nl, s, k, path, file, users)) {
+            fclose(fp);
+            free(users);
+            return 1;
+        }
+        fprintf(fp, "partition p%d %s\n", k + 1, slash ? strrchr(path, *slash) + 1 : path);
+    }
+    fprintf(fp, "\n");
+
+    /* one edge from the driver to every other partition using the node */
+    for (n = 1; n < nl->nnets; n++) {
+        if (s->owner[n] < 0)
+            continue;
+        if (strlen(nl->nets[n]) >= NGCPL_NAMELEN)
+            fprintf(stderr, "Warning: node name %s too long for coupling\n", nl->nets[n]);
+        for (k = 0; k < s->nparts; k++) {
+            if (!users[n * s->nparts + k] || k == s->owner[n])
+                continue;
+            if (s->current)
+                fprintf(fp, "couple p%d %s <-> p%d vcpl%d icpl%d_%d\n", s->owner[n] + 1,
+                        nl->nets[n], k + 1, n, n, k + 1);
+            else
+                fprintf(fp, "couple p%d %s -> p%d vcpl%d\n", s->owner[n] + 1, nl->nets[n],
+                        k + 1, n);
+        }
+    }
+    fclose(fp);
+    free(users);
+    return 0;
+}
+
+void
+ngsplit_print(const ngnetlist_t *nl, const ngsplit_t *s)
+{
+    int i, nshared = 0, ndevs = 0, maxdevs = 0;
+
+    for (i = 0; i < nl->ndevs; i++)
+        nshared += nl->devs[i].shared;
+    for (i = 0; i < s->nparts; i++) {
+        ndevs += s->devcount[i];
+        if (s->devcount[i] > maxdevs)
+            maxdevs = s->devcount[i];
+    }
+    printf("\n** Partitioning into %d: %d devices, %d shared sources, %d nodes **\n",
+           s->nparts, ndevs, nshared, nl->nnets);
+    printf("%-10s %10s %10s %10s\n", "partition", "devices", "inputs", "outputs");
+    for (i = 0; i < s->nparts; i++)
+        printf("p%-9d %10d %10d %10d\n", i + 1, s->devcount[i], s->inputs[i], s->outputs[i]);
+    printf("cut nodes:           %d\n", s->cutnets);
+    printf("couplings:           %d\n", s->couplings);
+    printf("imbalance:           %.3f (largest / mean device count)\n",
+           ndevs > 0 ? (double)maxdevs * s->nparts / ndevs : 0);
+    if (s->current)
+        printf("load currents are coupled back to the driving partitions\n");
+    else if (s->multidriven)
+        printf("Warning: %d cut nodes are driven from several partitions, their load is not coupled\n",
+               s->multidriven);
+    if (nl->ndropped)
+        printf("Note: %d cards (.print, .ic, .meas ...) not taken over\n", nl->ndropped);
+}
@@ -0,0 +1,56 @@
+/*
+Automatic partitioning of a flat netlist.
+
+Devices of the flattened netlist (netlist.h) connected by driving pins
+are merged into one vertex of a hypergraph, so a gate is never cut
+apart, every node connecting vertices is a hyperedge. Ground and the
+nodes of shared sources are left out, they are available in every
+partition. The hypergraph is cut into N pieces by recursive bisection,
+each one starting from a breadth first grown half and improved by
+Fiduccia-Mattheyses passes: moves of single vertices by gain, taken
+from bucket lists, keeping the device counts within 2 % of the target
+or the size of the largest vertex.
+
+Each cut node is driven by the partition with most driving pins on it
+(drains, sources, two terminal devices; not MOS gates, control inputs),
+its vector is coupled to an EXTERNAL voltage source in every other
+partition using it. Loading across the cut is lost, a warning is given
+for nodes with drivers in several partitions. With current coupling
+the devices are not grouped, the current of each of these sources is
+fed back into the driving partition by an EXTERNAL current source
+(coupling.h, <->), so the cut may be anywhere.
+
+For base.cir the netlists base_p1.cir ... base_pN.cir and the coupling
+description base.cpl are written next to it.
+*/
+
+#ifndef NG_SPLIT_H
+#define NG_SPLIT_H
+
+#include "netlist.h"
+
+typedef struct ngsplit {
+    int nparts;
+    bool current;              /* load currents coupled back */
+    int *part;                 /* partition of each device, -1 if shared */
+    int *owner;                /* driving partition of each node, -1 if not cut */
+    int *devcount;             /* devices per partition */
+    int *inputs, *outputs;     /* coupled nodes per partition */
+    int cutnets;
+    int couplings;             /* EXTERNAL sources over all partitions */
+    int multidriven;           /* cut nodes with drivers in several partitions */
+} ngsplit_t;
+
+/* min-cut partitioning of nl into nparts, current: couple load currents */
+ngsplit_t *ngsplit_new(const ngnetlist_t *nl, int nparts, bool current);
+void ngsplit_free(ngsplit_t *s);
+
+/* write the partition netlists and the coupling description for
+   netlist file, its path is returned in cplfile */
+int ngsplit_write(const ngnetlist_t *nl, const ngsplit_t *s, const char *file,
+                  char *cplfile, size_t len);
+
+/* device count per partition and cut size */
+void ngsplit_print(const ngnetlist_t *nl, const ngsplit_t *s);
+
+#endif
@@ -0,0 +1,562 @@
+/*
+Parameter sweep and Monte Carlo runner, see sweep.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "sweep.h"
+#include "wr.h"
+
+#define SWEEP_MAXTOK 64
+
+static const char *measnames[] = { "max", "min", "avg", "rms", "final", "pp" };
+static const char *statusnames[] = { "ok", "failed", "nomeasure" };
+
+/* split a line into whitespace separated tokens, '#' starts a comment */
+static int
+tokenize(char *line, char **tok)
+{
+    int n = 0;
+    char *s = line;
+
+    while (*s && n < SWEEP_MAXTOK) {
+        while (*s && isspace((unsigned char)*s))
+            s++;
+        if (!*s || *s == '#')
+            break;
+        tok[n++] = s;
+        while (*s && !isspace((unsigned char)*s))
+            s++;
+        if (*s)
+            *s++ = '\0';
+    }
+    return n;
+}
+
+/* xorshift64*, uniform in (0, 1) */
+static double
+rng_uniform(uint64_t *state)
+{
+    uint64_t x = *state;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return ((x * 0x2545F4914F6CDD1Dull >> 11) + 0.5) / 9007199254740992.0;
+}
+
+/* standard normal, Box-Muller */
+static double
+rng_normal(uint64_t *state)
+{
+    double u1 = rng_uniform(state), u2 = rng_uniform(state);
+
+    return sqrt(-2 * log(u1)) * cos(6.283185307179586 * u2);
+}
+
+/* parameter values of all points */
+static void
+make_points(ngsweep_t *s)
+{
+    uint64_t state = s->seed ? s->seed : 1;
+    int grid = 1, i, j;
+
+    for (j = 0; j < s->nparams; j++)
+        if (s->params[j].kind == SWEEP_LIN || s->params[j].kind == SWEEP_LIST)
+            grid *= s->params[j].n;
+    s->npoints = grid * s->samples;
+    s->values = (double *)malloc((size_t)s->npoints * (s->nparams + 1) * sizeof(double));
+
+    for (i = 0; i < s->npoints; i++) {
+        int g = i / s->samples;
+        for (j = 0; j < s->nparams; j++) {
+            ngsweep_param_t *pa = &s->params[j];
+            double *v = &s->values[i * s->nparams + j];
+            int k;
+            switch (pa->kind) {
+            case SWEEP_LIN:
+                k = g % pa->n;
+                g /= pa->n;
+                *v = pa->n > 1 ? pa->a + (pa->b - pa->a) * k / (pa->n - 1) : pa->a;
+                break;
+            case SWEEP_LIST:
+                k = g % pa->n;
+                g /= pa->n;
+                *v = pa->list[k];
+                break;
+            case SWEEP_GAUSS:
+                *v = pa->a + pa->b * rng_normal(&state);
+                break;
+            default:
+                *v = pa->a + (pa->b - pa->a) * rng_uniform(&state);
+                break;
+            }
+        }
+    }
+}
+
+ngsweep_t *
+ngsweep_read(const char *file)
+{
+    ngsweep_t *s;
+    char line[1024], dir[256], *tok[SWEEP_MAXTOK], *slash;
+    int lineno = 0, n, i;
+    FILE *fp = fopen(file, "r");
+
+    if (!fp) {
+        fprintf(stderr, "Error: cannot open sweep description %s\n", file);
+        return NULL;
+    }
+
+    /* the netlist is relative to the directory of the description */
+    snprintf(dir, sizeof(dir), "%s", file);
+    slash = strrchr(dir, '/');
+    if (!slash)
+        slash = strrchr(dir, '\\');
+    if (slash)
+        slash[1] = '\0';
+    else
+        dir[0] = '\0';
+
+    s = (ngsweep_t *)calloc(1, sizeof(ngsweep_t));
+    s->samples = 1;
+    s->seed = 1;
+
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        n = tokenize(line, tok);
+        if (n == 0)
+            continue;
+
+        if (cieq(tok[0], "netlist") && n == 2) {
+            if (tok[1][0] == '/' || tok[1][0] == '\\' || (tok[1][0] && tok[1][1] == ':'))
+                snprintf(s->netlist, sizeof(s->netlist), "%s", tok[1]);
+            else
+                snprintf(s->netlist, sizeof(s->netlist), "%s%s", dir, tok[1]);
+        }
+        else if (cieq(tok[0], "param") && n >= 4) {
+            ngsweep_param_t *pa;
+            s->params = (ngsweep_param_t *)realloc(s->params,
+                                                   (s->nparams + 1) * sizeof(ngsweep_param_t));
+            pa = &s->params[s->nparams++];
+            memset(pa, 0, sizeof(*pa));
+            snprintf(pa->name, sizeof(pa->name), "%s", tok[1]);
+            if (cieq(tok[2], "lin")) {
+                if (n != 6)
+                    goto badparam;
+                pa->kind = SWEEP_LIN;
+                pa->a = wr_value(tok[3]);
+                pa->b = wr_value(tok[4]);
+                pa->n = atoi(tok[5]);
+            }
+            else if (cieq(tok[2], "list")) {
+                pa->kind = SWEEP_LIST;
+                pa->n = n - 3;
+                pa->list = (double *)malloc((size_t)pa->n * sizeof(double));
+                for (i = 0; i < pa->n; i++)
+                    pa->list[i] = wr_value(tok[3 + i]);
+            }
+            else if (cieq(tok[2], "gauss") || cieq(tok[2], "uniform")) {
+                if (n != 5)
+                    goto badparam;
+                pa->kind = cieq(tok[2], "gauss") ? SWEEP_GAUSS : SWEEP_UNIFORM;
+                pa->a = wr_value(tok[3]);
+                pa->b = wr_value(tok[4]);
+            }
+            else {
+                fprintf(stderr, "%s:%d: unknown parameter kind %s\n", file, lineno, tok[2]);
+                goto error;
+            }
+            if ((pa->kind == SWEEP_LIN || pa->kind == SWEEP_LIST) && pa->n < 1) {
+                fprintf(stderr, "%s:%d: no points for %s\n", file, lineno, pa->name);
+                goto error;
+            }
+        }
+        else if (cieq(tok[0], "measure") && n == 4) {
+            ngsweep_meas_t *m;
+            int kind = -1;
+            for (i = 0; i < (int)(sizeof(measnames) / sizeof(measnames[0])); i++)
+                if (cieq(tok[2], measnames[i]))
+                    kind = i;
+            if (kind < 0) {
+                fprintf(stderr, "%s:%d: unknown measurement %s\n", file, lineno, tok[2]);
+                goto error;
+            }
+            s->meas = (ngsweep_meas_t *)realloc(s->meas, (s->nmeas + 1) * sizeof(ngsweep_meas_t));
+            m = &s->meas[s->nmeas++];
+            snprintf(m->name, sizeof(m->name), "%s", tok[1]);
+            m->kind = kind;
+            snprintf(m->vector, sizeof(m->vector), "%s", tok[3]);
+        }
+        else if (cieq(tok[0], "samples") && n == 2) {
+            s->samples = atoi(tok[1]);
+        }
+        else if (cieq(tok[0], "seed") && n == 2) {
+            s->seed = strtoull(tok[1], NULL, 10);
+        }
+        else {
+            fprintf(stderr, "%s:%d: syntax error\n", file, lineno);
+            goto error;
+        }
+    }
+    fclose(fp);
+    fp = NULL;
+
+    if (!s->netlist[0] || s->samples < 1) {
+        fprintf(stderr, "%s: netlist and samples >= 1 needed\n", file);
+        goto error;
+    }
+    s->circ = ngcirc_get(s->netlist);
+    if (!s->circ)
+        goto error;
+    s->names = (const char **)malloc((size_t)(s->nparams + 1) * sizeof(char *));
+    for (i = 0; i < s->nparams; i++)
+        s->names[i] = s->params[i].name;
+    make_points(s);
+    s->results = (double *)malloc((size_t)s->npoints * (s->nmeas + 1) * sizeof(double));
+    s->seconds = (double *)calloc((size_t)s->npoints, sizeof(double));
+    s->instance = (int *)calloc((size_t)s->npoints, sizeof(int));
+    s->status = (int *)calloc((size_t)s->npoints, sizeof(int));
+    return s;
+
+badparam:
+    fprintf(stderr, "%s:%d: param %s %s needs %s\n", file, lineno, tok[1], tok[2],
+            cieq(tok[2], "lin") ? "<from> <to> <n>" :
+            cieq(tok[2], "gauss") ? "<mean> <sigma>" : "<lo> <hi>");
+error:
+    if (fp)
+        fclose(fp);
+    ngsweep_free(s);
+    return NULL;
+}
+
+void
+ngsweep_free(ngsweep_t *s)
+{
+    int i;
+
+    if (!s)
+        return;
+    for (i = 0; i < s->nparams; i++)
+        free(s->params[i].list);
+    free(s->names);
+    free(s->params);
+    free(s->meas);
+    free(s->values);
+    free(s->results);
+    free(s->seconds);
+    free(s->instance);
+    free(s->status);
+    free(s);
+}
+
+/* reduce a vector of the current plot to measurement m */
+static double
+measure(ngpart_t *p, ngsweep_meas_t *m)
+{
+    pvector_info v = ngpart_vecinfo(p, m->vector);
+    pvector_info tv;
+    double *x, *t = NULL, r, lo, hi, sum = 0, span;
+    int n, k;
+
+    if (!v || !v->v_realdata || v->v_length < 1)
+        return NAN;
+    x = v->v_realdata;
+    n = v->v_length;
+    /* avg and rms over the time scale, steps are not equidistant */
+    if (m->kind == SWEEP_AVG || m->kind == SWEEP_RMS) {
+        tv = ngpart_vecinfo(p, "time");
+        if (tv && tv->v_realdata && tv->v_length == n)
+            t = tv->v_realdata;
+    }
+
+    switch (m->kind) {
+    case SWEEP_FINAL:
+        return x[n - 1];
+    case SWEEP_AVG:
+    case SWEEP_RMS:
+        if (n == 1 || !t || t[n - 1] <= t[0]) {
+            for (k = 0; k < n; k++)
+                sum += m->kind == SWEEP_RMS ? x[k] * x[k] : x[k];
+            r = sum / n;
+        }
+        else {
+            for (k = 1; k < n; k++)
+                sum += (t[k] - t[k - 1]) * (m->kind == SWEEP_RMS
+                                            ? (x[k] * x[k] + x[k - 1] * x[k - 1]) / 2
+                                            : (x[k] + x[k - 1]) / 2);
+            span = t[n - 1] - t[0];
+            r = sum / span;
+        }
+        return m->kind == SWEEP_RMS ? sqrt(r) : r;
+    default:
+        lo = hi = x[0];
+        for (k = 1; k < n; k++) {
+            if (x[k] < lo)
+                lo = x[k];
+            if (x[k] > hi)
+                hi = x[k];
+        }
+        return m->kind == SWEEP_MAX ? hi : m->kind == SWEEP_MIN ? lo : hi - lo;
+    }
+}
+
+/* block of points of an instance, stolen from at the end */
+typedef struct sweepq {
+    mutexType cs;
+    int next, end;
+} sweepq_t;
+
+typedef struct sweepctx {
+    ngsweep_t *s;
+    ngpart_t *p;
+    sweepq_t *q;               /* of all instances */
+    int self, n;
+    uint64_t steals;
+} sweepctx_t;
+
+/* next point of the own block, -1 if it is done */
+static int
+take(sweepq_t *q)
+{
+    int i = -1;
+
+    mutex_lock(&q->cs);
+    if (q->next < q->end)
+        i = q->next++;
+    mutex_unlock(&q->cs);
+    return i;
+}
+
+/* take the second half of the points left to another instance, and
+   return the first of them; -1 if no instance has any left */
+static int
+steal(sweepctx_t *c)
+{
+    int k;
+
+    for (k = 1; k < c->n; k++) {
+        sweepq_t *v = &c->q[(c->self + k) % c->n];
+        int first, end, left;
+
+        mutex_lock(&v->cs);
+        left = v->end - v->next;
+        if (left <= 0) {
+            mutex_unlock(&v->cs);
+            continue;
+        }
+        end = v->end;
+        first = end - (left + 1) / 2;
+        v->end = first;
+        mutex_unlock(&v->cs);
+
+        mutex_lock(&c->q[c->self].cs);
+        c->q[c->self].next = first + 1;
+        c->q[c->self].end = end;
+        mutex_unlock(&c->q[c->self].cs);
+        c->steals++;
+        return first;
+    }
+    return -1;
+}
+
+static void
+run_point(sweepctx_t *c, int i)
+{
+    ngsweep_t *s = c->s;
+    ngpart_t *p = c->p;
+    double *res = &s->results[i * s->nmeas];
+    uint64_t t0 = ng_now_ns();
+    char **circ = ngcirc_subst(s->circ, s->names, &s->values[i * s->nparams], s->nparams);
+    int l, rc;
+
+    rc = p->api.ngSpice_Circ(circ);
+    ngcirc_release(s->circ, circ);
+    if (rc == 0)
+        rc = ngpart_command(p, "run");
+    s->status[i] = rc ? SWEEP_SIMFAILED : 0;
+    for (l = 0; l < s->nmeas; l++) {
+        res[l] = rc == 0 ? measure(p, &s->meas[l]) : NAN;
+        if (rc == 0 && isnan(res[l]))
+            s->status[i] = SWEEP_NOMEASURE;
+    }
+    ngpart_command(p, "remcirc");
+    ngpart_command(p, "destroy all");
+    s->instance[i] = p->ident;
+    s->seconds[i] = (ng_now_ns() - t0) / 1e9;
+}
+
+static void *
+sweep_worker(void *arg)
+{
+    sweepctx_t *c = (sweepctx_t *)arg;
+    int i;
+
+    for (;;) {
+        i = take(&c->q[c->self]);
+        if (i < 0)
+            i = steal(c);
+        if (i < 0)
+            break;
+        run_point(c, i);
+    }
+    return NULL;
+}
+
+int
+ngsweep_run(ngsweep_t *s, int n)
+{
+    ngengine_t *e;
+    sweepq_t *q;
+    sweepctx_t *ctx;
+    threadId_t tids[NGENGINE_MAXPARTS];
+    bool started[NGENGINE_MAXPARTS];
+    int i;
+
+    if (n > s->npoints)
+        n = s->npoints;
+    if (n < 1)
+        n = 1;
+    e = ngengine_new(n, SYNC_BARRIER, -1);
+    if (!e)
+        return -1;
+    e->quiet = true;
+    e->capture = NULL;
+    if (ngengine_load(e)) {
+        ngengine_free(e);
+        return -1;
+    }
+    for (i = 0; i < n; i++)
+        if (!e->parts[i].api.ngSpice_Circ) {
+            fprintf(stderr, "Error: %s has no ngSpice_Circ, needed by the sweep\n",
+                    e->parts[i].libname);
+            ngengine_free(e);
+            return -1;
+        }
+    ngengine_init(e, 0);
+
+    q = (sweepq_t *)calloc((size_t)n, sizeof(sweepq_t));
+    ctx = (sweepctx_t *)calloc((size_t)n, sizeof(sweepctx_t));
+    for (i = 0; i < n; i++) {
+        mutex_init(&q[i].cs);
+        q[i].next = (int)((int64_t)s->npoints * i / n);
+        q[i].end = (int)((int64_t)s->npoints * (i + 1) / n);
+        ctx[i].s = s;
+        ctx[i].p = &e->parts[i];
+        ctx[i].q = q;
+        ctx[i].self = i;
+        ctx[i].n = n;
+    }
+
+    /* a point not run has failed */
+    for (i = 0; i < s->npoints; i++)
+        s->status[i] = SWEEP_SIMFAILED;
+    printf("\n** Sweep: %d points on %d instances **\n", s->npoints, n);
+    s->wall_ns = ng_now_ns();
+    for (i = 0; i < n; i++) {
+        started[i] = ng_thread_start(&tids[i], sweep_worker, &ctx[i]) == 0;
+        if (!started[i])
+            fprintf(stderr, "Warning: cannot start sweep thread %d\n", i + 1);
+    }
+    for (i = 0; i < n; i++)
+        if (started[i])
+            ng_thread_join(tids[i]);
+    s->wall_ns = ng_now_ns() - s->wall_ns;
+
+    s->ninstances = n;
+    s->steals = 0;
+    s->failed = 0;
+    for (i = 0; i < n; i++) {
+        s->steals += ctx[i].steals;
+        mutex_delete(&q[i].cs);
+    }
+    for (i = 0; i < s->npoints; i++)
+        if (s->status[i])
+            s->failed++;
+    free(q);
+    free(ctx);
+    ngengine_free(e);
+    return (int)s->failed;
+}
+
+void
+ngsweep_print(ngsweep_t *s)
+{
+    int i, j;
+
+    printf("\n** Sweep of %s: %d points on %d instances **\n", s->netlist, s->npoints,
+           s->ninstances);
+    printf("simulations:         %d, failed %llu\n", s->npoints, (unsigned long long)s->failed);
+    printf("wall time:           %.3f s\n", s->wall_ns / 1e9);
+    if (s->wall_ns > 0)
+        printf("throughput:          %.2f simulations/s\n", s->npoints / (s->wall_ns / 1e9));
+    printf("steals:              %llu\n", (unsigned long long)s->steals);
+    for (i = 1; i <= s->ninstances && i <= 16; i++) {
+        int runs = 0;
+        double busy = 0;
+        for (j = 0; j < s->npoints; j++)
+            if (s->instance[j] == i) {
+                runs++;
+                busy += s->seconds[j];
+            }
+        printf("  instance %3d:      %d simulations, busy %.3f s\n", i, runs, busy);
+    }
+    if (s->nmeas)
+        printf("%-16s %12s %12s %12s %12s\n", "measurement", "mean", "sigma", "min", "max");
+    for (j = 0; j < s->nmeas; j++) {
+        double sum = 0, sum2 = 0, lo = INFINITY, hi = -INFINITY, mean;
+        int n = 0;
+        for (i = 0; i < s->npoints; i++) {
+            double v = s->results[i * s->nmeas + j];
+            if (isnan(v))
+                continue;
+            sum += v;
+            sum2 += v * v;
+            if (v < lo)
+                lo = v;
+            if (v > hi)
+                hi = v;
+            n++;
+        }
+        mean = n ? sum / n : NAN;
+        printf("%-16s %12.6g %12.6g %12.6g %12.6g\n", s->meas[j].name, mean,
+               n > 1 ? sqrt((sum2 - n * mean * mean) / (n - 1) > 0
+                            ? (sum2 - n * mean * mean) / (n - 1) : 0) : 0.0,
+               n ? lo : NAN, n ? hi : NAN);
+    }
+}
+
+int
+ngsweep_write(ngsweep_t *s, const char *file)
+{
+    FILE *fp = fopen(file, "w");
+    int i, j;
+
+    if (!fp) {
+        fprintf(stderr, "Error: cannot write %s\n", file);
+        return 1;
+    }
+    fprintf(fp, "point,instance,seconds,status");
+    for (j = 0; j < s->nparams; j++)
+        fprintf(fp, ",%s", s->params[j].name);
+    for (j = 0; j < s->nmeas; j++)
+        fprintf(fp, ",%s", s->meas[j].name);
+    fprintf(fp, "\n");
+    for (i = 0; i < s->npoints; i++) {
+        fprintf(fp, "%d,%d,%.6f,%s", i + 1, s->instance[i], s->seconds[i],
+                statusnames[s->status[i]]);
+        for (j = 0; j < s->nparams; j++)
+            fprintf(fp, ",%.9g", s->values[i * s->nparams + j]);
+        for (j = 0; j < s->nmeas; j++)
+            fprintf(fp, ",%.9g", s->results[i * s->nmeas + j]);
+        fprintf(fp, "\n");
+    }
+    fclose(fp);
+    printf("%d points written to %s\n", s->npoints, file);
+    return 0;
+}
@@ -0,0 +1,115 @@
+/*
+Parameter sweep and Monte Carlo runner.
+
+Thousands of variants of one netlist are spread over a set of ngspice
+instances, one thread per instance. A sweep description gives the
+netlist, the parameters and the scalar measurements:
+
+    # comment
+    netlist <file>
+    param <name> lin <from> <to> <n>     n points, grid
+    param <name> list <v1> <v2> ...      given values, grid
+    param <name> gauss <mean> <sigma>    random, per sample
+    param <name> uniform <lo> <hi>       random, per sample
+    samples <n>                          random samples per grid point
+    seed <n>
+    measure <name> max|min|avg|rms|final|pp <vector>
+
+Every occurrence of {name} in the netlist is replaced by the value of
+the parameter, e.g. "vth0={VTH0N}" in a .model card. The points are the
+grid of all lin and list parameters, each one repeated samples times
+with new random values. Random values are drawn in advance from seed,
+a point has the same values whatever instance runs it.
+
+Each instance gets a contiguous block of points. It runs them one
+after another: the circuit is handed over by ngSpice_Circ(), simulated
+in the foreground by "run", reduced to the measurements from its
+vectors, and removed again. An instance that has finished its block
+steals half of the points left in the block of another one, so slow
+variants do not leave instances idle. The queue operations are rare
+next to a simulation, every block has a lock of its own instead of a
+lock free deque.
+
+Netlist paths are relative to the directory of the description. The
+netlist is read once through the netlist cache (circ.h), which expands
+its .include files and substitutes only the lines holding a '{'.
+*/
+
+#ifndef NG_SWEEP_H
+#define NG_SWEEP_H
+
+#include "partition.h"
+#include "circ.h"
+
+#define SWEEP_NAMELEN 32
+
+/* parameter kinds */
+#define SWEEP_LIN 0
+#define SWEEP_LIST 1
+#define SWEEP_GAUSS 2
+#define SWEEP_UNIFORM 3
+
+/* status of a point */
+#define SWEEP_SIMFAILED 1      /* ngSpice_Circ() or "run" failed */
+#define SWEEP_NOMEASURE 2      /* run, but a measurement not found */
+
+/* measurement kinds */
+#define SWEEP_MAX 0
+#define SWEEP_MIN 1
+#define SWEEP_AVG 2
+#define SWEEP_RMS 3
+#define SWEEP_FINAL 4
+#define SWEEP_PP 5
+
+typedef struct ngsweep_param {
+    char name[SWEEP_NAMELEN];
+    int kind;
+    double a, b;               /* from/to, mean/sigma, lo/hi */
+    int n;                     /* grid points */
+    double *list;
+} ngsweep_param_t;
+
+typedef struct ngsweep_meas {
+    char name[SWEEP_NAMELEN];
+    int kind;
+    char vector[64];
+} ngsweep_meas_t;
+
+typedef struct ngsweep {
+    char netlist[256];
+    const ngcirc_t *circ;
+    const char **names;        /* of the parameters, for ngcirc_subst() */
+    ngsweep_param_t *params;
+    int nparams;
+    ngsweep_meas_t *meas;
+    int nmeas;
+    int samples;
+    uint64_t seed;
+
+    int npoints;
+    double *values;            /* npoints x nparams */
+    double *results;           /* npoints x nmeas, NaN if failed */
+    int *instance;             /* that ran the point, 1 ... */
+    int *status;               /* 0, SWEEP_SIMFAILED or SWEEP_NOMEASURE */
+    double *seconds;           /* wall time of the point */
+
+    /* of the last run */
+    int ninstances;
+    uint64_t wall_ns;
+    uint64_t failed;           /* points with a status */
+    uint64_t steals;
+} ngsweep_t;
+
+ngsweep_t *ngsweep_read(const char *file);
+void ngsweep_free(ngsweep_t *s);
+
+/* run all points on n instances loaded by the current loader;
+   returns the number of points failed, -1 if not run */
+int ngsweep_run(ngsweep_t *s, int n);
+
+void ngsweep_print(ngsweep_t *s);
+
+/* points, parameter values and measurements as CSV */
+int ngsweep_write(ngsweep_t *s, const char *file);
+
+#endif
@@ -0,0 +1,542 @@
+/*
+Synchronization of the partitions: the callbacks ngspice calls from
+its bg threads for every time step and EXTERNAL source evaluation.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "wr.h"
+#include "net.h"
+#include "watchdog.h"
+#include "prof.h"
+#include "trace.h"
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#define FABS(a) ((a) > 0 ? (a) : -(a))
+
+/* Multirate: interface value at time t from the rendezvous samples */
+static double
+mr_value(ngengine_t *e, ngedge_t *ed, double t)
+{
+    if (e->mr_interp == MR_LINEAR && ed->t1 > ed->t0)
+        return ed->v1 + (ed->v1 - ed->v0) * (t - ed->t1) / (ed->t1 - ed->t0);
+    return ed->v1;
+}
+
+/* Value of the EXTERNAL source name from the samples of the partition
+   driving it, interpolated or predicted at the requested time. */
+static void
+input_value(ngpart_t *p, const char *name, double acttime, double *val)
+{
+    int edge = coupling_input_edge(p, name);
+    ngedge_t *ed;
+    uint64_t t0 = 0;
+
+    if (edge < 0)
+        return;
+    ed = &p->engine->cpl->edges[edge];
+    if (p->trace)
+        t0 = ng_now_ns();
+    if (p->engine->wr)
+        *val = wr_input(p->engine->wr, edge, acttime);
+    else if (p->engine->sync_mode == SYNC_MULTIRATE)
+        *val = mr_value(p->engine, ed, acttime);
+    else
+        *val = ngpred_value(p->engine->pred, &ed->chan, acttime);
+
+    /* the value of the last iteration is checked in ng_SyncData_optimistic() */
+    ed->used_t = acttime;
+    ed->used_v = *val;
+    if (p->trace)
+        ngtrace_put(p->trace, ed->current ? NGTRACE_ISRC : NGTRACE_VSRC, t0, ng_now_ns(), acttime,
+                    *val);
+}
+
+/* Thevenin side of a coupling: the node voltage of the driving partition */
+int ng_VSRCData(double* retvoltval, double acttime, char* nodename, int ident, void* userdata)
+{
+    (void)ident;
+    input_value((ngpart_t *)userdata, nodename, acttime, retvoltval);
+    return 0;
+}
+
+/* Norton side: the load current behind the cut, fed back into the node */
+int ng_ISRCData(double* retcurrval, double acttime, char* nodename, int ident, void* userdata)
+{
+    (void)ident;
+    input_value((ngpart_t *)userdata, nodename, acttime, retcurrval);
+    return 0;
+}
+
+/* Original synchronization: busy waiting on ok1 and ok2 */
+static int
+ng_SyncData_legacy(ngpart_t *p, double* deltatime, int redostep)
+{
+    ngengine_t *e = p->engine;
+    int ii;
+    uint64_t t0 = ng_now_ns(), dt;
+
+    mutex_lock(&e->sy_cs1);
+    e->threadcount1++;
+    /* collect data from all threads */
+    p->redo = redostep;
+
+    if (e->numthreads == 1) {
+        p->newdelta = p->delta;
+        e->sync_retval = redostep;
+        e->ok1 = e->ok2 = true;
+    }
+    else if (e->threadcount1 == e->numthreads) {
+        /* Simple synchronization: Find the minimum delta time
+        for the next time step derived from all threads' deltas and
+        impose it on all threads.
+          This is done by the final thread in a time point
+        - calculate newdelta as the minum of all deltatime
+        - If one redostep is TRUE, return TRUE
+        - Set ok to TRUE to release the waiting threads
+        - Go directly behind the waiting zone to flag nowait */
+        double dmin = 1e30;
+        int retval = 0;
+        ngwatchdog_lockstep(e);
+        for (ii = 0; ii < e->numthreads; ii++) {
+            dmin = MIN(e->parts[ii].delta, dmin);
+            retval = MAX(e->parts[ii].redo, retval);
+        }
+        ngprof_barrier(e, dmin);
+        if (e->prof)
+            ngprof_last(e->prof, p);
+        for (ii = 0; ii < e->numthreads; ii++) {
+            e->parts[ii].newdelta = dmin;
+        }
+        e->sync_retval = retval;
+        e->ok1 = true;
+    }
+    else if  (e->threadcount1 > e->nparts) {
+        fprintf(stderr, "Strange out-of-sync\n\n");
+    }
+    mutex_unlock(&e->sy_cs1);
+
+    /* collect all threads here and wait */
+    while ((!e->ok1) && (e->numthreads > 1))
+        ng_msleep(0);
+
+    mutex_lock(&e->sy_cs3);
+    e->threadcount1--;
+    if (e->threadcount1 == 0)
+        e->ok1 = false;
+    e->threadcount2++;
+    if ((e->threadcount2 == e->numthreads) && (e->ok1 == false)) {
+        e->ok2 = true;
+    }
+    *deltatime = p->newdelta;
+    mutex_unlock(&e->sy_cs3);
+
+    /* collect all threads here and wait */
+    while ((!e->ok2) && (e->numthreads > 1))
+        ng_msleep(0);
+
+    mutex_lock(&e->sy_cs2);
+    e->threadcount2--;
+    if (e->threadcount2 == 0)
+        e->ok2 = false;
+    /* statistics, to be compared with the barrier */
+    dt = ng_now_ns() - t0;
+    e->legacy_stats.waits++;
+    if (e->threadcount2 == 0)
+        e->legacy_stats.completions++;
+    e->legacy_stats.wait_ns += dt;
+    if (dt > e->legacy_stats.wait_max_ns)
+        e->legacy_stats.wait_max_ns = dt;
+    mutex_unlock(&e->sy_cs2);
+
+    return e->sync_retval;
+}
+
+/* Called by the last thread arriving at the barrier: find the minimum
+   delta time of all threads in this time point and impose it on all
+   of them. If one redostep is TRUE, return TRUE to all. */
+static void
+sync_consensus(void *arg)
+{
+    ngengine_t *e = (ngengine_t *)arg;
+    double dmin = 1e30;
+    int ii, retval = 0;
+
+    ngwatchdog_lockstep(e);
+    for (ii = 0; ii < e->nparts; ii++) {
+        ngpart_t *p = &e->parts[ii];
+        if (!p->arrived)
+            continue;
+        dmin = MIN(p->delta, dmin);
+        retval = MAX(p->redo, retval);
+    }
+    for (ii = 0; ii < e->nparts; ii++) {
+        ngpart_t *p = &e->parts[ii];
+        if (!p->arrived)
+            continue;
+        p->newdelta = dmin;
+        p->arrived = false;
+    }
+    ngprof_barrier(e, dmin);
+    e->sync_retval = retval;
+}
+
+/* Called by the last partition arriving at a rendezvous: all of them
+   are at the same time, take a snapshot of the interface values. */
+static void
+mr_rendezvous(void *arg)
+{
+    ngengine_t *e = (ngengine_t *)arg;
+    int k;
+
+    ngwatchdog_lockstep(e);
+    ngprof_barrier(e, 0);
+    for (k = 0; k < e->cpl->nedges; k++) {
+        ngedge_t *ed = &e->cpl->edges[k];
+        ngsample_t s;
+        ed->t0 = ed->t1;
+        ed->v0 = ed->v1;
+        ed->t1 = e->mr_next;
+        if (ngchan_latest(&ed->chan, &s))
+            ed->v1 = s.v;
+    }
+    e->mr_next += e->mr_interval;
+}
+
+/* Multirate: every partition keeps its own time step control. They meet
+   only at the rendezvous times k * mr_interval, which are breakpoints in
+   all partitions, so no partition steps across one. */
+static int
+ng_SyncData_multirate(ngpart_t *p, double acttime, double* deltatime, int redostep)
+{
+    ngengine_t *e = p->engine;
+    double eps = 1e-6 * e->mr_interval;
+
+    if (!redostep && acttime >= e->mr_next - eps) {
+        if (ngbarrier_wait(&e->barrier, mr_rendezvous, e) && e->prof)
+            ngprof_last(e->prof, p);
+        p->api.ngSpice_SetBkpt(e->mr_next);
+    }
+    if (acttime + *deltatime > e->mr_next - eps)
+        *deltatime = e->mr_next - acttime;
+    return redostep;
+}
+
+/* values of ngpart_t.waiting */
+#define OPT_WAITING 1
+#define OPT_BLOCKED 2
+
+/* Optimistic: 1 if the partition driving edge ed has passed time t, 0
+   if it will not, because it has finished or is waiting itself, maybe
+   for p (a coupling loop), -1 if it may still */
+static int
+opt_state(ngpart_t *src, ngedge_t *ed, double t)
+{
+    ngsample_t s;
+
+    if (ngchan_latest(&ed->chan, &s) && s.t >= t)
+        return 1;
+    if (ngat_load_i(&src->state) != NGPART_RUNNING || ngat_load_i(&src->unsynced) ||
+        ngat_load_i(&src->waiting))
+        return 0;
+    return -1;
+}
+
+/* Optimistic: sleep until opt_state() has decided */
+static bool
+opt_reached(ngpart_t *p, ngedge_t *ed, double t)
+{
+    ngpart_t *src = &p->engine->parts[ed->src];
+    int r, key;
+
+    ngat_store_i(&p->waiting, OPT_WAITING);
+    ngwake_signal(&p->progress);
+    while ((r = opt_state(src, ed, t)) < 0) {
+        key = ngwake_prepare(&src->progress);
+        if (opt_state(src, ed, t) < 0)
+            ngwake_wait(&src->progress, key);
+        else
+            ngwake_cancel(&src->progress);
+    }
+    ngat_store_i(&p->waiting, 0);
+    return r > 0;
+}
+
+/* Optimistic: true while dst still retires samples of ed */
+static bool
+opt_draining(ngedge_t *ed, ngpart_t *dst)
+{
+    return ngat_load_i(&dst->state) == NGPART_RUNNING && !ngat_load_i(&dst->unsynced) &&
+           ngat_load_i(&dst->waiting) != OPT_BLOCKED && ngchan_full(&ed->chan);
+}
+
+/* A sample of p for dst has not fit into ed: unless dst has stopped
+   taking samples, the run fails. Reported once. */
+static void
+samples_lost(ngpart_t *p, ngedge_t *ed, ngpart_t *dst, const char *why)
+{
+    if (ngat_load_i(&dst->state) != NGPART_RUNNING || ngat_load_i(&dst->unsynced))
+        return;
+    if (!p->engine->out_of_sync)
+        fprintf(stderr, "Error: partition %d is %d samples ahead of partition %d%s, samples"
+                " lost, the run fails\n", p->ident, (int)(ed->chan.ring.mask + 1), dst->ident,
+                why);
+    p->engine->out_of_sync = true;
+}
+
+/* A full channel bounds how far p runs ahead of the partition it drives:
+   p sleeps until that one has retired samples. Meanwhile p counts as
+   waiting, a partition waiting for p in opt_reached() goes on. A sample
+   is lost only if the driven partition is blocked itself (a coupling
+   loop of full channels), which fails the run. */
+void
+sync_push_optimistic(ngpart_t *p, ngedge_t *ed, double t, double v)
+{
+    ngpart_t *dst = &p->engine->parts[ed->dst];
+    uint64_t t0;
+    int key;
+
+    if (ngchan_full(&ed->chan)) {
+        t0 = ng_now_ns();
+        ngat_store_i(&p->waiting, OPT_BLOCKED);
+        ngwake_signal(&p->progress);
+        while (opt_draining(ed, dst)) {
+            key = ngwake_prepare(&dst->progress);
+            if (opt_draining(ed, dst))
+                ngwake_wait(&dst->progress, key);
+            else
+                ngwake_cancel(&dst->progress);
+        }
+        ngat_store_i(&p->waiting, 0);
+        p->blocked_ns += ng_now_ns() - t0;
+    }
+    if (!ngchan_push(&ed->chan, t, v))
+        samples_lost(p, ed, dst, ", both are blocked");
+}
+
+/* Lockstep and multirate: push a sample of p into ed. The driven partition
+   retires the samples at its accepted time, a full channel means it is
+   a whole channel behind; the samples are then lost and the run fails. */
+void
+sync_push(ngpart_t *p, ngedge_t *ed, double t, double v)
+{
+    if (!ngchan_push(&ed->chan, t, v))
+        samples_lost(p, ed, &p->engine->parts[ed->dst], "");
+}
+
+/* Optimistic: wake up the partitions waiting for samples of p, or for
+   p to retire theirs */
+void
+sync_progress(ngpart_t *p)
+{
+    if (p->engine->sync_mode == SYNC_OPTIMISTIC)
+        ngwake_signal(&p->progress);
+}
+
+/* Optimistic: no barrier, the step to acttime has been calculated with
+   input values predicted from the samples available then. Now compare
+   them with the samples of the driving partitions. If one is off by more
+   than opt_tol, the step is redone with half the time step, its inputs
+   are then interpolated from the driver's actual samples. */
+static int
+ng_SyncData_optimistic(ngpart_t *p, double acttime, double* deltatime, double olddeltatime,
+                       int redostep)
+{
+    ngengine_t *e = p->engine;
+    uint64_t t0 = ng_now_ns();
+    bool miss = false;
+    int k;
+
+    for (k = 0; k < p->ninputs && !redostep; k++) {
+        ngedge_t *ed = &e->cpl->edges[p->inputs[k].edge];
+        double actual;
+        /* opt_tol is a voltage, load currents are not checked */
+        if (ed->used_t != acttime || ed->current)
+            continue;
+        if (!opt_reached(p, ed, acttime)) {
+            p->unverified++;
+            continue;
+        }
+        actual = ngpred_value(e->pred_interp, &ed->chan, acttime);
+        if (FABS(actual - ed->used_v) > e->opt_tol) {
+            miss = true;
+            break;
+        }
+    }
+    p->verify_ns += ng_now_ns() - t0;
+
+    if (miss) {
+        p->rollbacks++;
+        p->wasted_ns += ng_now_ns() - p->step_ns;
+        p->wasted_t += olddeltatime;
+        *deltatime = olddeltatime / 2;
+        redostep = 1;
+    }
+    /* keep the samples needed when redoing the step from the last time point */
+    for (k = 0; k < p->ninputs; k++)
+        ngchan_retire(&e->cpl->edges[p->inputs[k].edge].chan,
+                      redostep ? acttime - olddeltatime : acttime);
+    sync_progress(p);
+    p->step_ns = ng_now_ns();
+    return redostep;
+}
+
+static int
+sync_step(ngpart_t *p, double acttime, double* deltatime, double olddeltatime, int redostep)
+{
+    ngengine_t *e = p->engine;
+    int k;
+
+    if (e->sync_mode == SYNC_OPTIMISTIC)
+        return ng_SyncData_optimistic(p, acttime, deltatime, olddeltatime, redostep);
+    /* acttime is accepted, earlier input samples are not needed any more */
+    for (k = 0; k < p->ninputs; k++)
+        ngchan_retire(&e->cpl->edges[p->inputs[k].edge].chan, acttime);
+    if (e->sync_mode == SYNC_MULTIRATE)
+        return ng_SyncData_multirate(p, acttime, deltatime, redostep);
+    if (e->sync_mode == SYNC_LEGACY)
+        return ng_SyncData_legacy(p, deltatime, redostep);
+    /* waveform relaxation: every partition keeps its own time steps */
+    if (e->sync_mode == SYNC_WR)
+        return redostep;
+    /* the hub of a distributed run is the barrier */
+    if (e->net)
+        return ngnet_step(p, acttime, deltatime, redostep);
+
+    /* deposit own data, the barrier publishes them to the last arriver */
+    p->redo = redostep;
+    p->arrived = true;
+
+    if (ngbarrier_wait(&e->barrier, sync_consensus, e) && e->prof)
+        ngprof_last(e->prof, p);
+
+    *deltatime = p->newdelta;
+    return e->sync_retval;
+}
+
+int ng_SyncData(double acttime, double* deltatime, double olddeltatime,
+                int redostep, int ident, int location, void* userdata)
+{
+    ngpart_t *p = (ngpart_t *)userdata;
+    ngengine_t *e = p->engine;
+    uint64_t t_in, t_out;
+    int ret;
+
+    (void)ident;
+    /* taken out by the watchdog, it runs on its own */
+    if (ngat_load_i(&p->unsynced))
+        return redostep;
+    p->syncs++;
+    if (redostep)
+        p->redos++;
+    p->delta = *deltatime;
+    p->acttime = acttime;
+    p->location = location;
+    if (!e->wd && !e->prof && !p->trace)
+        return sync_step(p, acttime, deltatime, olddeltatime, redostep);
+
+    /* watched, instrumented, traced */
+    t_in = ng_now_ns();
+    if (e->prof)
+        ngprof_in(e->prof, p, t_in);
+    ngat_store_u64(&p->sync_ns, t_in);
+    ngat_store_i(&p->insync, 1);
+    ret = sync_step(p, acttime, deltatime, olddeltatime, redostep);
+    ngat_store_i(&p->insync, 0);
+    t_out = ng_now_ns();
+    ngat_store_u64(&p->sync_ns, t_out);
+    if (e->prof)
+        ngprof_out(e->prof, p, t_in, t_out);
+    if (p->trace)
+        ngtrace_sync(p->trace, t_in, t_out, acttime, *deltatime, redostep);
+    return ret;
+}
+
+/* a process of the timeline for e, a thread for every partition */
+static void
+trace_attach(ngengine_t *e)
+{
+    char name[320];
+    int i;
+
+    if (!ngtrace_on() || e->workers)
+        return;
+    if (!e->trace_pid) {
+        sprintf(name, "%d partitions, %s", e->nparts,
+                e->sync_mode == SYNC_LEGACY ? "legacy ok1/ok2" :
+                e->sync_mode == SYNC_MULTIRATE ? "multirate" :
+                e->sync_mode == SYNC_OPTIMISTIC ? "optimistic" :
+                e->wr ? "waveform relaxation" : "barrier");
+        e->trace_pid = ngtrace_process(name);
+    }
+    for (i = 0; i < e->nparts; i++) {
+        ngpart_t *p = &e->parts[i];
+        if (!p->trace) {
+            snprintf(name, sizeof(name), "partition %d (%s)", p->ident, p->netlist);
+            p->trace = ngtrace_attach(e->trace_pid, p->ident, name);
+        }
+        if (p->trace)
+            p->trace->out_ns = 0;
+    }
+}
+
+/* reset the synchronization state before a run */
+void
+sync_prepare(ngengine_t *e)
+{
+    int i;
+
+    for (i = 0; i < e->nparts; i++) {
+        ngpart_t *p = &e->parts[i];
+        p->arrived = false;
+        p->syncs = p->redos = 0;
+        p->waiting = 0;
+        p->rollbacks = p->unverified = p->wasted_ns = p->verify_ns = p->blocked_ns = 0;
+        p->wasted_t = 0;
+        p->step_ns = ng_now_ns();
+        p->insync = p->unsynced = 0;
+        p->sync_ns = p->step_ns;
+    }
+    for (i = 0; e->cpl && i < e->cpl->nedges; i++) {
+        ngedge_t *ed = &e->cpl->edges[i];
+        ed->t0 = ed->v0 = ed->t1 = ed->v1 = 0;
+        ed->used_t = -1;
+        ed->used_v = 0;
+        ngchan_reset(&ed->chan);
+    }
+    e->mr_next = 0;
+    e->ok1 = e->ok2 = false;
+    e->threadcount1 = e->threadcount2 = 0;
+    memset(&e->legacy_stats, 0, sizeof(e->legacy_stats));
+    ngbarrier_destroy(&e->barrier);
+    if (e->workers)
+        ngbarrier_init_shared(&e->barrier, e->nparts, e->spin);
+    else
+        ngbarrier_init(&e->barrier, e->nparts, e->spin);
+    ngwatchdog_start(e);
+    ngprof_start(e);
+    trace_attach(e);
+}
+
+/* The bg thread of partition p has ended, the others go on without it. */
+void
+sync_leave(ngpart_t *p)
+{
+    ngengine_t *e = p->engine;
+
+    if (e->net)
+        ngnet_leave(p);
+    else if (e->sync_mode == SYNC_LEGACY) {
+        e->ok1 = (e->threadcount1 == e->numthreads);
+        if (e->threadcount2 && e->threadcount2 == e->numthreads && !e->ok1)
+            e->ok2 = true;
+    }
+    else if (e->sync_mode == SYNC_BARRIER)
+        ngbarrier_leave(&e->barrier, sync_consensus, e);
+    else if (e->sync_mode == SYNC_MULTIRATE)
+        ngbarrier_leave(&e->barrier, mr_rendezvous, e);
+    else
+        sync_progress(p);
+}
@@ -0,0 +1,328 @@
+/*
+Timeline of the partitions in the Chrome trace format, see trace.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+static const char *names[] = { "compute", "wait", "redo", "vsrc", "isrc", "data" };
+
+static bool started;
+static volatile int running;   /* the writer takes the events */
+static volatile int stopping;
+static threadId_t writer_tid;
+static ngwake_t wake;          /* events put, a ring detached, or stopping */
+static mutexType queues_cs;    /* queues, the file outside the writer */
+static ngtraceq_t *queues[NGTRACE_MAXQ];
+static int nprocs;
+static uint64_t ring_size = NGTRACE_SIZE;
+static uint64_t base_ns;
+static FILE *fp;
+static char *fname;
+static uint64_t written, dropped_total;
+
+/* the events are separated by commas */
+static void
+begin_event(void)
+{
+    fprintf(fp, written++ ? ",\n" : "\n");
+}
+
+static void
+put_string(const char *s)
+{
+    fputc('"', fp);
+    for (; *s; s++)
+        if (*s == '"' || *s == '\\')
+            fprintf(fp, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fputc(' ', fp);
+        else
+            fputc(*s, fp);
+    fputc('"', fp);
+}
+
+static void
+put_meta(const char *what, int pid, int tid, const char *name)
+{
+    begin_event();
+    fprintf(fp, "{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", what, pid,
+            tid);
+    put_string(name);
+    fprintf(fp, "}}");
+}
+
+static void
+put_event(ngtraceq_t *q, ngtrace_ev_t *ev)
+{
+    double ts = ev->t0 > base_ns ? (ev->t0 - base_ns) / 1e3 : 0;
+
+    begin_event();
+    fprintf(fp, "{\"name\":\"%s\",\"cat\":\"%s\",", names[ev->type],
+            ev->type <= NGTRACE_REDO ? "step" : "callback");
+    if (ev->type == NGTRACE_REDO)
+        fprintf(fp, "\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,", ts);
+    else
+        fprintf(fp, "\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,", ts, ev->dur / 1e3);
+    fprintf(fp, "\"pid\":%d,\"tid\":%d,\"args\":{", q->pid, q->tid);
+    if (ev->type == NGTRACE_DATA)
+        fprintf(fp, "\"time\":%.9g", ev->a);
+    else if (ev->type >= NGTRACE_VSRC)
+        fprintf(fp, "\"time\":%.9g,\"value\":%.9g", ev->a, ev->b);
+    else if (ev->type == NGTRACE_REDO)
+        fprintf(fp, "\"acttime\":%.9g", ev->a);
+    else
+        fprintf(fp, "\"acttime\":%.9g,\"delta\":%.9g", ev->a, ev->b);
+    fprintf(fp, "}}");
+}
+
+static uint64_t
+drain(ngtraceq_t *q)
+{
+    uint64_t head = ngring_end(&q->ring), i, n = head - q->ring.tail;
+
+    for (i = q->ring.tail; i < head; i++)
+        put_event(q, &q->ev[i & q->ring.mask]);
+    ngring_pop_to(&q->ring, head);
+    return n;
+}
+
+static void
+free_queue(int i)
+{
+    dropped_total += queues[i]->dropped;
+    free(queues[i]->ev);
+    free(queues[i]);
+    queues[i] = NULL;
+}
+
+/* with queues_cs */
+static bool
+pending(void)
+{
+    int i;
+
+    for (i = 0; i < NGTRACE_MAXQ; i++)
+        if (queues[i] && (ngring_end(&queues[i]->ring) != queues[i]->ring.tail ||
+                          ngat_load_i(&queues[i]->detached)))
+            return true;
+    return false;
+}
+
+static void *
+writer(void *arg)
+{
+    int i, key;
+
+    (void)arg;
+    for (;;) {
+        int stop = ngat_load_i(&stopping);
+        uint64_t n = 0;
+
+        mutex_lock(&queues_cs);
+        for (i = 0; i < NGTRACE_MAXQ; i++) {
+            ngtraceq_t *q = queues[i];
+            if (!q)
+                continue;
+            n += drain(q);
+            /* nothing more comes after the detach */
+            if (ngat_load_i(&q->detached))
+                free_queue(i);
+        }
+        if (stop && !n) {
+            mutex_unlock(&queues_cs);
+            break;
+        }
+        if (n) {
+            mutex_unlock(&queues_cs);
+            continue;
+        }
+        /* nothing came in, let the events out and sleep */
+        fflush(fp);
+        key = ngwake_prepare(&wake);
+        if (ngat_load_i(&stopping) || pending()) {
+            mutex_unlock(&queues_cs);
+            ngwake_cancel(&wake);
+            continue;
+        }
+        mutex_unlock(&queues_cs);
+        ngwake_wait(&wake, key);
+    }
+    return NULL;
+}
+
+#if !defined(__MINGW32__) && !defined(_MSC_VER)
+/* a forked process has no writer and must not write the file */
+static void
+forked_child(void)
+{
+    running = 0;
+    started = false;
+}
+#endif
+
+int
+ngtrace_start(const char *file, int size)
+{
+    if (started)
+        return 0;
+    ring_size = NGTRACE_SIZE;
+    if (size > 0)
+        for (ring_size = 1; ring_size < (uint64_t)size; ring_size <<= 1)
+            ;
+    fp = fopen(file, "w");
+    if (!fp) {
+        perror(file);
+        return 1;
+    }
+    fname = strdup(file);
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    base_ns = ng_now_ns();
+    started = true;
+    atexit(ngtrace_stop);
+    mutex_init(&queues_cs);
+    ngwake_init(&wake);
+#if !defined(__MINGW32__) && !defined(_MSC_VER)
+    pthread_atfork(NULL, NULL, forked_child);
+#endif
+    stopping = 0;
+    if (ng_thread_start(&writer_tid, writer, NULL)) {
+        fprintf(stderr, "Error: cannot start the trace writer, no trace\n");
+        fclose(fp);
+        started = false;
+        return 1;
+    }
+    ngat_store_i(&running, 1);
+    return 0;
+}
+
+void
+ngtrace_stop(void)
+{
+    int i;
+
+    if (!started)
+        return;
+    /* events put from now on are lost */
+    ngat_store_i(&running, 0);
+    ngat_store_i(&stopping, 1);
+    ngwake_signal(&wake);
+    ng_thread_join(writer_tid);
+    /* the rings of running engines stay, a bg thread may still put into them */
+    for (i = 0; i < NGTRACE_MAXQ; i++)
+        if (queues[i])
+            dropped_total += queues[i]->dropped;
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    printf("\n** Trace (%s) **\n", fname);
+    printf("events written:      %llu, dropped %llu\n", (unsigned long long)written,
+           (unsigned long long)dropped_total);
+    free(fname);
+    started = false;
+}
+
+bool
+ngtrace_on(void)
+{
+    return ngat_load_i(&running) != 0;
+}
+
+int
+ngtrace_process(const char *name)
+{
+    int pid;
+
+    if (!ngtrace_on())
+        return 0;
+    mutex_lock(&queues_cs);
+    pid = ++nprocs;
+    put_meta("process_name", pid, 0, name);
+    mutex_unlock(&queues_cs);
+    return pid;
+}
+
+ngtraceq_t *
+ngtrace_attach(int pid, int tid, const char *name)
+{
+    ngtraceq_t *q;
+    int i;
+
+    if (!ngtrace_on())
+        return NULL;
+    q = (ngtraceq_t *)calloc(1, sizeof(ngtraceq_t));
+    q->ev = (ngtrace_ev_t *)malloc(ngring_init(&q->ring, ring_size) * sizeof(ngtrace_ev_t));
+    q->pid = pid;
+    q->tid = tid;
+    snprintf(q->name, sizeof(q->name), "%s", name);
+    mutex_lock(&queues_cs);
+    for (i = 0; i < NGTRACE_MAXQ && queues[i]; i++)
+        ;
+    if (i == NGTRACE_MAXQ) {
+        mutex_unlock(&queues_cs);
+        fprintf(stderr, "Warning: more than %d traced threads, %s is not traced\n", NGTRACE_MAXQ,
+                name);
+        free(q->ev);
+        free(q);
+        return NULL;
+    }
+    put_meta("thread_name", pid, tid, name);
+    queues[i] = q;
+    mutex_unlock(&queues_cs);
+    return q;
+}
+
+void
+ngtrace_detach(ngtraceq_t *q)
+{
+    int i;
+
+    if (!q)
+        return;
+    mutex_lock(&queues_cs);
+    if (ngat_load_i(&running)) {
+        /* the writer frees it with the last events */
+        ngat_store_i(&q->detached, 1);
+        ngwake_signal(&wake);
+    }
+    else {
+        for (i = 0; i < NGTRACE_MAXQ; i++)
+            if (queues[i] == q)
+                free_queue(i);
+    }
+    mutex_unlock(&queues_cs);
+}
+
+void
+ngtrace_put(ngtraceq_t *q, int type, uint64_t t0, uint64_t t1, double a, double b)
+{
+    ngtrace_ev_t *ev;
+
+    if (ngring_full(&q->ring)) {
+        q->dropped++;
+        return;
+    }
+    ev = &q->ev[ngring_slot(&q->ring)];
+    ev->type = type;
+    ev->t0 = t0;
+    ev->dur = t1 > t0 ? t1 - t0 : 0;
+    ev->a = a;
+    ev->b = b;
+    ngring_push(&q->ring);
+    ngwake_signal(&wake);
+}
+
+void
+ngtrace_sync(ngtraceq_t *q, uint64_t t_in, uint64_t t_out, double acttime, double delta,
+             int redostep)
+{
+    /* the first step includes the setup of the run */
+    if (q->out_ns)
+        ngtrace_put(q, NGTRACE_COMPUTE, q->out_ns, t_in, acttime, delta);
+    if (redostep)
+        ngtrace_put(q, NGTRACE_REDO, t_in, t_in, acttime, 0);
+    ngtrace_put(q, NGTRACE_WAIT, t_in, t_out, acttime, delta);
+    q->out_ns = t_out;
+}
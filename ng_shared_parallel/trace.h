@@ -0,0 +1,78 @@
+/*
+Timeline of the partitions in the Chrome trace format.
+
+The counters of prof.h tell how much time went where, a timeline shows
+when: which partition was still computing while the others waited at
+the barrier, step by step. With ngtrace_start() the callbacks of every
+partition put events into a ring of their own:
+
+    compute     from leaving ng_SyncData() to coming in again
+    wait        in ng_SyncData(), at the barrier or verifying inputs
+    redo        ng_SyncData() called with redostep set (an instant)
+    vsrc, isrc  ng_VSRCData(), ng_ISRCData()
+    data        ng_data()
+
+A ring (ring.h) has one producer, the bg thread of its partition, and
+one consumer, the writer thread, which empties the rings into the trace
+file as JSON and sleeps while they are empty. A full ring drops the
+event and counts it. Every engine is a process in the trace, every partition a
+thread of it. Load the file into chrome://tracing or ui.perfetto.dev.
+
+The file is completed at exit. Worker processes are not traced.
+*/
+
+#ifndef NG_TRACE_H
+#define NG_TRACE_H
+
+#include "ring.h"
+
+/* event types */
+#define NGTRACE_COMPUTE 0
+#define NGTRACE_WAIT 1
+#define NGTRACE_REDO 2
+#define NGTRACE_VSRC 3
+#define NGTRACE_ISRC 4
+#define NGTRACE_DATA 5
+
+/* default events per ring, a power of 2 */
+#define NGTRACE_SIZE 16384
+/* rings at the same time */
+#define NGTRACE_MAXQ 1024
+
+typedef struct ngtrace_ev {
+    uint64_t t0, dur;          /* ns */
+    double a, b;               /* arguments, by type */
+    int type;
+} ngtrace_ev_t;
+
+typedef struct ngtraceq {
+    ngring_t ring;
+    ngtrace_ev_t *ev;
+    int pid, tid;
+    char name[64];
+    volatile int detached;     /* freed by the writer when empty */
+    uint64_t out_ns;           /* went out of ng_SyncData(), producer */
+    uint64_t dropped;          /* producer */
+} ngtraceq_t;
+
+/* write the trace into file, size events per ring, 0 for the default;
+   it is completed at exit */
+int ngtrace_start(const char *file, int size);
+void ngtrace_stop(void);
+bool ngtrace_on(void);
+
+/* a process of the trace, returns its pid */
+int ngtrace_process(const char *name);
+
+/* ring of thread tid of process pid, NULL if not tracing */
+ngtraceq_t *ngtrace_attach(int pid, int tid, const char *name);
+void ngtrace_detach(ngtraceq_t *q);
+
+/* an event from t0 to t1, an instant if they are equal */
+void ngtrace_put(ngtraceq_t *q, int type, uint64_t t0, uint64_t t1, double a, double b);
+
+/* ng_SyncData() from t_in to t_out, and the compute before */
+void ngtrace_sync(ngtraceq_t *q, uint64_t t_in, uint64_t t_out, double acttime, double delta,
+                  int redostep);
+
+#endif
@@ -0,0 +1,380 @@
+/*
+Socket transports of the distributed run, see transport.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "transport.h"
+
+#if defined(__MINGW32__) || defined(_MSC_VER)
+
+ngtransport_t *
+ngtransport_listen(const char *addr)
+{
+    fprintf(stderr, "Error: no transport %s on MS Windows\n", addr);
+    return NULL;
+}
+
+ngtransport_t *
+ngtransport_accept(ngtransport_t *l)
+{
+    (void)l;
+    return NULL;
+}
+
+ngtransport_t *
+ngtransport_connect(const char *addr, int timeout_ms)
+{
+    (void)timeout_ms;
+    fprintf(stderr, "Error: no transport %s on MS Windows\n", addr);
+    return NULL;
+}
+
+int
+ngtransport_send(ngtransport_t *t, int type, const void *data, size_t len)
+{
+    (void)t;
+    (void)type;
+    (void)data;
+    (void)len;
+    return -1;
+}
+
+int
+ngtransport_recv(ngtransport_t *t, int *type, size_t *len)
+{
+    (void)t;
+    (void)type;
+    (void)len;
+    return -1;
+}
+
+void
+ngtransport_close(ngtransport_t *t)
+{
+    (void)t;
+}
+
+#else
+
+#include <errno.h>
+#include <netdb.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define TRANSPORT_BACKLOG 64
+
+typedef struct msghdr_ng {
+    uint32_t type;
+    uint32_t len;
+} msghdr_ng;
+
+/* HOST:PORT, the port after the last colon */
+static struct addrinfo *
+tcp_resolve(const char *where, bool passive)
+{
+    struct addrinfo hints, *res = NULL;
+    char host[256];
+    const char *colon = strrchr(where, ':');
+    int rc;
+
+    if (!colon || colon - where >= (int)sizeof(host)) {
+        fprintf(stderr, "Error: tcp address %s is not HOST:PORT\n", where);
+        return NULL;
+    }
+    memcpy(host, where, (size_t)(colon - where));
+    host[colon - where] = '\0';
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    rc = getaddrinfo(host[0] && strcmp(host, "*") ? host : NULL, colon + 1, &hints, &res);
+    if (rc) {
+        fprintf(stderr, "Error: %s: %s\n", where, gai_strerror(rc));
+        return NULL;
+    }
+    return res;
+}
+
+static int
+tcp_listen(const char *where)
+{
+    struct addrinfo *res = tcp_resolve(where, true), *a;
+    int fd = -1, on = 1;
+
+    for (a = res; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0)
+            continue;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, a->ai_addr, a->ai_addrlen) || listen(fd, TRANSPORT_BACKLOG)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (res)
+        freeaddrinfo(res);
+    return fd;
+}
+
+static int
+tcp_connect(const char *where)
+{
+    struct addrinfo *res = tcp_resolve(where, false), *a;
+    int fd = -1, on = 1;
+
+    for (a = res; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (connect(fd, a->ai_addr, a->ai_addrlen)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd >= 0)
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    if (res)
+        freeaddrinfo(res);
+    return fd;
+}
+
+static int
+unix_address(const char *where, struct sockaddr_un *sa)
+{
+    memset(sa, 0, sizeof(*sa));
+    sa->sun_family = AF_UNIX;
+    if (strlen(where) >= sizeof(sa->sun_path)) {
+        fprintf(stderr, "Error: socket path %s too long\n", where);
+        return 1;
+    }
+    strcpy(sa->sun_path, where);
+    return 0;
+}
+
+static int
+unix_listen(const char *where)
+{
+    struct sockaddr_un sa;
+    int fd;
+
+    if (unix_address(where, &sa))
+        return -1;
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    unlink(where);
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) || listen(fd, TRANSPORT_BACKLOG)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int
+unix_connect(const char *where)
+{
+    struct sockaddr_un sa;
+    int fd;
+
+    if (unix_address(where, &sa))
+        return -1;
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+static const ngtransport_ops_t transports[] = {
+    { "tcp", tcp_listen, tcp_connect },
+    { "unix", unix_listen, unix_connect },
+};
+
+/* implementation of "name:where", NULL if unknown */
+static const ngtransport_ops_t *
+find_ops(const char *addr, const char **where)
+{
+    size_t i, n;
+
+    for (i = 0; i < sizeof(transports) / sizeof(transports[0]); i++) {
+        n = strlen(transports[i].name);
+        if (!strncmp(addr, transports[i].name, n) && addr[n] == ':') {
+            *where = addr + n + 1;
+            return &transports[i];
+        }
+    }
+    fprintf(stderr, "Error: address %s is not tcp:HOST:PORT or unix:PATH\n", addr);
+    return NULL;
+}
+
+static ngtransport_t *
+transport_new(const ngtransport_ops_t *ops, int fd, const char *where)
+{
+    ngtransport_t *t = (ngtransport_t *)calloc(1, sizeof(ngtransport_t));
+
+    t->ops = ops;
+    t->fd = fd;
+    snprintf(t->where, sizeof(t->where), "%s", where);
+    return t;
+}
+
+ngtransport_t *
+ngtransport_listen(const char *addr)
+{
+    const char *where;
+    const ngtransport_ops_t *ops = find_ops(addr, &where);
+    ngtransport_t *t;
+    int fd;
+
+    if (!ops)
+        return NULL;
+    fd = ops->listen(where);
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot listen on %s: %s\n", addr, strerror(errno));
+        return NULL;
+    }
+    /* a lost connection is seen by send(), not by a signal */
+    signal(SIGPIPE, SIG_IGN);
+    t = transport_new(ops, fd, where);
+    t->listening = true;
+    return t;
+}
+
+ngtransport_t *
+ngtransport_accept(ngtransport_t *l)
+{
+    int fd, on = 1;
+
+    do
+        fd = accept(l->fd, NULL, NULL);
+    while (fd < 0 && errno == EINTR);
+    if (fd < 0) {
+        perror("accept");
+        return NULL;
+    }
+    if (l->ops->listen == tcp_listen)
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return transport_new(l->ops, fd, l->where);
+}
+
+ngtransport_t *
+ngtransport_connect(const char *addr, int timeout_ms)
+{
+    const char *where;
+    const ngtransport_ops_t *ops = find_ops(addr, &where);
+    int fd, waited = 0;
+
+    if (!ops)
+        return NULL;
+    signal(SIGPIPE, SIG_IGN);
+    /* the hub may not listen yet */
+    while ((fd = ops->connect(where)) < 0 && waited < timeout_ms) {
+        ng_msleep(50);
+        waited += 50;
+    }
+    if (fd < 0) {
+        fprintf(stderr, "Error: cannot connect to %s: %s\n", addr, strerror(errno));
+        return NULL;
+    }
+    return transport_new(ops, fd, where);
+}
+
+static int
+read_all(int fd, void *data, size_t len)
+{
+    char *d = (char *)data;
+
+    while (len > 0) {
+        ssize_t n = read(fd, d, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        d += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int
+ngtransport_send(ngtransport_t *t, int type, const void *data, size_t len)
+{
+    msghdr_ng h;
+    struct iovec iov[2], *v = iov;
+    size_t left = sizeof(h) + len;
+    int cnt = len ? 2 : 1;
+
+    h.type = (uint32_t)type;
+    h.len = (uint32_t)len;
+    iov[0].iov_base = &h;
+    iov[0].iov_len = sizeof(h);
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len = len;
+    /* header and payload in one segment */
+    while (left > 0) {
+        ssize_t n = writev(t->fd, v, cnt);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        left -= (size_t)n;
+        /* skip what has been written */
+        while (cnt > 0 && (size_t)n >= v->iov_len) {
+            n -= (ssize_t)v->iov_len;
+            v++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            v->iov_base = (char *)v->iov_base + n;
+            v->iov_len -= (size_t)n;
+        }
+    }
+    t->msgs_sent++;
+    t->bytes_sent += sizeof(h) + len;
+    return 0;
+}
+
+int
+ngtransport_recv(ngtransport_t *t, int *type, size_t *len)
+{
+    msghdr_ng h;
+
+    if (read_all(t->fd, &h, sizeof(h)))
+        return -1;
+    if (h.len > t->cap) {
+        char *b = (char *)realloc(t->buf, h.len);
+        if (!b)
+            return -1;
+        t->buf = b;
+        t->cap = h.len;
+    }
+    if (h.len && read_all(t->fd, t->buf, h.len))
+        return -1;
+    *type = (int)h.type;
+    *len = h.len;
+    t->msgs_received++;
+    t->bytes_received += sizeof(h) + h.len;
+    return 0;
+}
+
+void
+ngtransport_close(ngtransport_t *t)
+{
+    if (!t)
+        return;
+    close(t->fd);
+    if (t->listening && t->ops->listen == unix_listen)
+        unlink(t->where);
+    free(t->buf);
+    free(t);
+}
+
+#endif
@@ -0,0 +1,61 @@
+/*
+Message transport between the hosts of a distributed run (net.h).
+
+A transport carries framed messages over a stream connection: an 8 byte
+header with type and payload length, then the payload. Addresses name
+the implementation and where it listens:
+
+    tcp:HOST:PORT      TCP, Nagle disabled, a message per step must
+                       not wait for the acknowledgement of the last one
+    unix:PATH          Unix domain stream socket, one host only
+
+Both are sockets and share the framing; an implementation only has to
+listen and connect. The payload is sent in host byte order, all hosts
+of a run must have the same byte order and double format. Not available
+on MS Windows.
+*/
+
+#ifndef NG_TRANSPORT_H
+#define NG_TRANSPORT_H
+
+#include <stddef.h>
+
+#include "port.h"
+
+typedef struct ngtransport_ops {
+    const char *name;
+    int (*listen)(const char *where);               /* listening fd, -1 on error */
+    int (*connect)(const char *where);              /* connected fd, -1 on error */
+} ngtransport_ops_t;
+
+typedef struct ngtransport {
+    const ngtransport_ops_t *ops;
+    int fd;
+    bool listening;
+    char where[256];
+    char *buf;                 /* payload of the last message received */
+    size_t cap;
+    uint64_t msgs_sent, msgs_received;
+    uint64_t bytes_sent, bytes_received;
+} ngtransport_t;
+
+/* listen on addr, NULL on error */
+ngtransport_t *ngtransport_listen(const char *addr);
+
+/* next connection on a listening transport, NULL on error */
+ngtransport_t *ngtransport_accept(ngtransport_t *l);
+
+/* connect to addr, retrying for up to timeout_ms while nobody listens */
+ngtransport_t *ngtransport_connect(const char *addr, int timeout_ms);
+
+/* Send a message. Returns 0, or -1 if the connection is lost. */
+int ngtransport_send(ngtransport_t *t, int type, const void *data, size_t len);
+
+/* Receive the next message, its payload is in t->buf until the next
+   call. Returns 0, or -1 on end of the connection or an error. */
+int ngtransport_recv(ngtransport_t *t, int *type, size_t *len);
+
+/* close the connection; a listening unix socket is removed */
+void ngtransport_close(ngtransport_t *t);
+
+#endif
@@ -0,0 +1,596 @@
+/*
+Unit tests of the modules which need no ngspice: ring and wakeup,
+sample channel, predictors, coupling parser, netlist cache, sweep
+points, capture file, barrier, and the shared locks of worker
+processes with one of them killed.
+
+Run by ctest or "make check" in a directory where the files the tests
+write may be created; they are removed again. Every check failed is
+reported with its line, the exit status is the number of them.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ring.h"
+#include "chan.h"
+#include "pred.h"
+#include "coupling.h"
+#include "circ.h"
+#include "sweep.h"
+#include "capture.h"
+#include "barrier.h"
+
+#if !defined(__MINGW32__) && !defined(_MSC_VER)
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
+
+static int checks, failed;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+#define CHECK_NEAR(a, b) check(fabs((a) - (b)) < 1e-9, #a " == " #b, __LINE__)
+
+static void
+check(int ok, const char *what, int line)
+{
+    checks++;
+    if (!ok) {
+        failed++;
+        fprintf(stderr, "unittest.c:%d: failed: %s\n", line, what);
+    }
+}
+
+static void
+write_file(const char *file, const char *text)
+{
+    FILE *fp = fopen(file, "w");
+
+    if (!fp) {
+        perror(file);
+        exit(1);
+    }
+    fputs(text, fp);
+    fclose(fp);
+}
+
+/* ring and wakeup: a consumer thread sleeping on empty, the producer on full */
+
+#define RING_ITEMS 200000
+
+typedef struct ringtest {
+    ngring_t ring;
+    ngwake_t data, space;
+    int items[16];
+    int errors;
+} ringtest_t;
+
+static void *
+ring_consumer(void *arg)
+{
+    ringtest_t *rt = (ringtest_t *)arg;
+    int next = 0, key;
+
+    while (next < RING_ITEMS) {
+        uint64_t head = ngring_end(&rt->ring), i;
+        if (head == rt->ring.tail) {
+            key = ngwake_prepare(&rt->data);
+            if (ngring_end(&rt->ring) == rt->ring.tail)
+                ngwake_wait(&rt->data, key);
+            else
+                ngwake_cancel(&rt->data);
+            continue;
+        }
+        for (i = rt->ring.tail; i < head; i++)
+            if (rt->items[i & rt->ring.mask] != next++)
+                rt->errors++;
+        ngring_pop_to(&rt->ring, head);
+        ngwake_signal(&rt->space);
+    }
+    return NULL;
+}
+
+static void
+test_ring(void)
+{
+    ringtest_t rt;
+    threadId_t tid;
+    int i, key;
+
+    memset(&rt, 0, sizeof(rt));
+    CHECK(ngring_init(&rt.ring, 10) == 16);
+    CHECK(ngring_depth(&rt.ring) == 0);
+    ngwake_init(&rt.data);
+    ngwake_init(&rt.space);
+    if (ng_thread_start(&tid, ring_consumer, &rt)) {
+        CHECK(!"consumer thread started");
+        return;
+    }
+    for (i = 0; i < RING_ITEMS; i++) {
+        while (ngring_full(&rt.ring)) {
+            key = ngwake_prepare(&rt.space);
+            if (ngring_full(&rt.ring))
+                ngwake_wait(&rt.space, key);
+            else
+                ngwake_cancel(&rt.space);
+        }
+        rt.items[ngring_slot(&rt.ring)] = i;
+        ngring_push(&rt.ring);
+        ngwake_signal(&rt.data);
+    }
+    ng_thread_join(tid);
+    CHECK(rt.errors == 0);
+    CHECK(rt.ring.tail == RING_ITEMS);
+    ngwake_destroy(&rt.data);
+    ngwake_destroy(&rt.space);
+}
+
+static void
+test_chan(void)
+{
+    ngchan_t c;
+    ngsample_t w[NGCHAN_HISTORY + 1], s;
+    int i, n;
+
+    ngchan_init(&c, 16);
+    CHECK(c.ring.mask == 15);
+    CHECK(!ngchan_latest(&c, &s));
+    CHECK(ngchan_window(&c, 1.0, w, 4) == 0);
+    for (i = 0; i < 16; i++)
+        CHECK(ngchan_push(&c, i, 10.0 * i));
+    CHECK(ngchan_full(&c));
+    CHECK(!ngchan_push(&c, 16, 160));
+    CHECK(c.overflows == 1);
+    CHECK(ngchan_latest(&c, &s) && s.t == 15);
+
+    /* up to nmax - 1 samples at or before t and the first one after */
+    n = ngchan_window(&c, 5.5, w, 4);
+    CHECK(n == 4);
+    CHECK(w[0].t == 3 && w[2].t == 5 && w[3].t == 6);
+    CHECK_NEAR(w[3].v, 60);
+
+    /* retiring keeps NGCHAN_HISTORY samples at or before t */
+    ngchan_retire(&c, 12.0);
+    CHECK(c.ring.tail == 12 - (NGCHAN_HISTORY - 1));
+    CHECK(!ngchan_full(&c));
+    CHECK(ngchan_push(&c, 16, 160));
+
+    n = ngchan_take(&c, w, 3);
+    CHECK(n == 3 && w[0].t == 12 - (NGCHAN_HISTORY - 1));
+    ngchan_reset(&c);
+    CHECK(!ngchan_latest(&c, &s) && c.overflows == 0);
+    ngchan_free(&c);
+}
+
+static void
+test_pred(void)
+{
+    const ngpredictor_t *lin = ngpred_find("linear"), *hold = ngpred_find("hold");
+    ngchan_t c;
+    int i;
+
+    CHECK(lin && hold);
+    CHECK(ngpred_find("poly") == ngpred_find("poly2"));
+    CHECK(ngpred_find("spline") == NULL);
+    if (!lin || !hold)
+        return;
+
+    ngchan_init(&c, 64);
+    CHECK(ngpred_value(lin, &c, 1.0) == 0);
+    /* v = 2 t + 1 */
+    for (i = 0; i < 8; i++)
+        ngchan_push(&c, i * 0.5, 2 * i * 0.5 + 1);
+    CHECK_NEAR(ngpred_value(lin, &c, 1.25), 3.5);
+    CHECK_NEAR(ngpred_value(lin, &c, 4.0), 9.0);
+    CHECK_NEAR(ngpred_value(hold, &c, 4.0), 8.0);
+    CHECK_NEAR(ngpred_value(ngpred_find("poly3"), &c, 4.5), 10.0);
+    ngchan_free(&c);
+}
+
+static void
+test_coupling(void)
+{
+    ngcoupling_t *c;
+
+    write_file("unittest_ok.cpl",
+               "# two partitions\n"
+               "partition a a.cir\n"
+               "partition b /abs/b.cir\n"
+               "couple a out -> b vin\n"
+               "couple b mid <-> a vmid imid\n");
+    c = ngcoupling_read("unittest_ok.cpl");
+    CHECK(c != NULL);
+    if (c) {
+        CHECK(c->nparts == 2 && c->nedges == 3);
+        CHECK(!strcmp(c->parts[0].netlist, "a.cir"));
+        CHECK(!strcmp(c->parts[1].netlist, "/abs/b.cir"));
+        CHECK(c->edges[0].src == 0 && c->edges[0].dst == 1 && !c->edges[0].current);
+        CHECK(!strcmp(c->edges[1].vector, "mid") && !strcmp(c->edges[1].source, "vmid"));
+        CHECK(!strcmp(c->edges[2].vector, "vmid#branch") && c->edges[2].current);
+        CHECK(c->edges[2].src == 0 && c->edges[2].dst == 1);
+        ngcoupling_free(c);
+    }
+
+    write_file("unittest_bad.cpl", "partition a a.cir\ncouple a out -> c vin\n");
+    CHECK(ngcoupling_read("unittest_bad.cpl") == NULL);
+    write_file("unittest_bad.cpl", "partition a a.cir\npartition b b.cir\n"
+               "couple a x -> b vin\ncouple a y -> b vin\n");
+    CHECK(ngcoupling_read("unittest_bad.cpl") == NULL);
+    write_file("unittest_bad.cpl", "# nothing\n");
+    CHECK(ngcoupling_read("unittest_bad.cpl") == NULL);
+    remove("unittest_ok.cpl");
+    remove("unittest_bad.cpl");
+}
+
+static bool
+has_line(char **lines, const char *line)
+{
+    for (; *lines; lines++)
+        if (!strcmp(*lines, line))
+            return true;
+    return false;
+}
+
+static void
+test_circ(void)
+{
+    const char *names[] = { "VDD", "W" };
+    double values[] = { 1.8, 2e-6 };
+    const ngcirc_t *c;
+    char **lines, *longline;
+    FILE *fp;
+
+    write_file("unittest_inc.cir", "r1 a b {W}\n");
+    write_file("unittest_top.cir",
+               "title line\n"
+               "v1 vdd 0 {VDD}\n"
+               ".include unittest_inc.cir\n"
+               ".lib 'models.lib' tt\n"
+               ".end\n");
+    c = ngcirc_get("unittest_top.cir");
+    CHECK(c != NULL);
+    if (c) {
+        CHECK(c->files == 2 && c->nlines == 5 && c->ntempl == 2);
+        CHECK(has_line(c->lines, "r1 a b {W}"));
+        /* relative to the working directory already */
+        CHECK(has_line(c->lines, ".lib 'models.lib' tt"));
+        CHECK(ngcirc_get("unittest_top.cir") == c);
+        lines = ngcirc_subst(c, names, values, 2);
+        CHECK(has_line(lines, "v1 vdd 0 1.8"));
+        CHECK(has_line(lines, "r1 a b 2e-06"));
+        CHECK(lines[0] == c->lines[0]);
+        ngcirc_release(c, lines);
+        lines = ngcirc_subst(c, names, values, 1);
+        CHECK(has_line(lines, "r1 a b {W}"));
+        ngcirc_release(c, lines);
+    }
+
+    /* a .lib file name relative to the including file */
+    write_file("unittest_sub.cir", "title\n.lib lib/models.lib tt\n");
+    c = ngcirc_get("./unittest_sub.cir");
+    CHECK(c && has_line(c->lines, ".lib ./lib/models.lib tt"));
+
+    /* a card longer than the buffer is not split */
+    longline = (char *)malloc(5000);
+    memset(longline, 'x', 4999);
+    longline[4999] = '\0';
+    fp = fopen("unittest_long.cir", "w");
+    if (fp) {
+        fprintf(fp, "title\n* %s\n.end\n", longline);
+        fclose(fp);
+    }
+    free(longline);
+    CHECK(ngcirc_get("unittest_long.cir") == NULL);
+    CHECK(ngcirc_get("unittest_missing.cir") == NULL);
+    ngcirc_flush();
+    remove("unittest_inc.cir");
+    remove("unittest_top.cir");
+    remove("unittest_sub.cir");
+    remove("unittest_long.cir");
+}
+
+static void
+test_sweep(void)
+{
+    ngsweep_t *s, *s2;
+    int i;
+
+    write_file("unittest_sw.cir", "title\nv1 a 0 {A}\nr1 a 0 {B}\n.end\n");
+    write_file("unittest.swp",
+               "netlist unittest_sw.cir\n"
+               "param A lin 0 1 3\n"
+               "param B list 1k 2k\n"
+               "param C gauss 1 0.1\n"
+               "samples 2\n"
+               "seed 7\n"
+               "measure vmax max v(a)\n");
+    s = ngsweep_read("unittest.swp");
+    CHECK(s != NULL);
+    if (!s)
+        goto out;
+    CHECK(s->nparams == 3 && s->nmeas == 1);
+    CHECK(s->npoints == 3 * 2 * 2);
+    /* the first parameter varies fastest, every grid point repeated */
+    CHECK_NEAR(s->values[0 * 3 + 0], 0);
+    CHECK_NEAR(s->values[1 * 3 + 0], 0);
+    CHECK_NEAR(s->values[2 * 3 + 0], 0.5);
+    CHECK_NEAR(s->values[4 * 3 + 0], 1);
+    CHECK_NEAR(s->values[4 * 3 + 1], 1000);
+    CHECK_NEAR(s->values[6 * 3 + 1], 2000);
+    CHECK(s->values[0 * 3 + 2] != s->values[1 * 3 + 2]);
+    for (i = 0; i < s->npoints; i++)
+        CHECK(fabs(s->values[i * 3 + 2] - 1) < 1);
+
+    /* the same seed, the same values */
+    s2 = ngsweep_read("unittest.swp");
+    CHECK(s2 && !memcmp(s->values, s2->values, (size_t)s->npoints * 3 * sizeof(double)));
+    ngsweep_free(s2);
+    ngsweep_free(s);
+
+    write_file("unittest.swp", "netlist unittest_sw.cir\nparam A lin 0 1\n");
+    CHECK(ngsweep_read("unittest.swp") == NULL);
+    write_file("unittest.swp", "netlist unittest_sw.cir\nparam A log 0 1 3\n");
+    CHECK(ngsweep_read("unittest.swp") == NULL);
+    write_file("unittest.swp", "param A lin 0 1 3\n");
+    CHECK(ngsweep_read("unittest.swp") == NULL);
+out:
+    ngcirc_flush();
+    remove("unittest.swp");
+    remove("unittest_sw.cir");
+}
+
+#if !defined(__MINGW32__) && !defined(_MSC_VER)
+/* points written over two blocks, rewound as by waveform relaxation */
+static void
+test_capture(void)
+{
+    vecinfo vi[3] = { { 0, "time", true, NULL, NULL },
+                      { 1, "out", true, NULL, NULL },
+                      { 2, "in", true, NULL, NULL } };
+    pvecinfo pv[3] = { &vi[0], &vi[1], &vi[2] };
+    vecinfoall info = { "tran1", "unittest", "", "transient", 3, pv };
+    uint64_t npts = NGCAPTURE_BLOCKPTS + 100, i;
+    ngcapture_reader_t *r;
+    ngcapture_t *c;
+    double v[2], *dst;
+
+    /* ngspice names the node voltages without v() */
+    c = ngcapture_open("unittest.ngc", &info, "v(out)");
+    CHECK(c != NULL);
+    if (!c)
+        return;
+    CHECK(c->ncols == 2);
+    for (i = 0; i < npts; i++) {
+        v[0] = (double)i;
+        v[1] = 2.0 * i;
+        ngcapture_append(c, v);
+    }
+    /* from time 10 again */
+    for (i = 10; i < 20; i++) {
+        v[0] = (double)i;
+        v[1] = -1.0 * i;
+        ngcapture_append(c, v);
+    }
+    ngcapture_close(c);
+
+    r = ngcapture_read("unittest.ngc");
+    CHECK(r != NULL);
+    if (r) {
+        CHECK(r->ncols == 2 && r->npoints == 20);
+        CHECK(ngcapture_column(r, "out") == 1);
+        CHECK(ngcapture_column(r, "in") < 0);
+        dst = (double *)malloc(20 * sizeof(double));
+        CHECK(ngcapture_values(r, 1, 0, 20, dst) == 20);
+        CHECK_NEAR(dst[9], 18);
+        CHECK_NEAR(dst[10], -10);
+        CHECK_NEAR(dst[19], -19);
+        CHECK(ngcapture_values(r, 0, 15, 10, dst) == 5);
+        CHECK_NEAR(dst[0], 15);
+        free(dst);
+        ngcapture_reader_free(r);
+    }
+
+    /* a long run, then read across the block border */
+    c = ngcapture_open("unittest.ngc", &info, "all");
+    CHECK(c && c->ncols == 3);
+    if (!c)
+        return;
+    for (i = 0; i < npts; i++) {
+        double w[3] = { (double)i, 1.0 * i, 3.0 * i };
+        ngcapture_append(c, w);
+    }
+    ngcapture_close(c);
+    r = ngcapture_read("unittest.ngc");
+    CHECK(r && r->npoints == npts);
+    if (r) {
+        dst = (double *)malloc(8 * sizeof(double));
+        CHECK(ngcapture_values(r, 2, NGCAPTURE_BLOCKPTS - 4, 8, dst) == 8);
+        CHECK_NEAR(dst[0], 3.0 * (NGCAPTURE_BLOCKPTS - 4));
+        CHECK_NEAR(dst[7], 3.0 * (NGCAPTURE_BLOCKPTS + 3));
+        free(dst);
+        ngcapture_reader_free(r);
+    }
+    remove("unittest.ngc");
+}
+#endif
+
+/* barrier: every thread completes every generation, one of them runs fn */
+
+#define BARRIER_THREADS 4
+#define BARRIER_ROUNDS 2000
+
+typedef struct barriertest {
+    ngbarrier_t b;
+    volatile int arrived;
+    int completions, errors;
+    volatile int last;         /* thread leaving early */
+} barriertest_t;
+
+static void
+barrier_complete(void *arg)
+{
+    barriertest_t *bt = (barriertest_t *)arg;
+
+    /* all participants have arrived, none has gone on */
+    if (ngat_load_i(&bt->arrived) != ngbarrier_count(&bt->b))
+        bt->errors++;
+    ngat_store_i(&bt->arrived, 0);
+    bt->completions++;
+}
+
+static void *
+barrier_thread(void *arg)
+{
+    barriertest_t *bt = (barriertest_t *)arg;
+    int me = ngat_add_i(&bt->last, 1), i;
+    /* the last thread leaves half way */
+    int rounds = me == BARRIER_THREADS - 1 ? BARRIER_ROUNDS / 2 : BARRIER_ROUNDS;
+
+    for (i = 0; i < rounds; i++) {
+        ngat_add_i(&bt->arrived, 1);
+        ngbarrier_wait(&bt->b, barrier_complete, bt);
+    }
+    if (rounds < BARRIER_ROUNDS)
+        ngbarrier_leave(&bt->b, barrier_complete, bt);
+    return NULL;
+}
+
+static void
+test_barrier(void)
+{
+    barriertest_t bt;
+    threadId_t tid[BARRIER_THREADS];
+    ngbarrier_stats st;
+    int i, started = 0;
+
+    memset(&bt, 0, sizeof(bt));
+    /* no spinning, the threads have to sleep */
+    ngbarrier_init(&bt.b, BARRIER_THREADS, 0);
+    for (i = 0; i < BARRIER_THREADS; i++)
+        if (!ng_thread_start(&tid[i], barrier_thread, &bt))
+            started++;
+    CHECK(started == BARRIER_THREADS);
+    for (i = 0; i < started; i++)
+        ng_thread_join(tid[i]);
+    if (started == BARRIER_THREADS) {
+        CHECK(bt.errors == 0);
+        CHECK(bt.completions == BARRIER_ROUNDS);
+        CHECK(ngbarrier_count(&bt.b) == BARRIER_THREADS - 1);
+        ngbarrier_get_stats(&bt.b, &st);
+        CHECK(st.completions == BARRIER_ROUNDS);
+    }
+    ngbarrier_destroy(&bt.b);
+}
+
+#if !defined(__MINGW32__) && !defined(_MSC_VER)
+/* worker processes: one is killed holding a shared lock while the others
+   wait for it in the barrier. The parent takes the lock over and leaves
+   the barrier on its behalf, as ngworkers_run() does, the others go on. */
+
+#define WORKERS 3
+#define WORKER_ROUNDS 200
+
+typedef struct workertest {
+    mutexType lock;
+    condType cond;
+    ngbarrier_t b;
+    volatile int rounds[WORKERS];
+    volatile int held;         /* the last worker holds the lock */
+} workertest_t;
+
+static void
+worker_proc(workertest_t *w, int me)
+{
+    int i;
+
+    for (i = 0; i < WORKER_ROUNDS; i++) {
+        /* the last worker stops half way with the lock, to be killed */
+        if (me == WORKERS - 1 && i == WORKER_ROUNDS / 2) {
+            mutex_lock(&w->lock);
+            ngat_store_i(&w->held, 1);
+            for (;;)
+                pause();
+        }
+        ngbarrier_wait(&w->b, NULL, NULL);
+        mutex_lock(&w->lock);
+        w->rounds[me]++;
+        mutex_unlock(&w->lock);
+    }
+    ngbarrier_leave(&w->b, NULL, NULL);
+    _exit(0);
+}
+
+static void
+test_worker_killed(void)
+{
+    workertest_t *w;
+    pid_t pid[WORKERS];
+    int i, status;
+
+    w = (workertest_t *)mmap(NULL, sizeof(*w), PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(w != MAP_FAILED);
+    if (w == MAP_FAILED)
+        return;
+    memset(w, 0, sizeof(*w));
+    mutex_init_shared(&w->lock);
+    cond_init_shared(&w->cond);
+    ngbarrier_init_shared(&w->b, WORKERS, 0);
+    fflush(stdout);
+    fflush(stderr);
+    for (i = 0; i < WORKERS; i++) {
+        pid[i] = fork();
+        if (pid[i] == 0)
+            worker_proc(w, i);
+    }
+
+    while (!ngat_load_i(&w->held))
+        ng_msleep(1);
+    kill(pid[WORKERS - 1], SIGKILL);
+    waitpid(pid[WORKERS - 1], &status, 0);
+    CHECK(WIFSIGNALED(status));
+
+    /* the lock is handed on and works as before, also for a wait */
+    mutex_lock(&w->lock);
+    CHECK(w->rounds[WORKERS - 1] == WORKER_ROUNDS / 2);
+    CHECK(!cond_wait_ms(&w->cond, &w->lock, 1));
+    mutex_unlock(&w->lock);
+    mutex_lock(&w->lock);
+    mutex_unlock(&w->lock);
+    ngbarrier_leave(&w->b, NULL, NULL);
+
+    for (i = 0; i < WORKERS - 1; i++) {
+        waitpid(pid[i], &status, 0);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        CHECK(w->rounds[i] == WORKER_ROUNDS);
+    }
+    CHECK(ngbarrier_count(&w->b) == 0);
+    mutex_delete(&w->lock);
+    cond_delete(&w->cond);
+    ngbarrier_destroy(&w->b);
+    munmap(w, sizeof(*w));
+}
+#endif
+
+int
+main(void)
+{
+    test_ring();
+    test_chan();
+    test_pred();
+    test_coupling();
+    test_circ();
+    test_sweep();
+#if !defined(__MINGW32__) && !defined(_MSC_VER)
+    test_capture();
+#endif
+    test_barrier();
+#if !defined(__MINGW32__) && !defined(_MSC_VER)
+    test_worker_killed();
+#endif
+    printf("%d checks, %d failed\n", checks, failed);
+    return failed;
+}
@@ -0,0 +1,274 @@
+/*
+Watchdog of the synchronization, see watchdog.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "watchdog.h"
+
+static const char *actions[] = { "report", "resync", "abort" };
+
+int
+ngwatchdog_action(const char *name)
+{
+    int i;
+
+    for (i = 0; i <= WATCHDOG_ABORT; i++)
+        if (cieq(name, actions[i]))
+            return i;
+    return -1;
+}
+
+const char *
+ngwatchdog_name(int action)
+{
+    return action >= 0 && action <= WATCHDOG_ABORT ? actions[action] : "none";
+}
+
+void
+ngwatchdog_start(ngengine_t *e)
+{
+    ngwatchdog_t *wd = e->wd;
+
+    if (e->wd_ms <= 0 || e->workers)
+        return;
+    if (!wd) {
+        wd = (ngwatchdog_t *)calloc(1, sizeof(ngwatchdog_t));
+        wd->stalled = (bool *)calloc((size_t)e->nparts, sizeof(bool));
+        e->wd = wd;
+    }
+    memset(wd->stalled, 0, (size_t)e->nparts * sizeof(bool));
+    wd->period = e->wd_ms / 4 < 1 ? 1 : e->wd_ms / 4 > 100 ? 100 : e->wd_ms / 4;
+    wd->progress = 0;
+    wd->progress_ns = ng_now_ns();
+    wd->stuck = false;
+    wd->forced = 0;
+    wd->aborted = false;
+    wd->stalls = wd->resyncs = 0;
+    wd->divergences = 0;
+    wd->div_reported = false;
+}
+
+void
+ngwatchdog_free(ngengine_t *e)
+{
+    if (!e->wd)
+        return;
+    free(e->wd->stalled);
+    free(e->wd);
+    e->wd = NULL;
+}
+
+void
+ngwatchdog_print(ngengine_t *e)
+{
+    ngwatchdog_t *wd = e->wd;
+
+    if (!wd || !wd->progress)
+        return;
+    printf("watchdog:            %s after %d ms, %llu stalls, %llu divergences, %llu taken out%s\n",
+           ngwatchdog_name(e->wd_action), e->wd_ms, (unsigned long long)wd->stalls,
+           (unsigned long long)wd->divergences, (unsigned long long)wd->resyncs,
+           wd->aborted ? ", aborted" : "");
+}
+
+int
+ngwatchdog_period(ngengine_t *e)
+{
+    return e->wd ? e->wd->period : -1;
+}
+
+/* time since p came into or went out of ng_SyncData() */
+static uint64_t
+since(ngpart_t *p, uint64_t now)
+{
+    uint64_t t = ngat_load_u64(&p->sync_ns);
+
+    return now > t ? now - t : 0;
+}
+
+static void
+diagnose(ngengine_t *e, uint64_t now)
+{
+    int i;
+
+    for (i = 0; i < e->nparts; i++) {
+        ngpart_t *p = &e->parts[i];
+        int state = ngat_load_i(&p->state);
+
+        fprintf(stderr, "  partition %3d: ", p->ident);
+        if (state == NGPART_IDLE)
+            fprintf(stderr, "not started");
+        else if (state == NGPART_DONE)
+            fprintf(stderr, "done");
+        else if (ngat_load_i(&p->unsynced))
+            fprintf(stderr, "out of the synchronization");
+        else if (ngat_load_i(&p->insync))
+            fprintf(stderr, "waiting for %.3f s", since(p, now) / 1e9);
+        else
+            fprintf(stderr, "in ngspice for %.3f s", since(p, now) / 1e9);
+        fprintf(stderr, ", step %llu, acttime %.9g, delta %g, location %d\n",
+                (unsigned long long)p->syncs, p->acttime, p->delta, p->location);
+    }
+}
+
+/* take p out of the synchronization, as if its bg thread had ended */
+static bool
+leave(ngengine_t *e, ngpart_t *p)
+{
+    bool left = false;
+
+    mutex_lock(&e->rt_cs);
+    if (ngat_load_i(&p->state) == NGPART_RUNNING && !ngat_load_i(&p->unsynced)) {
+        ngat_store_i(&p->unsynced, 1);
+        e->numthreads--;
+        sync_leave(p);
+        left = true;
+    }
+    mutex_unlock(&e->rt_cs);
+    return left;
+}
+
+/* release all partitions and halt them */
+static int
+abort_run(ngengine_t *e)
+{
+    int i;
+
+    e->wd->aborted = true;
+    e->out_of_sync = true;
+    for (i = 0; i < e->nparts; i++)
+        leave(e, &e->parts[i]);
+    if (e->sync_mode == SYNC_LEGACY)
+        e->ok1 = e->ok2 = true;
+    for (i = 0; i < e->nparts; i++)
+        if (ngat_load_i(&e->parts[i].state) == NGPART_RUNNING)
+            ngpart_command(&e->parts[i], "bg_halt");
+    fprintf(stderr, "Watchdog: run aborted\n\n");
+    return 1;
+}
+
+int
+ngwatchdog_check(ngengine_t *e)
+{
+    ngwatchdog_t *wd = e->wd;
+    uint64_t now, limit, syncs = 0;
+    int i, nstalled = 0, nrunning = 0;
+    bool anystalled = false;
+
+    if (!wd || wd->aborted)
+        return 0;
+    now = ng_now_ns();
+    limit = (uint64_t)e->wd_ms * 1000000ull;
+    for (i = 0; i < e->nparts; i++) {
+        ngpart_t *p = &e->parts[i];
+        bool stalled;
+
+        syncs += p->syncs;
+        if (ngat_load_i(&p->state) != NGPART_RUNNING || ngat_load_i(&p->unsynced))
+            continue;
+        nrunning++;
+        stalled = !ngat_load_i(&p->insync) && since(p, now) > limit;
+        if (stalled && !wd->stalled[i])
+            nstalled++;
+        wd->stalled[i] = stalled;
+        anystalled = anystalled || stalled;
+    }
+    /* no synchronization in this run */
+    if (!syncs)
+        return 0;
+    if (syncs != wd->progress) {
+        wd->progress = syncs;
+        wd->progress_ns = now;
+        wd->stuck = false;
+    }
+
+    if (ngat_load_u64(&wd->divergences) && !wd->div_reported) {
+        wd->div_reported = true;
+        fprintf(stderr, "\n** Watchdog: partitions diverged at step %llu, %d at acttime %.9g,"
+                " %d at %.9g, delta %g **\n", (unsigned long long)wd->div_step,
+                e->parts[wd->div_lo].ident, wd->div_tmin, e->parts[wd->div_hi].ident,
+                wd->div_tmax, wd->div_delta);
+        diagnose(e, now);
+        if (e->wd_action == WATCHDOG_ABORT)
+            return abort_run(e);
+    }
+
+    if (nstalled) {
+        wd->stalls++;
+        fprintf(stderr, "\n** Watchdog: %d partition(s) stalled in ngspice for more than %d ms **\n",
+                nstalled, e->wd_ms);
+        diagnose(e, now);
+        if (e->wd_action == WATCHDOG_ABORT)
+            return abort_run(e);
+        if (e->wd_action == WATCHDOG_RESYNC)
+            for (i = 0; i < e->nparts; i++)
+                if (wd->stalled[i] && leave(e, &e->parts[i])) {
+                    fprintf(stderr, "Watchdog: partition %d taken out of the synchronization\n\n",
+                            e->parts[i].ident);
+                    wd->resyncs++;
+                }
+        return 0;
+    }
+
+    /* all of them waiting, none in ngspice */
+    if (nrunning && !anystalled && !wd->stuck && now - wd->progress_ns > limit) {
+        wd->stuck = true;
+        wd->stalls++;
+        fprintf(stderr, "\n** Watchdog: no step through the synchronization for more than %d ms **\n",
+                e->wd_ms);
+        diagnose(e, now);
+        if (e->wd_action == WATCHDOG_REPORT)
+            return 0;
+        /* once, if it does not help the run is lost */
+        if (e->wd_action == WATCHDOG_RESYNC && e->sync_mode == SYNC_LEGACY && wd->forced != syncs) {
+            fprintf(stderr, "Watchdog: legacy ok1/ok2 forced\n\n");
+            wd->forced = syncs;
+            e->ok1 = e->ok2 = true;
+            return 0;
+        }
+        return abort_run(e);
+    }
+    return 0;
+}
+
+void
+ngwatchdog_lockstep(ngengine_t *e)
+{
+    ngwatchdog_t *wd = e->wd;
+    double tmin = 1e300, tmax = -1e300, dmin = 1e300;
+    int i, lo = -1, hi = -1;
+
+    if (!wd)
+        return;
+    for (i = 0; i < e->nparts; i++) {
+        ngpart_t *p = &e->parts[i];
+        if (!ngat_load_i(&p->insync) || ngat_load_i(&p->unsynced))
+            continue;
+        if (p->acttime < tmin) {
+            tmin = p->acttime;
+            lo = i;
+        }
+        if (p->acttime > tmax) {
+            tmax = p->acttime;
+            hi = i;
+        }
+        if (p->delta < dmin)
+            dmin = p->delta;
+    }
+    /* rounding of the time points is not a divergence */
+    if (lo < 0 || tmax - tmin <= 0.5 * dmin || tmax - tmin <= 1e-12 * tmax)
+        return;
+    /* the completing threads follow one another, the first one is kept */
+    if (!wd->divergences) {
+        wd->div_step = e->parts[lo].syncs;
+        wd->div_tmin = tmin;
+        wd->div_tmax = tmax;
+        wd->div_delta = dmin;
+        wd->div_lo = lo;
+        wd->div_hi = hi;
+    }
+    ngat_add_u64(&wd->divergences, 1);
+}
@@ -0,0 +1,81 @@
+/*
+Watchdog of the synchronization.
+
+A partition hanging in ngspice holds up all others in the barrier, and
+a partition whose time has drifted away from the others computes with
+the wrong interface values. Neither ends the run by itself.
+
+ng_SyncData() notes for every partition when it came in and went out,
+at which acttime, with which delta and location. The thread completing
+a barrier (a time step in lockstep, a rendezvous in multirate) compares
+the time points of the partitions there: more than half a time step
+apart, they have diverged. ngengine_wait() looks at the partitions a few
+times per timeout: a partition out of ng_SyncData() for longer than the
+timeout is stalled in ngspice, and if none has come through the
+synchronization for that long, all of them are stuck waiting. A
+diagnosis of all partitions is printed to stderr, then the action set is
+taken:
+
+    report      the diagnosis only
+    resync      the stalled partitions are taken out of the
+                synchronization, the others go on without them; all of
+                them waiting, the legacy flags are forced once. If the
+                run does not get going again, it is aborted.
+    abort       all partitions leave the synchronization and are
+                halted, ngengine_wait() returns 1. It waits another
+                timeout for them to stop; one still in ngspice then is
+                reported, and its capture, engine and library are kept.
+
+The first divergence of a run is reported; with abort, it ends the run.
+Runs without synchronization, and worker processes, are not watched.
+*/
+
+#ifndef NG_WATCHDOG_H
+#define NG_WATCHDOG_H
+
+#include "partition.h"
+
+/* actions */
+#define WATCHDOG_REPORT 0
+#define WATCHDOG_RESYNC 1
+#define WATCHDOG_ABORT 2
+
+/* timeout in ms of a watchdog asked for without one */
+#define NGWATCHDOG_MS 10000
+
+typedef struct ngwatchdog {
+    int period;                /* ms between the checks */
+    bool *stalled;             /* per partition, reported */
+    uint64_t progress;         /* sync calls of all partitions, last check */
+    uint64_t progress_ns;      /* when they changed */
+    bool stuck;                /* all waiting, reported */
+    uint64_t forced;           /* progress when the legacy flags were forced */
+    bool aborted;
+    uint64_t stalls, resyncs;
+
+    /* set by the thread completing a barrier */
+    volatile uint64_t divergences;
+    bool div_reported;
+    uint64_t div_step;
+    double div_tmin, div_tmax, div_delta;
+    int div_lo, div_hi;        /* partition index */
+} ngwatchdog_t;
+
+int ngwatchdog_action(const char *name);
+const char *ngwatchdog_name(int action);
+
+/* sync_prepare(): watch the run if e->wd_ms > 0 */
+void ngwatchdog_start(ngengine_t *e);
+void ngwatchdog_free(ngengine_t *e);
+void ngwatchdog_print(ngengine_t *e);
+
+/* ngengine_wait(): ms to wait between the checks, -1 if not watched */
+int ngwatchdog_period(ngengine_t *e);
+
+/* look at the partitions, take the action; returns 1 if the run was aborted */
+int ngwatchdog_check(ngengine_t *e);
+
+/* called by the thread completing a barrier, all partitions in it */
+void ngwatchdog_lockstep(ngengine_t *e);
+
+#endif
@@ -0,0 +1,278 @@
+/*
+Worker processes, one per partition, see worker.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "worker.h"
+#include "circ.h"
+
+#if defined(__MINGW32__) || defined(_MSC_VER)
+
+ngengine_t *
+ngworkers_new(int nparts, int sync_mode, int spin)
+{
+    (void)nparts;
+    (void)sync_mode;
+    (void)spin;
+    fprintf(stderr, "Error: worker processes are not available on MS Windows\n");
+    return NULL;
+}
+
+int
+ngworkers_run(ngengine_t *e, ngworker_fn *done)
+{
+    (void)done;
+    return e->nparts;
+}
+
+void
+ngworkers_free(ngengine_t *e)
+{
+    (void)e;
+}
+
+#else
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <signal.h>
+
+/* memory shared with the workers forked later, zeroed */
+static void *
+shm_alloc(size_t size)
+{
+    void *m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (m == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+    return m;
+}
+
+static size_t
+engine_size(int nparts)
+{
+    return sizeof(ngengine_t) + (size_t)nparts * sizeof(ngpart_t);
+}
+
+ngengine_t *
+ngworkers_new(int nparts, int sync_mode, int spin)
+{
+    ngengine_t *h, *e;
+    int i;
+
+    if (sync_mode == SYNC_WR) {
+        fprintf(stderr, "Error: no waveform relaxation with worker processes\n");
+        return NULL;
+    }
+    h = ngengine_new(nparts, sync_mode, spin);
+    if (!h)
+        return NULL;
+    e = (ngengine_t *)shm_alloc(engine_size(nparts));
+    if (!e) {
+        ngengine_free(h);
+        return NULL;
+    }
+
+    /* move the engine into shared memory, locks are made anew */
+    memcpy(e, h, sizeof(ngengine_t));
+    e->parts = (ngpart_t *)(e + 1);
+    memcpy(e->parts, h->parts, (size_t)nparts * sizeof(ngpart_t));
+    for (i = 0; i < nparts; i++) {
+        e->parts[i].engine = e;
+        ngwake_init_shared(&e->parts[i].progress);
+    }
+    e->workers = true;
+    e->loader = NGLOAD_PLAIN;
+    mutex_init_shared(&e->rt_cs);
+    cond_init_shared(&e->rt_cond);
+    mutex_init_shared(&e->sy_cs1);
+    mutex_init_shared(&e->sy_cs2);
+    mutex_init_shared(&e->sy_cs3);
+    ngbarrier_init_shared(&e->barrier, nparts, e->spin);
+    ngengine_free(h);
+    return e;
+}
+
+/* move the coupling edges and their sample buffers into shared memory */
+static int
+share_edges(ngengine_t *e)
+{
+    ngcoupling_t *c = e->cpl;
+    size_t head = ((size_t)c->nedges * sizeof(ngedge_t) + 63) & ~(size_t)63;
+    size_t len = head;
+    char *m;
+    int k;
+
+    for (k = 0; k < c->nedges; k++)
+        len += (size_t)(c->edges[k].chan.ring.mask + 1) * sizeof(ngsample_t);
+    m = (char *)shm_alloc(len);
+    if (!m)
+        return 1;
+    memcpy(m, c->edges, (size_t)c->nedges * sizeof(ngedge_t));
+    len = head;
+    for (k = 0; k < c->nedges; k++) {
+        ngedge_t *ed = (ngedge_t *)m + k;
+        ngchan_free(&c->edges[k].chan);
+        ed->chan.buf = (ngsample_t *)(m + len);
+        len += (size_t)(ed->chan.ring.mask + 1) * sizeof(ngsample_t);
+    }
+    free(c->edges);
+    c->edges = (ngedge_t *)m;
+    e->shm_edges = m;
+    e->shm_edges_len = len;
+    return 0;
+}
+
+/* cpu time of the workers waited for */
+static uint64_t
+children_cpu_ns(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_CHILDREN, &ru);
+    return ((uint64_t)ru.ru_utime.tv_sec + (uint64_t)ru.ru_stime.tv_sec) * 1000000000ull
+           + ((uint64_t)ru.ru_utime.tv_usec + (uint64_t)ru.ru_stime.tv_usec) * 1000ull;
+}
+
+/* the worker process of partition p */
+static void
+worker_main(ngpart_t *p, ngworker_fn *done)
+{
+    ngengine_t *e = p->engine;
+    int used;
+
+    if (ngpart_load(p, NGLOAD_PLAIN, &used)) {
+        fflush(stdout);
+        _exit(2);
+    }
+    ngpart_init(p, NGENGINE_SYNC);
+    ngpart_source(p, p->netlist);
+    ngpart_command(p, "bg_run");
+
+    /* until the bg thread has left, or ngspice was unloaded by ng_exit(),
+       both broadcast rt_cond; a crash ends the process anyway */
+    mutex_lock(&e->rt_cs);
+    while (p->state == NGPART_RUNNING && p->dllhandle)
+        cond_wait(&e->rt_cond, &e->rt_cs);
+    mutex_unlock(&e->rt_cs);
+    ngpart_capture_close(p);
+    if (p->dllhandle && done)
+        done(p);
+    fflush(stdout);
+    fflush(stderr);
+    _exit(p->dllhandle ? 0 : 3);
+}
+
+int
+ngworkers_run(ngengine_t *e, ngworker_fn *done)
+{
+    pid_t pids[NGENGINE_MAXPARTS];
+    uint64_t cpu0;
+    int i, n = 0, failed = 0;
+
+    if (!e->cpl) {
+        fprintf(stderr, "Error: worker processes need a coupling\n");
+        return e->nparts;
+    }
+    if (!e->shm_edges && share_edges(e))
+        return e->nparts;
+
+    sync_prepare(e);
+    for (i = 0; i < e->nparts; i++) {
+        ngat_store_i(&e->parts[i].state, NGPART_RUNNING);
+        e->parts[i].points = 0;
+        e->parts[i].crashed = 0;
+    }
+    e->numthreads = e->nparts;
+    e->no_bg = false;
+    e->out_of_sync = false;
+    e->wall_ns = ng_now_ns();
+    cpu0 = children_cpu_ns();
+
+    /* read the netlists here, the workers inherit the cache */
+    for (i = 0; i < e->nparts; i++)
+        ngcirc_get(e->parts[i].netlist);
+    fflush(stdout);
+    fflush(stderr);
+    for (i = 0; i < e->nparts; i++) {
+        pids[i] = fork();
+        if (pids[i] == 0)
+            worker_main(&e->parts[i], done);
+        if (pids[i] < 0) {
+            perror("fork");
+            ng_thread_runs(true, e->parts[i].ident, &e->parts[i]);
+            failed++;
+        }
+        else {
+            n++;
+        }
+    }
+
+    for (; n > 0; n--) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        ngpart_t *p = NULL;
+
+        if (pid < 0)
+            break;
+        for (i = 0; i < e->nparts; i++)
+            if (pids[i] == pid)
+                p = &e->parts[i];
+        if (!p)
+            continue;
+        if (WIFSIGNALED(status)) {
+            p->crashed = WTERMSIG(status);
+            fprintf(stderr, "Worker %d (%s) crashed, signal %d\n", p->ident, p->netlist,
+                    p->crashed);
+            failed++;
+        }
+        else if (WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Worker %d (%s) failed, exit status %d\n", p->ident, p->netlist,
+                    WEXITSTATUS(status));
+            failed++;
+        }
+        /* the capture of a worker is its own */
+        p->capture = NULL;
+        /* the others must not wait for it any more; the shared locks are
+           robust, one it has died holding is taken over */
+        if (ngat_load_i(&p->state) == NGPART_RUNNING)
+            ng_thread_runs(true, p->ident, p);
+    }
+
+    e->wall_ns = ng_now_ns() - e->wall_ns;
+    e->cpu_ns = children_cpu_ns() - cpu0;
+    return failed;
+}
+
+void
+ngworkers_free(ngengine_t *e)
+{
+    int i;
+
+    for (i = 0; i < e->nparts; i++) {
+        free(e->parts[i].outputs);
+        free(e->parts[i].inputs);
+        free(e->parts[i].srccache);
+        ngwake_destroy(&e->parts[i].progress);
+    }
+    if (e->shm_edges) {
+        munmap(e->shm_edges, e->shm_edges_len);
+        e->cpl->edges = NULL;
+        e->cpl->nedges = 0;
+    }
+    ngcoupling_free(e->cpl);
+    mutex_delete(&e->rt_cs);
+    cond_delete(&e->rt_cond);
+    mutex_delete(&e->sy_cs1);
+    mutex_delete(&e->sy_cs2);
+    mutex_delete(&e->sy_cs3);
+    ngbarrier_destroy(&e->barrier);
+    munmap(e, engine_size(e->nparts));
+}
+
+#endif
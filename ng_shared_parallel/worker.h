@@ -0,0 +1,44 @@
+/*
+Worker processes: every partition in a process of its own.
+
+In-process, an instance ending by ng_exit() or crashing takes all
+partitions with it, and the number of instances is limited by the
+library images available (loader.h). In worker mode the engine, its
+partitions, the coupling edges and their sample channels are placed in
+memory shared by all processes, at the same address in each one. One
+worker is forked per partition, it loads the library itself
+(NGLOAD_PLAIN), initializes, sources and runs its netlist. The
+callbacks work on the shared structures as with threads: samples go
+through the channels, the barrier of ng_SyncData() waits on a process
+shared futex, the consensus is calculated by the last arriving worker.
+
+The parent only waits for the workers. If one ends without having
+left the synchronization (crash, load error), the parent leaves on its
+behalf, so the others go on with its inputs predicted from the last
+samples. The locks shared by the workers are robust (port.h): one a
+worker has died holding is taken over by the next one locking it, so
+the others do not hang in ng_thread_runs() or the legacy sync. Wall
+time and cpu time of all workers are reported as for a threaded run.
+Not available with waveform relaxation, nor on MS Windows.
+*/
+
+#ifndef NG_WORKER_H
+#define NG_WORKER_H
+
+#include "partition.h"
+
+/* run in the worker after its simulation, e.g. to write the results */
+typedef void (ngworker_fn)(ngpart_t *p);
+
+/* engine in shared memory, NULL if worker mode is not available */
+ngengine_t *ngworkers_new(int nparts, int sync_mode, int spin);
+
+/* fork the workers and wait for them, the netlists are sourced and run
+   in the workers; done is called in every worker at its end. Returns
+   the number of workers that crashed or failed. */
+int ngworkers_run(ngengine_t *e, ngworker_fn *done);
+
+/* ngengine_free() of a worker engine */
+void ngworkers_free(ngengine_t *e);
+
+#endif
@@ -0,0 +1,408 @@
+/*
+Waveform relaxation: window and iteration control, recording and
+interpolation of the interface waveforms.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "wr.h"
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#define ABSDIFF(a,b) ((a) > (b) ? (a) - (b) : (b) - (a))
+
+void
+wr_defaults(ngwr_opts *o)
+{
+    o->method = WR_GAUSS_SEIDEL;
+    o->window = 0;
+    o->tol = 1e-3;
+    o->maxit = 20;
+}
+
+/* number with spice scale factor, e.g. 0.1ns, 20n, 1.5meg */
+double
+wr_value(const char *s)
+{
+    char *end;
+    double v = strtod(s, &end);
+
+    switch (tolower((unsigned char)*end)) {
+    case 't': return v * 1e12;
+    case 'g': return v * 1e9;
+    case 'k': return v * 1e3;
+    case 'u': return v * 1e-6;
+    case 'n': return v * 1e-9;
+    case 'p': return v * 1e-12;
+    case 'f': return v * 1e-15;
+    case 'm':
+        if (tolower((unsigned char)end[1]) == 'e' && tolower((unsigned char)end[2]) == 'g')
+            return v * 1e6;
+        return v * 1e-3;
+    default:  return v;
+    }
+}
+
+/* step and stop time from the .tran line of a netlist */
+static int
+tran_params(const char *netlist, double *tstep, double *tstop)
+{
+    char line[1024], card[64], a[64], b[64];
+    FILE *fp = fopen(netlist, "r");
+    int found = 0;
+
+    if (!fp) {
+        fprintf(stderr, "Error: cannot open %s\n", netlist);
+        return 1;
+    }
+    while (!found && fgets(line, sizeof(line), fp))
+        if (sscanf(line, "%63s %63s %63s", card, a, b) == 3 && cieq(card, ".tran")) {
+            *tstep = wr_value(a);
+            *tstop = wr_value(b);
+            found = 1;
+        }
+    fclose(fp);
+    if (!found || *tstep <= 0 || *tstop <= 0) {
+        fprintf(stderr, "Error: no .tran line in %s\n", netlist);
+        return 1;
+    }
+    return 0;
+}
+
+/* Step and stop time of the run from the .tran lines of all partitions.
+   They are simulated over the same span, a different stop time is an
+   error; of different steps the smallest one is taken. */
+static int
+wr_span(ngengine_t *e, double *tstep, double *tstop)
+{
+    double step, stop;
+    int i;
+
+    for (i = 0; i < e->nparts; i++) {
+        if (tran_params(e->parts[i].netlist, &step, &stop))
+            return 1;
+        if (i == 0) {
+            *tstep = step;
+            *tstop = stop;
+            continue;
+        }
+        if (!AlmostEqualUlps(stop, *tstop, 10)) {
+            fprintf(stderr, "Error: .tran of %s stops at %g s, of %s at %g s\n",
+                    e->parts[i].netlist, stop, e->parts[0].netlist, *tstop);
+            return 1;
+        }
+        if (!AlmostEqualUlps(step, *tstep, 10)) {
+            fprintf(stderr, "Warning: .tran of %s has step %g s, of %s %g s, using %g s\n",
+                    e->parts[i].netlist, step, e->parts[0].netlist, *tstep, MIN(step, *tstep));
+            *tstep = MIN(step, *tstep);
+        }
+    }
+    return 0;
+}
+
+static void
+wave_push(ngwave_t *w, double t, double v)
+{
+    /* a point at the same time replaces the previous one */
+    if (w->n > 0 && t <= w->t[w->n - 1]) {
+        w->t[w->n - 1] = t;
+        w->v[w->n - 1] = v;
+        return;
+    }
+    if (w->n == w->cap) {
+        w->cap = w->cap ? 2 * w->cap : 1024;
+        w->t = (double *)realloc(w->t, w->cap * sizeof(double));
+        w->v = (double *)realloc(w->v, w->cap * sizeof(double));
+    }
+    w->t[w->n] = t;
+    w->v[w->n] = v;
+    w->n++;
+}
+
+static double
+wave_lerp(const ngwave_t *w, int i, double t)
+{
+    double dt = w->t[i + 1] - w->t[i];
+    if (dt <= 0)
+        return w->v[i + 1];
+    return w->v[i] + (w->v[i + 1] - w->v[i]) * (t - w->t[i]) / dt;
+}
+
+/* value at time t by binary search, held constant outside */
+static double
+wave_at(const ngwave_t *w, double t)
+{
+    int lo = 0, hi = w->n - 1;
+
+    if (w->n == 0)
+        return 0;
+    if (t <= w->t[0])
+        return w->v[0];
+    if (t >= w->t[hi])
+        return w->v[hi];
+    while (hi - lo > 1) {
+        int mid = (lo + hi) / 2;
+        if (w->t[mid] <= t)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return wave_lerp(w, lo, t);
+}
+
+/* maximum difference of two waveforms from time ta on, at the sample
+   points of both of them */
+static double
+wave_diff(const ngwave_t *a, const ngwave_t *b, double ta)
+{
+    double d = 0;
+    int i;
+
+    if (a->n == 0 || b->n == 0)
+        return (a->n == b->n) ? 0 : 1e30;
+    for (i = 0; i < a->n; i++)
+        if (a->t[i] >= ta) {
+            double di = ABSDIFF(a->v[i], wave_at(b, a->t[i]));
+            d = MAX(d, di);
+        }
+    for (i = 0; i < b->n; i++)
+        if (b->t[i] >= ta) {
+            double di = ABSDIFF(b->v[i], wave_at(a, b->t[i]));
+            d = MAX(d, di);
+        }
+    return d;
+}
+
+/* the waveform just recorded becomes the one driving the sources */
+static void
+wave_swap(ngwr_t *wr, int edge)
+{
+    ngwave_t tmp = wr->prev[edge];
+    wr->prev[edge] = wr->cur[edge];
+    wr->cur[edge] = tmp;
+    wr->cur[edge].n = 0;
+    wr->prev[edge].cursor = 0;
+}
+
+/* Called by ng_data(): append the accepted point at time t to the outputs */
+void
+wr_record(ngpart_t *p, pvecvaluesall vdata, double t)
+{
+    ngwr_t *wr = p->engine->wr;
+    int i;
+
+    for (i = 0; i < p->noutputs; i++) {
+        ngoutput_t *o = &p->outputs[i];
+        if (o->vecindex >= 0)
+            wave_push(&wr->cur[o->edge], t, vdata->vecsa[o->vecindex]->creal);
+    }
+}
+
+/* Called by ng_VSRCData(): interpolate the waveform of the previous
+   iteration. The source is evaluated at slowly moving times, so the
+   search starts at the interval used last. 0 V before the first
+   waveform is known. */
+double
+wr_input(ngwr_t *wr, int edge, double t)
+{
+    ngwave_t *w = &wr->prev[edge];
+    int i = w->cursor;
+
+    if (w->n == 0)
+        return 0;
+    if (t <= w->t[0])
+        return w->v[0];
+    if (t >= w->t[w->n - 1])
+        return w->v[w->n - 1];
+    while (i > 0 && w->t[i] > t)
+        i--;
+    while (i < w->n - 2 && w->t[i + 1] <= t)
+        i++;
+    w->cursor = i;
+    return wave_lerp(w, i, t);
+}
+
+/* start the bg thread of a partition with a transient run up to tend */
+static void
+wr_start(ngengine_t *e, ngpart_t *p, double tend)
+{
+    char cmd[128];
+
+    /* only the last plot is kept */
+    ngpart_command(p, "destroy all");
+    mutex_lock(&e->rt_cs);
+    ngat_store_i(&p->state, NGPART_RUNNING);
+    e->numthreads++;
+    e->no_bg = false;
+    mutex_unlock(&e->rt_cs);
+    sprintf(cmd, "bg_tran %.15g %.15g", e->wr->tstep, tend);
+    ngpart_command(p, cmd);
+    e->wr->runs++;
+}
+
+/* wait until all bg threads have finished */
+static void
+wr_join(ngengine_t *e)
+{
+    ngengine_wait_all(e, -1);
+}
+
+/* compare and swap the outputs of partition i, returns the maximum change */
+static double
+wr_update(ngengine_t *e, int i, double ta)
+{
+    ngwr_t *wr = e->wr;
+    ngpart_t *p = &e->parts[i];
+    double d = 0;
+    int k;
+
+    for (k = 0; k < p->noutputs; k++) {
+        int edge = p->outputs[k].edge;
+        double de = wave_diff(&wr->cur[edge], &wr->prev[edge], ta);
+        d = MAX(d, de);
+        wave_swap(wr, edge);
+    }
+    return d;
+}
+
+/* one iteration over the window [ta, tb], returns the maximum change
+   of the interface waveforms */
+static double
+wr_iterate(ngengine_t *e, double ta, double tb)
+{
+    double d = 0, di;
+    int i;
+
+    if (e->wr->opts.method == WR_JACOBI) {
+        for (i = 0; i < e->nparts; i++)
+            wr_start(e, &e->parts[i], tb);
+        wr_join(e);
+        for (i = 0; i < e->nparts; i++) {
+            di = wr_update(e, i, ta);
+            d = MAX(d, di);
+        }
+    }
+    else {
+        for (i = 0; i < e->nparts; i++) {
+            wr_start(e, &e->parts[i], tb);
+            wr_join(e);
+            di = wr_update(e, i, ta);
+            d = MAX(d, di);
+        }
+    }
+    return d;
+}
+
+int
+ngengine_wr(ngengine_t *e, const ngwr_opts *o)
+{
+    ngwr_t *wr;
+    double ta, tb;
+    int i, nedges = e->cpl->nedges;
+
+    wr_free(e->wr);
+    wr = e->wr = (ngwr_t *)calloc(1, sizeof(ngwr_t));
+    wr->opts = *o;
+    if (wr_span(e, &wr->tstep, &wr->tstop))
+        return 1;
+    if (wr->opts.window <= 0 || wr->opts.window > wr->tstop)
+        wr->opts.window = wr->tstop;
+    if (wr->opts.maxit < 1)
+        wr->opts.maxit = 1;
+    /* two waveforms per edge, at least one to keep calloc happy */
+    wr->nedges = nedges;
+    wr->cur = (ngwave_t *)calloc((size_t)nedges + 1, sizeof(ngwave_t));
+    wr->prev = (ngwave_t *)calloc((size_t)nedges + 1, sizeof(ngwave_t));
+    i = (int)(wr->tstop / wr->opts.window + 0.999999);
+    wr->iters = (int *)calloc((size_t)i + 1, sizeof(int));
+    wr->diffs = (double *)calloc((size_t)i + 1, sizeof(double));
+
+    sync_prepare(e);
+    for (i = 0; i < e->nparts; i++)
+        e->parts[i].points = 0;
+    ngengine_capture_close(e);
+    e->numthreads = 0;
+    e->wall_ns = ng_now_ns();
+    e->cpu_ns = ng_cputime_ns();
+
+    for (ta = 0; ta < wr->tstop * (1 - 1e-9); ta = tb) {
+        double d = 1e30;
+        int it;
+
+        tb = MIN(ta + wr->opts.window, wr->tstop);
+        for (it = 1; it <= wr->opts.maxit; it++) {
+            d = wr_iterate(e, ta, tb);
+            if (d < wr->opts.tol)
+                break;
+        }
+        if (it > wr->opts.maxit) {
+            it = wr->opts.maxit;
+            wr->unconverged++;
+            fprintf(stderr, "Warning: window %g ... %g s not converged, change %g V\n", ta, tb, d);
+        }
+        wr->iters[wr->nwindows] = it;
+        wr->diffs[wr->nwindows] = d;
+        wr->nwindows++;
+    }
+
+    e->wall_ns = ng_now_ns() - e->wall_ns;
+    e->cpu_ns = ng_cputime_ns() - e->cpu_ns;
+    ngengine_capture_close(e);
+    return wr->unconverged ? 1 : 0;
+}
+
+void
+ngengine_print_wr(ngengine_t *e)
+{
+    ngwr_t *wr = e->wr;
+    int i, total = 0, imin = 1 << 30, imax = 0;
+
+    if (!wr || wr->nwindows == 0)
+        return;
+    for (i = 0; i < wr->nwindows; i++) {
+        total += wr->iters[i];
+        imin = MIN(imin, wr->iters[i]);
+        imax = MAX(imax, wr->iters[i]);
+    }
+
+    printf("\n** Waveform relaxation of %d partitions (%s) **\n", e->nparts,
+           wr->opts.method == WR_JACOBI ? "Jacobi" : "Gauss-Seidel");
+    printf("window:              %g s, %d windows up to %g s\n", wr->opts.window, wr->nwindows,
+           wr->tstop);
+    printf("tolerance:           %g V, at most %d iterations\n", wr->opts.tol, wr->opts.maxit);
+    printf("iterations:          %d, per window min %d, mean %.2f, max %d\n", total, imin,
+           (double)total / wr->nwindows, imax);
+    for (i = 0; i < wr->nwindows && i < 16; i++)
+        printf("  window %2d:         %d iterations, change %g V\n", i + 1, wr->iters[i], wr->diffs[i]);
+    if (wr->nwindows > 16)
+        printf("  ...\n");
+    printf("not converged:       %d windows\n", wr->unconverged);
+    printf("transient runs:      %d\n", wr->runs);
+    printf("accepted points:     %llu\n", (unsigned long long)ngengine_points(e));
+    printf("wall time:           %.3f s\n", e->wall_ns / 1e9);
+    if (e->wall_ns > 0)
+        printf("cpu load:            %.1f %% of one core\n", 100.0 * e->cpu_ns / e->wall_ns);
+}
+
+void
+wr_free(ngwr_t *wr)
+{
+    int i;
+
+    if (!wr)
+        return;
+    for (i = 0; wr->cur && i < wr->nedges; i++) {
+        free(wr->cur[i].t);
+        free(wr->cur[i].v);
+        free(wr->prev[i].t);
+        free(wr->prev[i].v);
+    }
+    free(wr->cur);
+    free(wr->prev);
+    free(wr->iters);
+    free(wr->diffs);
+    free(wr);
+}
@@ -0,0 +1,70 @@
+/*
+Waveform relaxation of the partitioned transient simulation.
+
+Instead of meeting in ng_SyncData() at every time step, each partition
+integrates a whole time window on its own, its EXTERNAL sources driven
+by the interface waveforms of the previous iteration. The window is
+repeated until no interface waveform changes by more than a tolerance.
+
+Jacobi: all partitions run in parallel, the new waveforms are used in
+the next iteration.
+Gauss-Seidel: the partitions run one after another in the order of the
+coupling description, each one uses the newest waveforms available.
+
+ngspice cannot restart a transient from a saved state, so every run
+starts at time 0 and ends at the end of the current window. The part
+before the window is driven by the already converged waveforms and is
+reproduced, only the window itself is compared.
+*/
+
+#ifndef NG_WR_H
+#define NG_WR_H
+
+#include "partition.h"
+
+#define WR_JACOBI 0
+#define WR_GAUSS_SEIDEL 1
+
+typedef struct ngwr_opts {
+    int method;                /* WR_JACOBI or WR_GAUSS_SEIDEL */
+    double window;             /* window length in s, <= 0 for the whole run */
+    double tol;                /* convergence tolerance in V */
+    int maxit;                 /* maximum iterations per window */
+} ngwr_opts;
+
+/* sampled interface waveform */
+typedef struct ngwave {
+    double *t, *v;
+    int n, cap;
+    int cursor;                /* last interval used by wr_input() */
+} ngwave_t;
+
+typedef struct ngwr {
+    ngwr_opts opts;
+    double tstep, tstop;       /* from the .tran lines, the same stop in all */
+    int nedges;
+    ngwave_t *cur;             /* per edge, recorded in this iteration */
+    ngwave_t *prev;            /* per edge, driving the EXTERNAL sources */
+
+    /* report */
+    int nwindows;
+    int *iters;                /* iterations per window */
+    double *diffs;             /* final difference per window */
+    int runs;                  /* transient runs of single partitions */
+    int unconverged;
+} ngwr_t;
+
+void wr_defaults(ngwr_opts *o);
+double wr_value(const char *s);
+
+/* Run the waveform relaxation on a sourced engine, returns 1 if a
+   window did not converge within maxit iterations */
+int ngengine_wr(ngengine_t *e, const ngwr_opts *o);
+void ngengine_print_wr(ngengine_t *e);
+void wr_free(ngwr_t *wr);
+
+/* used by the callbacks */
+void wr_record(ngpart_t *p, pvecvaluesall vdata, double t);
+double wr_input(ngwr_t *wr, int edge, double t);
+
+#endif